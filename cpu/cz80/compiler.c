@@ -0,0 +1,1487 @@
+/*
+ * Z80 recompiler
+ *
+ * This work is licensed under the terms of MAME license.
+ * See COPYING file in the top-level directory.
+ *
+ * notes:
+ * - CZ80 is the reference: it's built here once more and its main loop
+ *   hands over to drc_exec() before each op fetch. Anything not translated
+ *   natively ends the block and is left for CZ80 to execute, so behaviour
+ *   and timing are CZ80's, including the R register and its flag tables.
+ * - native code keeps all state in cz80_struc, and reaches everything else
+ *   it needs (flag tables, memory maps, RAM) relative to it
+ * - only code in Z80 RAM is translated, blocks are looked up by Z80 pc
+ * - memory is accessed through z80_read_map/z80_write_map by two shared
+ *   routines, RAM is read and written directly from there
+ * - writes to RAM holding translated code drop the affected blocks,
+ *   a block that notices translation state change leaves after current insn
+ * - jumps between blocks are linked and get unlinked when target goes away
+ * - x86-64 only
+ *
+ * implemented:
+ * - 8bit loads, ALU, INC/DEC on registers, (HL), (IX+d) and immediates
+ * - 16bit loads, INC/DEC/ADD, PUSH/POP, EX, rotates, all CB ops
+ * - JP/JR/DJNZ/CALL/RST with linking, RET and JP (HL)
+ *
+ * TODO:
+ * - ED ops, DAA, EI/HALT, IN/OUT
+ * - register caching, inline RET lookup
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../../pico/pico_int.h"
+#include "../drc/cmn.h"
+
+#ifndef __x86_64__
+#error the Z80 recompiler needs an x86-64 host
+#endif
+
+// limits
+#define TCACHE_SIZE             (1024*1024)
+#define MAX_BLOCK_SIZE          (Z80_BLOCK_INSN_LIMIT * 128)
+#define MAX_EXITS               (Z80_BLOCK_INSN_LIMIT * 3)
+#define BLOCK_MAX_COUNT         0x1000
+#define LINK_MAX_COUNT          0x2000
+#define RAM_ENTRY_MAX_COUNT     0x1000
+#define ULINK_HASH_SIZE         0x400
+
+// debug stuff
+// 01 - warnings/errors
+// 02 - block info/smc
+// {
+#ifndef DRC_DEBUG
+#define DRC_DEBUG 0
+#endif
+
+#if DRC_DEBUG
+#define dbg(l,...) { \
+  if ((l) & DRC_DEBUG) \
+    elprintf(EL_STATUS, ##__VA_ARGS__); \
+}
+static int insns_compiled, host_insn_count;
+#define COUNT_OP \
+	host_insn_count++
+#else // !DRC_DEBUG
+#define COUNT_OP
+#define dbg(...)
+#endif
+// }
+
+static PICO_TLS cz80_struc *drc_cpu;   // running CPU, NULL if none
+static PICO_TLS u16 ram_marks[0x2000]; // per RAM byte: blocks covering it
+
+static void drc_exec(cz80_struc *CPU);
+static void dr_ram_inval(u32 a);
+
+// the reference interpreter, CZ80 calls back before each op fetch
+#define CZ80_DRC_EXEC(CPU, PC) \
+	if ((CPU) == drc_cpu) { \
+		(CPU)->PC = PC; \
+		drc_exec(CPU); \
+		PC = (CPU)->PC; \
+		if ((CPU)->ICount <= 0) \
+			goto Cz80_Exec; \
+	}
+#define CZ80_DRC_WCHECK(p) { \
+	uptr a_ = (p) - (uptr)PicoMem.zram; \
+	if (a_ < sizeof(PicoMem.zram) && ram_marks[a_]) \
+		dr_ram_inval(a_); \
+}
+
+#include "cz80.c"
+
+static PICO_TLS u8 *tcache_ptr;
+
+#include "../drc/emit_x86.c"
+
+#define CTX_OFS(f)      offsetof(cz80_struc, f)
+// CZ80 and its data are in one image, so this is always in reach
+#define CTX_REL(p)      ((s32)((u8 *)(p) - (u8 *)&CZ80))
+
+#define A_OFS           CTX_OFS(AF.B.H)
+#define F_OFS           CTX_OFS(AF.B.L)
+#define HL_OFS          CTX_OFS(HL)
+#define SP_OFS          CTX_OFS(SP)
+
+// by Z80 encoding, 6 is (HL)
+static const u8 r8_ofs[8] = {
+  CTX_OFS(BC.B.H), CTX_OFS(BC.B.L), CTX_OFS(DE.B.H), CTX_OFS(DE.B.L),
+  CTX_OFS(HL.B.H), CTX_OFS(HL.B.L), 0, CTX_OFS(AF.B.H)
+};
+static const u8 r16_ofs[4] = {
+  CTX_OFS(BC), CTX_OFS(DE), CTX_OFS(HL), CTX_OFS(SP)
+};
+static const u8 r16af_ofs[4] = {
+  CTX_OFS(BC), CTX_OFS(DE), CTX_OFS(HL), CTX_OFS(AF)
+};
+
+struct block_link {
+  u32 target_pc;
+  u8 *jump;                     // patchable jmp in the source block
+  u8 *stub;                     // its destination while target isn't there
+  struct block_link *next;      // target's or unresolved list
+};
+
+struct block_desc {
+  u32 pc, end_pc;
+  u8 *tcache_ptr;               // NULL if CZ80 has to run the op at pc
+  struct block_link *entries;   // jumps linked to this block
+  int active;
+};
+
+struct ram_entry {
+  struct block_desc *block;
+  struct ram_entry *next;
+};
+
+#ifndef PICO_THREAD_SAFE
+static u8 ALIGNED(4096) tcache_default[TCACHE_SIZE];
+#endif
+static PICO_TLS u8 *tcache_z80;
+static PICO_TLS u8 *tcache_blocks;     // block area start, after the utils
+
+static PICO_TLS struct block_desc *block_table;
+static PICO_TLS struct block_desc **block_lut; // per Z80 pc below 0x4000
+static PICO_TLS int block_count;
+static PICO_TLS struct block_link *link_table;
+static PICO_TLS struct block_link **unresolved_links;
+static PICO_TLS int link_count;
+static PICO_TLS struct ram_entry *ram_entries;
+static PICO_TLS struct ram_entry *ram_blocks[0x20]; // per 256 bytes of RAM
+static PICO_TLS int ram_entry_count;
+
+// block_lut entry for ops that aren't translated natively
+static struct block_desc block_none;
+
+#define ULINK_HASH(pc) \
+  unresolved_links[(pc) & (ULINK_HASH_SIZE - 1)]
+
+// utils
+static PICO_TLS u32 (*z80_drc_entry)(cz80_struc *CPU, const void *block);
+static PICO_TLS u8 *z80_drc_exit;      // back to drc_exec(), Z80 pc in eax
+static PICO_TLS u8 *z80_drc_read8;     // eax = byte at ecx
+static PICO_TLS u8 *z80_drc_write8;    // byte at ecx = dl
+
+// ---------------------------------------------------------------
+// block and link tracking
+
+static void dr_add_link(u32 target_pc, u8 *jump, u8 *stub)
+{
+  struct block_link *bl = &link_table[link_count++];
+  struct block_link **head;
+  struct block_desc *bd = NULL;
+
+  bl->target_pc = target_pc;
+  bl->jump = jump;
+  bl->stub = stub;
+
+  if (target_pc < 0x4000)
+    bd = block_lut[target_pc];
+  if (bd != NULL && bd->tcache_ptr != NULL) {
+    emith_jump_patch(jump, bd->tcache_ptr);
+    bl->next = bd->entries;
+    bd->entries = bl;
+  }
+  else {
+    emith_jump_patch(jump, stub);
+    head = &ULINK_HASH(target_pc);
+    bl->next = *head;
+    *head = bl;
+  }
+}
+
+static void dr_resolve_links(struct block_desc *bd)
+{
+  struct block_link **head, *bl;
+
+  head = &ULINK_HASH(bd->pc);
+  while ((bl = *head) != NULL) {
+    if (bl->target_pc == bd->pc) {
+      *head = bl->next;
+      emith_jump_patch(bl->jump, bd->tcache_ptr);
+      bl->next = bd->entries;
+      bd->entries = bl;
+    }
+    else
+      head = &bl->next;
+  }
+}
+
+// RAM offset range of the code at pc, which never crosses a mirror
+#define PC_RAM(pc)      ((pc) & 0x1fff)
+#define NONE_LEN(pc)    (0x2000 - PC_RAM(pc) < 4 ? 0x2000 - PC_RAM(pc) : 4)
+
+static void dr_rm_block(struct block_desc *bd)
+{
+  struct block_link *bl, *next, **head;
+  u32 a;
+
+  block_lut[bd->pc] = NULL;
+
+  // whoever jumped here goes back to exiting
+  for (bl = bd->entries; bl != NULL; bl = next) {
+    next = bl->next;
+    emith_jump_patch(bl->jump, bl->stub);
+    head = &ULINK_HASH(bl->target_pc);
+    bl->next = *head;
+    *head = bl;
+  }
+  bd->entries = NULL;
+  bd->active = 0;
+
+  for (a = PC_RAM(bd->pc); a < PC_RAM(bd->pc) + bd->end_pc - bd->pc; a++)
+    ram_marks[a]--;
+}
+
+static void dr_add_ram_block(struct block_desc *bd)
+{
+  u32 start = PC_RAM(bd->pc);
+  u32 end = start + bd->end_pc - bd->pc;
+  struct ram_entry *re;
+  u32 a;
+
+  for (a = start; a < end; a++)
+    ram_marks[a]++;
+  for (a = start >> 8; a <= (end - 1) >> 8; a++) {
+    re = &ram_entries[ram_entry_count++];
+    re->block = bd;
+    re->next = ram_blocks[a];
+    ram_blocks[a] = re;
+  }
+}
+
+// CZ80 runs the op at pc, until the bytes it may take are written
+static void dr_add_none(u32 pc)
+{
+  u32 a;
+
+  block_lut[pc] = &block_none;
+  for (a = PC_RAM(pc); a < PC_RAM(pc) + NONE_LEN(pc); a++)
+    ram_marks[a]++;
+}
+
+static void dr_rm_none(u32 pc)
+{
+  u32 a;
+
+  block_lut[pc] = NULL;
+  for (a = PC_RAM(pc); a < PC_RAM(pc) + NONE_LEN(pc); a++)
+    ram_marks[a]--;
+}
+
+// a byte of RAM with translated code on it was written
+static void dr_ram_inval(u32 a)
+{
+  struct ram_entry **head = &ram_blocks[a >> 8], *re;
+  u32 pc;
+
+  while ((re = *head) != NULL) {
+    struct block_desc *bd = re->block;
+    u32 start = PC_RAM(bd->pc);
+    if (bd->active && (a < start || start + bd->end_pc - bd->pc <= a)) {
+      head = &re->next;
+      continue;
+    }
+    if (bd->active) {
+      dbg(2, "smc @%04x: rm block %04x-%04x", a, bd->pc, bd->end_pc);
+      dr_rm_block(bd);
+    }
+    *head = re->next;
+  }
+
+  for (pc = a; pc + 4 > a && pc != (u32)-1; pc--) {
+    if (block_lut[pc] == &block_none && a < pc + NONE_LEN(pc))
+      dr_rm_none(pc);
+    if (block_lut[pc + 0x2000] == &block_none && a < pc + NONE_LEN(pc))
+      dr_rm_none(pc + 0x2000);
+  }
+
+  if (drc_cpu != NULL)
+    drc_cpu->drc_exit = 1;
+}
+
+static void dr_flush(void)
+{
+  dbg(2, "flush: %d blocks, %d links, %d bytes", block_count, link_count,
+    (int)(tcache_ptr - tcache_blocks));
+
+  tcache_ptr = tcache_blocks;
+  memset(block_lut, 0, 0x4000 * sizeof(block_lut[0]));
+  memset(unresolved_links, 0, ULINK_HASH_SIZE * sizeof(unresolved_links[0]));
+  memset(ram_blocks, 0, sizeof(ram_blocks));
+  memset(ram_marks, 0, sizeof(ram_marks));
+  block_count = link_count = ram_entry_count = 0;
+
+  if (drc_cpu != NULL)
+    drc_cpu->drc_exit = 1;
+}
+
+// ---------------------------------------------------------------
+// translation
+
+static PICO_TLS u32 tr_insn_pc[Z80_BLOCK_INSN_LIMIT];
+static PICO_TLS u8 *tr_insn_ptr[Z80_BLOCK_INSN_LIMIT];
+
+static PICO_TLS struct {
+  u8 *jump;
+  u32 pc;                       // Z80 pc to leave with
+} tr_exits[MAX_EXITS];
+static PICO_TLS int tr_exit_count;
+
+static PICO_TLS struct {
+  u8 *jump;
+  u32 target_pc;
+} tr_links[MAX_EXITS];
+static PICO_TLS int tr_link_count;
+
+#define OPB(pc, n) \
+  PicoMem.zram[((pc) + (n)) & 0x1fff]
+
+static void tr_exit_jcc(int cond, u32 pc)
+{
+  tr_exits[tr_exit_count].jump = tcache_ptr;
+  tr_exits[tr_exit_count].pc = pc;
+  tr_exit_count++;
+  emith_jump_cond(cond, tcache_ptr); // patched to the stub later
+}
+
+static void tr_link_jmp(u32 target_pc)
+{
+  tr_links[tr_link_count].jump = tcache_ptr;
+  tr_links[tr_link_count].target_pc = target_pc;
+  tr_link_count++;
+  emith_jump(tcache_ptr);
+}
+
+static void emit_call(const void *func)
+{
+  intptr_t disp = (u8 *)func - (tcache_ptr + 5);
+
+  if (disp == (s32)disp) {
+    emith_call(func);
+  } else {
+    emith_move_r_ptr_imm(xAX, func);
+    emith_call_reg(xAX);
+  }
+}
+
+static void emit_r_inc(int n)
+{
+  emith_ctx_arith8_imm(0, CTX_OFS(R.B.L), n);
+}
+
+// count cycles, leave with next insn's pc when out of them
+static void emit_cycles(int cycles, u32 next)
+{
+  emith_ctx_sub_imm(CTX_OFS(ICount), cycles);
+  tr_exit_jcc(DCOND_LE, next);
+}
+
+// leave after a write that dropped translated code
+static void emit_wcheck(u32 next)
+{
+  emith_ctx_cmp8_imm(CTX_OFS(drc_exit), 0);
+  tr_exit_jcc(DCOND_NE, next);
+}
+
+// static Z80 target, linked
+static void emit_jump(int cycles, u32 target, int wr)
+{
+  emith_ctx_sub_imm(CTX_OFS(ICount), cycles);
+  tr_exit_jcc(DCOND_LE, target);
+  if (wr)
+    emit_wcheck(target);
+  tr_link_jmp(target);
+}
+
+// Z80 pc in eax
+static void emit_jump_dynamic(int cycles)
+{
+  emith_ctx_sub_imm(CTX_OFS(ICount), cycles);
+  emith_jump(z80_drc_exit);
+}
+
+// jumps over the taken path unless Z80 condition cc holds, patch later
+static u8 *emit_cond_skip(int cc)
+{
+  static const u8 cc_mask[4] = { ZF, CF, PF, SF };
+  u8 *jump;
+
+  emith_ctx_tst8_imm(F_OFS, cc_mask[cc >> 1]);
+  jump = tcache_ptr;
+  emith_jump_cond((cc & 1) ? DCOND_EQ : DCOND_NE, tcache_ptr);
+  return jump;
+}
+
+// memory, ecx is the address, data goes in edx and comes out in eax
+static void emit_addr(int ofs, int d)
+{
+  emith_ctx_read_u16(xCX, ofs);
+  if (d != 0) {
+    emith_add_r_imm(xCX, d);
+    emith_and_r_imm(xCX, 0xffff);
+  }
+}
+
+static void emit_read8(void)
+{
+  emith_call(z80_drc_read8);
+}
+
+static void emit_write8(void)
+{
+  emith_call(z80_drc_write8);
+}
+
+static void emit_read8_imm(u32 a)
+{
+  uptr v = z80_read_map[a >> Z80_MEM_SHIFT];
+  u8 *p = (u8 *)(v << 1) + a;
+
+  if (!map_flag_set(v) && PicoMem.zram <= p && p < PicoMem.zram + sizeof(PicoMem.zram))
+    emith_ctx_read_u8(xAX, CTX_REL(p));
+  else {
+    emith_move_r_imm(xCX, a);
+    emit_read8();
+  }
+}
+
+static void emit_read16_imm(u32 a)
+{
+  emit_read8_imm(a);
+  emith_move_r_r(xBX, xAX);
+  emit_read8_imm((a + 1) & 0xffff);
+  emith_lsl(xAX, xAX, 8);
+  emith_or_r_r(xAX, xBX);
+}
+
+// 16bit register at ofs, or imm if ofs < 0
+static void emit_push(int ofs, u32 imm)
+{
+  emith_ctx_read_u16(xCX, SP_OFS);
+  emith_sub_r_imm(xCX, 2);
+  emith_and_r_imm(xCX, 0xffff);
+  emith_ctx_write16(xCX, SP_OFS);
+  if (ofs >= 0)
+    emith_ctx_read_u8(xDX, ofs);
+  else
+    emith_move_r_imm(xDX, imm & 0xff);
+  emit_write8();
+  emit_addr(SP_OFS, 1);
+  if (ofs >= 0)
+    emith_ctx_read_u8(xDX, ofs + 1);
+  else
+    emith_move_r_imm(xDX, imm >> 8);
+  emit_write8();
+}
+
+static void emit_pop(void)
+{
+  emith_ctx_read_u16(xCX, SP_OFS);
+  emit_read8();
+  emith_move_r_r(xBX, xAX);
+  emit_addr(SP_OFS, 1);
+  emit_read8();
+  emith_lsl(xAX, xAX, 8);
+  emith_or_r_r(xAX, xBX);
+  emith_ctx_arith16_imm(0, SP_OFS, 2);
+}
+
+// A <op>= edx, op as in Z80 encoding: add adc sub sbc and xor or cp
+static void emit_alu(int op)
+{
+  s32 tab = op < 2 ? CTX_REL(SZHVC_add) : CTX_REL(SZHVC_sub);
+  int carry = op == 1 || op == 3;
+
+  emith_ctx_read_u8(xAX, A_OFS);
+  switch (op) {
+  case 4: case 5: case 6:
+    emith_arith_r_r(op == 4 ? 4 : op == 5 ? 6 : 1, xAX, xDX);
+    emith_ctx_write8(xAX, A_OFS);
+    emith_ctx_read_u8_idx(xAX, xAX, CTX_REL(SZP));
+    if (op == 4)
+      emith_or_r_imm(xAX, HF);
+    break;
+  default:
+    if (carry) {
+      emith_ctx_read_u8(xBX, F_OFS);
+      emith_and_r_imm(xBX, CF);
+    }
+    emith_move_r_r(xCX, xAX);
+    emith_arith_r_r(op < 2 ? 0 : 5, xCX, xDX);
+    if (carry)
+      emith_arith_r_r(op < 2 ? 0 : 5, xCX, xBX);
+    emith_zext8_r_r(xCX, xCX);
+    if (op != 7)
+      emith_ctx_write8(xCX, A_OFS);
+    emith_lsl(xAX, xAX, 8);
+    emith_or_r_r(xAX, xCX);
+    if (carry) {
+      emith_lsl(xBX, xBX, 16);
+      emith_or_r_r(xAX, xBX);
+    }
+    emith_ctx_read_u8_idx(xAX, xAX, tab);
+    if (op == 7) {
+      emith_and_r_imm(xAX, ~(YF | XF) & 0xff);
+      emith_and_r_imm(xDX, YF | XF);
+      emith_or_r_r(xAX, xDX);
+    }
+    break;
+  }
+  emith_ctx_write8(xAX, F_OFS);
+}
+
+// F from the INC/DEC result in eax
+static void emit_incdec_flags(int dec)
+{
+  emith_ctx_read_u8(xCX, F_OFS);
+  emith_and_r_imm(xCX, CF);
+  emith_ctx_read_u8_idx(xAX, xAX, dec ? CTX_REL(SZHV_dec) : CTX_REL(SZHV_inc));
+  emith_or_r_r(xAX, xCX);
+  emith_ctx_write8(xAX, F_OFS);
+}
+
+// shift/rotate op as in CB encoding on eax: result in ecx, carry out in edx
+static void emit_shift_res(int op)
+{
+  emith_move_r_r(xCX, xAX);
+  if (op & 1) {
+    emith_lsr(xCX, xCX, 1);
+    switch (op) {
+    case 1: emith_lsl(xDX, xAX, 7); break;
+    case 3: emith_ctx_read_u8(xDX, F_OFS);
+            emith_and_r_imm(xDX, CF);
+            emith_lsl(xDX, xDX, 7); break;
+    case 5: emith_and_r_r_imm(xDX, xAX, 0x80); break;
+    }
+    if (op != 7)
+      emith_or_r_r(xCX, xDX);
+    emith_and_r_r_imm(xDX, xAX, CF);
+  }
+  else {
+    emith_lsl(xCX, xCX, 1);
+    switch (op) {
+    case 0: emith_lsr(xDX, xAX, 7); emith_or_r_r(xCX, xDX); break;
+    case 2: emith_ctx_read_u8(xDX, F_OFS);
+            emith_and_r_imm(xDX, CF);
+            emith_or_r_r(xCX, xDX); break;
+    case 6: emith_or_r_imm(xCX, 1); break;
+    }
+    emith_lsr(xDX, xAX, 7);
+  }
+  emith_zext8_r_r(xCX, xCX);
+}
+
+static void emit_shift(int op)
+{
+  emit_shift_res(op);
+  emith_ctx_read_u8_idx(xAX, xCX, CTX_REL(SZP));
+  emith_or_r_r(xAX, xDX);
+  emith_ctx_write8(xAX, F_OFS);
+}
+
+// RLCA RRCA RLA RRA
+static void emit_rot_a(int op)
+{
+  emith_ctx_read_u8(xAX, A_OFS);
+  emit_shift_res(op);
+  emith_ctx_write8(xCX, A_OFS);
+  emith_and_r_r_imm(xAX, xCX, YF | XF);
+  emith_or_r_r(xAX, xDX);
+  emith_ctx_read_u8(xDX, F_OFS);
+  emith_and_r_imm(xDX, SF | ZF | PF);
+  emith_or_r_r(xAX, xDX);
+  emith_ctx_write8(xAX, F_OFS);
+}
+
+// BIT on eax, with (IX+d) the undocumented bits come from ebx
+static void emit_bit(int mask, int xy)
+{
+  emith_and_r_imm(xAX, mask);
+  emith_ctx_read_u8_idx(xAX, xAX, CTX_REL(SZ_BIT));
+  if (xy) {
+    emith_and_r_imm(xAX, ~(YF | XF) & 0xff);
+    emith_lsr(xCX, xBX, 8);
+    emith_and_r_imm(xCX, YF | XF);
+    emith_or_r_r(xAX, xCX);
+  }
+  emith_ctx_read_u8(xCX, F_OFS);
+  emith_and_r_imm(xCX, CF);
+  emith_or_r_r(xAX, xCX);
+  emith_or_r_imm(xAX, HF);
+  emith_ctx_write8(xAX, F_OFS);
+}
+
+static void emit_add16(int d_ofs, int s_ofs)
+{
+  emith_ctx_read_u16(xAX, d_ofs);
+  emith_ctx_read_u16(xDX, s_ofs);
+  emith_move_r_r(xCX, xAX);
+  emith_add_r_r(xCX, xDX);
+  emith_ctx_write16(xCX, d_ofs);
+  emith_eor_r_r(xAX, xDX);
+  emith_eor_r_r(xAX, xCX);
+  emith_lsr(xAX, xAX, 8);
+  emith_and_r_imm(xAX, HF);
+  emith_lsr(xDX, xCX, 16);
+  emith_or_r_r(xAX, xDX);
+  emith_lsr(xCX, xCX, 8);
+  emith_and_r_imm(xCX, YF | XF);
+  emith_or_r_r(xAX, xCX);
+  emith_ctx_read_u8(xCX, F_OFS);
+  emith_and_r_imm(xCX, SF | ZF | VF);
+  emith_or_r_r(xAX, xCX);
+  emith_ctx_write8(xAX, F_OFS);
+}
+
+static void emit_swap16(int ofs1, int ofs2)
+{
+  emith_ctx_read_u16(xAX, ofs1);
+  emith_ctx_read_u16(xCX, ofs2);
+  emith_ctx_write16(xCX, ofs1);
+  emith_ctx_write16(xAX, ofs2);
+}
+
+// CB ops, r == 6 is (HL), or (xy+d) if xy is set with the address in ebx
+static int emit_op_cb(u32 op, int xy, int *cyc, int *wr)
+{
+  int r = op & 7, mask = 1 << ((op >> 3) & 7);
+
+  if (xy && r != 6 && (op & 0xc0) != 0x40)
+    return 0; // undocumented store to a register too
+  if (xy)
+    r = 6;
+
+  if (r != 6) {
+    *cyc = 8;
+    if (op >= 0x80) {
+      emith_ctx_arith8_imm(op >= 0xc0 ? 1 : 4, r8_ofs[r],
+        op >= 0xc0 ? mask : ~mask & 0xff);
+      return 1;
+    }
+    emith_ctx_read_u8(xAX, r8_ofs[r]);
+  }
+  else {
+    if (!xy)
+      emith_ctx_read_u16(xBX, HL_OFS);
+    emith_move_r_r(xCX, xBX);
+    emit_read8();
+  }
+
+  if ((op & 0xc0) == 0x40) {
+    emit_bit(mask, xy);
+    if (r == 6)
+      *cyc = xy ? 16 : 12;
+    return 1;
+  }
+
+  if (op < 0x40) {
+    emit_shift(op >> 3);
+    if (r != 6) {
+      emith_ctx_write8(xCX, r8_ofs[r]);
+      return 1;
+    }
+    emith_move_r_r(xDX, xCX);
+  }
+  else {
+    if (op >= 0xc0)
+      emith_or_r_imm(xAX, mask);
+    else
+      emith_and_r_imm(xAX, ~mask & 0xff);
+    emith_move_r_r(xDX, xAX);
+  }
+  emith_move_r_r(xCX, xBX);
+  emit_write8();
+  *cyc = xy ? 19 : 15;
+  *wr = 1;
+  return 1;
+}
+
+// DD/FD prefixed ops, xy is the IX or IY offset
+static int emit_op_xy(u32 pc, int xy, int *cyc, int *wr, int *end)
+{
+  u32 op = OPB(pc, 1);
+  s8 d = OPB(pc, 2);
+  int len = 2, r;
+
+  emit_r_inc(1);
+  emith_ctx_sub_imm(CTX_OFS(ICount), 4);
+  *cyc = 0;
+
+  if ((op & 0xc7) == 0x46 && op != 0x76) {
+    // LD r,(xy+d)
+    emit_addr(xy, d);
+    emit_read8();
+    emith_ctx_write8(xAX, r8_ofs[(op >> 3) & 7]);
+    *cyc = 15;
+    return 3;
+  }
+  if ((op & 0xf8) == 0x70 && op != 0x76) {
+    // LD (xy+d),r
+    emit_addr(xy, d);
+    emith_ctx_read_u8(xDX, r8_ofs[op & 7]);
+    emit_write8();
+    *cyc = 15;
+    *wr = 1;
+    return 3;
+  }
+  if ((op & 0xc7) == 0x86) {
+    // ALU A,(xy+d)
+    emit_addr(xy, d);
+    emit_read8();
+    emith_move_r_r(xDX, xAX);
+    emit_alu((op >> 3) & 7);
+    *cyc = 15;
+    return 3;
+  }
+
+  switch (op) {
+  case 0x09: case 0x19: case 0x29: case 0x39: // ADD xy,rr
+    r = (op >> 4) & 3;
+    emit_add16(xy, r == 2 ? xy : r16_ofs[r]);
+    *cyc = 11;
+    break;
+  case 0x21: // LD xy,nn
+    emith_move_r_imm(xAX, OPB(pc, 2) | (OPB(pc, 3) << 8));
+    emith_ctx_write16(xAX, xy);
+    *cyc = 10;
+    len = 4;
+    break;
+  case 0x22: // LD (nn),xy
+    r = OPB(pc, 2) | (OPB(pc, 3) << 8);
+    emith_move_r_imm(xCX, r);
+    emith_ctx_read_u8(xDX, xy);
+    emit_write8();
+    emith_move_r_imm(xCX, (r + 1) & 0xffff);
+    emith_ctx_read_u8(xDX, xy + 1);
+    emit_write8();
+    *cyc = 16;
+    *wr = 1;
+    len = 4;
+    break;
+  case 0x2a: // LD xy,(nn)
+    emit_read16_imm(OPB(pc, 2) | (OPB(pc, 3) << 8));
+    emith_ctx_write16(xAX, xy);
+    *cyc = 16;
+    len = 4;
+    break;
+  case 0x23: // INC xy
+  case 0x2b: // DEC xy
+    emith_ctx_arith16_imm(op == 0x23 ? 0 : 5, xy, 1);
+    *cyc = 6;
+    break;
+  case 0x34: // INC (xy+d)
+  case 0x35: // DEC (xy+d)
+    emit_addr(xy, d);
+    emith_move_r_r(xBX, xCX);
+    emith_ctx_sub_imm(CTX_OFS(ICount), 8);
+    emit_read8();
+    emith_arith_r_imm(op == 0x34 ? 0 : 5, xAX, 1);
+    emith_zext8_r_r(xAX, xAX);
+    emith_move_r_r(xDX, xAX);
+    emit_incdec_flags(op == 0x35);
+    emith_move_r_r(xCX, xBX);
+    emit_write8();
+    *cyc = 11;
+    *wr = 1;
+    len = 3;
+    break;
+  case 0x36: // LD (xy+d),n
+    emit_addr(xy, d);
+    emith_move_r_imm(xDX, OPB(pc, 3));
+    emit_write8();
+    *cyc = 15;
+    *wr = 1;
+    len = 4;
+    break;
+  case 0xcb:
+    emit_r_inc(1);
+    emit_addr(xy, d);
+    emith_move_r_r(xBX, xCX);
+    if (!emit_op_cb(OPB(pc, 3), 1, cyc, wr))
+      return 0;
+    len = 4;
+    break;
+  case 0xe1: // POP xy
+    emit_pop();
+    emith_ctx_write16(xAX, xy);
+    *cyc = 10;
+    break;
+  case 0xe5: // PUSH xy
+    emit_push(xy, 0);
+    *cyc = 11;
+    *wr = 1;
+    break;
+  case 0xe9: // JP (xy)
+    emith_ctx_read_u16(xAX, xy);
+    emit_jump_dynamic(4);
+    *end = 1;
+    break;
+  case 0xf9: // LD SP,xy
+    emith_ctx_read_u16(xAX, xy);
+    emith_ctx_write16(xAX, SP_OFS);
+    *cyc = 6;
+    break;
+  default:
+    return 0;
+  }
+  return len;
+}
+
+// returns op length, 0 if it has to be left for CZ80
+static int emit_op(u32 pc, int *end)
+{
+  u32 op = OPB(pc, 0);
+  u32 nn = OPB(pc, 1) | (OPB(pc, 2) << 8);
+  s8 e = OPB(pc, 1);
+  int len = 1, cyc = 4, wr = 0;
+  u32 next, target;
+  u8 *jump;
+  int r, s;
+
+  emit_r_inc(1);
+
+  if (0x40 <= op && op < 0x80 && op != 0x76) {
+    // LD r,r
+    r = (op >> 3) & 7;
+    s = op & 7;
+    if (s == 6) {
+      emit_addr(HL_OFS, 0);
+      emit_read8();
+      emith_ctx_write8(xAX, r8_ofs[r]);
+      cyc = 7;
+    }
+    else if (r == 6) {
+      emit_addr(HL_OFS, 0);
+      emith_ctx_read_u8(xDX, r8_ofs[s]);
+      emit_write8();
+      cyc = 7;
+      wr = 1;
+    }
+    else if (r != s) {
+      emith_ctx_read_u8(xAX, r8_ofs[s]);
+      emith_ctx_write8(xAX, r8_ofs[r]);
+    }
+    goto done;
+  }
+  if (0x80 <= op && op < 0xc0) {
+    // ALU A,r
+    s = op & 7;
+    if (s == 6) {
+      emit_addr(HL_OFS, 0);
+      emit_read8();
+      emith_move_r_r(xDX, xAX);
+      cyc = 7;
+    }
+    else
+      emith_ctx_read_u8(xDX, r8_ofs[s]);
+    emit_alu((op >> 3) & 7);
+    goto done;
+  }
+
+  switch (op) {
+  case 0x00: // NOP
+    break;
+
+  case 0x01: case 0x11: case 0x21: case 0x31: // LD rr,nn
+    emith_move_r_imm(xAX, nn);
+    emith_ctx_write16(xAX, r16_ofs[op >> 4]);
+    cyc = 10;
+    len = 3;
+    break;
+  case 0x02: case 0x12: // LD (rr),A
+    emit_addr(r16_ofs[op >> 4], 0);
+    emith_ctx_read_u8(xDX, A_OFS);
+    emit_write8();
+    cyc = 7;
+    wr = 1;
+    break;
+  case 0x0a: case 0x1a: // LD A,(rr)
+    emit_addr(r16_ofs[op >> 4], 0);
+    emit_read8();
+    emith_ctx_write8(xAX, A_OFS);
+    cyc = 7;
+    break;
+  case 0x22: // LD (nn),HL
+    emith_move_r_imm(xCX, nn);
+    emith_ctx_read_u8(xDX, HL_OFS);
+    emit_write8();
+    emith_move_r_imm(xCX, (nn + 1) & 0xffff);
+    emith_ctx_read_u8(xDX, HL_OFS + 1);
+    emit_write8();
+    cyc = 16;
+    wr = 1;
+    len = 3;
+    break;
+  case 0x2a: // LD HL,(nn)
+    emit_read16_imm(nn);
+    emith_ctx_write16(xAX, HL_OFS);
+    cyc = 16;
+    len = 3;
+    break;
+  case 0x32: // LD (nn),A
+    emith_move_r_imm(xCX, nn);
+    emith_ctx_read_u8(xDX, A_OFS);
+    emit_write8();
+    cyc = 13;
+    wr = 1;
+    len = 3;
+    break;
+  case 0x3a: // LD A,(nn)
+    emit_read8_imm(nn);
+    emith_ctx_write8(xAX, A_OFS);
+    cyc = 13;
+    len = 3;
+    break;
+  case 0xf9: // LD SP,HL
+    emith_ctx_read_u16(xAX, HL_OFS);
+    emith_ctx_write16(xAX, SP_OFS);
+    cyc = 6;
+    break;
+
+  case 0x03: case 0x13: case 0x23: case 0x33: // INC rr
+  case 0x0b: case 0x1b: case 0x2b: case 0x3b: // DEC rr
+    emith_ctx_arith16_imm((op & 8) ? 5 : 0, r16_ofs[op >> 4], 1);
+    cyc = 6;
+    break;
+  case 0x09: case 0x19: case 0x29: case 0x39: // ADD HL,rr
+    emit_add16(HL_OFS, r16_ofs[op >> 4]);
+    cyc = 11;
+    break;
+
+  case 0x04: case 0x0c: case 0x14: case 0x1c: // INC r
+  case 0x24: case 0x2c: case 0x34: case 0x3c:
+  case 0x05: case 0x0d: case 0x15: case 0x1d: // DEC r
+  case 0x25: case 0x2d: case 0x35: case 0x3d:
+    r = op >> 3;
+    if (r == 6) {
+      emith_ctx_read_u16(xBX, HL_OFS);
+      emith_move_r_r(xCX, xBX);
+      emit_read8();
+    }
+    else
+      emith_ctx_read_u8(xAX, r8_ofs[r]);
+    emith_arith_r_imm((op & 1) ? 5 : 0, xAX, 1);
+    emith_zext8_r_r(xAX, xAX);
+    if (r == 6)
+      emith_move_r_r(xDX, xAX);
+    else
+      emith_ctx_write8(xAX, r8_ofs[r]);
+    emit_incdec_flags(op & 1);
+    if (r == 6) {
+      emith_move_r_r(xCX, xBX);
+      emit_write8();
+      cyc = 11;
+      wr = 1;
+    }
+    break;
+
+  case 0x06: case 0x0e: case 0x16: case 0x1e: // LD r,n
+  case 0x26: case 0x2e: case 0x36: case 0x3e:
+    r = op >> 3;
+    if (r == 6) {
+      emit_addr(HL_OFS, 0);
+      emith_move_r_imm(xDX, nn & 0xff);
+      emit_write8();
+      cyc = 10;
+      wr = 1;
+    }
+    else {
+      emith_ctx_write8_imm(r8_ofs[r], nn & 0xff);
+      cyc = 7;
+    }
+    len = 2;
+    break;
+  case 0xc6: case 0xce: case 0xd6: case 0xde: // ALU A,n
+  case 0xe6: case 0xee: case 0xf6: case 0xfe:
+    emith_move_r_imm(xDX, nn & 0xff);
+    emit_alu((op >> 3) & 7);
+    cyc = 7;
+    len = 2;
+    break;
+
+  case 0x07: case 0x0f: case 0x17: case 0x1f: // RLCA RRCA RLA RRA
+    emit_rot_a(op >> 3);
+    break;
+  case 0x2f: // CPL
+    emith_ctx_arith8_imm(6, A_OFS, 0xff);
+    emith_ctx_read_u8(xAX, A_OFS);
+    emith_and_r_imm(xAX, YF | XF);
+    emith_ctx_read_u8(xCX, F_OFS);
+    emith_and_r_imm(xCX, SF | ZF | PF | CF);
+    emith_or_r_r(xAX, xCX);
+    emith_or_r_imm(xAX, HF | NF);
+    emith_ctx_write8(xAX, F_OFS);
+    break;
+  case 0x37: // SCF
+  case 0x3f: // CCF
+    emith_ctx_read_u8(xAX, A_OFS);
+    emith_and_r_imm(xAX, YF | XF);
+    emith_ctx_read_u8(xCX, F_OFS);
+    if (op == 0x37) {
+      emith_and_r_imm(xCX, SF | ZF | PF);
+      emith_or_r_imm(xAX, CF);
+    }
+    else {
+      emith_and_r_r_imm(xDX, xCX, CF);
+      emith_lsl(xDX, xDX, 4);
+      emith_or_r_r(xAX, xDX);
+      emith_and_r_imm(xCX, SF | ZF | PF | CF);
+      emith_eor_r_imm(xCX, CF);
+    }
+    emith_or_r_r(xAX, xCX);
+    emith_ctx_write8(xAX, F_OFS);
+    break;
+
+  case 0x08: // EX AF,AF'
+    emit_swap16(CTX_OFS(AF), CTX_OFS(AF2));
+    break;
+  case 0xeb: // EX DE,HL
+    emit_swap16(CTX_OFS(DE), CTX_OFS(HL));
+    break;
+  case 0xd9: // EXX
+    emit_swap16(CTX_OFS(BC), CTX_OFS(BC2));
+    emit_swap16(CTX_OFS(DE), CTX_OFS(DE2));
+    emit_swap16(CTX_OFS(HL), CTX_OFS(HL2));
+    break;
+  case 0xf3: // DI
+    emith_eor_r_r(xAX, xAX);
+    emith_ctx_write16(xAX, CTX_OFS(IFF));
+    break;
+
+  case 0xc1: case 0xd1: case 0xe1: case 0xf1: // POP rr
+    emit_pop();
+    emith_ctx_write16(xAX, r16af_ofs[(op >> 4) & 3]);
+    cyc = 10;
+    break;
+  case 0xc5: case 0xd5: case 0xe5: case 0xf5: // PUSH rr
+    emit_push(r16af_ofs[(op >> 4) & 3], 0);
+    cyc = 11;
+    wr = 1;
+    break;
+
+  // branches
+  case 0xc3: // JP nn
+    emit_jump(10, nn, 0);
+    *end = 1;
+    return 3;
+  case 0xc2: case 0xca: case 0xd2: case 0xda: // JP cc,nn
+  case 0xe2: case 0xea: case 0xf2: case 0xfa:
+    jump = emit_cond_skip((op >> 3) & 7);
+    emit_jump(10, nn, 0);
+    emith_jump_patch(jump, tcache_ptr);
+    cyc = 10;
+    len = 3;
+    break;
+  case 0xe9: // JP (HL)
+    emith_ctx_read_u16(xAX, HL_OFS);
+    emit_jump_dynamic(4);
+    *end = 1;
+    return 1;
+
+  case 0x18: // JR e
+  case 0x10: // DJNZ e
+  case 0x20: case 0x28: case 0x30: case 0x38: // JR cc,e
+    target = (pc + 2 + e) & 0xffff;
+    if ((target ^ pc) & ~0x1fff)
+      return 0; // CZ80 doesn't rebase on JR
+    if (op == 0x18) {
+      emit_jump(12, target, 0);
+      *end = 1;
+      return 2;
+    }
+    if (op == 0x10) {
+      emith_ctx_arith8_imm(5, r8_ofs[0], 1);
+      jump = tcache_ptr;
+      emith_jump_cond(DCOND_EQ, tcache_ptr);
+      emit_jump(13, target, 0);
+      cyc = 8;
+    }
+    else {
+      jump = emit_cond_skip((op >> 3) & 3);
+      emit_jump(12, target, 0);
+      cyc = 7;
+    }
+    emith_jump_patch(jump, tcache_ptr);
+    len = 2;
+    break;
+
+  case 0xcd: // CALL nn
+    emit_push(-1, (pc + 3) & 0xffff);
+    emit_jump(17, nn, 1);
+    *end = 1;
+    return 3;
+  case 0xc4: case 0xcc: case 0xd4: case 0xdc: // CALL cc,nn
+  case 0xe4: case 0xec: case 0xf4: case 0xfc:
+    jump = emit_cond_skip((op >> 3) & 7);
+    emit_push(-1, (pc + 3) & 0xffff);
+    emit_jump(17, nn, 1);
+    emith_jump_patch(jump, tcache_ptr);
+    cyc = 10;
+    len = 3;
+    break;
+  case 0xc7: case 0xcf: case 0xd7: case 0xdf: // RST n
+  case 0xe7: case 0xef: case 0xf7: case 0xff:
+    emit_push(-1, (pc + 1) & 0xffff);
+    emit_jump(11, op & 0x38, 1);
+    *end = 1;
+    return 1;
+
+  case 0xc9: // RET
+    emit_pop();
+    emit_jump_dynamic(10);
+    *end = 1;
+    return 1;
+  case 0xc0: case 0xc8: case 0xd0: case 0xd8: // RET cc
+  case 0xe0: case 0xe8: case 0xf0: case 0xf8:
+    jump = emit_cond_skip((op >> 3) & 7);
+    emith_ctx_sub_imm(CTX_OFS(ICount), 1);
+    emit_pop();
+    emit_jump_dynamic(10);
+    emith_jump_patch(jump, tcache_ptr);
+    cyc = 5;
+    break;
+
+  // prefixes
+  case 0xcb:
+    emit_r_inc(1);
+    if (!emit_op_cb(OPB(pc, 1), 0, &cyc, &wr))
+      return 0;
+    len = 2;
+    break;
+  case 0xdd:
+  case 0xfd:
+    len = emit_op_xy(pc, op == 0xdd ? CTX_OFS(IX) : CTX_OFS(IY),
+      &cyc, &wr, end);
+    if (len == 0 || *end)
+      return len;
+    break;
+
+  default:
+    return 0;
+  }
+
+done:
+  next = (pc + len) & 0xffff;
+  emit_cycles(cyc, next);
+  if (wr)
+    emit_wcheck(next);
+  return len;
+}
+
+static u8 *tr_exit_stub(u32 pc, u8 **stub_ptrs, u32 *stub_pcs, int *stub_count)
+{
+  int i;
+
+  for (i = 0; i < *stub_count; i++)
+    if (stub_pcs[i] == pc)
+      return stub_ptrs[i];
+
+  stub_pcs[i] = pc;
+  stub_ptrs[i] = tcache_ptr;
+  (*stub_count)++;
+  emith_move_r_imm(xAX, pc);
+  emith_jump(z80_drc_exit);
+  return stub_ptrs[i];
+}
+
+static struct block_desc *dr_translate(u32 base_pc)
+{
+  static PICO_TLS u8 *stub_ptrs[MAX_EXITS * 2];
+  static PICO_TLS u32 stub_pcs[MAX_EXITS * 2];
+  int stub_count = 0;
+  struct block_desc *bd;
+  u32 pc, page_end = (base_pc | 0x1fff) + 1;
+  u8 *block_start, *insn_start;
+  int i, n, len = 0, end = 0;
+
+  if (tcache_ptr + MAX_BLOCK_SIZE > tcache_z80 + TCACHE_SIZE
+      || block_count >= BLOCK_MAX_COUNT
+      || link_count + MAX_EXITS > LINK_MAX_COUNT
+      || ram_entry_count + 4 > RAM_ENTRY_MAX_COUNT)
+    dr_flush();
+
+  tr_exit_count = tr_link_count = 0;
+  block_start = tcache_ptr;
+
+  for (i = 0, pc = base_pc; i < Z80_BLOCK_INSN_LIMIT; i++) {
+    int exit_count = tr_exit_count, link_count_ = tr_link_count;
+    if (tr_exit_count + 4 > MAX_EXITS)
+      break;
+
+    tr_insn_pc[i] = pc;
+    tr_insn_ptr[i] = insn_start = tcache_ptr;
+    len = emit_op(pc, &end);
+    if (len == 0 || pc + len > page_end) {
+      // leave it to CZ80
+      tcache_ptr = insn_start;
+      tr_exit_count = exit_count;
+      tr_link_count = link_count_;
+      end = 0;
+      break;
+    }
+#if DRC_DEBUG
+    insns_compiled++;
+#endif
+    pc += len;
+    if (end)
+      break;
+  }
+  n = end ? i + 1 : i;
+
+  if (n == 0) {
+    dr_add_none(base_pc);
+    return &block_none;
+  }
+  if (!end) // ran out of insns or memory, continue in the next block
+    tr_link_jmp(pc);
+
+  // local branches go straight to the insn
+  for (i = 0; i < tr_link_count; i++) {
+    u32 t = tr_links[i].target_pc;
+    int j;
+    if (t < base_pc || t >= pc)
+      continue;
+    for (j = 0; j < n; j++)
+      if (tr_insn_pc[j] == t)
+        break;
+    if (j < n) {
+      emith_jump_patch(tr_links[i].jump, tr_insn_ptr[j]);
+      tr_links[i].jump = NULL;
+    }
+  }
+
+  for (i = 0; i < tr_exit_count; i++)
+    emith_jump_patch(tr_exits[i].jump,
+      tr_exit_stub(tr_exits[i].pc, stub_ptrs, stub_pcs, &stub_count));
+  assert(tcache_ptr <= block_start + MAX_BLOCK_SIZE);
+
+  bd = &block_table[block_count++];
+  bd->pc = base_pc;
+  bd->end_pc = pc;
+  bd->tcache_ptr = block_start;
+  bd->entries = NULL;
+  bd->active = 1;
+  block_lut[base_pc] = bd;
+  dr_resolve_links(bd);
+
+  for (i = 0; i < tr_link_count; i++) {
+    if (tr_links[i].jump == NULL)
+      continue;
+    dr_add_link(tr_links[i].target_pc, tr_links[i].jump,
+      tr_exit_stub(tr_links[i].target_pc, stub_ptrs, stub_pcs, &stub_count));
+  }
+  assert(tcache_ptr <= block_start + MAX_BLOCK_SIZE + MAX_EXITS * 10);
+
+  dr_add_ram_block(bd);
+
+  dbg(2, "block #%d %04x-%04x, %d insns, %d bytes", block_count - 1,
+    base_pc, pc, n, (int)(tcache_ptr - block_start));
+  return bd;
+}
+
+// ---------------------------------------------------------------
+// runtime
+
+// CZ80's main loop calls here with CPU->PC at the next op
+static void drc_exec(cz80_struc *CPU)
+{
+  struct block_desc *bd;
+  u32 pc;
+
+  do {
+    pc = (u32)(CPU->PC - CPU->BasePC);
+    if (pc >= 0x4000 || (u8 *)CPU->PC != PicoMem.zram + PC_RAM(pc))
+      return;
+    bd = block_lut[pc];
+    if (bd == NULL)
+      bd = dr_translate(pc);
+    if (bd->tcache_ptr == NULL)
+      return;
+
+    CPU->drc_exit = 0;
+    pc = z80_drc_entry(CPU, bd->tcache_ptr);
+    CPU->BasePC = CPU->Fetch[pc >> CZ80_FETCH_SFT];
+    CPU->PC = CPU->BasePC + pc;
+  } while (CPU->ICount > 0);
+}
+
+void cz80_drc_wcheck_ram(unsigned int a)
+{
+  if (tcache_z80 != NULL && ram_marks[a & 0x1fff])
+    dr_ram_inval(a & 0x1fff);
+}
+
+void cz80_drc_flush(void)
+{
+  if (tcache_z80 != NULL)
+    dr_flush();
+}
+
+// stack space for C calls from the utils, win64 wants its shadow area
+#ifdef _WIN32
+#define UTIL_STACK 0x28
+#else
+#define UTIL_STACK 0x08
+#endif
+
+static int dr_reachable(const void *p, size_t size)
+{
+  intptr_t d = (u8 *)p - (u8 *)&CZ80;
+  return d == (s32)d && d + (intptr_t)size == (s32)(d + size);
+}
+
+static int dr_startup(void)
+{
+  int arg0, arg1;
+
+  if (!dr_reachable(SZP, sizeof(SZP)) || !dr_reachable(SZ_BIT, sizeof(SZ_BIT))
+      || !dr_reachable(SZHV_inc, sizeof(SZHV_inc))
+      || !dr_reachable(SZHV_dec, sizeof(SZHV_dec))
+      || !dr_reachable(SZHVC_add, sizeof(SZHVC_add))
+      || !dr_reachable(SZHVC_sub, sizeof(SZHVC_sub))
+      || !dr_reachable(z80_read_map, sizeof(z80_read_map))
+      || !dr_reachable(z80_write_map, sizeof(z80_write_map))
+      || !dr_reachable(PicoMem.zram, sizeof(PicoMem.zram))
+      || !dr_reachable(ram_marks, sizeof(ram_marks))) {
+    elprintf(EL_STATUS, "z80 drc: data out of reach");
+    return -1;
+  }
+
+#ifndef PICO_THREAD_SAFE
+  tcache_z80 = tcache_default;
+#else
+  tcache_z80 = plat_mmap(0, TCACHE_SIZE, 1, 0);
+  if (tcache_z80 == NULL)
+    return -1;
+#endif
+  plat_mem_set_exec(tcache_z80, TCACHE_SIZE);
+
+  block_table = calloc(BLOCK_MAX_COUNT, sizeof(block_table[0]));
+  block_lut = calloc(0x4000, sizeof(block_lut[0]));
+  link_table = calloc(LINK_MAX_COUNT, sizeof(link_table[0]));
+  unresolved_links = calloc(ULINK_HASH_SIZE, sizeof(unresolved_links[0]));
+  ram_entries = calloc(RAM_ENTRY_MAX_COUNT, sizeof(ram_entries[0]));
+  if (block_table == NULL || block_lut == NULL || link_table == NULL
+      || unresolved_links == NULL || ram_entries == NULL)
+    goto fail;
+
+  tcache_ptr = tcache_z80;
+  host_arg2reg(arg0, 0);
+  host_arg2reg(arg1, 1);
+
+  // z80_drc_entry(cz80_struc *CPU, const void *block)
+  z80_drc_entry = (void *)tcache_ptr;
+  emith_sh2_drc_entry();
+  emith_move_r_r_ptr(CONTEXT_REG, arg0);
+  emith_jump_reg(arg1);
+
+  z80_drc_exit = tcache_ptr;
+  emith_sh2_drc_exit();
+
+  // read8: RAM directly, handlers get the address
+  z80_drc_read8 = tcache_ptr;
+  emith_lsr(xAX, xCX, Z80_MEM_SHIFT);
+  emith_ctx_read_ptr_idx(xAX, xAX, CTX_REL(z80_read_map));
+  emith_add_r_r_ptr(xAX, xAX); // map flag to carry
+  EMITH_JMP_START(DCOND_LO);
+  emith_read8_zext_r_r_r(xAX, xAX, xCX);
+  emith_ret();
+  EMITH_JMP_END(DCOND_LO);
+  emith_move_r_r(arg0, xCX);
+  emith_add_r_r_ptr_imm(xSP, xSP, -UTIL_STACK);
+  emith_call_reg(xAX);
+  emith_add_r_r_ptr_imm(xSP, xSP, UTIL_STACK);
+  emith_zext8_r_r(xAX, xAX);
+  emith_ret();
+
+  // write8: same, RAM writes check for translated code
+  z80_drc_write8 = tcache_ptr;
+  emith_lsr(xAX, xCX, Z80_MEM_SHIFT);
+  emith_ctx_read_ptr_idx(xAX, xAX, CTX_REL(z80_write_map));
+  emith_add_r_r_ptr(xAX, xAX);
+  EMITH_JMP_START(DCOND_LO);
+  emith_write8_r_r_r(xDX, xAX, xCX);
+  emith_add_r_r_ptr(xAX, xCX);
+  emith_sub_r_r_ptr(xAX, CONTEXT_REG);
+  emith_add_r_r_ptr_imm(xAX, xAX, -CTX_REL(PicoMem.zram));
+  emith_cmp_r_imm_ptr(xAX, sizeof(PicoMem.zram));
+  EMITH_JMP_START(DCOND_HS);
+  emith_ctx_read_u16_idx(xDX, xAX, CTX_REL(ram_marks));
+  emith_tst_r_r(xDX, xDX);
+  EMITH_JMP_START(DCOND_EQ);
+  emith_move_r_r(arg0, xAX);
+  emith_add_r_r_ptr_imm(xSP, xSP, -UTIL_STACK);
+  emit_call(dr_ram_inval);
+  emith_add_r_r_ptr_imm(xSP, xSP, UTIL_STACK);
+  EMITH_JMP_END(DCOND_EQ);
+  EMITH_JMP_END(DCOND_HS);
+  emith_ret();
+  EMITH_JMP_END(DCOND_LO);
+  if (arg0 == xDX) { // not the case on any supported ABI
+    assert(0);
+  }
+  emith_move_r_r(arg1, xDX);
+  emith_move_r_r(arg0, xCX);
+  emith_add_r_r_ptr_imm(xSP, xSP, -UTIL_STACK);
+  emith_call_reg(xAX);
+  emith_add_r_r_ptr_imm(xSP, xSP, UTIL_STACK);
+  emith_ret();
+
+  tcache_blocks = tcache_ptr;
+  dr_flush();
+
+  elprintf(EL_STATUS, "z80 drc: %p, %d bytes", tcache_z80, TCACHE_SIZE);
+  return 0;
+
+fail:
+  cz80_drc_finish();
+  return -1;
+}
+
+void cz80_drc_finish(void)
+{
+#if DRC_DEBUG
+  dbg(1, "z80 drc: %d insns, %d host ops", insns_compiled, host_insn_count);
+#endif
+#ifdef PICO_THREAD_SAFE
+  if (tcache_z80 != NULL)
+    plat_munmap(tcache_z80, TCACHE_SIZE);
+#endif
+  tcache_z80 = NULL;
+
+  free(block_table);
+  block_table = NULL;
+  free(block_lut);
+  block_lut = NULL;
+  free(link_table);
+  link_table = NULL;
+  free(unresolved_links);
+  unresolved_links = NULL;
+  free(ram_entries);
+  ram_entries = NULL;
+  memset(ram_blocks, 0, sizeof(ram_blocks));
+  memset(ram_marks, 0, sizeof(ram_marks));
+  block_count = link_count = ram_entry_count = 0;
+}
+
+int cz80_drc_exec(cz80_struc *CPU, int cycles)
+{
+  int ret;
+
+  // native code is tied to this thread's CZ80
+  if (CPU != &CZ80 || (tcache_z80 == NULL && dr_startup() != 0))
+    return Cz80_Exec(CPU, cycles);
+
+  drc_cpu = CPU;
+  ret = Cz80_Exec(CPU, cycles);
+  drc_cpu = NULL;
+  return ret;
+}
+
+// vim:shiftwidth=2:ts=2:expandtab
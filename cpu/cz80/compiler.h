@@ -0,0 +1,12 @@
+#ifdef DRC_Z80
+int  cz80_drc_exec(cz80_struc *CPU, int cycles);
+void cz80_drc_finish(void);
+void cz80_drc_flush(void);
+void cz80_drc_wcheck_ram(unsigned int a);
+#else
+#define cz80_drc_finish()
+#define cz80_drc_flush()
+#define cz80_drc_wcheck_ram(a)
+#endif
+
+#define Z80_BLOCK_INSN_LIMIT 64
@@ -50,23 +50,23 @@
 	O[o\
 ******************************************************************************/
 
-cz80_struc ALIGN_DATA CZ80;
+PICO_TLS cz80_struc ALIGN_DATA CZ80;
 
 
 /******************************************************************************
 	[Jϐ
 ******************************************************************************/
 
-static UINT8 ALIGN_DATA cz80_bad_address[1 << CZ80_FETCH_SFT];
+static PICO_TLS UINT8 ALIGN_DATA cz80_bad_address[1 << CZ80_FETCH_SFT];
 
-static UINT8 ALIGN_DATA SZ[256];
-static UINT8 ALIGN_DATA SZP[256];
-static UINT8 ALIGN_DATA SZ_BIT[256];
-static UINT8 ALIGN_DATA SZHV_inc[256];
-static UINT8 ALIGN_DATA SZHV_dec[256];
+static PICO_TLS UINT8 ALIGN_DATA SZ[256];
+static PICO_TLS UINT8 ALIGN_DATA SZP[256];
+static PICO_TLS UINT8 ALIGN_DATA SZ_BIT[256];
+static PICO_TLS UINT8 ALIGN_DATA SZHV_inc[256];
+static PICO_TLS UINT8 ALIGN_DATA SZHV_dec[256];
 #if CZ80_BIG_FLAGS_ARRAY
-static UINT8 ALIGN_DATA SZHVC_add[2*256*256];
-static UINT8 ALIGN_DATA SZHVC_sub[2*256*256];
+static PICO_TLS UINT8 ALIGN_DATA SZHVC_add[2*256*256];
+static PICO_TLS UINT8 ALIGN_DATA SZHVC_sub[2*256*256];
 #endif
 
 
@@ -258,6 +258,9 @@ INT32 Cz80_Exec(cz80_struc *CPU, INT32 cycles)
 Cz80_Exec:
 		if (CPU->ICount > 0)
 		{
+#ifdef CZ80_DRC_EXEC
+			CZ80_DRC_EXEC(CPU, PC)
+#endif
 Cz80_Exec_nocheck:
 			data = pzHL;
 			Opcode = READ_OP();
@@ -17,6 +17,8 @@
 #include <stdint.h>
 #endif
 
+#include "../../pico/pico_port.h" // PICO_TLS
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -245,7 +247,7 @@ typedef struct cz80_t
 	UINT8 I;
 	UINT8 IM;
 	UINT8 HaltState;
-	UINT8 dummy;
+	UINT8 drc_exit;	/* recompiler: leave block after current insn */
 
 	INT32 IRQLine;
 	INT32 IRQState;
@@ -278,7 +280,7 @@ typedef struct cz80_t
 /* Publics Z80 variables */
 /*************************/
 
-extern cz80_struc CZ80;
+extern PICO_TLS cz80_struc CZ80;
 
 /*************************/
 /* Publics Z80 functions */
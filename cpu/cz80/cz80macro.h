@@ -70,14 +70,19 @@
 #endif
 
 #if PICODRIVE_HACKS
+#ifndef CZ80_DRC_WCHECK
+#define CZ80_DRC_WCHECK(p)
+#endif
 #define WRITE_MEM8(A, D) { \
 	unsigned short a = A; \
 	unsigned char d = D; \
 	uptr v = z80_write_map[a >> Z80_MEM_SHIFT]; \
 	if (map_flag_set(v)) \
 		((z80_write_f *)(v << 1))(a, d); \
-	else \
+	else { \
 		*(unsigned char *)((v << 1) + a) = d; \
+		CZ80_DRC_WCHECK((v << 1) + a) \
+	} \
 }
 #else
 #define WRITE_MEM8(A, D)	CPU->Write_Byte(A, D);
@@ -10,16 +10,28 @@
 #include <pico/pico_int.h>
 #include "cmn.h"
 
+#ifndef PICO_THREAD_SAFE
 u8 ALIGNED(4096) tcache_default[DRC_TCACHE_SIZE];
-u8 *tcache;
+#else
+// each thread needs its own cache, allocated on init
+static PICO_TLS int tcache_mapped;
+#endif
+PICO_TLS u8 *tcache;
 
 void drc_cmn_init(void)
 {
   int ret;
 
   tcache = plat_mem_get_for_drc(DRC_TCACHE_SIZE);
+#ifndef PICO_THREAD_SAFE
   if (tcache == NULL)
     tcache = tcache_default;
+#else
+  if (tcache == NULL) {
+    tcache = plat_mmap(0, DRC_TCACHE_SIZE, 1, 0);
+    tcache_mapped = tcache != NULL;
+  }
+#endif
 
   ret = plat_mem_set_exec(tcache, DRC_TCACHE_SIZE);
   elprintf(EL_STATUS, "drc_cmn_init: %p, %zd bytes: %d",
@@ -51,6 +63,13 @@ void drc_cmn_init(void)
 
 void drc_cmn_cleanup(void)
 {
+#ifdef PICO_THREAD_SAFE
+  if (tcache_mapped) {
+    plat_munmap(tcache, DRC_TCACHE_SIZE);
+    tcache_mapped = 0;
+  }
+  tcache = NULL;
+#endif
 }
 
 // vim:shiftwidth=2:expandtab
@@ -5,9 +5,11 @@ typedef signed short   s16;
 typedef unsigned int   u32;
 typedef signed int     s32;
 
+#ifndef DRC_TCACHE_SIZE
 #define DRC_TCACHE_SIZE         (2*1024*1024)
+#endif
 
-extern u8 *tcache;
+extern PICO_TLS u8 *tcache;
 
 void drc_cmn_init(void);
 void drc_cmn_cleanup(void);
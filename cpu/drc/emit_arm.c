@@ -534,6 +534,9 @@ static int emith_xbranch(int cond, void *target, int is_call)
 #define emith_add_r_r_ptr_imm(d, s, imm) \
 	emith_add_r_r_imm(d, s, imm)
 
+#define emith_add_r_r_ptr(d, s) \
+	emith_add_r_r(d, s)
+
 #define emith_sub_r_r_imm(d, s, imm) \
 	emith_op_imm2(A_COND_AL, 0, A_OP_SUB, d, s, imm)
 
@@ -713,6 +716,8 @@ static int emith_xbranch(int cond, void *target, int is_call)
 	*ptr_ = (*ptr_ & 0xff000000) | (val_ & 0x00ffffff); \
 } while (0)
 
+#define emith_jump_patch_size() 4
+
 #define emith_jump_at(ptr, target) { \
 	u32 val_ = (u32 *)(target) - (u32 *)(ptr) - 2; \
 	EOP_C_B_PTR(ptr, A_COND_AL, 0, val_ & 0xffffff); \
@@ -0,0 +1,935 @@
+/*
+ * Basic macros to emit AArch64 instructions and some utils
+ * Copyright (C) 2008,2009,2010 notaz
+ *
+ * This work is licensed under the terms of MAME license.
+ * See COPYING file in the top-level directory.
+ *
+ * notes:
+ *  - all ops are 32bit (w regs) unless marked _ptr, host pointers are 64bit.
+ *  - there is no conditional execution, so *_c ops are plain ops and
+ *    EMITH_SJMP_* use real short branches, like on x86.
+ *  - AArch64 carry is inverted on subtraction, same as on ARM.
+ *  - x16/x17 (ip0/ip1) are used as scratch by the macros here
+ *    and must never be handed out by the register cache.
+ */
+#define CONTEXT_REG 19
+#define RET_REG     0
+
+#define A64_TMP_REG  16
+#define A64_TMP_REG2 17
+#define A64_FP       29
+#define A64_LR       30
+#define A64_ZR       31 // also SP, depending on insn
+#define A64_SP       31
+
+#define EMIT_PTR(ptr, x) \
+	do { \
+		*(u32 *)(ptr) = x; \
+		ptr = (void *)((u8 *)(ptr) + sizeof(u32)); \
+		COUNT_OP; \
+	} while (0)
+
+#define EMIT(x) EMIT_PTR(tcache_ptr, x)
+
+#define A64_COND_EQ 0x0
+#define A64_COND_NE 0x1
+#define A64_COND_HS 0x2
+#define A64_COND_LO 0x3
+#define A64_COND_MI 0x4
+#define A64_COND_PL 0x5
+#define A64_COND_VS 0x6
+#define A64_COND_VC 0x7
+#define A64_COND_HI 0x8
+#define A64_COND_LS 0x9
+#define A64_COND_GE 0xa
+#define A64_COND_LT 0xb
+#define A64_COND_GT 0xc
+#define A64_COND_LE 0xd
+#define A64_COND_AL 0xe
+#define A64_COND_CS A64_COND_HS
+#define A64_COND_CC A64_COND_LO
+
+/* unified conditions */
+#define DCOND_EQ A64_COND_EQ
+#define DCOND_NE A64_COND_NE
+#define DCOND_MI A64_COND_MI
+#define DCOND_PL A64_COND_PL
+#define DCOND_HI A64_COND_HI
+#define DCOND_HS A64_COND_HS
+#define DCOND_LO A64_COND_LO
+#define DCOND_GE A64_COND_GE
+#define DCOND_GT A64_COND_GT
+#define DCOND_LT A64_COND_LT
+#define DCOND_LS A64_COND_LS
+#define DCOND_LE A64_COND_LE
+#define DCOND_VS A64_COND_VS
+#define DCOND_VC A64_COND_VC
+
+/* shift types for shifted register ops */
+#define A64_LSL 0
+#define A64_LSR 1
+#define A64_ASR 2
+#define A64_ROR 3
+
+/* add/sub */
+#define A64_OP_ADD 0
+#define A64_OP_SUB 1
+
+/* logical op opc */
+#define A64_OP_AND  0
+#define A64_OP_ORR  1
+#define A64_OP_EOR  2
+#define A64_OP_ANDS 3
+
+/* bitfield move opc */
+#define A64_OP_SBFM 0
+#define A64_OP_BFM  1
+#define A64_OP_UBFM 2
+
+/* move wide opc */
+#define A64_OP_MOVN 0
+#define A64_OP_MOVZ 2
+#define A64_OP_MOVK 3
+
+// sf: 1 for 64bit op, s: 1 to set flags
+#define A64_ADDSUB_IMM(sf,op,s,sh,imm12,rn,rd) \
+	(((sf)<<31) | ((op)<<30) | ((s)<<29) | 0x11000000 | ((sh)<<22) | \
+	 (((imm12)&0xfff)<<10) | ((rn)<<5) | (rd))
+
+#define A64_ADDSUB_REG(sf,op,s,shift,rm,imm6,rn,rd) \
+	(((sf)<<31) | ((op)<<30) | ((s)<<29) | 0x0b000000 | ((shift)<<22) | \
+	 ((rm)<<16) | (((imm6)&0x3f)<<10) | ((rn)<<5) | (rd))
+
+#define A64_ADCSBC(sf,op,s,rm,rn,rd) \
+	(((sf)<<31) | ((op)<<30) | ((s)<<29) | 0x1a000000 | \
+	 ((rm)<<16) | ((rn)<<5) | (rd))
+
+#define A64_ADD_EXT_UXTW(rm,rn,rd) \
+	(0x8b204000 | ((rm)<<16) | ((rn)<<5) | (rd))
+
+// n: 1 to invert rm (bic, orn, eon)
+#define A64_LOGIC_REG(sf,opc,n,shift,rm,imm6,rn,rd) \
+	(((sf)<<31) | ((opc)<<29) | 0x0a000000 | ((shift)<<22) | ((n)<<21) | \
+	 ((rm)<<16) | (((imm6)&0x3f)<<10) | ((rn)<<5) | (rd))
+
+// immr_imms: N:immr:imms as returned by emith_log_imm()
+#define A64_LOGIC_IMM(opc,immr_imms,rn,rd) \
+	(((opc)<<29) | 0x12000000 | ((immr_imms)<<10) | ((rn)<<5) | (rd))
+
+#define A64_MOVW(sf,opc,hw,imm16,rd) \
+	(((sf)<<31) | ((opc)<<29) | 0x12800000 | ((hw)<<21) | \
+	 (((imm16)&0xffff)<<5) | (rd))
+
+#define A64_BFM(sf,opc,immr,imms,rn,rd) \
+	(((sf)<<31) | ((opc)<<29) | 0x13000000 | ((sf)<<22) | \
+	 (((immr)&0x3f)<<16) | (((imms)&0x3f)<<10) | ((rn)<<5) | (rd))
+
+#define A64_EXTR(sf,rm,lsb,rn,rd) \
+	(((sf)<<31) | 0x13800000 | ((sf)<<22) | \
+	 ((rm)<<16) | (((lsb)&0x3f)<<10) | ((rn)<<5) | (rd))
+
+#define A64_CSINC(cond,rm,rn,rd) \
+	(0x1a800400 | ((rm)<<16) | ((cond)<<12) | ((rn)<<5) | (rd))
+
+#define A64_MADD(rm,ra,rn,rd) \
+	(0x1b000000 | ((rm)<<16) | ((ra)<<10) | ((rn)<<5) | (rd))
+
+#define A64_SMADDL(rm,ra,rn,rd) \
+	(0x9b200000 | ((rm)<<16) | ((ra)<<10) | ((rn)<<5) | (rd))
+
+#define A64_UMADDL(rm,ra,rn,rd) \
+	(0x9ba00000 | ((rm)<<16) | ((ra)<<10) | ((rn)<<5) | (rd))
+
+/* load/store, unsigned scaled imm12 forms */
+#define A64_LDR_W  0xb9400000
+#define A64_STR_W  0xb9000000
+#define A64_LDR_X  0xf9400000
+#define A64_STR_X  0xf9000000
+#define A64_LDRB   0x39400000
+#define A64_STRB   0x39000000
+#define A64_LDRH   0x79400000
+#define A64_STRH   0x79000000
+
+#define A64_LDST_UNSCALED 0x01000000 // clear to get ldur/stur
+#define A64_LDST_REG_SXTW 0x0020c800 // add to ldur/stur for [xn, wm, sxtw]
+
+/* load/store pair, imm7 scaled by access size */
+#define A64_STP_W_OFFS 0x29000000
+#define A64_LDP_W_OFFS 0x29400000
+#define A64_STP_X_OFFS 0xa9000000
+#define A64_LDP_X_OFFS 0xa9400000
+#define A64_STP_X_PRE  0xa9800000
+#define A64_LDP_X_POST 0xa8c00000
+
+#define A64_LDSTP(op,imm7,rt2,rn,rt) \
+	((op) | (((imm7)&0x7f)<<15) | ((rt2)<<10) | ((rn)<<5) | (rt))
+
+/* branches */
+#define A64_B(offs)        (0x14000000 | (((offs)>>2)&0x03ffffff))
+#define A64_BL(offs)       (0x94000000 | (((offs)>>2)&0x03ffffff))
+#define A64_BCOND(cond,offs) \
+	(0x54000000 | ((((offs)>>2)&0x7ffff)<<5) | (cond))
+#define A64_BR(rn)         (0xd61f0000 | ((rn)<<5))
+#define A64_BLR(rn)        (0xd63f0000 | ((rn)<<5))
+#define A64_RET(rn)        (0xd65f0000 | ((rn)<<5))
+
+#define is_offset_26(offs) \
+	((offs) >= -0x08000000 && (offs) < 0x08000000)
+#define is_offset_19(offs) \
+	((offs) >= -0x00100000 && (offs) < 0x00100000)
+
+/*
+ * returns N:immr:imms encoding of 32bit logical immediate,
+ * or -1 if the value can't be encoded
+ */
+static int emith_log_imm(u32 imm)
+{
+	u32 mask, v;
+	int size, ones, r;
+
+	if (imm == 0 || imm == ~0)
+		return -1;
+
+	// smallest repeating element
+	for (size = 32; size > 2; size /= 2) {
+		mask = (1u << (size / 2)) - 1;
+		if ((imm & mask) != ((imm >> (size / 2)) & mask))
+			break;
+	}
+	mask = (size == 32) ? ~0 : (1u << size) - 1;
+	imm &= mask;
+
+	// rotate right until ones are at the bottom
+	for (r = 0; r < size; r++) {
+		v = ((imm >> r) | (imm << ((size - r) & (size - 1)))) & mask;
+		if (r == 0)
+			v = imm;
+		if ((v & 1) && !(v & (v + 1)))
+			break;
+	}
+	if (r == size)
+		return -1;
+	for (ones = 0; v & 1; v >>= 1)
+		ones++;
+
+	return (((size - r) & (size - 1)) << 6) |
+		((0x3f & ~((size << 1) - 1)) | (ones - 1));
+}
+
+static void emith_move_r_imm_(int r, u32 imm)
+{
+	u32 lo = imm & 0xffff, hi = imm >> 16;
+	int enc;
+
+	if (hi == 0)
+		EMIT(A64_MOVW(0, A64_OP_MOVZ, 0, lo, r));
+	else if (lo == 0)
+		EMIT(A64_MOVW(0, A64_OP_MOVZ, 1, hi, r));
+	else if (hi == 0xffff)
+		EMIT(A64_MOVW(0, A64_OP_MOVN, 0, ~lo, r));
+	else if (lo == 0xffff)
+		EMIT(A64_MOVW(0, A64_OP_MOVN, 1, ~hi, r));
+	else if ((enc = emith_log_imm(imm)) >= 0)
+		EMIT(A64_LOGIC_IMM(A64_OP_ORR, enc, A64_ZR, r));
+	else {
+		EMIT(A64_MOVW(0, A64_OP_MOVZ, 0, lo, r));
+		EMIT(A64_MOVW(0, A64_OP_MOVK, 1, hi, r));
+	}
+}
+
+static void emith_move_r_ptr_imm_(int r, uintptr_t imm)
+{
+	int hw, first = 1;
+
+	for (hw = 0; hw < 4; hw++) {
+		u32 v = (imm >> (hw * 16)) & 0xffff;
+		if (v == 0 && !(first && hw == 3))
+			continue;
+		EMIT(A64_MOVW(1, first ? A64_OP_MOVZ : A64_OP_MOVK, hw, v, r));
+		first = 0;
+	}
+}
+
+// add/sub imm, uses ip0 if imm doesn't fit
+static void emith_addsub_imm(int sf, int op, int s, int rd, int rn, u32 imm)
+{
+	s32 v = imm;
+
+	// flipping to the other op keeps C and V right, except for INT_MIN
+	if (v < 0 && !(v == (s32)0x80000000 && s && !sf)) {
+		v = -v;
+		op ^= 1;
+	}
+	imm = v;
+
+	if (imm < 0x1000) {
+		if (imm == 0 && !s && rd == rn)
+			return;
+		EMIT(A64_ADDSUB_IMM(sf, op, s, 0, imm, rn, rd));
+	}
+	else if (!(imm & 0xfff) && imm < 0x1000000)
+		EMIT(A64_ADDSUB_IMM(sf, op, s, 1, imm >> 12, rn, rd));
+	else if (!s && imm < 0x1000000) {
+		EMIT(A64_ADDSUB_IMM(sf, op, 0, 0, imm & 0xfff, rn, rd));
+		EMIT(A64_ADDSUB_IMM(sf, op, 0, 1, imm >> 12, rd, rd));
+	}
+	else {
+		emith_move_r_imm_(A64_TMP_REG, imm);
+		EMIT(A64_ADDSUB_REG(sf, op, s, A64_LSL, A64_TMP_REG, 0, rn, rd));
+	}
+}
+
+// logical imm, uses ip0 if imm can't be encoded
+static void emith_log_op_imm(int opc, int rd, int rn, u32 imm)
+{
+	int enc = emith_log_imm(imm);
+
+	if (enc >= 0) {
+		EMIT(A64_LOGIC_IMM(opc, enc, rn, rd));
+		return;
+	}
+
+	// the special cases of all zeros and all ones
+	if (opc != A64_OP_ANDS &&
+	    ((opc == A64_OP_AND && imm == ~0) || (opc != A64_OP_AND && imm == 0))) {
+		if (rd != rn)
+			EMIT(A64_LOGIC_REG(0, A64_OP_ORR, 0, A64_LSL, rn, 0, A64_ZR, rd));
+		return;
+	}
+	if (opc == A64_OP_AND && imm == 0) {
+		EMIT(A64_MOVW(0, A64_OP_MOVZ, 0, 0, rd));
+		return;
+	}
+	if (opc == A64_OP_ORR && imm == ~0) {
+		EMIT(A64_MOVW(0, A64_OP_MOVN, 0, 0, rd));
+		return;
+	}
+
+	emith_move_r_imm_(A64_TMP_REG, imm);
+	EMIT(A64_LOGIC_REG(0, opc, 0, A64_LSL, A64_TMP_REG, 0, rn, rd));
+}
+
+// ldr/str with any offset, op is the unsigned scaled imm form
+static void emith_ldst_offs(u32 op, int size_log2, int rt, int rn, s32 offs)
+{
+	if (offs >= 0 && !(offs & ((1 << size_log2) - 1))
+	    && (offs >> size_log2) < 0x1000)
+		EMIT(op | ((offs >> size_log2) << 10) | ((rn) << 5) | (rt));
+	else if (offs >= -0x100 && offs < 0x100)
+		EMIT((op & ~A64_LDST_UNSCALED) | ((offs & 0x1ff) << 12)
+			| ((rn) << 5) | (rt));
+	else {
+		emith_move_r_imm_(A64_TMP_REG, offs);
+		EMIT((op & ~A64_LDST_UNSCALED) | A64_LDST_REG_SXTW
+			| (A64_TMP_REG << 16) | ((rn) << 5) | (rt));
+	}
+}
+
+#define JMP_POS(ptr) \
+	ptr = tcache_ptr; \
+	tcache_ptr += sizeof(u32)
+
+#define JMP_EMIT(cond, ptr) { \
+	u8 *p_ = (u8 *)(ptr); \
+	EMIT_PTR(p_, A64_BCOND(cond, (u8 *)tcache_ptr - (u8 *)(ptr))); \
+}
+
+#define JMP_EMIT_NC(ptr) { \
+	u8 *p_ = (u8 *)(ptr); \
+	EMIT_PTR(p_, A64_B((u8 *)tcache_ptr - (u8 *)(ptr))); \
+}
+
+#define EMITH_JMP_START(cond) { \
+	u8 *cond_ptr; \
+	JMP_POS(cond_ptr)
+
+#define EMITH_JMP_END(cond) \
+	JMP_EMIT(cond, cond_ptr); \
+}
+
+#define EMITH_JMP3_START(cond) { \
+	u8 *cond_ptr, *else_ptr; \
+	JMP_POS(cond_ptr)
+
+#define EMITH_JMP3_MID(cond) \
+	JMP_POS(else_ptr); \
+	JMP_EMIT(cond, cond_ptr);
+
+#define EMITH_JMP3_END() \
+	JMP_EMIT_NC(else_ptr); \
+}
+
+// "simple" jump (no more then a few insns)
+// no conditional insns here, so use a short branch like x86
+#define EMITH_SJMP_DECL_() \
+	u8 *cond_ptr
+
+#define EMITH_SJMP_START_(cond) \
+	JMP_POS(cond_ptr)
+
+#define EMITH_SJMP_END_(cond) \
+	JMP_EMIT(cond, cond_ptr)
+
+#define EMITH_SJMP_START EMITH_JMP_START
+#define EMITH_SJMP_END EMITH_JMP_END
+
+#define EMITH_SJMP3_START EMITH_JMP3_START
+#define EMITH_SJMP3_MID EMITH_JMP3_MID
+#define EMITH_SJMP3_END EMITH_JMP3_END
+
+// _r_r
+#define emith_move_r_r(d, s) \
+	EMIT(A64_LOGIC_REG(0, A64_OP_ORR, 0, A64_LSL, s, 0, A64_ZR, d))
+
+#define emith_move_r_r_ptr(d, s) \
+	EMIT(A64_LOGIC_REG(1, A64_OP_ORR, 0, A64_LSL, s, 0, A64_ZR, d))
+
+#define emith_mvn_r_r(d, s) \
+	EMIT(A64_LOGIC_REG(0, A64_OP_ORR, 1, A64_LSL, s, 0, A64_ZR, d))
+
+#define emith_add_r_r(d, s) \
+	EMIT(A64_ADDSUB_REG(0, A64_OP_ADD, 0, A64_LSL, s, 0, d, d))
+
+#define emith_add_r_r_ptr(d, s) \
+	EMIT(A64_ADDSUB_REG(1, A64_OP_ADD, 0, A64_LSL, s, 0, d, d))
+
+#define emith_sub_r_r(d, s) \
+	EMIT(A64_ADDSUB_REG(0, A64_OP_SUB, 0, A64_LSL, s, 0, d, d))
+
+#define emith_adc_r_r(d, s) \
+	EMIT(A64_ADCSBC(0, A64_OP_ADD, 0, s, d, d))
+
+#define emith_sbc_r_r(d, s) \
+	EMIT(A64_ADCSBC(0, A64_OP_SUB, 0, s, d, d))
+
+#define emith_and_r_r(d, s) \
+	EMIT(A64_LOGIC_REG(0, A64_OP_AND, 0, A64_LSL, s, 0, d, d))
+
+#define emith_or_r_r(d, s) \
+	EMIT(A64_LOGIC_REG(0, A64_OP_ORR, 0, A64_LSL, s, 0, d, d))
+
+#define emith_eor_r_r(d, s) \
+	EMIT(A64_LOGIC_REG(0, A64_OP_EOR, 0, A64_LSL, s, 0, d, d))
+
+#define emith_neg_r_r(d, s) \
+	EMIT(A64_ADDSUB_REG(0, A64_OP_SUB, 0, A64_LSL, s, 0, A64_ZR, d))
+
+#define emith_tst_r_r(d, s) \
+	EMIT(A64_LOGIC_REG(0, A64_OP_ANDS, 0, A64_LSL, s, 0, d, A64_ZR))
+
+#define emith_tst_r_r_ptr(d, s) \
+	EMIT(A64_LOGIC_REG(1, A64_OP_ANDS, 0, A64_LSL, s, 0, d, A64_ZR))
+
+#define emith_cmp_r_r(d, s) \
+	EMIT(A64_ADDSUB_REG(0, A64_OP_SUB, 1, A64_LSL, s, 0, d, A64_ZR))
+
+// test equivalence - get_flags(d ^ s), only N and Z are valid
+#define emith_teq_r_r(d, s) do { \
+	EMIT(A64_LOGIC_REG(0, A64_OP_EOR, 0, A64_LSL, s, 0, d, A64_TMP_REG)); \
+	emith_tst_r_r(A64_TMP_REG, A64_TMP_REG); \
+} while (0)
+
+// _r_r_r
+#define emith_add_r_r_r(d, s1, s2) \
+	EMIT(A64_ADDSUB_REG(0, A64_OP_ADD, 0, A64_LSL, s2, 0, s1, d))
+
+#define emith_eor_r_r_r(d, s1, s2) \
+	EMIT(A64_LOGIC_REG(0, A64_OP_EOR, 0, A64_LSL, s2, 0, s1, d))
+
+// _r_r_shift
+#define emith_or_r_r_lsl(d, s, lslimm) \
+	EMIT(A64_LOGIC_REG(0, A64_OP_ORR, 0, A64_LSL, s, lslimm, d, d))
+
+#define emith_eor_r_r_lsr(d, s, lsrimm) \
+	EMIT(A64_LOGIC_REG(0, A64_OP_EOR, 0, A64_LSR, s, lsrimm, d, d))
+
+// _r_imm
+#define emith_move_r_imm(r, imm) \
+	emith_move_r_imm_(r, imm)
+
+#define emith_move_r_imm_s8(r, imm) \
+	emith_move_r_imm(r, (u32)(signed int)(signed char)(imm))
+
+#define emith_move_r_ptr_imm(r, imm) \
+	emith_move_r_ptr_imm_(r, (uintptr_t)(imm))
+
+#define emith_add_r_imm(r, imm) \
+	emith_addsub_imm(0, A64_OP_ADD, 0, r, r, imm)
+
+#define emith_sub_r_imm(r, imm) \
+	emith_addsub_imm(0, A64_OP_SUB, 0, r, r, imm)
+
+#define emith_subf_r_imm(r, imm) \
+	emith_addsub_imm(0, A64_OP_SUB, 1, r, r, imm)
+
+#define emith_cmp_r_imm(r, imm) \
+	emith_addsub_imm(0, A64_OP_SUB, 1, A64_ZR, r, imm)
+
+#define emith_adc_r_imm(r, imm) do { \
+	emith_move_r_imm_(A64_TMP_REG, imm); \
+	emith_adc_r_r(r, A64_TMP_REG); \
+} while (0)
+
+#define emith_and_r_imm(r, imm) \
+	emith_log_op_imm(A64_OP_AND, r, r, imm)
+
+#define emith_bic_r_imm(r, imm) \
+	emith_log_op_imm(A64_OP_AND, r, r, ~(imm))
+
+#define emith_or_r_imm(r, imm) \
+	emith_log_op_imm(A64_OP_ORR, r, r, imm)
+
+#define emith_eor_r_imm(r, imm) \
+	emith_log_op_imm(A64_OP_EOR, r, r, imm)
+
+#define emith_tst_r_imm(r, imm) \
+	emith_log_op_imm(A64_OP_ANDS, A64_ZR, r, imm)
+
+// fake conditionals (using SJMP instead)
+#define emith_move_r_imm_c(cond, r, imm) do { \
+	(void)(cond); \
+	emith_move_r_imm(r, imm); \
+} while (0)
+
+#define emith_add_r_imm_c(cond, r, imm) do { \
+	(void)(cond); \
+	emith_add_r_imm(r, imm); \
+} while (0)
+
+#define emith_sub_r_imm_c(cond, r, imm) do { \
+	(void)(cond); \
+	emith_sub_r_imm(r, imm); \
+} while (0)
+
+#define emith_or_r_imm_c(cond, r, imm) \
+	emith_or_r_imm(r, imm)
+#define emith_eor_r_imm_c(cond, r, imm) \
+	emith_eor_r_imm(r, imm)
+#define emith_bic_r_imm_c(cond, r, imm) \
+	emith_bic_r_imm(r, imm)
+#define emith_ror_c(cond, d, s, cnt) \
+	emith_ror(d, s, cnt)
+
+#define emith_read_r_r_offs_c(cond, r, rs, offs) \
+	emith_read_r_r_offs(r, rs, offs)
+#define emith_write_r_r_offs_c(cond, r, rs, offs) \
+	emith_write_r_r_offs(r, rs, offs)
+#define emith_read8_r_r_offs_c(cond, r, rs, offs) \
+	emith_read8_r_r_offs(r, rs, offs)
+#define emith_write8_r_r_offs_c(cond, r, rs, offs) \
+	emith_write8_r_r_offs(r, rs, offs)
+#define emith_read16_r_r_offs_c(cond, r, rs, offs) \
+	emith_read16_r_r_offs(r, rs, offs)
+#define emith_write16_r_r_offs_c(cond, r, rs, offs) \
+	emith_write16_r_r_offs(r, rs, offs)
+#define emith_jump_reg_c(cond, r) \
+	emith_jump_reg(r)
+#define emith_jump_ctx_c(cond, offs) \
+	emith_jump_ctx(offs)
+#define emith_ret_c(cond) \
+	emith_ret()
+
+#define emith_clear_msb_c(cond, d, s, count) \
+	emith_clear_msb(d, s, count)
+
+// _r_r_imm
+#define emith_add_r_r_imm(d, s, imm) \
+	emith_addsub_imm(0, A64_OP_ADD, 0, d, s, imm)
+
+#define emith_add_r_r_ptr_imm(d, s, imm) \
+	emith_addsub_imm(1, A64_OP_ADD, 0, d, s, imm)
+
+#define emith_and_r_r_imm(d, s, imm) \
+	emith_log_op_imm(A64_OP_AND, d, s, imm)
+
+// shift
+#define emith_lsl(d, s, cnt) do { \
+	int c_ = (cnt) & 31; \
+	EMIT(A64_BFM(0, A64_OP_UBFM, (32 - c_) & 31, 31 - c_, s, d)); \
+} while (0)
+
+#define emith_lsr(d, s, cnt) \
+	EMIT(A64_BFM(0, A64_OP_UBFM, (cnt) & 31, 31, s, d))
+
+#define emith_asr(d, s, cnt) \
+	EMIT(A64_BFM(0, A64_OP_SBFM, (cnt) & 31, 31, s, d))
+
+#define emith_ror(d, s, cnt) \
+	EMIT(A64_EXTR(0, s, (cnt) & 31, s, d))
+
+#define emith_rol(d, s, cnt) \
+	emith_ror(d, s, 32 - (cnt))
+
+// there are no flag setting shifts, so carry is set with an extra adds
+// note: only C flag updated correctly, except for lslf
+#define emith_carry_from_bit31(r) \
+	EMIT(A64_ADDSUB_REG(0, A64_OP_ADD, 1, A64_LSL, r, 0, r, A64_ZR))
+
+#define emith_lslf(d, s, cnt) do { \
+	int s_ = s; \
+	if ((cnt) > 1) { \
+		emith_lsl(A64_TMP_REG, s, (cnt) - 1); \
+		s_ = A64_TMP_REG; \
+	} \
+	EMIT(A64_ADDSUB_REG(0, A64_OP_ADD, 1, A64_LSL, s_, 0, s_, d)); \
+} while (0)
+
+#define emith_lsrf(d, s, cnt) do { \
+	emith_lsl(A64_TMP_REG, s, 32 - (cnt)); \
+	emith_carry_from_bit31(A64_TMP_REG); \
+	emith_lsr(d, s, cnt); \
+} while (0)
+
+#define emith_asrf(d, s, cnt) do { \
+	emith_lsl(A64_TMP_REG, s, 32 - (cnt)); \
+	emith_carry_from_bit31(A64_TMP_REG); \
+	emith_asr(d, s, cnt); \
+} while (0)
+
+#define emith_rolf(d, s, cnt) do { \
+	emith_lsl(A64_TMP_REG, s, (cnt) - 1); \
+	emith_carry_from_bit31(A64_TMP_REG); \
+	emith_rol(d, s, cnt); \
+} while (0)
+
+#define emith_rorf(d, s, cnt) do { \
+	emith_ror(d, s, cnt); \
+	emith_carry_from_bit31(d); \
+} while (0)
+
+#define emith_rolcf(d) \
+	emith_adcf_r_r(d, d)
+
+#define emith_rorcf(d) do { \
+	EMIT(A64_CSINC(A64_COND_CC, A64_ZR, A64_ZR, A64_TMP_REG)); /* cset ip0, cs */ \
+	emith_lsl(A64_TMP_REG2, d, 31); \
+	emith_carry_from_bit31(A64_TMP_REG2); \
+	EMIT(A64_EXTR(0, d, 1, A64_TMP_REG, d)); \
+} while (0)
+
+// "flag" arithmetic
+#define emith_addf_r_r(d, s) \
+	EMIT(A64_ADDSUB_REG(0, A64_OP_ADD, 1, A64_LSL, s, 0, d, d))
+
+#define emith_subf_r_r(d, s) \
+	EMIT(A64_ADDSUB_REG(0, A64_OP_SUB, 1, A64_LSL, s, 0, d, d))
+
+#define emith_adcf_r_r(d, s) \
+	EMIT(A64_ADCSBC(0, A64_OP_ADD, 1, s, d, d))
+
+#define emith_sbcf_r_r(d, s) \
+	EMIT(A64_ADCSBC(0, A64_OP_SUB, 1, s, d, d))
+
+// d = 0 - s - !C
+#define emith_negcf_r_r(d, s) \
+	EMIT(A64_ADCSBC(0, A64_OP_SUB, 1, s, A64_ZR, d))
+
+// no eors, only N and Z are valid
+#define emith_eorf_r_r(d, s) do { \
+	emith_eor_r_r(d, s); \
+	emith_tst_r_r(d, d); \
+} while (0)
+
+// misc
+#define emith_clear_msb(d, s, count) do { \
+	if ((count) == 0) { \
+		if ((d) != (s)) \
+			emith_move_r_r(d, s); \
+	} else \
+		EMIT(A64_BFM(0, A64_OP_UBFM, 0, 31 - (count), s, d)); \
+} while (0)
+
+#define emith_sext(d, s, bits) \
+	EMIT(A64_BFM(0, A64_OP_SBFM, 0, (bits) - 1, s, d))
+
+#define emith_mul(d, s1, s2) \
+	EMIT(A64_MADD(s2, A64_ZR, s1, d))
+
+#define emith_mul_u64(dlo, dhi, s1, s2) do { \
+	EMIT(A64_UMADDL(s2, A64_ZR, s1, A64_TMP_REG)); \
+	emith_move_r_r(dlo, A64_TMP_REG); \
+	EMIT(A64_BFM(1, A64_OP_UBFM, 32, 63, A64_TMP_REG, dhi)); /* lsr x, #32 */ \
+} while (0)
+
+#define emith_mul_s64(dlo, dhi, s1, s2) do { \
+	EMIT(A64_SMADDL(s2, A64_ZR, s1, A64_TMP_REG)); \
+	emith_move_r_r(dlo, A64_TMP_REG); \
+	EMIT(A64_BFM(1, A64_OP_UBFM, 32, 63, A64_TMP_REG, dhi)); \
+} while (0)
+
+// (dlo,dhi) += signed(s1) * signed(s2)
+#define emith_mula_s64(dlo, dhi, s1, s2) do { \
+	EMIT(A64_BFM(1, A64_OP_UBFM, 32, 31, dhi, A64_TMP_REG)); /* lsl x, #32 */ \
+	EMIT(A64_ADD_EXT_UXTW(dlo, A64_TMP_REG, A64_TMP_REG)); \
+	EMIT(A64_SMADDL(s2, A64_TMP_REG, s1, A64_TMP_REG)); \
+	emith_move_r_r(dlo, A64_TMP_REG); \
+	EMIT(A64_BFM(1, A64_OP_UBFM, 32, 63, A64_TMP_REG, dhi)); \
+} while (0)
+
+#define emith_read_r_r_offs(r, rs, offs) \
+	emith_ldst_offs(A64_LDR_W, 2, r, rs, offs)
+
+#define emith_write_r_r_offs(r, rs, offs) \
+	emith_ldst_offs(A64_STR_W, 2, r, rs, offs)
+
+#define emith_read8_r_r_offs(r, rs, offs) \
+	emith_ldst_offs(A64_LDRB, 0, r, rs, offs)
+
+#define emith_write8_r_r_offs(r, rs, offs) \
+	emith_ldst_offs(A64_STRB, 0, r, rs, offs)
+
+#define emith_read16_r_r_offs(r, rs, offs) \
+	emith_ldst_offs(A64_LDRH, 1, r, rs, offs)
+
+#define emith_write16_r_r_offs(r, rs, offs) \
+	emith_ldst_offs(A64_STRH, 1, r, rs, offs)
+
+#define emith_ctx_read(r, offs) \
+	emith_read_r_r_offs(r, CONTEXT_REG, offs)
+
+#define emith_ctx_read_ptr(r, offs) \
+	emith_ldst_offs(A64_LDR_X, 3, r, CONTEXT_REG, offs)
+
+#define emith_ctx_write(r, offs) \
+	emith_write_r_r_offs(r, CONTEXT_REG, offs)
+
+#define emith_ctx_write_ptr(r, offs) \
+	emith_ldst_offs(A64_STR_X, 3, r, CONTEXT_REG, offs)
+
+// r..r+count-1 <-> ctx, ldp/stp for pairs
+#define emith_ctx_do_multiple(op_p, op, r, offs, count) do { \
+	int r_ = r, offs_ = offs, c_ = count;                \
+	for (; c_ >= 2; r_ += 2, offs_ += 8, c_ -= 2)        \
+		EMIT(A64_LDSTP(op_p, offs_ / 4, r_ + 1, CONTEXT_REG, r_)); \
+	if (c_)                                              \
+		emith_ldst_offs(op, 2, r_, CONTEXT_REG, offs_); \
+} while (0)
+
+#define emith_ctx_read_multiple(r, offs, count, tmpr) \
+	emith_ctx_do_multiple(A64_LDP_W_OFFS, A64_LDR_W, r, offs, count)
+
+#define emith_ctx_write_multiple(r, offs, count, tmpr) \
+	emith_ctx_do_multiple(A64_STP_W_OFFS, A64_STR_W, r, offs, count)
+
+// save/restore caller saved regs on stack, 16 bytes for each pair
+static void emith_do_caller_regs(u32 mask, int is_restore)
+{
+	int regs[16], i, cnt = 0;
+
+	for (i = 0; i < 16; i++)
+		if (mask & (1 << i))
+			regs[cnt++] = i;
+
+	if (!is_restore) {
+		for (i = 0; i < cnt; i += 2)
+			EMIT(A64_LDSTP(A64_STP_X_PRE, -2,
+				i + 1 < cnt ? regs[i + 1] : A64_ZR, A64_SP, regs[i]));
+	} else {
+		for (i = (cnt - 1) & ~1; i >= 0; i -= 2)
+			EMIT(A64_LDSTP(A64_LDP_X_POST, 2,
+				i + 1 < cnt ? regs[i + 1] : A64_TMP_REG, A64_SP, regs[i]));
+	}
+}
+
+#define emith_save_caller_regs(mask) \
+	emith_do_caller_regs(mask, 0)
+
+#define emith_restore_caller_regs(mask) \
+	emith_do_caller_regs(mask, 1)
+
+#define emith_pass_arg_r(arg, reg) \
+	emith_move_r_r_ptr(arg, reg)
+
+#define emith_pass_arg_imm(arg, imm) \
+	emith_move_r_imm(arg, imm)
+
+// branches out of range of b/bl go through ip0
+static void emith_branch(void *target, int is_call)
+{
+	intptr_t offs = (u8 *)target - (u8 *)tcache_ptr;
+
+	if (is_offset_26(offs))
+		EMIT(is_call ? A64_BL(offs) : A64_B(offs));
+	else {
+		emith_move_r_ptr_imm(A64_TMP_REG, target);
+		EMIT(is_call ? A64_BLR(A64_TMP_REG) : A64_BR(A64_TMP_REG));
+	}
+}
+
+static void emith_branch_cond(int cond, void *target)
+{
+	intptr_t offs = (u8 *)target - (u8 *)tcache_ptr;
+
+	if (is_offset_19(offs))
+		EMIT(A64_BCOND(cond, offs));
+	else {
+		// b.cond only has +-1MB range, skip a long jump instead
+		EMITH_JMP_START(cond ^ 1);
+		emith_branch(target, 0);
+		EMITH_JMP_END(cond ^ 1);
+	}
+}
+
+#define emith_jump(target) \
+	emith_branch(target, 0)
+
+// always a single b, must only be used for targets inside tcache
+#define emith_jump_patchable(target) \
+	EMIT(A64_B((u8 *)(target) - (u8 *)tcache_ptr))
+
+#define emith_jump_cond(cond, target) \
+	emith_branch_cond(cond, target)
+
+// the conditional part is done by SJMP around it
+#define emith_jump_cond_patchable(cond, target) \
+	emith_jump_patchable(target)
+
+#define emith_jump_patch(ptr, target) do { \
+	u32 *ptr_ = (u32 *)(ptr); \
+	assert((*ptr_ & 0xfc000000) == 0x14000000); \
+	*ptr_ = A64_B((u8 *)(target) - (u8 *)ptr_); \
+} while (0)
+
+#define emith_jump_patch_size() 4
+
+#define emith_jump_at(ptr, target) do { \
+	u32 *ptr_ = (u32 *)(ptr); \
+	*ptr_ = A64_B((u8 *)(target) - (u8 *)ptr_); \
+} while (0)
+
+#define emith_jump_reg(r) \
+	EMIT(A64_BR(r))
+
+#define emith_jump_ctx(offs) do { \
+	emith_ctx_read_ptr(A64_TMP_REG, offs); \
+	emith_jump_reg(A64_TMP_REG); \
+} while (0)
+
+#define emith_call(target) \
+	emith_branch(target, 1)
+
+#define emith_call_cond(cond, target) \
+	emith_call(target)
+
+#define emith_call_reg(r) \
+	EMIT(A64_BLR(r))
+
+#define emith_call_ctx(offs) do { \
+	emith_ctx_read_ptr(A64_TMP_REG, offs); \
+	emith_call_reg(A64_TMP_REG); \
+} while (0)
+
+#define emith_ret() \
+	EMIT(A64_RET(A64_LR))
+
+#define emith_ret_to_ctx(offs) \
+	emith_ctx_write_ptr(A64_LR, offs)
+
+// keeps sp 16 byte aligned
+#define emith_push_ret() \
+	EMIT(A64_LDSTP(A64_STP_X_PRE, -2, A64_LR, A64_SP, A64_FP))
+
+#define emith_pop_and_ret() do { \
+	EMIT(A64_LDSTP(A64_LDP_X_POST, 2, A64_LR, A64_SP, A64_FP)); \
+	emith_ret(); \
+} while (0)
+
+#define host_instructions_updated(base, end) \
+	__builtin___clear_cache((char *)(base), (char *)(end))
+
+#define host_arg2reg(rd, arg) \
+	rd = arg
+
+/* SH2 drc specific */
+/* saves all callee saved regs, x19 is the context, x20-x28 static regs */
+#define emith_sh2_drc_entry() do { \
+	EMIT(A64_LDSTP(A64_STP_X_PRE, -12, A64_LR, A64_SP, A64_FP)); \
+	EMIT(A64_LDSTP(A64_STP_X_OFFS, 2, 20, A64_SP, 19)); \
+	EMIT(A64_LDSTP(A64_STP_X_OFFS, 4, 22, A64_SP, 21)); \
+	EMIT(A64_LDSTP(A64_STP_X_OFFS, 6, 24, A64_SP, 23)); \
+	EMIT(A64_LDSTP(A64_STP_X_OFFS, 8, 26, A64_SP, 25)); \
+	EMIT(A64_LDSTP(A64_STP_X_OFFS, 10, 28, A64_SP, 27)); \
+} while (0)
+
+#define emith_sh2_drc_exit() do { \
+	EMIT(A64_LDSTP(A64_LDP_X_OFFS, 10, 28, A64_SP, 27)); \
+	EMIT(A64_LDSTP(A64_LDP_X_OFFS, 8, 26, A64_SP, 25)); \
+	EMIT(A64_LDSTP(A64_LDP_X_OFFS, 6, 24, A64_SP, 23)); \
+	EMIT(A64_LDSTP(A64_LDP_X_OFFS, 4, 22, A64_SP, 21)); \
+	EMIT(A64_LDSTP(A64_LDP_X_OFFS, 2, 20, A64_SP, 19)); \
+	EMIT(A64_LDSTP(A64_LDP_X_POST, 12, A64_LR, A64_SP, A64_FP)); \
+	emith_ret(); \
+} while (0)
+
+// tail call to write handler: tab[a >> SH2_WRITE_SHIFT](a, d, ctx)
+#define emith_sh2_wcall(a, tab) do { \
+	emith_lsr(A64_TMP_REG, a, SH2_WRITE_SHIFT); \
+	EMIT((A64_LDR_X & ~A64_LDST_UNSCALED) | 0x00207800 | \
+		(A64_TMP_REG << 16) | ((tab) << 5) | A64_TMP_REG); /* ldr ip0, [tab, ip0, lsl #3] */ \
+	emith_move_r_r_ptr(2, CONTEXT_REG); \
+	emith_jump_reg(A64_TMP_REG); \
+} while (0)
+
+#define emith_sh2_dtbf_loop() { \
+	u8 *jmp0; /* not end of loop */                                   \
+	int cr, rn;                                                          \
+	int tmp_ = rcache_get_tmp();                                         \
+	cr = rcache_get_reg(SHR_SR, RC_GR_RMW);                              \
+	rn = rcache_get_reg((op >> 8) & 0x0f, RC_GR_RMW);                    \
+	emith_sub_r_imm(rn, 1);                /* sub rn, #1 */              \
+	emith_bic_r_imm(cr, 1);                /* bic cr, #1 */              \
+	emith_sub_r_imm(cr, (cycles+1) << 12); /* sub cr, #(cycles+1)<<12 */ \
+	cycles = 0;                                                          \
+	emith_asr(tmp_, cr, 2+12);             /* asr tmp_, cr, #2+12 */     \
+	EMIT(A64_LOGIC_REG(0, A64_OP_AND, 1, A64_ASR, tmp_, 31, tmp_, tmp_)); \
+	                                       /* bic tmp_, tmp_, asr #31 */ \
+	emith_clear_msb(cr, cr, 20);           /* ubfx cr, cr, #0, #12 */    \
+	emith_subf_r_r(rn, tmp_);              /* subs rn, tmp_ */           \
+	JMP_POS(jmp0);                         /* b.hi jmp0 */               \
+	emith_neg_r_r(tmp_, rn);               /* neg tmp_, rn */            \
+	emith_or_r_r_lsl(cr, tmp_, 12+2);      /* orr cr, tmp_, lsl #12+2 */ \
+	emith_or_r_imm(cr, 1);                 /* orr cr, #1 */              \
+	emith_move_r_imm(rn, 0);               /* mov rn, #0 */              \
+	JMP_EMIT(A64_COND_HI, jmp0);                                         \
+	rcache_free_tmp(tmp_);                                               \
+}
+
+#define emith_write_sr(sr, srcr) \
+	EMIT(A64_BFM(0, A64_OP_BFM, 0, 9, srcr, sr)) /* bfi sr, srcr, #0, #10 */
+
+// T is kept in sr, only C is set here (inverted for sub)
+#define emith_tpop_carry(sr, is_sub) do { \
+	emith_and_r_r_imm(A64_TMP_REG, sr, 1); \
+	if (is_sub) /* C = !T, negs ip0 */ \
+		EMIT(A64_ADDSUB_REG(0, A64_OP_SUB, 1, A64_LSL, A64_TMP_REG, 0, A64_ZR, A64_ZR)); \
+	else        /* C = T, cmp ip0, #1 */ \
+		emith_cmp_r_imm(A64_TMP_REG, 1); \
+} while (0)
+
+#define emith_tpush_carry(sr, is_sub) do { \
+	/* cset ip0, cs (cc for sub) */ \
+	EMIT(A64_CSINC((is_sub) ? A64_COND_CS : A64_COND_CC, A64_ZR, A64_ZR, A64_TMP_REG)); \
+	EMIT(A64_BFM(0, A64_OP_BFM, 0, 0, A64_TMP_REG, sr)); /* bfi sr, ip0, #0, #1 */ \
+} while (0)
+
+/*
+ * if Q
+ *   t = carry(Rn += Rm)
+ * else
+ *   t = carry(Rn -= Rm)
+ * T ^= t
+ */
+#define emith_sh2_div1_step(rn, rm, sr) {         \
+	u8 *jmp0, *jmp1;                          \
+	emith_tst_r_imm(sr, Q);  /* if (Q ^ M) */ \
+	JMP_POS(jmp0);           /* b.eq do_sub */\
+	emith_addf_r_r(rn, rm);                   \
+	EMIT(A64_CSINC(A64_COND_CC, A64_ZR, A64_ZR, A64_TMP_REG)); /* cset ip0, cs */ \
+	JMP_POS(jmp1);           /* b done */     \
+	JMP_EMIT(A64_COND_EQ, jmp0); /* do_sub: */\
+	emith_subf_r_r(rn, rm);                   \
+	EMIT(A64_CSINC(A64_COND_CS, A64_ZR, A64_ZR, A64_TMP_REG)); /* cset ip0, cc */ \
+	JMP_EMIT_NC(jmp1);       /* done: */      \
+	emith_eor_r_r(sr, A64_TMP_REG);           \
+}
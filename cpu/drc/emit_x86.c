@@ -7,6 +7,8 @@
  *
  * note:
  *  temp registers must be eax-edx due to use of SETcc and r/w 8/16.
+ *  on x86-64 r8-r15 are reachable through EMIT_OP_MODRM, which emits
+ *  the needed REX prefix (r12/r13 can't be used as base with mod 0).
  * note about silly things like emith_eor_r_r_r:
  *  these are here because the compiler was designed
  *  for ARM as it's primary target.
@@ -84,14 +86,25 @@ enum { xAX = 0, xCX, xDX, xBX, xSP, xBP, xSI, xDI };
 #define EMIT_REX(w,r,x,b) \
 	EMIT(0x40 | ((w)<<3) | ((r)<<2) | ((x)<<1) | (b), u8)
 
-#define EMIT_OP_MODRM(op,mod,r,rm) do { \
+// no REX, caller must emit it if needed; r12 as base needs a SIB byte
+#define EMIT_OP_MODRM64(op, mod, r, rm) do { \
 	EMIT_OP(op); \
-	EMIT_MODRM(mod, (r), rm); \
+	EMIT_MODRM(mod, (r) & ~8u, (rm) & ~8u); \
+	if ((mod) != 3 && (rm) == 12) \
+		EMIT_SIB(0, 4, 4); \
+} while (0)
+
+#define EMIT_OP_MODRM(op,mod,r,rm) do { \
+	EMIT_REX_IF(0, r, rm); \
+	EMIT_OP_MODRM64(op, mod, r, rm); \
 } while (0)
 
-// 64bit friendly, rm when everything is converted
-#define EMIT_OP_MODRM64(op, mod, r, rm) \
-	EMIT_OP_MODRM(op, mod, (r) & ~8u, (rm) & ~8u)
+// 0x0f escaped ops, REX has to go before the escape byte
+#define EMIT_OP0F_MODRM(op,mod,r,rm) do { \
+	EMIT_REX_IF(0, r, rm); \
+	EMIT(0x0f, u8); \
+	EMIT_OP_MODRM64(op, mod, r, rm); \
+} while (0)
 
 #define JMP8_POS(ptr) \
 	ptr = tcache_ptr; \
@@ -117,6 +130,20 @@ enum { xAX = 0, xCX, xDX, xBX, xSP, xBP, xSI, xDI };
 #define emith_add_r_r(d, s) \
 	EMIT_OP_MODRM(0x01, 3, s, d)
 
+#define emith_add_r_r_ptr(d, s) do { \
+	EMIT_REX_IF(1, s, d); \
+	EMIT_OP_MODRM64(0x01, 3, s, d); \
+} while (0)
+
+#define emith_sub_r_r_ptr(d, s) do { \
+	EMIT_REX_IF(1, s, d); \
+	EMIT_OP_MODRM64(0x29, 3, s, d); \
+} while (0)
+
+// <op> d, s; op as in emith_arith_r_imm
+#define emith_arith_r_r(op, d, s) \
+	EMIT_OP_MODRM(((op) << 3) | 1, 3, s, d)
+
 #define emith_sub_r_r(d, s) \
 	EMIT_OP_MODRM(0x29, 3, s, d)
 
@@ -214,7 +241,8 @@ enum { xAX = 0, xCX, xDX, xBX, xSP, xBP, xSI, xDI };
 
 // _r_imm
 #define emith_move_r_imm(r, imm) do { \
-	EMIT_OP(0xb8 + (r)); \
+	EMIT_REX_IF(0, 0, r); \
+	EMIT_OP(0xb8 + ((r) & 7)); \
 	EMIT(imm, u32); \
 } while (0)
 
@@ -257,6 +285,12 @@ enum { xAX = 0, xCX, xDX, xBX, xSP, xBP, xSI, xDI };
 #define emith_cmp_r_imm(r, imm) \
 	emith_arith_r_imm(7, r, imm)
 
+#define emith_cmp_r_imm_ptr(r, imm) do { \
+	EMIT_REX_IF(1, 0, r); \
+	EMIT_OP_MODRM64(0x81, 3, 7, r); \
+	EMIT(imm, u32); \
+} while (0)
+
 #define emith_tst_r_imm(r, imm) do { \
 	EMIT_OP_MODRM(0xf7, 3, 0, r); \
 	EMIT(imm, u32); \
@@ -360,6 +394,10 @@ enum { xAX = 0, xCX, xDX, xBX, xSP, xBP, xSI, xDI };
 #define emith_ror(d, s, cnt) \
 	emith_shift(1, d, s, cnt)
 
+// d <<= cl
+#define emith_lsl_cl(d) \
+	EMIT_OP_MODRM(0xd3, 3, 4, d)
+
 #define emith_rolc(r) \
 	EMIT_OP_MODRM(0xd1, 3, 2, r)
 
@@ -367,16 +405,20 @@ enum { xAX = 0, xCX, xDX, xBX, xSP, xBP, xSI, xDI };
 	EMIT_OP_MODRM(0xd1, 3, 3, r)
 
 // misc
-#define emith_push(r) \
-	EMIT_OP(0x50 + (r))
+#define emith_push(r) do { \
+	EMIT_REX_IF(0, 0, r); \
+	EMIT_OP(0x50 + ((r) & 7)); \
+} while (0)
 
 #define emith_push_imm(imm) do { \
 	EMIT_OP(0x68); \
 	EMIT(imm, u32); \
 } while (0)
 
-#define emith_pop(r) \
-	EMIT_OP(0x58 + (r))
+#define emith_pop(r) do { \
+	EMIT_REX_IF(0, 0, r); \
+	EMIT_OP(0x58 + ((r) & 7)); \
+} while (0)
 
 #define emith_neg_r(r) \
 	EMIT_OP_MODRM(0xf7, 3, 3, r)
@@ -401,8 +443,17 @@ enum { xAX = 0, xCX, xDX, xBX, xSP, xBP, xSI, xDI };
 
 #define emith_setc(r) do { \
 	assert(is_abcdx(r)); \
-	EMIT_OP(0x0f); \
-	EMIT_OP_MODRM(0x92, 3, 0, r); /* SETC r */ \
+	EMIT_OP0F_MODRM(0x92, 3, 0, r); /* SETC r */ \
+} while (0)
+
+#define emith_set_cond(cond, r) do { \
+	assert(is_abcdx(r)); \
+	EMIT_OP0F_MODRM(0x90 | (cond), 3, 0, r); /* SETcc r */ \
+} while (0)
+
+#define emith_zext8_r_r(d, s) do { \
+	assert(is_abcdx(s)); \
+	EMIT_OP0F_MODRM(0xb6, 3, d, s); /* MOVZX d, s8 */ \
 } while (0)
 
 // XXX: stupid mess
@@ -472,18 +523,29 @@ enum { xAX = 0, xCX, xDX, xBX, xSP, xBP, xSI, xDI };
 #define emith_rolcf emith_rolc
 #define emith_rorcf emith_rorc
 
-#define emith_deref_op(op, r, rs, offs) do { \
+// no REX, see emith_deref_op
+#define emith_deref_modrm(op, r, rs, offs) do { \
 	/* mov r <-> [ebp+#offs] */ \
-	if ((offs) >= 0x80) { \
+	if ((s32)(offs) != (s8)(offs)) { \
 		EMIT_OP_MODRM64(op, 2, r, rs); \
 		EMIT(offs, u32); \
 	} else { \
 		EMIT_OP_MODRM64(op, 1, r, rs); \
-		EMIT(offs, u8); \
+		EMIT((u8)(offs), u8); \
 	} \
 } while (0)
 
+#define emith_deref_op(op, r, rs, offs) do { \
+	EMIT_REX_IF(0, r, rs); \
+	emith_deref_modrm(op, r, rs, offs); \
+} while (0)
+
+// 8bit regs without REX; with it any reg is fine (no ah..bh then)
+#ifdef __x86_64__
+#define is_abcdx(r) ((xAX <= (r) && (r) <= xDX) || (r) >= 8)
+#else
 #define is_abcdx(r) (xAX <= (r) && (r) <= xDX)
+#endif
 
 #define emith_read_r_r_offs(r, rs, offs) \
 	emith_deref_op(0x8b, r, rs, offs)
@@ -529,12 +591,159 @@ enum { xAX = 0, xCX, xDX, xBX, xSP, xBP, xSI, xDI };
 
 #define emith_ctx_read_ptr(r, offs) do { \
 	EMIT_REX_IF(1, r, CONTEXT_REG); \
-	emith_deref_op(0x8b, r, CONTEXT_REG, offs); \
+	emith_deref_modrm(0x8b, r, CONTEXT_REG, offs); \
 } while (0)
 
 #define emith_ctx_write(r, offs) \
 	emith_write_r_r_offs(r, CONTEXT_REG, offs)
 
+#define emith_ctx_write_ptr(r, offs) do { \
+	EMIT_REX_IF(1, r, CONTEXT_REG); \
+	emith_deref_modrm(0x89, r, CONTEXT_REG, offs); \
+} while (0)
+
+#define emith_ctx_cmp_ptr(r, offs) do { \
+	EMIT_REX_IF(1, r, CONTEXT_REG); \
+	emith_deref_modrm(0x39, r, CONTEXT_REG, offs); \
+} while (0)
+
+// these don't need a temp reg, r must be eax-edx for 8bit stores
+#define emith_ctx_read_u8(r, offs) do { \
+	EMIT_REX_IF(0, r, CONTEXT_REG); \
+	EMIT(0x0f, u8); \
+	emith_deref_modrm(0xb6, r, CONTEXT_REG, offs); \
+} while (0)
+
+#define emith_ctx_read_s8(r, offs) do { \
+	EMIT_REX_IF(0, r, CONTEXT_REG); \
+	EMIT(0x0f, u8); \
+	emith_deref_modrm(0xbe, r, CONTEXT_REG, offs); \
+} while (0)
+
+#define emith_ctx_read_u16(r, offs) do { \
+	EMIT_REX_IF(0, r, CONTEXT_REG); \
+	EMIT(0x0f, u8); \
+	emith_deref_modrm(0xb7, r, CONTEXT_REG, offs); \
+} while (0)
+
+#define emith_ctx_read_s16(r, offs) do { \
+	EMIT_REX_IF(0, r, CONTEXT_REG); \
+	EMIT(0x0f, u8); \
+	emith_deref_modrm(0xbf, r, CONTEXT_REG, offs); \
+} while (0)
+
+#define emith_ctx_write8(r, offs) do { \
+	assert(is_abcdx(r)); \
+	emith_deref_op(0x88, r, CONTEXT_REG, offs); \
+} while (0)
+
+#define emith_ctx_write16(r, offs) \
+	emith_write16_r_r_offs(r, CONTEXT_REG, offs)
+
+// <op> dword [ctx+offs], imm; op as in emith_arith_r_imm
+#define emith_ctx_arith_imm(op, offs, imm) do { \
+	if ((s32)(imm) == (s8)(imm)) { \
+		emith_deref_op(0x83, op, CONTEXT_REG, offs); \
+		EMIT(imm, u8); \
+	} else { \
+		emith_deref_op(0x81, op, CONTEXT_REG, offs); \
+		EMIT(imm, u32); \
+	} \
+} while (0)
+
+#define emith_ctx_add_imm(offs, imm) \
+	emith_ctx_arith_imm(0, offs, imm)
+
+#define emith_ctx_sub_imm(offs, imm) \
+	emith_ctx_arith_imm(5, offs, imm)
+
+#define emith_ctx_cmp_imm(offs, imm) \
+	emith_ctx_arith_imm(7, offs, imm)
+
+#define emith_ctx_sub16_imm(offs, imm) do { \
+	EMIT(0x66, u8); \
+	emith_deref_op(0x83, 5, CONTEXT_REG, offs); \
+	EMIT(imm, u8); \
+} while (0)
+
+// <op> word [ctx+offs], imm8; op as in emith_arith_r_imm
+#define emith_ctx_arith16_imm(op, offs, imm) do { \
+	EMIT(0x66, u8); \
+	emith_deref_op(0x83, op, CONTEXT_REG, offs); \
+	EMIT(imm, u8); \
+} while (0)
+
+#define emith_ctx_tst_imm(offs, imm) do { \
+	emith_deref_op(0xf7, 0, CONTEXT_REG, offs); \
+	EMIT(imm, u32); \
+} while (0)
+
+#define emith_ctx_write_imm(offs, imm) do { \
+	emith_deref_op(0xc7, 0, CONTEXT_REG, offs); \
+	EMIT(imm, u32); \
+} while (0)
+
+#define emith_ctx_write8_imm(offs, imm) do { \
+	emith_deref_op(0xc6, 0, CONTEXT_REG, offs); \
+	EMIT(imm, u8); \
+} while (0)
+
+#define emith_ctx_cmp8_imm(offs, imm) do { \
+	emith_deref_op(0x80, 7, CONTEXT_REG, offs); \
+	EMIT(imm, u8); \
+} while (0)
+
+// <op> byte [ctx+offs], imm; op as in emith_arith_r_imm
+#define emith_ctx_arith8_imm(op, offs, imm) do { \
+	emith_deref_op(0x80, op, CONTEXT_REG, offs); \
+	EMIT(imm, u8); \
+} while (0)
+
+#define emith_ctx_tst8_imm(offs, imm) do { \
+	emith_deref_op(0xf6, 0, CONTEXT_REG, offs); \
+	EMIT(imm, u8); \
+} while (0)
+
+// op r, [ctx+idx*(1<<scale)+offs]
+// no REX, idx must be < 8
+#define emith_ctx_deref_idx_op(op, r, idx, scale, offs) do { \
+	assert((idx) != xSP); \
+	if ((s32)(offs) != (s8)(offs)) { \
+		EMIT_OP_MODRM64(op, 2, r, 4); \
+		EMIT_SIB(scale, idx, CONTEXT_REG); \
+		EMIT(offs, u32); \
+	} else { \
+		EMIT_OP_MODRM64(op, 1, r, 4); \
+		EMIT_SIB(scale, idx, CONTEXT_REG); \
+		EMIT((u8)(offs), u8); \
+	} \
+} while (0)
+
+// u16 arrays in the context, [ctx+idx*2+offs]
+#define emith_ctx_read_u16_idx(r, idx, offs) do { \
+	EMIT_REX_IF(0, r, 0); \
+	EMIT(0x0f, u8); \
+	emith_ctx_deref_idx_op(0xb7, r, idx, 1, offs); \
+} while (0)
+
+#define emith_ctx_write16_idx(r, idx, offs) do { \
+	EMIT(0x66, u8); \
+	EMIT_REX_IF(0, r, 0); \
+	emith_ctx_deref_idx_op(0x89, r, idx, 1, offs); \
+} while (0)
+
+// u8 and pointer arrays in the context
+#define emith_ctx_read_u8_idx(r, idx, offs) do { \
+	EMIT_REX_IF(0, r, 0); \
+	EMIT(0x0f, u8); \
+	emith_ctx_deref_idx_op(0xb6, r, idx, 0, offs); \
+} while (0)
+
+#define emith_ctx_read_ptr_idx(r, idx, offs) do { \
+	EMIT_REX_IF(1, r, CONTEXT_REG); \
+	emith_ctx_deref_idx_op(0x8b, r, idx, PTR_SCALE, offs); \
+} while (0)
+
 #define emith_ctx_read_multiple(r, offs, cnt, tmpr) do { \
 	int r_ = r, offs_ = offs, cnt_ = cnt;     \
 	for (; cnt_ > 0; r_++, offs_ += 4, cnt_--) \
@@ -553,15 +762,26 @@ enum { xAX = 0, xCX, xDX, xBX, xSP, xBP, xSI, xDI };
 	emith_ctx_write(xBX, offs); \
 }
 
+// targets out of rel32 range (C code when tcache is mmap'd far away)
+// are reached through NA_TMP_REG
 #define emith_jump(ptr) { \
-	u32 disp = (u8 *)(ptr) - ((u8 *)tcache_ptr + 5); \
+	intptr_t disp_ = (u8 *)(ptr) - ((u8 *)tcache_ptr + 5); \
+	if (disp_ == (s32)disp_) { \
+		EMIT_OP(0xe9); \
+		EMIT((u32)disp_, u32); \
+	} else { \
+		emith_move_r_ptr_imm(NA_TMP_REG, ptr); \
+		emith_jump_reg(NA_TMP_REG); \
+	} \
+}
+
+// always rel32, target must be in tcache
+#define emith_jump_patchable(target) { \
+	u32 disp = (u8 *)(target) - ((u8 *)tcache_ptr + 5); \
 	EMIT_OP(0xe9); \
 	EMIT(disp, u32); \
 }
 
-#define emith_jump_patchable(target) \
-	emith_jump(target)
-
 #define emith_jump_cond(cond, ptr) do { \
 	u32 disp = (u8 *)(ptr) - ((u8 *)tcache_ptr + 6); \
 	EMIT(0x0f, u8); \
@@ -578,6 +798,8 @@ enum { xAX = 0, xCX, xDX, xBX, xSP, xBP, xSI, xDI };
 	EMIT_PTR((u8 *)(ptr) + offs_, disp_ - offs_, u32); \
 } while (0)
 
+#define emith_jump_patch_size() 6
+
 #define emith_jump_at(ptr, target) { \
 	u32 disp_ = (u8 *)(target) - ((u8 *)(ptr) + 5); \
 	EMIT_PTR(ptr, 0xe9, u8); \
@@ -585,9 +807,14 @@ enum { xAX = 0, xCX, xDX, xBX, xSP, xBP, xSI, xDI };
 }
 
 #define emith_call(ptr) { \
-	u32 disp = (u8 *)(ptr) - ((u8 *)tcache_ptr + 5); \
-	EMIT_OP(0xe8); \
-	EMIT(disp, u32); \
+	intptr_t disp_ = (u8 *)(ptr) - ((u8 *)tcache_ptr + 5); \
+	if (disp_ == (s32)disp_) { \
+		EMIT_OP(0xe8); \
+		EMIT((u32)disp_, u32); \
+	} else { \
+		emith_move_r_ptr_imm(NA_TMP_REG, ptr); \
+		emith_call_reg(NA_TMP_REG); \
+	} \
 }
 
 #define emith_call_cond(cond, ptr) \
@@ -596,11 +823,45 @@ enum { xAX = 0, xCX, xDX, xBX, xSP, xBP, xSI, xDI };
 #define emith_call_reg(r) \
 	EMIT_OP_MODRM(0xff, 3, 2, r)
 
+// call [base + idx * sizeof(void *)]
+#define emith_call_r_idx_ptr(base, idx) do { \
+	assert((base) != xBP); \
+	EMIT_OP_MODRM(0xff, 0, 2, 4); \
+	EMIT_SIB(PTR_SCALE, idx, base); \
+} while (0)
+
+// d = [base + idx * sizeof(void *)]
+#define emith_read_r_r_idx_ptr(d, base, idx) do { \
+	assert((base) != xBP); \
+	EMIT_REX_IF(1, d, base); \
+	EMIT_OP_MODRM64(0x8b, 0, d, 4); \
+	EMIT_SIB64(PTR_SCALE, idx, base); \
+} while (0)
+
 #define emith_call_ctx(offs) do { \
 	EMIT_OP_MODRM(0xff, 2, 2, CONTEXT_REG); \
 	EMIT(offs, u32); \
 } while (0)
 
+// d = byte [base + idx], zero extended
+#define emith_read8_zext_r_r_r(d, base, idx) do { \
+	assert((base) != xBP); \
+	EMIT_OP0F_MODRM(0xb6, 0, d, 4); \
+	EMIT_SIB(0, idx, base); \
+} while (0)
+
+// byte [base + idx] = s
+#define emith_write8_r_r_r(s, base, idx) do { \
+	assert(is_abcdx(s) && (base) != xBP); \
+	EMIT_OP_MODRM(0x88, 0, s, 4); \
+	EMIT_SIB(0, idx, base); \
+} while (0)
+
+#define emith_read16_zext_r_r(d, s) do { \
+	assert(((s) & 7) != xSP && ((s) & 7) != xBP); \
+	EMIT_OP0F_MODRM(0xb7, 0, d, s); /* MOVZX d, word [s] */ \
+} while (0)
+
 #define emith_ret() \
 	EMIT_OP(0xc3)
 
@@ -675,10 +936,16 @@ enum { xAX = 0, xCX, xDX, xBX, xSP, xBP, xSI, xDI };
 #define NA_TMP_REG xAX // non-arg tmp from reg_temp[]
 
 #define EMIT_REX_IF(w, r, rm) do { \
-	int r_ = (r) > 7 ? 1 : 0; \
-	int rm_ = (rm) > 7 ? 1 : 0; \
-	if ((w) | r_ | rm_) \
-		EMIT_REX(1, r_, 0, rm_); \
+	int rex_r_ = (r) > 7 ? 1 : 0; \
+	int rex_b_ = (rm) > 7 ? 1 : 0; \
+	if ((w) | rex_r_ | rex_b_) \
+		EMIT_REX(w, rex_r_, 0, rex_b_); \
+} while (0)
+
+#define emith_move_r_ptr_imm(r, imm) do { \
+	EMIT_REX(1, 0, 0, (r) > 7); \
+	EMIT_OP(0xb8 + ((r) & 7)); \
+	EMIT((uint64_t)(uintptr_t)(imm), uint64_t); \
 } while (0)
 
 #ifndef _WIN32
@@ -690,14 +957,23 @@ enum { xAX = 0, xCX, xDX, xBX, xSP, xBP, xSI, xDI };
 	case 2: rd = xDX; break; \
 	}
 
+// r12-r15 hold static SH2 regs
 #define emith_sh2_drc_entry() { \
 	emith_push(xBX); \
 	emith_push(xBP); \
+	emith_push(12); \
+	emith_push(13); \
+	emith_push(14); \
+	emith_push(15); \
 	emith_push(xSI); /* to align */ \
 }
 
 #define emith_sh2_drc_exit() {  \
 	emith_pop(xSI); \
+	emith_pop(15); \
+	emith_pop(14); \
+	emith_pop(13); \
+	emith_pop(12); \
 	emith_pop(xBP); \
 	emith_pop(xBX); \
 	emith_ret(); \
@@ -717,11 +993,19 @@ enum { xAX = 0, xCX, xDX, xBX, xSP, xBP, xSI, xDI };
 	emith_push(xBP); \
 	emith_push(xSI); \
 	emith_push(xDI); \
+	emith_push(12); \
+	emith_push(13); \
+	emith_push(14); \
+	emith_push(15); \
 	emith_add_r_r_ptr_imm(xSP, xSP, -8*5); \
 }
 
 #define emith_sh2_drc_exit() {  \
 	emith_add_r_r_ptr_imm(xSP, xSP, 8*5); \
+	emith_pop(15); \
+	emith_pop(14); \
+	emith_pop(13); \
+	emith_pop(12); \
 	emith_pop(xDI); \
 	emith_pop(xSI); \
 	emith_pop(xBP); \
@@ -736,6 +1020,9 @@ enum { xAX = 0, xCX, xDX, xBX, xSP, xBP, xSI, xDI };
 #define PTR_SCALE 2
 #define NA_TMP_REG xBX // non-arg tmp from reg_temp[]
 
+#define emith_move_r_ptr_imm(r, imm) \
+	emith_move_r_imm(r, (u32)(uintptr_t)(imm))
+
 #define EMIT_REX_IF(w, r, rm) do { \
 	assert((u32)(r) < 8u); \
 	assert((u32)(rm) < 8u); \
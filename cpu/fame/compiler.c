@@ -0,0 +1,1428 @@
+/*
+ * 68000 recompiler
+ *
+ * This work is licensed under the terms of MAME license.
+ * See COPYING file in the top-level directory.
+ *
+ * notes:
+ * - FAME is the reference: it's built here once more (function per opcode)
+ *   and its main loop hands over to drc_exec(). Anything not translated
+ *   natively becomes a direct call of the FAME handler, so behaviour and
+ *   timing are FAME's by construction.
+ * - native code keeps all state in M68K_CONTEXT, in FAME flag format, and
+ *   takes its cycle counts from the FAME handlers (dr_op_cycles())
+ * - only ROM and main RAM code is translated, blocks are keyed by both
+ *   68k and host PC so remapped ROM banks never alias
+ * - 68k writes to RAM holding translated code drop the affected blocks,
+ *   a block that notices translation state change leaves after current insn
+ * - jumps between blocks are linked and get unlinked when target goes away
+ * - x86-64 only
+ *
+ * implemented:
+ * - moves, add/sub/cmp/logic and shifts on registers and immediates
+ * - Bcc/BRA/DBcc, linking and block-local branches
+ * - static targets of BSR/JSR/JMP (through FAME, then linked)
+ *
+ * TODO:
+ * - memory operands, register caching
+ * - inline RTS lookup
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../../pico/pico_int.h"
+#include "../drc/cmn.h"
+
+#ifndef __x86_64__
+#error the 68k recompiler needs an x86-64 host
+#endif
+
+// limits
+#define TCACHE_SIZE             (4*1024*1024)
+#define MAX_BLOCK_SIZE          (M68K_BLOCK_INSN_LIMIT * 160)
+#define MAX_EXITS               (M68K_BLOCK_INSN_LIMIT * 2)
+#define BLOCK_MAX_COUNT         0x2000
+#define LINK_MAX_COUNT          0x4000
+#define RAM_ENTRY_MAX_COUNT     0x2000
+#define BLOCK_HASH_SIZE         0x1000
+#define ULINK_HASH_SIZE         0x400
+
+// debug stuff
+// 01 - warnings/errors
+// 02 - block info/smc
+// {
+#ifndef DRC_DEBUG
+#define DRC_DEBUG 0
+#endif
+
+#if DRC_DEBUG
+#define dbg(l,...) { \
+  if ((l) & DRC_DEBUG) \
+    elprintf(EL_STATUS, ##__VA_ARGS__); \
+}
+static int insns_compiled, insns_native, host_insn_count;
+#define COUNT_OP \
+	host_insn_count++
+#else // !DRC_DEBUG
+#define COUNT_OP
+#define dbg(...)
+#endif
+// }
+
+static PICO_TLS M68K_CONTEXT *drc_ctx; // running context, NULL if none
+
+static void drc_exec(M68K_CONTEXT *ctx);
+
+// the reference interpreter, its JumpTable is private to the recompiler
+#ifndef FAMEC_NO_GOTOS
+#define FAMEC_NO_GOTOS
+#endif
+#define FAMEC_EXEC(ctx)         drc_exec(ctx)
+#define fm68k_init              fm68k_drc_fame_init
+#define fm68k_reset             fm68k_drc_fame_reset
+#define fm68k_emulate           fm68k_drc_fame_emulate
+#define fm68k_get_pc            fm68k_drc_fame_get_pc
+#define fm68k_would_interrupt   fm68k_drc_fame_would_interrupt
+#define fm68k_idle_install      fm68k_drc_idle_install
+#define fm68k_idle_remove       fm68k_drc_idle_remove
+
+#include "famec.c"
+
+#undef fm68k_init
+#undef fm68k_reset
+#undef fm68k_emulate
+#undef fm68k_get_pc
+#undef fm68k_would_interrupt
+#undef fm68k_idle_install
+#undef fm68k_idle_remove
+#undef Opcode
+#undef cycles_needed
+#undef PC
+#undef BasePC
+#undef flag_C
+#undef flag_V
+#undef flag_NotZ
+#undef flag_N
+#undef flag_X
+#undef flag_T
+#undef flag_S
+#undef flag_I
+
+static PICO_TLS u8 *tcache_ptr;
+
+#include "../drc/emit_x86.c"
+
+#define CTX_OFS(f)      offsetof(M68K_CONTEXT, f)
+#define DREG_OFS(r)     (CTX_OFS(dreg) + (r) * 4) // An follow Dn
+
+struct block_link {
+  u32 target_pc;
+  u16 *target_hpc;
+  u8 *jump;                     // patchable jmp in the source block
+  u8 *stub;                     // its destination while target isn't there
+  struct block_link *next;      // target's or unresolved list
+};
+
+struct block_desc {
+  u32 pc;
+  u16 *hpc, *hpc_end;
+  u8 *tcache_ptr;
+  struct block_link *entries;   // jumps linked to this block
+  struct block_desc *next;      // hash chain
+  int active;
+};
+
+struct ram_entry {
+  struct block_desc *block;
+  struct ram_entry *next;
+};
+
+#ifndef PICO_THREAD_SAFE
+static u8 ALIGNED(4096) tcache_default[TCACHE_SIZE];
+#endif
+static PICO_TLS u8 *tcache_m68k;
+static PICO_TLS u8 *tcache_blocks;     // block area start, after the utils
+
+static PICO_TLS struct block_desc *block_table;
+static PICO_TLS struct block_desc **block_hash;
+static PICO_TLS int block_count;
+static PICO_TLS struct block_link *link_table;
+static PICO_TLS struct block_link **unresolved_links;
+static PICO_TLS int link_count;
+static PICO_TLS struct ram_entry *ram_entries;
+static PICO_TLS struct ram_entry *ram_blocks[0x100]; // per 256 bytes of RAM
+static PICO_TLS int ram_entry_count;
+static PICO_TLS u16 *ram_marks;        // per RAM word: blocks covering it
+static PICO_TLS u8 fetch_used[0x100];  // banks natively branched to
+
+#define HASH_FUNC(tab, addr, mask) \
+  (tab)[(((addr) >> 1) ^ ((addr) >> 13)) & (mask)]
+
+// utils
+static PICO_TLS void (*m68k_drc_entry)(M68K_CONTEXT *ctx, const void *block);
+static PICO_TLS u8 *m68k_drc_exit;     // back to drc_exec(), PC is stored
+static PICO_TLS u8 *m68k_drc_exit_pc;  // same, PC to be stored from xAX
+
+// ---------------------------------------------------------------
+// block and link tracking
+
+static struct block_desc *dr_find_block(u32 pc, const u16 *hpc)
+{
+  struct block_desc *bd = HASH_FUNC(block_hash, pc, BLOCK_HASH_SIZE - 1);
+
+  for (; bd != NULL; bd = bd->next)
+    if (bd->pc == pc && bd->hpc == hpc)
+      return bd;
+
+  return NULL;
+}
+
+static void dr_add_link(u32 target_pc, u16 *target_hpc, u8 *jump, u8 *stub)
+{
+  struct block_link *bl = &link_table[link_count++];
+  struct block_link **head;
+  struct block_desc *bd;
+
+  bl->target_pc = target_pc;
+  bl->target_hpc = target_hpc;
+  bl->jump = jump;
+  bl->stub = stub;
+
+  bd = dr_find_block(target_pc, target_hpc);
+  if (bd != NULL) {
+    emith_jump_patch(jump, bd->tcache_ptr);
+    bl->next = bd->entries;
+    bd->entries = bl;
+  }
+  else {
+    emith_jump_patch(jump, stub);
+    head = &HASH_FUNC(unresolved_links, target_pc, ULINK_HASH_SIZE - 1);
+    bl->next = *head;
+    *head = bl;
+  }
+}
+
+static void dr_resolve_links(struct block_desc *bd)
+{
+  struct block_link **head, *bl;
+
+  head = &HASH_FUNC(unresolved_links, bd->pc, ULINK_HASH_SIZE - 1);
+  while ((bl = *head) != NULL) {
+    if (bl->target_pc == bd->pc && bl->target_hpc == bd->hpc) {
+      *head = bl->next;
+      emith_jump_patch(bl->jump, bd->tcache_ptr);
+      bl->next = bd->entries;
+      bd->entries = bl;
+    }
+    else
+      head = &bl->next;
+  }
+}
+
+static int dr_is_ram(const u16 *hpc)
+{
+  return PicoMem.ram <= (u8 *)hpc && (u8 *)hpc < PicoMem.ram + sizeof(PicoMem.ram);
+}
+
+static void dr_rm_block(struct block_desc *bd)
+{
+  struct block_desc **pbd;
+  struct block_link *bl, *next, **head;
+  u32 a;
+
+  pbd = &HASH_FUNC(block_hash, bd->pc, BLOCK_HASH_SIZE - 1);
+  for (; *pbd != bd; pbd = &(*pbd)->next)
+    ;
+  *pbd = bd->next;
+
+  // whoever jumped here goes back to exiting
+  for (bl = bd->entries; bl != NULL; bl = next) {
+    next = bl->next;
+    emith_jump_patch(bl->jump, bl->stub);
+    head = &HASH_FUNC(unresolved_links, bl->target_pc, ULINK_HASH_SIZE - 1);
+    bl->next = *head;
+    *head = bl;
+  }
+  bd->entries = NULL;
+  bd->active = 0;
+
+  if (dr_is_ram(bd->hpc)) {
+    for (a = (u8 *)bd->hpc - PicoMem.ram; a < (u8 *)bd->hpc_end - PicoMem.ram; a += 2)
+      ram_marks[a >> 1]--;
+  }
+}
+
+static void dr_add_ram_block(struct block_desc *bd)
+{
+  u32 start = (u8 *)bd->hpc - PicoMem.ram;
+  u32 end = (u8 *)bd->hpc_end - PicoMem.ram;
+  struct ram_entry *re;
+  u32 a;
+
+  for (a = start; a < end; a += 2)
+    ram_marks[a >> 1]++;
+  for (a = start >> 8; a <= (end - 1) >> 8; a++) {
+    re = &ram_entries[ram_entry_count++];
+    re->block = bd;
+    re->next = ram_blocks[a];
+    ram_blocks[a] = re;
+  }
+}
+
+// a word of RAM with translated code on it was written
+static void dr_ram_inval(u32 a)
+{
+  struct ram_entry **head = &ram_blocks[a >> 8], *re;
+  const u8 *p = PicoMem.ram + a;
+
+  while ((re = *head) != NULL) {
+    struct block_desc *bd = re->block;
+    if (bd->active && (p < (u8 *)bd->hpc || (u8 *)bd->hpc_end <= p)) {
+      head = &re->next;
+      continue;
+    }
+    if (bd->active) {
+      dbg(2, "smc @%06x: rm block %06x-%06x", a, bd->pc,
+        bd->pc + (u32)((u8 *)bd->hpc_end - (u8 *)bd->hpc));
+      dr_rm_block(bd);
+    }
+    *head = re->next;
+  }
+
+  if (drc_ctx != NULL)
+    drc_ctx->drc_exit = 1;
+}
+
+static void dr_flush(void)
+{
+  dbg(2, "flush: %d blocks, %d links, %d bytes", block_count, link_count,
+    (int)(tcache_ptr - tcache_blocks));
+
+  tcache_ptr = tcache_blocks;
+  if (block_count != 0) {
+    memset(block_hash, 0, BLOCK_HASH_SIZE * sizeof(block_hash[0]));
+    memset(unresolved_links, 0, ULINK_HASH_SIZE * sizeof(unresolved_links[0]));
+    memset(ram_blocks, 0, sizeof(ram_blocks));
+    memset(ram_marks, 0, sizeof(PicoMem.ram) / 2 * sizeof(ram_marks[0]));
+    memset(fetch_used, 0, sizeof(fetch_used));
+  }
+  block_count = link_count = ram_entry_count = 0;
+
+  if (drc_ctx != NULL)
+    drc_ctx->drc_exit = 1;
+}
+
+// ---------------------------------------------------------------
+// translation
+
+static PICO_TLS u32 tr_base_pc;
+static PICO_TLS u16 *tr_base_hpc;
+static PICO_TLS u16 *tr_insn_hpc[M68K_BLOCK_INSN_LIMIT];
+static PICO_TLS u8 *tr_insn_ptr[M68K_BLOCK_INSN_LIMIT];
+
+static PICO_TLS struct {
+  u8 *jump;
+  u16 *hpc;                     // ctx->PC to leave with
+} tr_exits[MAX_EXITS];
+static PICO_TLS int tr_exit_count;
+
+static PICO_TLS struct {
+  u8 *jump;
+  u32 target_pc;
+  u16 *target_hpc;
+  int pc_set;                   // ctx->PC is already target_hpc
+} tr_links[MAX_EXITS];
+static PICO_TLS int tr_link_count;
+
+#define TR_PC(hpc) \
+  (tr_base_pc + (u32)((u8 *)(hpc) - (u8 *)tr_base_hpc))
+#define TR_HPC(pc) \
+  ((u16 *)((u8 *)tr_base_hpc + (s32)((pc) - tr_base_pc)))
+
+// host address of 68k pc, as SET_PC would do it
+static u16 *dr_hpc(M68K_CONTEXT *ctx, u32 pc)
+{
+  uptr base = ctx->Fetch[(pc >> M68K_FETCHSFT) & M68K_FETCHMASK];
+  base -= pc & 0xff000000;
+  return (u16 *)(pc + base);
+}
+
+// end of translatable memory hpc is in, NULL if none
+static u16 *dr_code_end(const u16 *hpc)
+{
+  const u8 *p = (const u8 *)hpc;
+
+  if (Pico.rom != NULL && Pico.rom <= p && p < Pico.rom + Pico.romsize)
+    return (u16 *)(Pico.rom + (Pico.romsize & ~1));
+  if (dr_is_ram(hpc))
+    return (u16 *)(PicoMem.ram + sizeof(PicoMem.ram));
+  return NULL;
+}
+
+static void tr_exit_jcc(int cond, u16 *hpc)
+{
+  tr_exits[tr_exit_count].jump = tcache_ptr;
+  tr_exits[tr_exit_count].hpc = hpc;
+  tr_exit_count++;
+  emith_jump_cond(cond, tcache_ptr); // patched to the stub later
+}
+
+static void tr_link_jmp(u32 target_pc, u16 *target_hpc, int pc_set)
+{
+  tr_links[tr_link_count].jump = tcache_ptr;
+  tr_links[tr_link_count].target_pc = target_pc;
+  tr_links[tr_link_count].target_hpc = target_hpc;
+  tr_links[tr_link_count].pc_set = pc_set;
+  tr_link_count++;
+  emith_jump(tcache_ptr);
+}
+
+static void emit_call(const void *func)
+{
+  intptr_t disp = (u8 *)func - (tcache_ptr + 5);
+
+  if (disp == (s32)disp) {
+    emith_call(func);
+  } else {
+    emith_move_r_ptr_imm(xAX, func);
+    emith_call_reg(xAX);
+  }
+}
+
+// count cycles, leave with next insn's PC when out of them
+static void emit_cycles(int cycles, u16 *next)
+{
+  emith_ctx_sub_imm(CTX_OFS(io_cycle_counter), cycles);
+  tr_exit_jcc(DCOND_LE, next);
+}
+
+// FAME flags: C, X - bit 8; V, N - bit 7; Z - NotZ == 0
+static void emit_flags_nz(int sz, int r)
+{
+  emith_ctx_write(r, CTX_OFS(flag_NotZ));
+  if (sz > 1)
+    emith_lsr(r, r, sz * 8 - 8);
+  emith_ctx_write(r, CTX_OFS(flag_N));
+}
+
+// from setc dl, seto cl
+static void emit_flags_cv(int set_x)
+{
+  emith_zext8_r_r(xDX, xDX);
+  emith_lsl(xDX, xDX, 8);
+  emith_ctx_write(xDX, CTX_OFS(flag_C));
+  if (set_x)
+    emith_ctx_write(xDX, CTX_OFS(flag_X));
+  emith_zext8_r_r(xCX, xCX);
+  emith_lsl(xCX, xCX, 7);
+  emith_ctx_write(xCX, CTX_OFS(flag_V));
+}
+
+static void emit_flags_cv_clear(void)
+{
+  emith_eor_r_r(xCX, xCX);
+  emith_ctx_write(xCX, CTX_OFS(flag_C));
+  emith_ctx_write(xCX, CTX_OFS(flag_V));
+}
+
+static void emit_read_dn(int r, int reg, int sz, int sext)
+{
+  switch (sz) {
+  case 1:
+    if (sext) emith_ctx_read_s8(r, DREG_OFS(reg));
+    else      emith_ctx_read_u8(r, DREG_OFS(reg));
+    break;
+  case 2:
+    if (sext) emith_ctx_read_s16(r, DREG_OFS(reg));
+    else      emith_ctx_read_u16(r, DREG_OFS(reg));
+    break;
+  default:
+    emith_ctx_read(r, DREG_OFS(reg));
+    break;
+  }
+}
+
+static void emit_write_dn(int r, int reg, int sz)
+{
+  switch (sz) {
+  case 1:  emith_ctx_write8(r, DREG_OFS(reg)); break;
+  case 2:  emith_ctx_write16(r, DREG_OFS(reg)); break;
+  default: emith_ctx_write(r, DREG_OFS(reg)); break;
+  }
+}
+
+enum { ALU_ADD, ALU_SUB, ALU_CMP, ALU_AND, ALU_OR, ALU_EOR };
+
+// <op>.sz src,Dn where src is register sreg or imm (sreg < 0).
+// Operands are shifted to the top so host flags come out for the 68k size.
+static void emit_alu(int op, int sz, int dreg, int sreg, u32 imm, int set_x)
+{
+  int sh = 32 - sz * 8;
+
+  emith_ctx_read(xAX, DREG_OFS(dreg));
+  if (sreg >= 0)
+    emith_ctx_read(xCX, DREG_OFS(sreg));
+  else
+    emith_move_r_imm(xCX, sh ? imm << sh : imm);
+  if (sh) {
+    emith_lsl(xAX, xAX, sh);
+    if (sreg >= 0)
+      emith_lsl(xCX, xCX, sh);
+  }
+
+  switch (op) {
+  case ALU_ADD: emith_add_r_r(xAX, xCX); break;
+  case ALU_SUB:
+  case ALU_CMP: emith_sub_r_r(xAX, xCX); break;
+  case ALU_AND: emith_and_r_r(xAX, xCX); break;
+  case ALU_OR:  emith_or_r_r(xAX, xCX); break;
+  case ALU_EOR: emith_eor_r_r(xAX, xCX); break;
+  }
+  if (op <= ALU_CMP) {
+    emith_set_cond(DCOND_LO, xDX); // carry/borrow
+    emith_set_cond(DCOND_VS, xCX);
+  }
+  if (sh)
+    emith_lsr(xAX, xAX, sh);
+  if (op != ALU_CMP)
+    emit_write_dn(xAX, dreg, sz);
+  emit_flags_nz(sz, xAX);
+  if (op <= ALU_CMP)
+    emit_flags_cv(set_x);
+  else
+    emit_flags_cv_clear();
+}
+
+// ADDA/SUBA/CMPA, src sign extended from sz
+static void emit_alu_an(int op, int sz, int areg, int sreg, u32 imm)
+{
+  emith_ctx_read(xAX, DREG_OFS(areg));
+  if (sreg >= 0)
+    emit_read_dn(xCX, sreg, sz, 1);
+  else
+    emith_move_r_imm(xCX, sz == 2 ? (u32)(s16)imm : imm);
+
+  switch (op) {
+  case ALU_ADD:
+    emith_add_r_r(xAX, xCX);
+    emith_ctx_write(xAX, DREG_OFS(areg));
+    break;
+  case ALU_SUB:
+    emith_sub_r_r(xAX, xCX);
+    emith_ctx_write(xAX, DREG_OFS(areg));
+    break;
+  case ALU_CMP:
+    emith_sub_r_r(xAX, xCX);
+    emith_set_cond(DCOND_LO, xDX);
+    emith_set_cond(DCOND_VS, xCX);
+    emit_flags_nz(4, xAX);
+    emit_flags_cv(0);
+    break;
+  }
+}
+
+// sets host flags so that returned condition is true when 68k cc is
+static int emit_cond(int cc)
+{
+  switch (cc) {
+  case 0x2: // HI
+  case 0x3: // LS
+    emith_ctx_read(xAX, CTX_OFS(flag_C));
+    emith_lsr(xAX, xAX, 8);
+    emith_eor_r_r(xCX, xCX);
+    emith_ctx_cmp_imm(CTX_OFS(flag_NotZ), 0);
+    emith_set_cond(DCOND_EQ, xCX);
+    emith_or_r_r(xAX, xCX);
+    emith_tst_r_imm(xAX, 1);
+    return cc == 0x2 ? DCOND_EQ : DCOND_NE;
+  case 0x4: // CC
+  case 0x5: // CS
+    emith_ctx_tst_imm(CTX_OFS(flag_C), 0x100);
+    return cc == 0x4 ? DCOND_EQ : DCOND_NE;
+  case 0x6: // NE
+  case 0x7: // EQ
+    emith_ctx_cmp_imm(CTX_OFS(flag_NotZ), 0);
+    return cc == 0x6 ? DCOND_NE : DCOND_EQ;
+  case 0x8: // VC
+  case 0x9: // VS
+    emith_ctx_tst_imm(CTX_OFS(flag_V), 0x80);
+    return cc == 0x8 ? DCOND_EQ : DCOND_NE;
+  case 0xa: // PL
+  case 0xb: // MI
+    emith_ctx_tst_imm(CTX_OFS(flag_N), 0x80);
+    return cc == 0xa ? DCOND_EQ : DCOND_NE;
+  case 0xc: // GE
+  case 0xd: // LT
+    emith_ctx_read(xAX, CTX_OFS(flag_N));
+    emith_ctx_read(xCX, CTX_OFS(flag_V));
+    emith_eor_r_r(xAX, xCX);
+    emith_tst_r_imm(xAX, 0x80);
+    return cc == 0xc ? DCOND_EQ : DCOND_NE;
+  default: // GT, LE
+    emith_ctx_read(xAX, CTX_OFS(flag_N));
+    emith_ctx_read(xCX, CTX_OFS(flag_V));
+    emith_eor_r_r(xAX, xCX);
+    emith_lsr(xAX, xAX, 7);
+    emith_eor_r_r(xCX, xCX);
+    emith_ctx_cmp_imm(CTX_OFS(flag_NotZ), 0);
+    emith_set_cond(DCOND_EQ, xCX);
+    emith_or_r_r(xAX, xCX);
+    emith_tst_r_imm(xAX, 1);
+    return cc == 0xe ? DCOND_EQ : DCOND_NE;
+  }
+}
+
+// cycles FAME charges for a non-branching op
+static int dr_op_cycles(u16 *hpc)
+{
+  M68K_CONTEXT c;
+
+  memset(&c, 0, sizeof(c));
+  c.Opcode = hpc[0];
+  c.PC = hpc + 1;
+  c.io_cycle_counter = 1000;
+  JumpTable[hpc[0]](&c);
+  return 1000 - c.io_cycle_counter;
+}
+
+// ea extension words
+static int ea_len(int mode, int reg, int sz)
+{
+  switch (mode) {
+  case 5: case 6:
+    return 1;
+  case 7:
+    switch (reg) {
+    case 0: case 2: case 3: return 1;
+    case 1: return 2;
+    case 4: return sz == 4 ? 2 : 1;
+    }
+  }
+  return 0;
+}
+
+// insn length in words. Only has to be exact for natively handled ops,
+// for the rest a wrong guess just makes the block exit after the insn.
+static int op_len(const u16 *hpc)
+{
+  static const u8 sizes[4] = { 1, 2, 4, 2 };
+  u32 op = hpc[0];
+  int mode = (op >> 3) & 7, reg = op & 7;
+  int sz = sizes[(op >> 6) & 3];
+
+  switch (op >> 12) {
+  case 0x0:
+    if ((op & 0x0138) == 0x0108)        // MOVEP
+      return 2;
+    if (op & 0x0100)                    // BTST..BSET Dn,<ea>
+      return 1 + ea_len(mode, reg, 1);
+    if ((op & 0x0f00) == 0x0800)        // BTST..BSET #,<ea>
+      return 2 + ea_len(mode, reg, 1);
+    if ((op & 0x3f) == 0x3c)            // to CCR/SR
+      return 2;
+    return 1 + (sz == 4 ? 2 : 1) + ea_len(mode, reg, sz);
+  case 0x1:
+    return 1 + ea_len(mode, reg, 1) + ea_len((op >> 6) & 7, (op >> 9) & 7, 1);
+  case 0x2:
+    return 1 + ea_len(mode, reg, 4) + ea_len((op >> 6) & 7, (op >> 9) & 7, 4);
+  case 0x3:
+    return 1 + ea_len(mode, reg, 2) + ea_len((op >> 6) & 7, (op >> 9) & 7, 2);
+  case 0x4:
+    if ((op & 0xfff8) == 0x4e50 || op == 0x4e72) // LINK, STOP
+      return 2;
+    if ((op & 0xff80) == 0x4e00 || (op & 0xffc0) == 0x4e40)
+      return 1;
+    if ((op & 0xfb80) == 0x4880 && mode >= 2) // MOVEM
+      return 2 + ea_len(mode, reg, 2);
+    if ((op & 0xf900) != 0x4000 && (op & 0xff00) != 0x4a00)
+      sz = 2;
+    else if ((op & 0xc0) == 0xc0)
+      sz = 2;
+    return 1 + ea_len(mode, reg, sz);
+  case 0x5:
+    if ((op & 0xf8) == 0xc8)            // DBcc
+      return 2;
+    return 1 + ea_len(mode, reg, (op & 0xc0) == 0xc0 ? 1 : sz);
+  case 0x6:
+    return (op & 0xff) ? 1 : 2;
+  case 0x8: case 0x9: case 0xb: case 0xc: case 0xd:
+    if ((op & 0x1c0) == 0x1c0 && (op >> 12) != 0x8 && (op >> 12) != 0xc)
+      sz = 4;
+    else if ((op & 0xc0) == 0xc0)
+      sz = 2;
+    return 1 + ea_len(mode, reg, sz);
+  case 0xe:
+    if ((op & 0xc0) == 0xc0)
+      return 1 + ea_len(mode, reg, 2);
+    return 1;
+  }
+  return 1;
+}
+
+// ops the idle loop detector owns, their code can change under us
+static int is_idle_op(u32 op)
+{
+  if ((op & 0xf100) == 0x7100) // illegal MOVEQ, detector's replacement ops
+    return 1;
+  switch (op) {
+  case 0x66fa: case 0x66f8: case 0x66f6: case 0x66f2:
+  case 0x67fa: case 0x67f8: case 0x67f6: case 0x67f2:
+  case 0x60fe: case 0x60fc:
+    return 1;
+  }
+  return 0;
+}
+
+// leave or continue after FAME ran an op
+static void emit_fallback_checks(void)
+{
+  emith_ctx_cmp_imm(CTX_OFS(io_cycle_counter), 0);
+  emith_jump_cond(DCOND_LE, m68k_drc_exit);
+  emith_ctx_cmp8_imm(CTX_OFS(drc_exit), 0);
+  emith_jump_cond(DCOND_NE, m68k_drc_exit);
+}
+
+static void emit_pc_check(u16 *hpc)
+{
+  emith_move_r_ptr_imm(xAX, hpc);
+  emith_ctx_cmp_ptr(xAX, CTX_OFS(PC));
+}
+
+// idle loop candidates: FAME runs whatever op is in memory at the time
+static int emit_dynamic(u16 *hpc, int len)
+{
+  u32 op = hpc[0];
+  u32 target = TR_PC(hpc) + 2 + (s8)(op & 0xfe);
+  int bra = (op & 0xff00) == 0x6000 || (op & 0xfd00) == 0x7d00;
+
+  emith_move_r_ptr_imm(xAX, hpc + 1);
+  emith_ctx_write_ptr(xAX, CTX_OFS(PC));
+  emith_move_r_ptr_imm(xDX, hpc);
+  emith_read16_zext_r_r(xAX, xDX);
+  emith_ctx_write(xAX, CTX_OFS(Opcode));
+  emith_move_r_ptr_imm(xDX, JumpTable);
+  emith_pass_arg_r(0, CONTEXT_REG);
+  emith_call_r_idx_ptr(xDX, xAX);
+  emit_fallback_checks();
+
+  emit_pc_check((u16 *)((u8 *)hpc + 2 + (s8)(op & 0xfe)));
+  EMITH_JMP_START(DCOND_NE);
+  tr_link_jmp(target, (u16 *)((u8 *)hpc + 2 + (s8)(op & 0xfe)), 1);
+  EMITH_JMP_END(DCOND_NE);
+  if (bra) {
+    emith_jump(m68k_drc_exit);
+    return 1;
+  }
+  emit_pc_check(hpc + len);
+  emith_jump_cond(DCOND_NE, m68k_drc_exit);
+  return 0;
+}
+
+// flow change done by FAME with a target known at translation time
+static int op_static_target(M68K_CONTEXT *ctx, u16 *hpc, u32 *target)
+{
+  u32 op = hpc[0], pc = TR_PC(hpc);
+
+  if ((op & 0xfe00) == 0x6000) {      // BRA, BSR
+    if (op & 0xff)
+      *target = pc + 2 + (s8)op;
+    else
+      *target = pc + 2 + (s16)hpc[1];
+  }
+  else if ((op & 0xff80) == 0x4e80) { // JSR, JMP
+    switch (op & 0x3f) {
+    case 0x38: *target = (s16)hpc[1]; break;
+    case 0x39: *target = (hpc[1] << 16) | hpc[2]; break;
+    case 0x3a: *target = pc + 2 + (s16)hpc[1]; break;
+    default:   return 0;
+    }
+  }
+  else
+    return 0;
+
+  return !(*target & 1);
+}
+
+static int op_ends_block(u32 op)
+{
+  if ((op & 0xfe00) == 0x6000 || (op & 0xff80) == 0x4e80) // BRA/BSR/JSR/JMP
+    return 1;
+  switch (op) {
+  case 0x4e72: // STOP
+  case 0x4e73: // RTE
+  case 0x4e75: // RTS
+  case 0x4e77: // RTR
+  case 0x4afc: // ILLEGAL
+    return 1;
+  }
+  if ((op & 0xfff0) == 0x4e40) // TRAP
+    return 1;
+  if ((op >> 12) == 0xa || (op >> 12) == 0xf)
+    return 1;
+  return 0;
+}
+
+static int emit_fallback(M68K_CONTEXT *ctx, u16 *hpc, int len)
+{
+  u32 op = hpc[0], target;
+  u16 *target_hpc;
+
+  emith_move_r_ptr_imm(xAX, hpc + 1);
+  emith_ctx_write_ptr(xAX, CTX_OFS(PC));
+  emith_ctx_write_imm(CTX_OFS(Opcode), op);
+  emith_pass_arg_r(0, CONTEXT_REG);
+  emit_call(JumpTable[op]);
+  emit_fallback_checks();
+
+  if (!op_ends_block(op)) {
+    emit_pc_check(hpc + len);
+    emith_jump_cond(DCOND_NE, m68k_drc_exit);
+    return 0;
+  }
+
+  if (op_static_target(ctx, hpc, &target)) {
+    target_hpc = dr_hpc(ctx, target);
+    if (dr_code_end(target_hpc) != NULL) {
+      emit_pc_check(target_hpc);
+      emith_jump_cond(DCOND_NE, m68k_drc_exit);
+      tr_link_jmp(target, target_hpc, 1);
+      return 1;
+    }
+  }
+  emith_jump(m68k_drc_exit);
+  return 1;
+}
+
+// branch with SET_PC, native only if that gives the block's own base
+static int tr_setpc_ok(M68K_CONTEXT *ctx, u32 target)
+{
+  if (target & 1)
+    return 0;
+  if (dr_hpc(ctx, target) != TR_HPC(target))
+    return 0;
+  fetch_used[(target >> M68K_FETCHSFT) & M68K_FETCHMASK] = 1;
+  return 1;
+}
+
+static void emit_taken(int cycles, u32 target)
+{
+  u16 *target_hpc = TR_HPC(target);
+
+  emith_ctx_sub_imm(CTX_OFS(io_cycle_counter), cycles);
+  tr_exit_jcc(DCOND_LE, target_hpc);
+  tr_link_jmp(target, target_hpc, 0);
+}
+
+static int emit_bcc(M68K_CONTEXT *ctx, u16 *hpc, int len)
+{
+  u32 op = hpc[0], pc = TR_PC(hpc), target;
+  int cc = (op >> 8) & 0xf, cond;
+
+  if (cc == 1) // BSR
+    return -1;
+  if (op & 0xff) {
+    if (cc == 0) {
+      target = pc + 2 + (s8)op;
+      if (!tr_setpc_ok(ctx, target))
+        return -1;
+    }
+    else // PC += disp, odd bit dropped
+      target = pc + 2 + (s8)(op & 0xfe);
+  }
+  else {
+    target = pc + 2 + (s16)hpc[1];
+    if (!tr_setpc_ok(ctx, target))
+      return -1;
+  }
+
+  if (cc == 0) {
+    emit_taken(10, target);
+    return 1;
+  }
+
+  cond = emit_cond(cc);
+  {
+    EMITH_JMP_START(cond ^ 1);
+    emit_taken(10, target);
+    EMITH_JMP_END(cond ^ 1);
+  }
+  emit_cycles((op & 0xff) ? 8 : 12, hpc + len);
+  return 0;
+}
+
+static int emit_dbcc(M68K_CONTEXT *ctx, u16 *hpc, int len)
+{
+  u32 op = hpc[0], target = TR_PC(hpc) + 2 + (s16)hpc[1];
+  int cc = (op >> 8) & 0xf, reg = op & 7, cond;
+  u8 *jmp_true = NULL;
+
+  if (!tr_setpc_ok(ctx, target))
+    return -1;
+  if (cc == 0) { // DBT
+    emit_cycles(12, hpc + len);
+    return 0;
+  }
+
+  emith_ctx_write8_imm(CTX_OFS(not_polling), 1);
+  if (cc != 1) {
+    cond = emit_cond(cc);
+    jmp_true = tcache_ptr;
+    emith_jump_cond(cond, tcache_ptr);
+  }
+  emith_ctx_sub16_imm(DREG_OFS(reg), 1);
+  {
+    EMITH_JMP_START(DCOND_LO); // expired
+    emit_taken(10, target);
+    EMITH_JMP_END(DCOND_LO);
+  }
+  emith_ctx_sub_imm(CTX_OFS(io_cycle_counter), 14);
+  tr_exit_jcc(DCOND_LE, hpc + len);
+  if (jmp_true != NULL) {
+    u8 *jmp_out;
+    JMP8_POS(jmp_out);
+    emith_jump_patch(jmp_true, tcache_ptr);
+    emith_ctx_sub_imm(CTX_OFS(io_cycle_counter), 12);
+    tr_exit_jcc(DCOND_LE, hpc + len);
+    JMP8_EMIT_NC(jmp_out);
+  }
+  return 0;
+}
+
+// source operand of reg-only ops: Dn, An or #imm; returns reg or -1 for imm
+static int tr_src(const u16 *hpc, int sz, int *ok, u32 *imm)
+{
+  int mode = (hpc[0] >> 3) & 7, reg = hpc[0] & 7;
+
+  *ok = 1;
+  if (mode == 0)
+    return reg;
+  if (mode == 1 && sz != 1)
+    return 8 + reg;
+  if (mode == 7 && reg == 4) {
+    if (sz == 1)      *imm = hpc[1] & 0xff;
+    else if (sz == 2) *imm = hpc[1];
+    else              *imm = (hpc[1] << 16) | hpc[2];
+    return -1;
+  }
+  *ok = 0;
+  return -1;
+}
+
+// returns -1 if op isn't handled, else 1 if it ends the block
+static int emit_native(M68K_CONTEXT *ctx, u16 *hpc, int len)
+{
+  static const u8 move_sizes[4] = { 0, 1, 4, 2 };
+  static const s8 imm_ops[8] = { ALU_OR, ALU_AND, ALU_SUB, ALU_ADD,
+                                 -1, ALU_EOR, ALU_CMP, -1 };
+  u32 op = hpc[0], imm = 0;
+  int mode = (op >> 3) & 7, reg = op & 7;
+  int reg9 = (op >> 9) & 7, opm = (op >> 6) & 7;
+  int sz = 1 << ((op >> 6) & 3);
+  int sreg, ok, alu;
+
+  switch (op >> 12) {
+  case 0x0: // ORI/ANDI/SUBI/ADDI/EORI/CMPI #imm,Dn
+    alu = imm_ops[(op >> 9) & 7];
+    if ((op & 0x0138) != 0 || sz > 4 || alu < 0)
+      return -1;
+    if (len != 1 + (sz == 4 ? 2 : 1))
+      return -1;
+    imm = sz == 1 ? hpc[1] & 0xff : sz == 2 ? hpc[1] : (hpc[1] << 16) | hpc[2];
+    emit_alu(alu, sz, reg, -1, imm, alu == ALU_ADD || alu == ALU_SUB);
+    break;
+
+  case 0x1: case 0x2: case 0x3: // MOVE, MOVEA to register
+    sz = move_sizes[op >> 12];
+    if (opm > 1 || (opm == 1 && sz == 1))
+      return -1;
+    sreg = tr_src(hpc, sz, &ok, &imm);
+    if (!ok)
+      return -1;
+    if (opm == 1) {
+      if (sreg >= 0)
+        emit_read_dn(xAX, sreg, sz, 1);
+      else
+        emith_move_r_imm(xAX, sz == 2 ? (u32)(s16)imm : imm);
+      emith_ctx_write(xAX, DREG_OFS(8 + reg9));
+      break;
+    }
+    if (sreg >= 0)
+      emit_read_dn(xAX, sreg, sz, 0);
+    else
+      emith_move_r_imm(xAX, imm);
+    emit_write_dn(xAX, reg9, sz);
+    emit_flags_nz(sz, xAX);
+    emit_flags_cv_clear();
+    break;
+
+  case 0x4:
+    if (op == 0x4e71) // NOP
+      break;
+    if ((op & 0xf1c0) == 0x41c0) { // LEA
+      u32 pc = TR_PC(hpc);
+      switch (mode) {
+      case 2:
+        emith_ctx_read(xAX, DREG_OFS(8 + reg));
+        break;
+      case 5:
+        emith_ctx_read(xAX, DREG_OFS(8 + reg));
+        emith_add_r_imm(xAX, (u32)(s16)hpc[1]);
+        break;
+      case 7:
+        if (reg == 0)
+          emith_move_r_imm(xAX, (u32)(s16)hpc[1]);
+        else if (reg == 1)
+          emith_move_r_imm(xAX, (hpc[1] << 16) | hpc[2]);
+        else if (reg == 2)
+          emith_move_r_imm(xAX, pc + 2 + (s16)hpc[1]);
+        else
+          return -1;
+        break;
+      default:
+        return -1;
+      }
+      emith_ctx_write(xAX, DREG_OFS(8 + reg9));
+      break;
+    }
+    if ((op & 0xfff8) == 0x4840) { // SWAP
+      emith_ctx_read(xAX, DREG_OFS(reg));
+      emith_rol(xAX, xAX, 16);
+      emith_ctx_write(xAX, DREG_OFS(reg));
+      emit_flags_nz(4, xAX);
+      emit_flags_cv_clear();
+      break;
+    }
+    if ((op & 0xffb8) == 0x4880) { // EXT.W, EXT.L
+      sz = (op & 0x40) ? 4 : 2;
+      emit_read_dn(xAX, reg, sz / 2, 1);
+      emit_write_dn(xAX, reg, sz);
+      emith_and_r_imm(xAX, sz == 4 ? 0xffffffff : 0xffff);
+      emit_flags_nz(sz, xAX);
+      emit_flags_cv_clear();
+      break;
+    }
+    if (((op & 0xff00) == 0x4200 || (op & 0xff00) == 0x4a00)
+        && sz <= 4 && mode == 0)
+    {
+      if (op & 0x0800) // TST
+        emit_read_dn(xAX, reg, sz, 0);
+      else {           // CLR
+        emith_eor_r_r(xAX, xAX);
+        emit_write_dn(xAX, reg, sz);
+      }
+      emit_flags_nz(sz, xAX);
+      emit_flags_cv_clear();
+      break;
+    }
+    return -1;
+
+  case 0x5:
+    if ((op & 0xf8) == 0xc8)
+      return emit_dbcc(ctx, hpc, len);
+    if (sz > 4 || mode > 1 || (mode == 1 && sz == 1))
+      return -1;
+    imm = reg9 ? reg9 : 8;
+    if (mode == 1) { // ADDQ/SUBQ #,An - whole register, no flags
+      emith_ctx_read(xAX, DREG_OFS(8 + reg));
+      if (op & 0x100)
+        emith_sub_r_imm(xAX, imm);
+      else
+        emith_add_r_imm(xAX, imm);
+      emith_ctx_write(xAX, DREG_OFS(8 + reg));
+      break;
+    }
+    emit_alu((op & 0x100) ? ALU_SUB : ALU_ADD, sz, reg, -1, imm, 1);
+    break;
+
+  case 0x6:
+    return emit_bcc(ctx, hpc, len);
+
+  case 0x7: // MOVEQ
+    if (op & 0x100)
+      return -1;
+    emith_move_r_imm(xAX, (u32)(s8)op);
+    emith_ctx_write(xAX, DREG_OFS(reg9));
+    emith_ctx_write(xAX, CTX_OFS(flag_NotZ));
+    emith_ctx_write(xAX, CTX_OFS(flag_N));
+    emit_flags_cv_clear();
+    break;
+
+  case 0x8: case 0x9: case 0xb: case 0xc: case 0xd:
+    switch (op >> 12) {
+    case 0x8: alu = ALU_OR; break;
+    case 0x9: alu = ALU_SUB; break;
+    case 0xb: alu = opm >= 4 && opm <= 6 ? ALU_EOR : ALU_CMP; break;
+    case 0xc: alu = ALU_AND; break;
+    default:  alu = ALU_ADD; break;
+    }
+    if (opm == 3 || opm == 7) { // ADDA/SUBA/CMPA
+      if (alu == ALU_OR || alu == ALU_AND)
+        return -1;
+      sz = opm == 3 ? 2 : 4;
+      sreg = tr_src(hpc, sz, &ok, &imm);
+      if (!ok)
+        return -1;
+      emit_alu_an(alu, sz, 8 + reg9, sreg, imm);
+      break;
+    }
+    if (alu == ALU_EOR) { // EOR Dn,Dn
+      if (mode != 0)
+        return -1;
+      emit_alu(alu, 1 << (opm - 4), reg, reg9, 0, 0);
+      break;
+    }
+    if (opm > 2)
+      return -1;
+    sreg = tr_src(hpc, sz, &ok, &imm);
+    if (!ok || (sreg >= 8 && (alu == ALU_OR || alu == ALU_AND)))
+      return -1;
+    emit_alu(alu, sz, reg9, sreg, imm, alu == ALU_ADD || alu == ALU_SUB);
+    break;
+
+  case 0xe: // LSL, LSR, ASR #,Dn
+    if ((op & 0xc0) == 0xc0 || (op & 0x20))
+      return -1;
+    if ((op & 0x18) == 0x08) {
+      if (op & 0x100) {
+        emith_ctx_read(xAX, DREG_OFS(reg));
+        if (sz < 4)
+          emith_lsl(xAX, xAX, 32 - sz * 8);
+        emith_lsl(xAX, xAX, reg9 ? reg9 : 8);
+        emith_set_cond(DCOND_LO, xDX);
+        if (sz < 4)
+          emith_lsr(xAX, xAX, 32 - sz * 8);
+      }
+      else {
+        emit_read_dn(xAX, reg, sz, 0);
+        emith_lsr(xAX, xAX, reg9 ? reg9 : 8);
+        emith_set_cond(DCOND_LO, xDX);
+      }
+    }
+    else if ((op & 0x118) == 0x000) {
+      emit_read_dn(xAX, reg, sz, 1);
+      emith_asr(xAX, xAX, reg9 ? reg9 : 8);
+      emith_set_cond(DCOND_LO, xDX);
+      if (sz < 4)
+        emith_and_r_imm(xAX, (1u << sz * 8) - 1);
+    }
+    else
+      return -1;
+    emit_write_dn(xAX, reg, sz);
+    emit_flags_nz(sz, xAX);
+    emith_eor_r_r(xCX, xCX); // V
+    emit_flags_cv(1);
+    break;
+
+  default:
+    return -1;
+  }
+
+  emit_cycles(dr_op_cycles(hpc), hpc + len);
+  return 0;
+}
+
+static u8 *tr_exit_stub(u16 *hpc, u8 **stub_ptrs, u16 **stub_hpcs, int *stub_count)
+{
+  int i;
+
+  for (i = 0; i < *stub_count; i++)
+    if (stub_hpcs[i] == hpc)
+      return stub_ptrs[i];
+
+  stub_hpcs[i] = hpc;
+  stub_ptrs[i] = tcache_ptr;
+  (*stub_count)++;
+  emith_move_r_ptr_imm(xAX, hpc);
+  emith_jump(m68k_drc_exit_pc);
+  return stub_ptrs[i];
+}
+
+static struct block_desc *dr_translate(M68K_CONTEXT *ctx, u32 base_pc, u16 *base_hpc)
+{
+  static PICO_TLS u8 *stub_ptrs[MAX_EXITS * 2];
+  static PICO_TLS u16 *stub_hpcs[MAX_EXITS * 2];
+  int stub_count = 0;
+  struct block_desc *bd;
+  u16 *hpc, *hpc_end;
+  u8 *block_start;
+  int i, n, ret = 0;
+
+  hpc_end = dr_code_end(base_hpc);
+  if (hpc_end == NULL || base_hpc + op_len(base_hpc) > hpc_end)
+    return NULL;
+
+  if (tcache_ptr + MAX_BLOCK_SIZE > tcache_m68k + TCACHE_SIZE
+      || block_count >= BLOCK_MAX_COUNT
+      || link_count + MAX_EXITS > LINK_MAX_COUNT
+      || ram_entry_count + 0x10 > RAM_ENTRY_MAX_COUNT)
+    dr_flush();
+
+  tr_base_pc = base_pc;
+  tr_base_hpc = base_hpc;
+  tr_exit_count = tr_link_count = 0;
+  block_start = tcache_ptr;
+
+  for (i = 0, hpc = base_hpc; i < M68K_BLOCK_INSN_LIMIT; i++) {
+    int len = op_len(hpc);
+    if (hpc + len > hpc_end || tr_exit_count + 4 > MAX_EXITS)
+      break;
+
+    tr_insn_hpc[i] = hpc;
+    tr_insn_ptr[i] = tcache_ptr;
+    if (is_idle_op(hpc[0]))
+      ret = emit_dynamic(hpc, len);
+    else {
+      ret = emit_native(ctx, hpc, len);
+#if DRC_DEBUG
+      if (ret >= 0)
+        insns_native++;
+#endif
+      if (ret < 0)
+        ret = emit_fallback(ctx, hpc, len);
+    }
+#if DRC_DEBUG
+    insns_compiled++;
+#endif
+    hpc += len;
+    if (ret)
+      break;
+  }
+  n = ret ? i + 1 : i;
+  if (!ret) // ran out of insns or memory, continue in the next block
+    tr_link_jmp(TR_PC(hpc), hpc, 0);
+
+  // local branches go straight to the insn
+  for (i = 0; i < tr_link_count; i++) {
+    u16 *t = tr_links[i].target_hpc;
+    int j;
+    if (TR_PC(t) != tr_links[i].target_pc || t < base_hpc || t >= hpc)
+      continue;
+    for (j = 0; j < n; j++)
+      if (tr_insn_hpc[j] == t)
+        break;
+    if (j < n) {
+      emith_jump_patch(tr_links[i].jump, tr_insn_ptr[j]);
+      tr_links[i].jump = NULL;
+    }
+  }
+
+  for (i = 0; i < tr_exit_count; i++)
+    emith_jump_patch(tr_exits[i].jump,
+      tr_exit_stub(tr_exits[i].hpc, stub_ptrs, stub_hpcs, &stub_count));
+  for (i = 0; i < tr_link_count; i++)
+    if (tr_links[i].jump != NULL && !tr_links[i].pc_set)
+      tr_exit_stub(tr_links[i].target_hpc, stub_ptrs, stub_hpcs, &stub_count);
+  assert(tcache_ptr <= block_start + MAX_BLOCK_SIZE);
+
+  bd = &block_table[block_count++];
+  bd->pc = base_pc;
+  bd->hpc = base_hpc;
+  bd->hpc_end = hpc;
+  bd->tcache_ptr = block_start;
+  bd->entries = NULL;
+  bd->active = 1;
+  bd->next = HASH_FUNC(block_hash, base_pc, BLOCK_HASH_SIZE - 1);
+  HASH_FUNC(block_hash, base_pc, BLOCK_HASH_SIZE - 1) = bd;
+  dr_resolve_links(bd);
+
+  for (i = 0; i < tr_link_count; i++) {
+    if (tr_links[i].jump == NULL)
+      continue;
+    dr_add_link(tr_links[i].target_pc, tr_links[i].target_hpc, tr_links[i].jump,
+      tr_links[i].pc_set ? m68k_drc_exit :
+        tr_exit_stub(tr_links[i].target_hpc, stub_ptrs, stub_hpcs, &stub_count));
+  }
+
+  if (dr_is_ram(base_hpc))
+    dr_add_ram_block(bd);
+
+  dbg(2, "block #%d %06x-%06x, %d insns, %d bytes", block_count - 1,
+    base_pc, TR_PC(hpc), n, (int)(tcache_ptr - block_start));
+  return bd;
+}
+
+// ---------------------------------------------------------------
+// runtime
+
+// FAME's main loop calls here with ctx->PC at the next op
+static void drc_exec(M68K_CONTEXT *ctx)
+{
+  struct block_desc *bd;
+  u32 pc;
+
+  do {
+    pc = (u32)((uptr)ctx->PC - ctx->BasePC);
+    bd = dr_find_block(pc, ctx->PC);
+    if (bd == NULL)
+      bd = dr_translate(ctx, pc, ctx->PC);
+    if (bd != NULL) {
+      ctx->drc_exit = 0;
+      m68k_drc_entry(ctx, bd->tcache_ptr);
+    }
+    else {
+      // not translatable, interpret an insn
+      ctx->Opcode = *ctx->PC++;
+      JumpTable[ctx->Opcode](ctx);
+    }
+  } while (ctx->io_cycle_counter > 0);
+}
+
+static PICO_TLS void (*drc_write_byte)(unsigned int a, unsigned char d);
+static PICO_TLS void (*drc_write_word)(unsigned int a, unsigned short d);
+static PICO_TLS void (*drc_write_long)(unsigned int a, unsigned int d);
+
+#define RAM_WCHECK(a) \
+  if (((a) & 0xe00000) == 0xe00000 && ram_marks[((a) & 0xffff) >> 1]) \
+    dr_ram_inval((a) & 0xfffe)
+
+static void dr_write_byte(unsigned int a, unsigned char d)
+{
+  drc_write_byte(a, d);
+  RAM_WCHECK(a);
+}
+
+static void dr_write_word(unsigned int a, unsigned short d)
+{
+  drc_write_word(a, d);
+  RAM_WCHECK(a);
+}
+
+static void dr_write_long(unsigned int a, unsigned int d)
+{
+  drc_write_long(a, d);
+  RAM_WCHECK(a);
+  RAM_WCHECK(a + 2);
+}
+
+void fm68k_drc_wcheck_ram(unsigned int a)
+{
+  if (ram_marks != NULL)
+    RAM_WCHECK(a);
+}
+
+void fm68k_drc_fetch_changed(int bank)
+{
+  if (tcache_m68k != NULL && fetch_used[bank & 0xff])
+    dr_flush();
+}
+
+void fm68k_drc_flush(void)
+{
+  if (tcache_m68k != NULL)
+    dr_flush();
+}
+
+static int dr_startup(void)
+{
+  int arg0, arg1;
+
+#ifndef PICO_THREAD_SAFE
+  tcache_m68k = tcache_default;
+#else
+  tcache_m68k = plat_mmap(0, TCACHE_SIZE, 1, 0);
+  if (tcache_m68k == NULL)
+    return -1;
+#endif
+  plat_mem_set_exec(tcache_m68k, TCACHE_SIZE);
+
+  block_table = calloc(BLOCK_MAX_COUNT, sizeof(block_table[0]));
+  block_hash = calloc(BLOCK_HASH_SIZE, sizeof(block_hash[0]));
+  link_table = calloc(LINK_MAX_COUNT, sizeof(link_table[0]));
+  unresolved_links = calloc(ULINK_HASH_SIZE, sizeof(unresolved_links[0]));
+  ram_entries = calloc(RAM_ENTRY_MAX_COUNT, sizeof(ram_entries[0]));
+  ram_marks = calloc(sizeof(PicoMem.ram) / 2, sizeof(ram_marks[0]));
+  if (block_table == NULL || block_hash == NULL || link_table == NULL
+      || unresolved_links == NULL || ram_entries == NULL || ram_marks == NULL)
+    goto fail;
+
+  tcache_ptr = tcache_m68k;
+
+  // m68k_drc_entry(M68K_CONTEXT *ctx, const void *block)
+  m68k_drc_entry = (void *)tcache_ptr;
+  emith_sh2_drc_entry();
+  host_arg2reg(arg0, 0);
+  host_arg2reg(arg1, 1);
+  emith_move_r_r_ptr(CONTEXT_REG, arg0);
+  emith_jump_reg(arg1);
+
+  // exits, ctx->PC in xAX or already stored
+  m68k_drc_exit_pc = tcache_ptr;
+  emith_ctx_write_ptr(xAX, CTX_OFS(PC));
+  m68k_drc_exit = tcache_ptr;
+  emith_sh2_drc_exit();
+
+  tcache_blocks = tcache_ptr;
+  dr_flush();
+
+  elprintf(EL_STATUS, "m68k drc: %p, %d bytes", tcache_m68k, TCACHE_SIZE);
+  return 0;
+
+fail:
+  fm68k_drc_finish();
+  return -1;
+}
+
+int fm68k_drc_init(void)
+{
+  // the handler table, so that idle detection can patch it
+  fm68k_drc_fame_init();
+  return 0;
+}
+
+void fm68k_drc_finish(void)
+{
+#if DRC_DEBUG
+  dbg(1, "m68k drc: %d insns, %d native, %d host ops",
+    insns_compiled, insns_native, host_insn_count);
+#endif
+#ifdef PICO_THREAD_SAFE
+  if (tcache_m68k != NULL)
+    plat_munmap(tcache_m68k, TCACHE_SIZE);
+#endif
+  tcache_m68k = NULL;
+
+  free(block_table);
+  block_table = NULL;
+  free(block_hash);
+  block_hash = NULL;
+  free(link_table);
+  link_table = NULL;
+  free(unresolved_links);
+  unresolved_links = NULL;
+  free(ram_entries);
+  ram_entries = NULL;
+  free(ram_marks);
+  ram_marks = NULL;
+  memset(ram_blocks, 0, sizeof(ram_blocks));
+  block_count = link_count = ram_entry_count = 0;
+}
+
+int fm68k_drc_emulate(M68K_CONTEXT *ctx, int cycles)
+{
+  int ret;
+
+  if (tcache_m68k == NULL && dr_startup() != 0)
+    return fm68k_emulate(ctx, cycles, fm68k_reason_emulate);
+
+  // watch writes for code in RAM
+  drc_write_byte = ctx->write_byte;
+  drc_write_word = ctx->write_word;
+  drc_write_long = ctx->write_long;
+  ctx->write_byte = dr_write_byte;
+  ctx->write_word = dr_write_word;
+  ctx->write_long = dr_write_long;
+  drc_ctx = ctx;
+
+  ret = fm68k_drc_fame_emulate(ctx, cycles, fm68k_reason_emulate);
+
+  drc_ctx = NULL;
+  ctx->write_byte = drc_write_byte;
+  ctx->write_word = drc_write_word;
+  ctx->write_long = drc_write_long;
+  return ret;
+}
+
+// vim:shiftwidth=2:ts=2:expandtab
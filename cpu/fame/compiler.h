@@ -0,0 +1,20 @@
+#ifdef DRC_M68K
+int  fm68k_drc_init(void);
+void fm68k_drc_finish(void);
+int  fm68k_drc_emulate(M68K_CONTEXT *ctx, int cycles);
+void fm68k_drc_flush(void);
+void fm68k_drc_wcheck_ram(unsigned int a);
+void fm68k_drc_fetch_changed(int bank);
+int  fm68k_drc_idle_install(void);
+int  fm68k_drc_idle_remove(void);
+#else
+#define fm68k_drc_init() 0
+#define fm68k_drc_finish()
+#define fm68k_drc_flush()
+#define fm68k_drc_wcheck_ram(a)
+#define fm68k_drc_fetch_changed(bank)
+#define fm68k_drc_idle_install() 0
+#define fm68k_drc_idle_remove() 0
+#endif
+
+#define M68K_BLOCK_INSN_LIMIT 128
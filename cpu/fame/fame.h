@@ -144,7 +144,8 @@ typedef struct
 	unsigned int   flag_I;
 
 	unsigned char  not_polling;
-	unsigned char  pad[3];
+	unsigned char  drc_exit;
+	unsigned char  pad[2];
 
 	uintptr_t      Fetch[M68K_FETCHBANK1];
 } M68K_CONTEXT;
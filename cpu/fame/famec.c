@@ -16,6 +16,7 @@
 #endif
 
 #include "fame.h"
+#include "../../pico/pico_port.h" // PICO_TLS
 
 
 // Options //
@@ -287,11 +288,16 @@ typedef signed int	s32;
 
 #else
 
+#ifdef FAMEC_EXEC
+#define NEXT \
+    FAMEC_EXEC(ctx);
+#else
 #define NEXT \
     do { \
         FETCH_WORD(Opcode); \
         JumpTable[Opcode](ctx); \
     } while (ctx->io_cycle_counter > 0);
+#endif
 
 #define RET(A) \
     ctx->io_cycle_counter -= (A);  \
@@ -548,16 +554,16 @@ typedef signed int	s32;
 // global variable
 ///////////////////
 
-static u32 initialised = 0;
+static PICO_TLS u32 initialised = 0;
 
 #ifdef PICODRIVE_HACK
-extern M68K_CONTEXT PicoCpuFS68k;
+extern PICO_TLS M68K_CONTEXT PicoCpuFS68k;
 #endif
 
 /* Custom function handler */
 typedef void (*opcode_func)(M68K_CONTEXT *ctx);
 
-static opcode_func JumpTable[0x10000];
+static PICO_TLS opcode_func JumpTable[0x10000];
 
 // exception cycle table (taken from musashi core)
 static const s32 exception_cycle_table[256] =
@@ -6,17 +6,23 @@
  * See COPYING file in the top-level directory.
  *
  * notes:
- * - tcache, block descriptor, link buffer overflows result in sh2_translate()
- *   failure, followed by full tcache invalidation for that region
+ * - tcaches are used as ring buffers, tcache, block descriptor and link
+ *   buffer overflows evict the oldest blocks; full tcache invalidation
+ *   only happens if sh2_translate() still fails
  * - jumps between blocks are tracked for SMC handling (in block_entry->links),
- *   except jumps between different tcaches
+ *   also between tcaches, except from the shared ROM/SDRAM tcache into
+ *   the per-cpu BIOS/data array ones
  *
  * implemented:
  * - static register allocation
  * - remaining register caching and tracking in temporaries
  * - block-local branch linking
- * - block linking (except between tcaches)
- * - some constant propagation
+ * - block linking
+ * - some constant propagation, including loads from cart ROM
+ * - per-block liveness, used to skip dead T updates and guide rcache eviction
+ * - inline SDRAM, ROM and data array access, with SMC checks on writes
+ * - translated blocks can be kept in a file between sessions,
+ *   see sh2_drc_cache_load()
  *
  * TODO:
  * - better constant propagation
@@ -27,6 +33,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <zlib.h>
 
 #include "../../pico/pico_int.h"
 #include "../../pico/arm_features.h"
@@ -38,9 +45,14 @@
 // features
 #define PROPAGATE_CONSTANTS     1
 #define LINK_BRANCHES           1
+#ifndef PDB_NET // io checksums are done in the handler wrappers
+#define FAST_MEMORY_ACCESS      1
+#else
+#define FAST_MEMORY_ACCESS      0
+#endif
 
 // limits (per block)
-#define MAX_BLOCK_SIZE          (BLOCK_INSN_LIMIT * 6 * 6)
+#define MAX_BLOCK_SIZE          (BLOCK_INSN_LIMIT * 6 * 6 * 6) // inline mem access
 
 // max literal offset from the block end
 #define MAX_LITERAL_OFFSET      32*2
@@ -73,6 +85,14 @@ static int insns_compiled, hash_collisions, host_insn_count;
 #define dbg(...)
 #endif
 
+// blocks are only relocatable if all their calls out of tcache are
+// emitted by emit_xref(), debug code calls C functions directly
+#if !DRC_DEBUG && !defined(PDB) && !defined(DRC_CMP)
+#define DRC_CACHE 1
+#else
+#define DRC_CACHE 0
+#endif
+
 ///
 #define FETCH_OP(pc) \
   dr_pc_base[(pc) / 2]
@@ -101,7 +121,7 @@ static int insns_compiled, hash_collisions, host_insn_count;
 
 #define SHR_T SHR_SR // might make them separate someday
 
-static struct op_data {
+static PICO_TLS struct op_data {
   u8 op;
   u8 cycles;
   u8 size;     // 0, 1, 2 - byte, word, long
@@ -110,6 +130,7 @@ static struct op_data {
   u32 dest;    // bitmask of dest regs
   u32 imm;     // immediate/io address/branch target
                // (for literal - address, not value)
+  u32 live;    // regs possibly read after this op, see dr_scan_live()
 } ops[BLOCK_INSN_LIMIT];
 
 enum op_types {
@@ -129,7 +150,7 @@ enum op_types {
 
 #ifdef DRC_SH2
 
-static int literal_disabled_frames;
+static PICO_TLS int literal_disabled_frames;
 
 #if (DRC_DEBUG & 4)
 static u8 *tcache_dsm_ptrs[3];
@@ -160,24 +181,28 @@ static void REGPARM(3) *sh2_drc_log_entry(void *block, SH2 *sh2, u32 sr)
 // BIOS shares tcache with data array because it's only used for init
 // and can be discarded early
 // XXX: need to tune sizes
-static const int tcache_sizes[TCACHE_BUFFERS] = {
+// the first one also gives up space for the utils, see sh2_drc_init()
+static int tcache_sizes[TCACHE_BUFFERS] = {
   DRC_TCACHE_SIZE * 6 / 8, // ROM (rarely used), DRAM
   DRC_TCACHE_SIZE / 8, // BIOS, data array in master sh2
   DRC_TCACHE_SIZE / 8, // ... slave
 };
 
-static u8 *tcache_bases[TCACHE_BUFFERS];
-static u8 *tcache_ptrs[TCACHE_BUFFERS];
+static PICO_TLS u8 *tcache_bases[TCACHE_BUFFERS];
+static PICO_TLS u8 *tcache_ptrs[TCACHE_BUFFERS];
 
 // ptr for code emiters
-static u8 *tcache_ptr;
+static PICO_TLS u8 *tcache_ptr;
 
 #define MAX_BLOCK_ENTRIES (BLOCK_INSN_LIMIT / 8)
 
 struct block_link {
   u32 target_pc;
   void *jump;                // insn address
-  struct block_link *next;   // either in block_entry->links or 
+  struct block_link *next;   // either in block_entry->links or unresolved
+  struct block_link *prev;
+  struct block_link **head;  // list the link is on, NULL if free
+  struct block_link *exit_next; // next link out of the same block
 };
 
 struct block_entry {
@@ -198,26 +223,96 @@ struct block_desc {
   int refcount;
 #endif
   int entry_count;
-  struct block_entry entryp[MAX_BLOCK_ENTRIES];
+  struct block_link *exits;  // links from this block to others
+  struct block_entry entryp[MAX_BLOCK_ENTRIES]; // [0] starts the code
 };
 
+// block tables are rings in tcache order, oldest block is at block_firsts
+// (default sizes are 4*1024, 256, 256)
 static const int block_max_counts[TCACHE_BUFFERS] = {
-  4*1024,
-  256,
-  256,
+  DRC_TCACHE_SIZE / 512,
+  DRC_TCACHE_SIZE / 8192,
+  DRC_TCACHE_SIZE / 8192,
 };
-static struct block_desc *block_tables[TCACHE_BUFFERS];
-static int block_counts[TCACHE_BUFFERS];
+static PICO_TLS struct block_desc *block_tables[TCACHE_BUFFERS];
+static PICO_TLS int block_firsts[TCACHE_BUFFERS];
+static PICO_TLS int block_counts[TCACHE_BUFFERS];
 
-// we have block_link_pool to avoid using mallocs
+// we have block_link_pool to avoid using mallocs,
+// links are owned by the tcache of the block they jump from
 static const int block_link_pool_max_counts[TCACHE_BUFFERS] = {
-  4*1024,
-  256,
-  256,
+  DRC_TCACHE_SIZE / 256,
+  DRC_TCACHE_SIZE / 4096,
+  DRC_TCACHE_SIZE / 4096,
+};
+static PICO_TLS struct block_link *block_link_pool[TCACHE_BUFFERS]; 
+static PICO_TLS struct block_link *block_link_free[TCACHE_BUFFERS];
+// links to pcs of each tcache that have no block entry yet
+static PICO_TLS struct block_link *unresolved_links[TCACHE_BUFFERS];
+
+// references from a block to code outside of it, which have to be
+// redone when the block is loaded from the code cache to another place
+enum {
+  XREF_CALL,       // emith_call(), arg is XT_*
+  XREF_JUMP,       // emith_jump(), arg is XT_*
+  XREF_JUMP_COND,  // emith_jump_cond(), arg is XT_* | cond << 8
+  XREF_EXIT,       // patchable block exit, arg is the target pc
 };
-static struct block_link *block_link_pool[TCACHE_BUFFERS]; 
-static int block_link_pool_counts[TCACHE_BUFFERS];
-static struct block_link *unresolved_links[TCACHE_BUFFERS];
+
+enum {
+  XT_READ8, XT_READ16, XT_READ32,
+  XT_WRITE8, XT_WRITE16, XT_WRITE32,
+  XT_DISPATCHER, XT_EXIT, XT_TEST_IRQ,
+};
+
+#if DRC_CACHE
+struct block_xref {
+  u16 offs;                  // from block start
+  u8 type;                   // XREF_*
+  u8 size;                   // of the emitted code, exits are always patched
+  u32 arg;
+};
+
+// everything needed to recreate a block without translating it,
+// followed by xrefs, literal addresses and (in the cache file) code
+struct block_save {
+  u32 addr;
+  u16 size;
+  u16 size_nolit;
+  u32 crc;                   // of SH2 code and literals at translation
+  u8 tcache_id;
+  u8 entry_count;
+  u16 xref_count;
+  u16 literal_count;
+  u16 code_size;
+  u32 entry_pc[MAX_BLOCK_ENTRIES];
+  u16 entry_offs[MAX_BLOCK_ENTRIES];
+  struct block_save *next;   // in cache_store, not meaningful in the file
+};
+
+#define BS_XREFS(bs)    ((struct block_xref *)((bs) + 1))
+#define BS_LITERALS(bs) ((u32 *)(BS_XREFS(bs) + (bs)->xref_count))
+#define BS_CODE(bs)     ((u8 *)(BS_LITERALS(bs) + (bs)->literal_count))
+
+// save data for translated blocks, indexed like block_tables
+static PICO_TLS struct block_save **block_saves[TCACHE_BUFFERS];
+
+// xrefs of the block being translated, recorded if block_xref_base is set
+static PICO_TLS struct block_xref block_xrefs[BLOCK_INSN_LIMIT * 2];
+static PICO_TLS int block_xref_count;
+static PICO_TLS u8 *block_xref_base;
+
+// blocks loaded from the cache file, waiting to be used
+#define CACHE_STORE_HASH_SIZE 0x1000
+static PICO_TLS struct block_save **cache_store;
+static PICO_TLS int cache_enabled;
+static PICO_TLS u32 cache_rom_crc;
+#endif
+
+#if (DRC_DEBUG & 2)
+static int tcache_flushes[TCACHE_BUFFERS];
+static int blocks_evicted[TCACHE_BUFFERS];
+#endif
 
 // used for invalidation
 static const int ram_sizes[TCACHE_BUFFERS] = {
@@ -234,14 +329,14 @@ struct block_list {
 
 // array of pointers to block_lists for RAM and 2 data arrays
 // each array has len: sizeof(mem) / INVAL_PAGE_SIZE 
-static struct block_list **inval_lookup[TCACHE_BUFFERS];
+static PICO_TLS struct block_list **inval_lookup[TCACHE_BUFFERS];
 
 static const int hash_table_sizes[TCACHE_BUFFERS] = {
   0x1000,
   0x100,
   0x100,
 };
-static struct block_entry **hash_tables[TCACHE_BUFFERS];
+static PICO_TLS struct block_entry **hash_tables[TCACHE_BUFFERS];
 
 #define HASH_FUNC(hash_tab, addr, mask) \
   (hash_tab)[(((addr) >> 20) ^ ((addr) >> 2)) & (mask)]
@@ -297,7 +392,7 @@ static const int reg_map_g2h[] = {
 
 #endif
 
-static temp_reg_t reg_temp[] = {
+static PICO_TLS temp_reg_t reg_temp[] = {
   {  0, },
   {  1, },
   { 12, },
@@ -319,7 +414,7 @@ static const int reg_map_g2h[] = {
 };
 
 // ax, cx, dx are usually temporaries by convention
-static temp_reg_t reg_temp[] = {
+static PICO_TLS temp_reg_t reg_temp[] = {
   { xAX, },
   { xBX, },
   { xCX, },
@@ -329,26 +424,27 @@ static temp_reg_t reg_temp[] = {
 #elif defined(__x86_64__)
 #include "../drc/emit_x86.c"
 
+// r12-r15 are callee saved, saved/restored by emith_sh2_drc_entry/exit
 static const int reg_map_g2h[] = {
 #ifndef _WIN32
+  12, 13, 14, -1,
   -1, -1, -1, -1,
   -1, -1, -1, -1,
-  -1, -1, -1, -1,
-  -1, -1, -1, -1,  // r12 .. sp
+  -1, -1, -1, 15,  // r12 .. sp
   -1, -1, -1, xBX, // SHR_PC,  SHR_PPC, SHR_PR,   SHR_SR,
   -1, -1, -1, -1,  // SHR_GBR, SHR_VBR, SHR_MACH, SHR_MACL,
 #else
-  xDI,-1, -1, -1,
+  xDI,12, 13, 14,
   -1, -1, -1, -1,
   -1, -1, -1, -1,
-  -1, -1, -1, -1,  // r12 .. sp
+  -1, -1, -1, 15,  // r12 .. sp
   -1, -1, -1, xBX, // SHR_PC,  SHR_PPC, SHR_PR,   SHR_SR,
   -1, -1, -1, -1,  // SHR_GBR, SHR_VBR, SHR_MACH, SHR_MACL,
 #endif
 };
 
 // ax, cx, dx are usually temporaries by convention
-static temp_reg_t reg_temp[] = {
+static PICO_TLS temp_reg_t reg_temp[] = {
   { xAX, },
   { xCX, },
   { xDX, },
@@ -358,6 +454,39 @@ static temp_reg_t reg_temp[] = {
 #endif
 };
 
+#elif defined(__aarch64__)
+#include "../drc/emit_arm64.c"
+
+// x19 is context, x20-x28 are callee saved and stay mapped for the whole run
+static const int reg_map_g2h[] = {
+  20, 21, 22, 23,
+  24, 25, 26, -1,
+  -1, -1, -1, -1,
+  -1, -1, -1, 27, // r12 .. sp
+  -1, -1, -1, 28, // SHR_PC,  SHR_PPC, SHR_PR,   SHR_SR,
+  -1, -1, -1, -1, // SHR_GBR, SHR_VBR, SHR_MACH, SHR_MACL,
+};
+
+// x0-x3 are args/return, x16/x17 are reserved for emitter
+static PICO_TLS temp_reg_t reg_temp[] = {
+  {  0, },
+  {  1, },
+  {  2, },
+  {  3, },
+  {  4, },
+  {  5, },
+  {  6, },
+  {  7, },
+  {  8, },
+  {  9, },
+  { 10, },
+  { 11, },
+  { 12, },
+  { 13, },
+  { 14, },
+  { 15, },
+};
+
 #else
 #error unsupported arch
 #endif
@@ -373,17 +502,79 @@ static temp_reg_t reg_temp[] = {
 #define Q_SHIFT 8
 #define M_SHIFT 9
 
-static void REGPARM(1) (*sh2_drc_entry)(SH2 *sh2);
-static void            (*sh2_drc_dispatcher)(void);
-static void            (*sh2_drc_exit)(void);
-static void            (*sh2_drc_test_irq)(void);
+static PICO_TLS void REGPARM(1) (*sh2_drc_entry)(SH2 *sh2);
+static PICO_TLS void            (*sh2_drc_dispatcher)(void);
+static PICO_TLS void            (*sh2_drc_exit)(void);
+static PICO_TLS void            (*sh2_drc_test_irq)(void);
+
+static PICO_TLS u32  REGPARM(2) (*sh2_drc_read8)(u32 a, SH2 *sh2);
+static PICO_TLS u32  REGPARM(2) (*sh2_drc_read16)(u32 a, SH2 *sh2);
+static PICO_TLS u32  REGPARM(2) (*sh2_drc_read32)(u32 a, SH2 *sh2);
+static PICO_TLS void REGPARM(2) (*sh2_drc_write8)(u32 a, u32 d);
+static PICO_TLS void REGPARM(2) (*sh2_drc_write16)(u32 a, u32 d);
+static PICO_TLS void REGPARM(3) (*sh2_drc_write32)(u32 a, u32 d, SH2 *sh2);
+
+#if DRC_CACHE
+static void dr_add_xref(u8 *ptr, int type, u32 arg, int size)
+{
+  struct block_xref *xr;
 
-static u32  REGPARM(2) (*sh2_drc_read8)(u32 a, SH2 *sh2);
-static u32  REGPARM(2) (*sh2_drc_read16)(u32 a, SH2 *sh2);
-static u32  REGPARM(2) (*sh2_drc_read32)(u32 a, SH2 *sh2);
-static void REGPARM(2) (*sh2_drc_write8)(u32 a, u32 d);
-static void REGPARM(2) (*sh2_drc_write16)(u32 a, u32 d);
-static void REGPARM(3) (*sh2_drc_write32)(u32 a, u32 d, SH2 *sh2);
+  if (block_xref_base == NULL)
+    return;
+  if (block_xref_count >= ARRAY_SIZE(block_xrefs)) {
+    dbg(1, "warning: block_xrefs overflow");
+    block_xref_base = NULL; // can't be cached
+    return;
+  }
+
+  xr = &block_xrefs[block_xref_count++];
+  xr->offs = ptr - block_xref_base;
+  xr->type = type;
+  xr->size = size;
+  xr->arg = arg;
+}
+#endif
+
+static void *dr_xref_target(int target)
+{
+  switch (target) {
+  case XT_READ8:      return (void *)sh2_drc_read8;
+  case XT_READ16:     return (void *)sh2_drc_read16;
+  case XT_READ32:     return (void *)sh2_drc_read32;
+  case XT_WRITE8:     return (void *)sh2_drc_write8;
+  case XT_WRITE16:    return (void *)sh2_drc_write16;
+  case XT_WRITE32:    return (void *)sh2_drc_write32;
+  case XT_DISPATCHER: return (void *)sh2_drc_dispatcher;
+  case XT_EXIT:       return (void *)sh2_drc_exit;
+  case XT_TEST_IRQ:   return (void *)sh2_drc_test_irq;
+  }
+  return NULL;
+}
+
+// call or jump to a handler or util, see XREF_*
+static void emit_xref(int type, u32 arg)
+{
+  void *target = dr_xref_target(arg & 0xff);
+  int cond = arg >> 8;
+#if DRC_CACHE
+  u8 *ptr = tcache_ptr;
+#endif
+
+  switch (type) {
+  case XREF_CALL:
+    emith_call(target);
+    break;
+  case XREF_JUMP:
+    emith_jump(target);
+    break;
+  case XREF_JUMP_COND:
+    emith_jump_cond(cond, target);
+    break;
+  }
+#if DRC_CACHE
+  dr_add_xref(ptr, type, arg, (u8 *)tcache_ptr - ptr);
+#endif
+}
 
 // address space stuff
 static int dr_ctx_get_mem_ptr(u32 a, u32 *mask)
@@ -415,6 +606,36 @@ static int dr_ctx_get_mem_ptr(u32 a, u32 *mask)
   return poffs;
 }
 
+#if PROPAGATE_CONSTANTS
+// cart ROM can't change (unless banked), so loads from it are done
+// at translation time
+static int dr_rom_read(u32 a, int size, u32 *val)
+{
+  u16 *rom = (u16 *)Pico.rom;
+  u32 w;
+
+  if ((a & 0xc6000000) != 0x02000000 || carthw_ssf2_active)
+    return 0;
+  a &= 0x3fffff;
+  if ((a & ((1 << size) - 1)) || a + (1 << size) > Pico.romsize)
+    return 0;
+
+  w = rom[a / 2];
+  switch (size) {
+  case 0:
+    *val = (u32)(signed char)((a & 1) ? w : w >> 8);
+    break;
+  case 1:
+    *val = (u32)(signed short)w;
+    break;
+  default:
+    *val = (w << 16) | rom[a / 2 + 1];
+    break;
+  }
+  return 1;
+}
+#endif
+
 static struct block_entry *dr_get_entry(u32 pc, int is_slave, int *tcache_id)
 {
   struct block_entry *be;
@@ -479,33 +700,25 @@ static void rm_block_list(struct block_list **blist)
   *blist = NULL;
 }
 
-static void REGPARM(1) flush_tcache(int tcid)
+static void add_to_link_list(struct block_link **head, struct block_link *bl)
 {
-  int i;
-
-  dbg(1, "tcache #%d flush! (%d/%d, bds %d/%d)", tcid,
-    tcache_ptrs[tcid] - tcache_bases[tcid], tcache_sizes[tcid],
-    block_counts[tcid], block_max_counts[tcid]);
-
-  block_counts[tcid] = 0;
-  block_link_pool_counts[tcid] = 0;
-  unresolved_links[tcid] = NULL;
-  memset(hash_tables[tcid], 0, sizeof(*hash_tables[0]) * hash_table_sizes[tcid]);
-  tcache_ptrs[tcid] = tcache_bases[tcid];
-  if (Pico32xMem != NULL) {
-    if (tcid == 0) // ROM, RAM
-      memset(Pico32xMem->drcblk_ram, 0,
-             sizeof(Pico32xMem->drcblk_ram));
-    else
-      memset(Pico32xMem->drcblk_da[tcid - 1], 0,
-             sizeof(Pico32xMem->drcblk_da[0]));
-  }
-#if (DRC_DEBUG & 4)
-  tcache_dsm_ptrs[tcid] = tcache_bases[tcid];
-#endif
+  bl->head = head;
+  bl->prev = NULL;
+  bl->next = *head;
+  if (*head != NULL)
+    (*head)->prev = bl;
+  *head = bl;
+}
 
-  for (i = 0; i < ram_sizes[tcid] / INVAL_PAGE_SIZE; i++)
-    rm_block_list(&inval_lookup[tcid][i]);
+static void rm_from_link_list(struct block_link *bl)
+{
+  if (bl->prev != NULL)
+    bl->prev->next = bl->next;
+  else
+    *bl->head = bl->next;
+  if (bl->next != NULL)
+    bl->next->prev = bl->prev;
+  bl->head = NULL;
 }
 
 static void add_to_hashlist(struct block_entry *be, int tcache_id)
@@ -543,25 +756,26 @@ static void rm_from_hashlist(struct block_entry *be, int tcache_id)
       prev->next = cur->next;
       return;
     }
+    prev = cur;
   }
 
 missing:
   dbg(1, "rm_from_hashlist: be %p %08x missing?", be, be->pc);
 }
 
+// incoming links go back to dispatcher until the pc gets a new entry
 static void unregister_links(struct block_entry *be, int tcache_id)
 {
-  struct block_link *bl_unresolved = unresolved_links[tcache_id];
   struct block_link *bl, *bl_next;
 
-  for (bl = be->links; bl != NULL; ) {
+  for (bl = be->links; bl != NULL; bl = bl_next) {
     bl_next = bl->next;
-    bl->next = bl_unresolved;
-    bl_unresolved = bl;
-    bl = bl_next;
+    emith_jump_patch(bl->jump, sh2_drc_dispatcher);
+    host_instructions_updated(bl->jump,
+      (u8 *)bl->jump + emith_jump_patch_size());
+    add_to_link_list(&unresolved_links[tcache_id], bl);
   }
   be->links = NULL;
-  unresolved_links[tcache_id] = bl_unresolved;
 }
 
 // unlike sh2_smc_rm_block, the block stays and can still be accessed
@@ -572,13 +786,146 @@ static void kill_block_entry(struct block_entry *be, int tcache_id)
   unregister_links(be, tcache_id);
 }
 
+static int is_inval_tracked(u32 addr)
+{
+  return (addr & 0xc7fc0000) == 0x06000000
+      || (addr & 0xfffff000) == 0xc0000000;
+}
+
+// release the oldest block in tcache, its tcache space can be reused after
+static int dr_free_oldest_block(int tcache_id)
+{
+  struct block_desc *bd;
+  struct block_link *bl, *bl_next;
+  u32 addr, end_addr, mask;
+  int i;
+
+  if (block_counts[tcache_id] == 0)
+    return 0;
+
+  bd = &block_tables[tcache_id][block_firsts[tcache_id]];
+  dbg(2, "  evicting block %08x, blkid %d,%d", bd->addr,
+    tcache_id, block_firsts[tcache_id]);
+
+  // blocks killed by SMC are already out of hash table and inval_lookup
+  if (bd->entry_count > 0) {
+    if (is_inval_tracked(bd->addr)) {
+      mask = tcache_id != 0 ? 0xfff : 0x3ffff;
+      addr = bd->addr & ~(INVAL_PAGE_SIZE - 1);
+      end_addr = bd->addr + bd->size;
+      for (; addr < end_addr; addr += INVAL_PAGE_SIZE) {
+        i = (addr & mask) / INVAL_PAGE_SIZE;
+        rm_from_block_list(&inval_lookup[tcache_id][i], bd);
+      }
+    }
+
+    for (i = 0; i < bd->entry_count; i++) {
+      rm_from_hashlist(&bd->entryp[i], tcache_id);
+      unregister_links(&bd->entryp[i], tcache_id);
+    }
+  }
+
+  // links out of the block, whichever tcache they point to
+  for (bl = bd->exits; bl != NULL; bl = bl_next) {
+    bl_next = bl->exit_next;
+    rm_from_link_list(bl);
+    bl->target_pc = 0;
+    bl->next = block_link_free[tcache_id];
+    block_link_free[tcache_id] = bl;
+  }
+
+  bd->exits = NULL;
+  bd->addr = bd->size = bd->size_nolit = 0;
+  bd->entry_count = 0;
+
+#if DRC_CACHE
+  free(block_saves[tcache_id][block_firsts[tcache_id]]);
+  block_saves[tcache_id][block_firsts[tcache_id]] = NULL;
+#endif
+
+  block_firsts[tcache_id] = (block_firsts[tcache_id] + 1)
+                            % block_max_counts[tcache_id];
+  block_counts[tcache_id]--;
+#if (DRC_DEBUG & 2)
+  blocks_evicted[tcache_id]++;
+#endif
+  return 1;
+}
+
+static void REGPARM(1) flush_tcache(int tcid)
+{
+  int i;
+
+  dbg(1, "tcache #%d flush! (%d/%d, bds %d/%d)", tcid,
+    tcache_ptrs[tcid] - tcache_bases[tcid], tcache_sizes[tcid],
+    block_counts[tcid], block_max_counts[tcid]);
+#if (DRC_DEBUG & 2)
+  tcache_flushes[tcid]++;
+#endif
+
+  // this also unlinks the other tcaches from this one,
+  // their links stay in unresolved_links
+  while (dr_free_oldest_block(tcid))
+    ;
+
+  block_firsts[tcid] = 0;
+  memset(hash_tables[tcid], 0, sizeof(*hash_tables[0]) * hash_table_sizes[tcid]);
+  tcache_ptrs[tcid] = tcache_bases[tcid];
+  if (Pico32xMem != NULL) {
+    if (tcid == 0) // ROM, RAM
+      memset(Pico32xMem->drcblk_ram, 0,
+             sizeof(Pico32xMem->drcblk_ram));
+    else
+      memset(Pico32xMem->drcblk_da[tcid - 1], 0,
+             sizeof(Pico32xMem->drcblk_da[0]));
+  }
+#if (DRC_DEBUG & 4)
+  tcache_dsm_ptrs[tcid] = tcache_bases[tcid];
+#endif
+
+  for (i = 0; i < ram_sizes[tcid] / INVAL_PAGE_SIZE; i++)
+    rm_block_list(&inval_lookup[tcid][i]);
+}
+
+// make room for a block of given size at tcache_ptrs[tcache_id],
+// blocks are evicted oldest first, wrapping around at the end of tcache
+static void dr_make_room(int tcache_id, int size)
+{
+  u8 *end = tcache_bases[tcache_id] + tcache_sizes[tcache_id];
+  u8 *ptr = tcache_ptrs[tcache_id];
+  struct block_desc *bd;
+  u8 *start;
+
+  if (ptr + size > end) {
+    // whatever is left past ptr is from the previous lap, so older
+    while (block_counts[tcache_id] > 0) {
+      bd = &block_tables[tcache_id][block_firsts[tcache_id]];
+      if ((u8 *)bd->entryp[0].tcache_ptr < ptr)
+        break;
+      dr_free_oldest_block(tcache_id);
+    }
+    ptr = tcache_ptrs[tcache_id] = tcache_bases[tcache_id];
+#if (DRC_DEBUG & 4)
+    tcache_dsm_ptrs[tcache_id] = ptr;
+#endif
+  }
+
+  while (block_counts[tcache_id] > 0) {
+    bd = &block_tables[tcache_id][block_firsts[tcache_id]];
+    start = bd->entryp[0].tcache_ptr;
+    if (start < ptr || start >= ptr + size)
+      break;
+    dr_free_oldest_block(tcache_id);
+  }
+}
+
 static struct block_desc *dr_add_block(u32 addr, u16 size_lit,
   u16 size_nolit, int is_slave, int *blk_id)
 {
   struct block_entry *be;
   struct block_desc *bd;
   int tcache_id;
-  int *bcount;
+  int slot;
 
   // do a lookup to get tcache_id and override check
   be = dr_get_entry(addr, is_slave, &tcache_id);
@@ -587,16 +934,18 @@ static struct block_desc *dr_add_block(u32 addr, u16 size_lit,
     kill_block_entry(be, tcache_id);
   }
 
-  bcount = &block_counts[tcache_id];
-  if (*bcount >= block_max_counts[tcache_id]) {
-    dbg(1, "bd overflow for tcache %d", tcache_id);
-    return NULL;
+  if (block_counts[tcache_id] >= block_max_counts[tcache_id]) {
+    dbg(2, "bd overflow for tcache %d", tcache_id);
+    dr_free_oldest_block(tcache_id);
   }
 
-  bd = &block_tables[tcache_id][*bcount];
+  slot = (block_firsts[tcache_id] + block_counts[tcache_id])
+         % block_max_counts[tcache_id];
+  bd = &block_tables[tcache_id][slot];
   bd->addr = addr;
   bd->size = size_lit;
   bd->size_nolit = size_nolit;
+  bd->exits = NULL;
 
   bd->entry_count = 1;
   bd->entryp[0].pc = addr;
@@ -608,8 +957,8 @@ static struct block_desc *dr_add_block(u32 addr, u16 size_lit,
 #endif
   add_to_hashlist(&bd->entryp[0], tcache_id);
 
-  *blk_id = *bcount;
-  (*bcount)++;
+  *blk_id = slot;
+  block_counts[tcache_id]++;
 
   return bd;
 }
@@ -636,43 +985,60 @@ static void *dr_failure(void)
   exit(1);
 }
 
-static void *dr_prepare_ext_branch(u32 pc, int is_slave, int tcache_id)
+static struct block_link *dr_alloc_link(int tcache_id)
+{
+  struct block_link *bl;
+
+  // the newest block is the one being compiled, keep it
+  while (block_link_free[tcache_id] == NULL) {
+    dbg(2, "bl overflow for tcache %d", tcache_id);
+    if (block_counts[tcache_id] <= 1)
+      return NULL;
+    dr_free_oldest_block(tcache_id);
+  }
+
+  bl = block_link_free[tcache_id];
+  block_link_free[tcache_id] = bl->next;
+  return bl;
+}
+
+static void *dr_prepare_ext_branch(struct block_desc *owner, u32 pc,
+  int is_slave, int tcache_id)
 {
 #if LINK_BRANCHES
-  struct block_link *bl = block_link_pool[tcache_id];
-  int cnt = block_link_pool_counts[tcache_id];
-  struct block_entry *be = NULL;
+  struct block_link *bl;
+  struct block_entry *be;
   int target_tcache_id;
-  int i;
+#endif
 
-  be = dr_get_entry(pc, is_slave, &target_tcache_id);
-  if (target_tcache_id != tcache_id)
+#if DRC_CACHE
+  dr_add_xref(tcache_ptr, XREF_EXIT, pc, 0);
+#endif
+#if LINK_BRANCHES
+  // ROM/SDRAM tcache is shared by both cpus,
+  // so it can't link into their own BIOS/data array tcaches
+  dr_get_entry(pc, is_slave, &target_tcache_id);
+  if (target_tcache_id != tcache_id && target_tcache_id != 0)
     return sh2_drc_dispatcher;
 
-  // if pool has been freed, reuse
-  for (i = cnt - 1; i >= 0; i--)
-    if (bl[i].target_pc != 0)
-      break;
-  cnt = i + 1;
-  if (cnt >= block_link_pool_max_counts[tcache_id]) {
-    dbg(1, "bl overflow for tcache %d", tcache_id);
+  // may evict blocks, so look up the target after it
+  bl = dr_alloc_link(tcache_id);
+  if (bl == NULL)
     return NULL;
-  }
-  bl += cnt;
-  block_link_pool_counts[tcache_id]++;
 
   bl->target_pc = pc;
   bl->jump = tcache_ptr;
+  bl->exit_next = owner->exits;
+  owner->exits = bl;
 
+  be = dr_get_entry(pc, is_slave, &target_tcache_id);
   if (be != NULL) {
     dbg(2, "- early link from %p to pc %08x", bl->jump, pc);
-    bl->next = be->links;
-    be->links = bl;
+    add_to_link_list(&be->links, bl);
     return be->tcache_ptr;
   }
   else {
-    bl->next = unresolved_links[tcache_id];
-    unresolved_links[tcache_id] = bl;
+    add_to_link_list(&unresolved_links[target_tcache_id], bl);
     return sh2_drc_dispatcher;
   }
 #else
@@ -683,30 +1049,20 @@ static void *dr_prepare_ext_branch(u32 pc, int is_slave, int tcache_id)
 static void dr_link_blocks(struct block_entry *be, int tcache_id)
 {
 #if LINK_BRANCHES
-  struct block_link *first = unresolved_links[tcache_id];
-  struct block_link *bl, *prev, *tmp;
+  struct block_link *bl, *bl_next;
   u32 pc = be->pc;
 
-  for (bl = prev = first; bl != NULL; ) {
+  for (bl = unresolved_links[tcache_id]; bl != NULL; bl = bl_next) {
+    bl_next = bl->next;
     if (bl->target_pc == pc) {
       dbg(2, "- link from %p to pc %08x", bl->jump, pc);
-      emith_jump_patch(bl->jump, tcache_ptr);
+      emith_jump_patch(bl->jump, be->tcache_ptr);
 
       // move bl from unresolved_links to block_entry
-      tmp = bl->next;
-      bl->next = be->links;
-      be->links = bl;
-
-      if (bl == first)
-        first = prev = bl = tmp;
-      else
-        prev->next = bl = tmp;
-      continue;
+      rm_from_link_list(bl);
+      add_to_link_list(&be->links, bl);
     }
-    prev = bl;
-    bl = bl->next;
   }
-  unresolved_links[tcache_id] = first;
 
   // could sync arm caches here, but that's unnecessary
 #endif
@@ -741,10 +1097,10 @@ typedef enum {
 static int rcache_get_reg_(sh2_reg_e r, rc_gr_mode mode, int do_locking);
 
 // guest regs with constants
-static u32 dr_gcregs[24];
+static PICO_TLS u32 dr_gcregs[24];
 // a mask of constant/dirty regs
-static u32 dr_gcregs_mask;
-static u32 dr_gcregs_dirty;
+static PICO_TLS u32 dr_gcregs_mask;
+static PICO_TLS u32 dr_gcregs_dirty;
 
 #if PROPAGATE_CONSTANTS
 static void gconst_new(sh2_reg_e r, u32 val)
@@ -823,18 +1179,23 @@ static void gconst_invalidate(void)
   dr_gcregs_mask = dr_gcregs_dirty = 0;
 }
 
-static u16 rcache_counter;
+static PICO_TLS u16 rcache_counter;
+static PICO_TLS u32 rcache_regs_live = ~0; // guest regs still used in block
 
 static temp_reg_t *rcache_evict(void)
 {
-  // evict reg with oldest stamp
+  // evict reg with oldest stamp, prefering ones not read anymore
   int i, oldest = -1;
-  u16 min_stamp = (u16)-1;
+  u32 min_stamp = (u32)-1, stamp;
 
   for (i = 0; i < ARRAY_SIZE(reg_temp); i++) {
-    if (reg_temp[i].type == HR_CACHED && !(reg_temp[i].flags & HRF_LOCKED) &&
-        reg_temp[i].stamp <= min_stamp) {
-      min_stamp = reg_temp[i].stamp;
+    if (reg_temp[i].type != HR_CACHED || (reg_temp[i].flags & HRF_LOCKED))
+      continue;
+    stamp = reg_temp[i].stamp;
+    if (rcache_regs_live & BITMASK1(reg_temp[i].greg))
+      stamp += 0x10000;
+    if (stamp <= min_stamp) {
+      min_stamp = stamp;
       oldest = i;
     }
   }
@@ -1183,78 +1544,171 @@ static void emit_or_t_if_eq(int srr)
   EMITH_SJMP_END(DCOND_NE);
 }
 
+// direct access to plain memory, bypassing the C handlers.
+// Regions are decoded like the sh2 memory map does (by a >> 25),
+// bit 29 selects the cache-through area, which maps the same memory.
+#define FASTMEM_SDRAM_MASK  0xde000000
+#define FASTMEM_SDRAM       0x06000000
+#define FASTMEM_ROM_MASK    0xde000000
+#define FASTMEM_ROM         0x02000000
+#define FASTMEM_DA_MASK     0xfe000000
+#define FASTMEM_DA          0xc0000000
+
+// if the address in arg0 is in the region, load the host pointer to
+// ctx->(poffs) into tmp, the offset into RET_REG and jump to the access
+// code. Returns the jump, to be patched by the caller
+static void *emit_fastmem_select(u32 rmask, u32 region, int poffs,
+  int msb, int tmp)
+{
+  void *jmp;
+  int arg0;
+  host_arg2reg(arg0, 0);
+
+  emith_and_r_r_imm(tmp, arg0, rmask);
+  emith_cmp_r_imm(tmp, region);
+  EMITH_JMP_START(DCOND_NE);
+  emith_ctx_read_ptr(tmp, poffs);
+  emith_clear_msb(RET_REG, arg0, msb);
+  jmp = tcache_ptr;
+  emith_jump_patchable(tcache_ptr);
+  EMITH_JMP_END(DCOND_NE);
+
+  return jmp;
+}
+
+// read from host memory set up by emit_fastmem_select, result in RET_REG
+static void emit_fastmem_read(int size, int tmp)
+{
+  if (size == 0)
+    emith_eor_r_imm(RET_REG, 1);
+  else // like the handlers, align 32bit accesses to 16bit only
+    emith_bic_r_imm(RET_REG, 1);
+  emith_add_r_r_ptr(tmp, RET_REG);
+  switch (size) {
+  case 0: // 8
+    emith_read8_r_r_offs(RET_REG, tmp, 0);
+    emith_clear_msb(RET_REG, RET_REG, 24);
+    break;
+  case 1: // 16
+    emith_read16_r_r_offs(RET_REG, tmp, 0);
+    emith_clear_msb(RET_REG, RET_REG, 16);
+    break;
+  case 2: // 32
+    emith_read_r_r_offs(RET_REG, tmp, 0);
+    emith_ror(RET_REG, RET_REG, 16);
+    break;
+  }
+}
+
+// same for writes of arg1 to the address in arg0. Only done if the SMC
+// marks at ctx->(pblk) for the written location are clear, else the
+// C handler must run to invalidate the blocks there.
+static void *emit_fastmem_write(int size, u32 rmask, u32 region,
+  int poffs, int pblk, int msb, int t1, int t2)
+{
+  void *jmp;
+  int arg0, arg1;
+  host_arg2reg(arg0, 0);
+  host_arg2reg(arg1, 1);
+
+  emith_and_r_r_imm(t1, arg0, rmask);
+  emith_cmp_r_imm(t1, region);
+  EMITH_JMP_START(DCOND_NE);
+  emith_clear_msb(t1, arg0, msb);
+  emith_bic_r_imm(t1, 1);
+  // one mark per 16bit word
+  emith_ctx_read_ptr(t2, pblk);
+  emith_add_r_r_ptr(t2, t1);
+  if (size == 2)
+    emith_read_r_r_offs(t2, t2, 0);
+  else {
+    emith_read16_r_r_offs(t2, t2, 0);
+    emith_clear_msb(t2, t2, 16);
+  }
+  emith_tst_r_r(t2, t2);
+  EMITH_JMP_START(DCOND_NE);
+  if (size == 0) {
+    emith_clear_msb(t1, arg0, msb);
+    emith_eor_r_imm(t1, 1);
+  }
+  emith_ctx_read_ptr(t2, poffs);
+  emith_add_r_r_ptr(t2, t1);
+  switch (size) {
+  case 0: // 8
+    // t1 is free now, it can be used for byte access on x86
+    emith_move_r_r(t1, arg1);
+    emith_write8_r_r_offs(t1, t2, 0);
+    break;
+  case 1: // 16
+    emith_write16_r_r_offs(arg1, t2, 0);
+    break;
+  case 2: // 32
+    emith_ror(arg1, arg1, 16);
+    emith_write_r_r_offs(arg1, t2, 0);
+    break;
+  }
+  jmp = tcache_ptr;
+  emith_jump_patchable(tcache_ptr);
+  EMITH_JMP_END(DCOND_NE);
+  EMITH_JMP_END(DCOND_NE);
+
+  return jmp;
+}
+
 // arguments must be ready
 // reg cache must be clean before call
 static int emit_memhandler_read_(int size, int ram_check)
 {
-  int arg1;
-#if 0
-  int arg0;
-  host_arg2reg(arg0, 0);
-#endif
+  void *jmp[3];
+  int arg1, i, n = 0;
 
   rcache_clean();
 
+  arg1 = rcache_get_tmp_arg(1);
+
+  // SDRAM, ROM and the data array are accessed inline, anything else
+  // (including unmapped areas) goes through the handlers
+  if (FAST_MEMORY_ACCESS && ram_check) {
+    jmp[n++] = emit_fastmem_select(FASTMEM_SDRAM_MASK, FASTMEM_SDRAM,
+      offsetof(SH2, p_sdram), 14, arg1);
+    if (!carthw_ssf2_active)
+      jmp[n++] = emit_fastmem_select(FASTMEM_ROM_MASK, FASTMEM_ROM,
+        offsetof(SH2, p_rom), 10, arg1);
+    jmp[n++] = emit_fastmem_select(FASTMEM_DA_MASK, FASTMEM_DA,
+      offsetof(SH2, p_da), 20, arg1);
+  }
+
   // must writeback cycles for poll detection stuff
   // FIXME: rm
   if (reg_map_g2h[SHR_SR] != -1)
     emith_ctx_write(reg_map_g2h[SHR_SR], SHR_SR * 4);
 
-  arg1 = rcache_get_tmp_arg(1);
   emith_move_r_r_ptr(arg1, CONTEXT_REG);
-
-#if 0 // can't do this because of unmapped reads
- // ndef PDB_NET
-  if (ram_check && Pico.rom == (void *)0x02000000 && Pico32xMem->sdram == (void *)0x06000000) {
-    int tmp = rcache_get_tmp();
-    emith_and_r_r_imm(tmp, arg0, 0xfb000000);
-    emith_cmp_r_imm(tmp, 0x02000000);
-    switch (size) {
-    case 0: // 8
-      EMITH_SJMP3_START(DCOND_NE);
-      emith_eor_r_imm_c(DCOND_EQ, arg0, 1);
-      emith_read8_r_r_offs_c(DCOND_EQ, arg0, arg0, 0);
-      EMITH_SJMP3_MID(DCOND_NE);
-      emith_call_cond(DCOND_NE, sh2_drc_read8);
-      EMITH_SJMP3_END();
-      break;
-    case 1: // 16
-      EMITH_SJMP3_START(DCOND_NE);
-      emith_read16_r_r_offs_c(DCOND_EQ, arg0, arg0, 0);
-      EMITH_SJMP3_MID(DCOND_NE);
-      emith_call_cond(DCOND_NE, sh2_drc_read16);
-      EMITH_SJMP3_END();
-      break;
-    case 2: // 32
-      EMITH_SJMP3_START(DCOND_NE);
-      emith_read_r_r_offs_c(DCOND_EQ, arg0, arg0, 0);
-      emith_ror_c(DCOND_EQ, arg0, arg0, 16);
-      EMITH_SJMP3_MID(DCOND_NE);
-      emith_call_cond(DCOND_NE, sh2_drc_read32);
-      EMITH_SJMP3_END();
-      break;
-    }
-  }
-  else
-#endif
-  {
-    switch (size) {
-    case 0: // 8
-      emith_call(sh2_drc_read8);
-      break;
-    case 1: // 16
-      emith_call(sh2_drc_read16);
-      break;
-    case 2: // 32
-      emith_call(sh2_drc_read32);
-      break;
-    }
+  switch (size) {
+  case 0: // 8
+    emit_xref(XREF_CALL, XT_READ8);
+    break;
+  case 1: // 16
+    emit_xref(XREF_CALL, XT_READ16);
+    break;
+  case 2: // 32
+    emit_xref(XREF_CALL, XT_READ32);
+    break;
   }
-  rcache_invalidate();
 
   if (reg_map_g2h[SHR_SR] != -1)
     emith_ctx_read(reg_map_g2h[SHR_SR], SHR_SR * 4);
 
+  if (n > 0) {
+    void *jmp_done = tcache_ptr;
+    emith_jump_patchable(tcache_ptr);
+    for (i = 0; i < n; i++)
+      emith_jump_patch(jmp[i], tcache_ptr);
+    emit_fastmem_read(size, arg1);
+    emith_jump_patch(jmp_done, tcache_ptr);
+  }
+  rcache_invalidate();
+
   return rcache_get_tmp_ret();
 }
 
@@ -1269,6 +1723,12 @@ static int emit_memhandler_read_rr(sh2_reg_e rd, sh2_reg_e rs, u32 offs, int siz
   u32 val, offs2;
 
   if (gconst_get(rs, &val)) {
+#if PROPAGATE_CONSTANTS
+    if (dr_rom_read(val + offs, size, &offs2)) {
+      gconst_new(rd, offs2);
+      return -1;
+    }
+#endif
     hr = emit_get_rbase_and_offs(val + offs, &offs2);
     if (hr != -1) {
       hr2 = rcache_get_reg(rd, RC_GR_WRITE);
@@ -1309,30 +1769,52 @@ static int emit_memhandler_read_rr(sh2_reg_e rd, sh2_reg_e rs, u32 offs, int siz
 
 static void emit_memhandler_write(int size)
 {
-  int ctxr;
+  void *jmp[2];
+  int ctxr, i, n = 0;
   host_arg2reg(ctxr, 2);
-  if (reg_map_g2h[SHR_SR] != -1)
-    emith_ctx_write(reg_map_g2h[SHR_SR], SHR_SR * 4);
 
   rcache_clean();
 
+  if (FAST_MEMORY_ACCESS) {
+    // the reg cache is invalidated after the handler call anyway, so any
+    // temp not holding an argument may be used without allocating it
+    int t[2], arg0, arg1, c = 0;
+    host_arg2reg(arg0, 0);
+    host_arg2reg(arg1, 1);
+    for (i = 0; i < ARRAY_SIZE(reg_temp) && c < 2; i++)
+      if (reg_temp[i].hreg != arg0 && reg_temp[i].hreg != arg1)
+        t[c++] = reg_temp[i].hreg;
+
+    // 8bit writes to the cache-through SDRAM area need the xmen sync hack
+    jmp[n++] = emit_fastmem_write(size, size == 0 ? 0xfe000000 :
+      FASTMEM_SDRAM_MASK, FASTMEM_SDRAM, offsetof(SH2, p_sdram),
+      offsetof(SH2, p_drcblk_ram), 14, t[0], t[1]);
+    jmp[n++] = emit_fastmem_write(size, FASTMEM_DA_MASK, FASTMEM_DA,
+      offsetof(SH2, p_da), offsetof(SH2, p_drcblk_da), 20, t[0], t[1]);
+  }
+
+  if (reg_map_g2h[SHR_SR] != -1)
+    emith_ctx_write(reg_map_g2h[SHR_SR], SHR_SR * 4);
+
   switch (size) {
   case 0: // 8
-    // XXX: consider inlining sh2_drc_write8
-    emith_call(sh2_drc_write8);
+    emit_xref(XREF_CALL, XT_WRITE8);
     break;
   case 1: // 16
-    emith_call(sh2_drc_write16);
+    emit_xref(XREF_CALL, XT_WRITE16);
     break;
   case 2: // 32
     emith_move_r_r_ptr(ctxr, CONTEXT_REG);
-    emith_call(sh2_drc_write32);
+    emit_xref(XREF_CALL, XT_WRITE32);
     break;
   }
 
-  rcache_invalidate();
   if (reg_map_g2h[SHR_SR] != -1)
     emith_ctx_read(reg_map_g2h[SHR_SR], SHR_SR * 4);
+
+  for (i = 0; i < n; i++)
+    emith_jump_patch(jmp[i], tcache_ptr);
+  rcache_invalidate();
 }
 
 // @(Rx,Ry)
@@ -1431,8 +1913,233 @@ static void emit_block_entry(void)
     cycles = 0; \
   }
 
+// T result of the current op is overwritten before anything reads it
+#define T_UNUSED() \
+  (!(opd->live & BITMASK1(SHR_T)))
+
+// backwards pass over the scanned block, finding the regs that may be
+// read after each op. All regs are live wherever the block can be left:
+// branches and their delay slots, and before branch targets (which may
+// exit on cycle check). Note that T is SR, so any SR access keeps it live.
+static void dr_scan_live(const u8 *op_flags, int i_end)
+{
+  struct op_data *opd;
+  u32 live = ~0;
+  int i;
+
+  for (i = i_end - 1; i >= 0; i--) {
+    opd = &ops[i];
+#ifndef DRC_CMP
+    if ((op_flags[i] & OF_DELAY_OP) || (op_flags[i + 1] & OF_DELAY_OP)
+        || (op_flags[i + 1] & OF_BTARGET)
+        || (OP_BRANCH <= opd->op && opd->op <= OP_BRANCH_RF)
+        || opd->op == OP_SLEEP || opd->op == OP_RTE)
+#endif
+      live = ~0;
+    opd->live = live;
+    live = (live & ~opd->dest) | opd->source;
+  }
+}
+
 static void *dr_get_pc_base(u32 pc, int is_slave);
 
+static void dr_add_block_entry(struct block_desc *block, u32 pc, void *ptr,
+  int is_slave, int tcache_id)
+{
+  struct block_entry *be, *be_old;
+
+  be = &block->entryp[block->entry_count];
+  be->pc = pc;
+  be->tcache_ptr = ptr;
+  be->links = NULL;
+#if (DRC_DEBUG & 2)
+  be->block = block;
+#endif
+  be_old = dr_get_entry(pc, is_slave, &tcache_id);
+  if (be_old != NULL) {
+    dbg(1, "entry override for %08x, was %p", pc, be_old->tcache_ptr);
+    kill_block_entry(be_old, tcache_id);
+  }
+
+  add_to_hashlist(be, tcache_id);
+  block->entry_count++;
+
+  // since we made a block entry, link any other blocks
+  // that jump to current pc
+  dr_link_blocks(be, tcache_id);
+}
+
+// mark memory blocks as containing compiled code
+// override any overlay blocks as they become unreachable anyway
+static void dr_mark_memory(struct block_desc *block, int is_slave,
+  int tcache_id, const u32 *literal_addr, int literal_addr_count)
+{
+  u16 *drc_ram_blk = NULL;
+  u32 addr, mask = 0, shift = 0;
+  int i;
+
+  if (!is_inval_tracked(block->addr))
+    return;
+
+  if (tcache_id != 0) {
+    // data array, BIOS
+    drc_ram_blk = Pico32xMem->drcblk_da[is_slave];
+    shift = SH2_DRCBLK_DA_SHIFT;
+    mask = 0xfff;
+  }
+  else {
+    // SDRAM
+    drc_ram_blk = Pico32xMem->drcblk_ram;
+    shift = SH2_DRCBLK_RAM_SHIFT;
+    mask = 0x3ffff;
+  }
+
+  // mark recompiled insns
+  drc_ram_blk[(block->addr & mask) >> shift] = 1;
+  for (addr = block->addr; addr < block->addr + block->size_nolit; addr += 2)
+    drc_ram_blk[(addr & mask) >> shift] = 1;
+
+  // mark literals
+  for (i = 0; i < literal_addr_count; i++) {
+    addr = literal_addr[i];
+    drc_ram_blk[(addr & mask) >> shift] = 1;
+  }
+
+  // add to invalidation lookup lists
+  addr = block->addr & ~(INVAL_PAGE_SIZE - 1);
+  for (; addr < block->addr + block->size; addr += INVAL_PAGE_SIZE) {
+    i = (addr & mask) / INVAL_PAGE_SIZE;
+    add_to_block_list(&inval_lookup[tcache_id][i], block);
+  }
+}
+
+#if DRC_CACHE
+#define CACHE_STORE_HASH(addr) \
+  HASH_FUNC(cache_store, addr, CACHE_STORE_HASH_SIZE - 1)
+
+// keep what's needed to write the just translated block to the cache file
+static void dr_cache_keep(struct block_desc *block, int tcache_id, int blkid,
+  u16 *dr_pc_base, const u32 *literal_addr, int literal_addr_count)
+{
+  u8 *code = block->entryp[0].tcache_ptr;
+  struct block_save *bs;
+  int i;
+
+  if (block_xref_base == NULL)
+    return;
+  block_xref_base = NULL;
+
+  bs = malloc(sizeof(*bs) + block_xref_count * sizeof(block_xrefs[0])
+              + literal_addr_count * sizeof(literal_addr[0]));
+  if (bs == NULL) {
+    elprintf(EL_ANOMALY, "drc OOM (2)");
+    return;
+  }
+  memset(bs, 0, sizeof(*bs));
+  bs->addr = block->addr;
+  bs->size = block->size;
+  bs->size_nolit = block->size_nolit;
+  bs->crc = crc32(0, (u8 *)&dr_pc_base[block->addr / 2], block->size);
+  bs->tcache_id = tcache_id;
+  bs->entry_count = block->entry_count;
+  bs->xref_count = block_xref_count;
+  bs->literal_count = literal_addr_count;
+  bs->code_size = tcache_ptr - code;
+  for (i = 0; i < block->entry_count; i++) {
+    bs->entry_pc[i] = block->entryp[i].pc;
+    bs->entry_offs[i] = (u8 *)block->entryp[i].tcache_ptr - code;
+  }
+  memcpy(BS_XREFS(bs), block_xrefs, block_xref_count * sizeof(block_xrefs[0]));
+  memcpy(BS_LITERALS(bs), literal_addr,
+    literal_addr_count * sizeof(literal_addr[0]));
+
+  free(block_saves[tcache_id][blkid]);
+  block_saves[tcache_id][blkid] = bs;
+}
+
+// recreate a block from the cache file if its SH2 code is still the same,
+// returns 1 if done, 0 if there's nothing usable, -1 if it can't be linked
+static int dr_cache_restore(SH2 *sh2, int tcache_id, u32 base_pc,
+  u16 *dr_pc_base, void **block_entry)
+{
+  struct block_save *bs, **bsp;
+  struct block_desc *block;
+  struct block_xref *xr;
+  u8 *code = tcache_ptr;
+  void *target;
+  int blkid, i;
+
+  if (cache_store == NULL)
+    return 0;
+
+  for (bsp = &CACHE_STORE_HASH(base_pc); *bsp != NULL; bsp = &(*bsp)->next) {
+    bs = *bsp;
+    if (bs->addr == base_pc && bs->tcache_id == tcache_id &&
+        bs->crc == crc32(0, (u8 *)&dr_pc_base[base_pc / 2], bs->size))
+      break;
+  }
+  if (*bsp == NULL)
+    return 0;
+  *bsp = bs->next;
+  bs->next = NULL;
+
+  // put the code in place and redo the calls out of it,
+  // which must come out the same size as when it was translated
+  memcpy(code, BS_CODE(bs), bs->code_size);
+  for (i = 0, xr = BS_XREFS(bs); i < bs->xref_count; i++, xr++) {
+    if (xr->type == XREF_EXIT)
+      continue;
+    tcache_ptr = code + xr->offs;
+    emit_xref(xr->type, xr->arg);
+    if (tcache_ptr != code + xr->offs + xr->size)
+      break;
+  }
+  tcache_ptr = code;
+  if (i < bs->xref_count) {
+    dbg(1, "cache: can't relocate block %08x", base_pc);
+    free(bs);
+    return 0;
+  }
+
+  block = dr_add_block(base_pc, bs->size, bs->size_nolit,
+    sh2->is_slave, &blkid);
+  free(block_saves[tcache_id][blkid]);
+  block_saves[tcache_id][blkid] = bs;
+  dbg(2, "== %csh2 block #%d,%d %08x-%08x -> %p (cached)",
+    sh2->is_slave ? 's' : 'm', tcache_id, blkid,
+    base_pc, base_pc + bs->size_nolit, code);
+
+  dr_link_blocks(&block->entryp[0], tcache_id);
+  for (i = 1; i < bs->entry_count; i++)
+    dr_add_block_entry(block, bs->entry_pc[i], code + bs->entry_offs[i],
+      sh2->is_slave, tcache_id);
+
+  // exits are linked like in a new block
+  for (i = 0, xr = BS_XREFS(bs); i < bs->xref_count; i++, xr++) {
+    if (xr->type != XREF_EXIT)
+      continue;
+    tcache_ptr = code + xr->offs;
+    target = dr_prepare_ext_branch(block, xr->arg, sh2->is_slave, tcache_id);
+    if (target == NULL)
+      return -1;
+    emith_jump_patch((void *)tcache_ptr, target);
+  }
+
+  dr_mark_memory(block, sh2->is_slave, tcache_id,
+    BS_LITERALS(bs), bs->literal_count);
+
+  tcache_ptr = code + bs->code_size;
+  tcache_ptrs[tcache_id] = tcache_ptr;
+  host_instructions_updated(code, tcache_ptr);
+
+  if ((base_pc & 0xc6000000) == 0x02000000) // ROM
+    Pico32x.emu_flags |= P32XF_DRC_ROM_C;
+
+  *block_entry = code;
+  return 1;
+}
+#endif
+
 static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
 {
   u32 branch_target_pc[MAX_LOCAL_BRANCHES];
@@ -1476,17 +2183,20 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
     exit(1);
   }
 
+  // predict tcache overflow
+  dr_make_room(tcache_id, MAX_BLOCK_SIZE);
   tcache_ptr = tcache_ptrs[tcache_id];
 
-  // predict tcache overflow
-  tmp = tcache_ptr - tcache_bases[tcache_id];
-  if (tmp > tcache_sizes[tcache_id] - MAX_BLOCK_SIZE) {
-    dbg(1, "tcache %d overflow", tcache_id);
-    return NULL;
-  }
+#if DRC_CACHE
+  block_xref_base = NULL;
+  v = dr_cache_restore(sh2, tcache_id, base_pc, dr_pc_base, &block_entry_ptr);
+  if (v != 0)
+    return v > 0 ? block_entry_ptr : NULL;
+#endif
 
   // initial passes to disassemble and analyze the block
   scan_block(base_pc, sh2->is_slave, op_flags, &end_pc, &end_literals);
+  dr_scan_live(op_flags, (end_pc - base_pc) / 2);
 
   if (drcf.literals_disabled)
     end_literals = end_pc;
@@ -1499,6 +2209,10 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
   block_entry_ptr = tcache_ptr;
   dbg(2, "== %csh2 block #%d,%d %08x-%08x -> %p", sh2->is_slave ? 's' : 'm',
     tcache_id, blkid_main, base_pc, end_pc, block_entry_ptr);
+#if DRC_CACHE
+  block_xref_base = cache_enabled ? block_entry_ptr : NULL;
+  block_xref_count = 0;
+#endif
 
   dr_link_blocks(&block->entryp[0], tcache_id);
 
@@ -1531,6 +2245,9 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
 
     opd = &ops[i];
     op = FETCH_OP(pc);
+    // regs accessed by the current op are kept by LRU order in evict
+    rcache_regs_live = opd->live | opd->source | opd->dest
+      | BITMASK2(SHR_PC, SHR_SR);
 
 #if (DRC_DEBUG & 2)
     insns_compiled++;
@@ -1553,30 +2270,10 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
         v = block->entry_count;
         if (v < ARRAY_SIZE(block->entryp))
         {
-          struct block_entry *be_old;
-
-          block->entryp[v].pc = pc;
-          block->entryp[v].tcache_ptr = tcache_ptr;
-          block->entryp[v].links = NULL;
-#if (DRC_DEBUG & 2)
-          block->entryp[v].block = block;
-#endif
-          be_old = dr_get_entry(pc, sh2->is_slave, &tcache_id);
-          if (be_old != NULL) {
-            dbg(1, "entry override for %08x, was %p", pc, be_old->tcache_ptr);
-            kill_block_entry(be_old, tcache_id);
-          }
-
-          add_to_hashlist(&block->entryp[v], tcache_id);
-          block->entry_count++;
-
           dbg(2, "-- %csh2 block #%d,%d entry %08x -> %p",
             sh2->is_slave ? 's' : 'm', tcache_id, blkid_main,
             pc, tcache_ptr);
-
-          // since we made a block entry, link any other blocks
-          // that jump to current pc
-          dr_link_blocks(&block->entryp[v], tcache_id);
+          dr_add_block_entry(block, pc, tcache_ptr, sh2->is_slave, tcache_id);
         }
         else {
           dbg(1, "too many entryp for block #%d,%d pc=%08x",
@@ -1613,7 +2310,7 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
       // check cycles
       sr = rcache_get_reg(SHR_SR, RC_GR_READ);
       emith_cmp_r_imm(sr, 0);
-      emith_jump_cond(DCOND_LE, sh2_drc_exit);
+      emit_xref(XREF_JUMP_COND, XT_EXIT | (DCOND_LE << 8));
       do_host_disasm(tcache_id);
       rcache_unlock_all();
     }
@@ -1736,7 +2433,10 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
 
     case OP_LOAD_POOL:
 #if PROPAGATE_CONSTANTS
-      if (opd->imm != 0 && opd->imm < end_literals
+      if (opd->imm != 0 && dr_rom_read(opd->imm, opd->size, &tmp))
+        // no need to track ROM literals, not even if out of block range
+        gconst_new(GET_Rn(), tmp);
+      else if (opd->imm != 0 && opd->imm < end_literals
           && literal_addr_count < MAX_LITERALS)
       {
         ADD_TO_ARRAY(literal_addr, literal_addr_count, opd->imm,);
@@ -1832,10 +2532,14 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
         switch (GET_Fx())
         {
         case 0: // CLRT               0000000000001000
+          if (T_UNUSED())
+            break;
           sr = rcache_get_reg(SHR_SR, RC_GR_RMW);
           emith_bic_r_imm(sr, T);
           break;
         case 1: // SETT               0000000000011000
+          if (T_UNUSED())
+            break;
           sr = rcache_get_reg(SHR_SR, RC_GR_RMW);
           emith_or_r_imm(sr, T);
           break;
@@ -1981,6 +2685,8 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
         EMITH_SJMP_END(DCOND_PL);
         goto end_op;
       case 0x08: // TST Rm,Rn           0010nnnnmmmm1000
+        if (T_UNUSED())
+          goto end_op;
         sr  = rcache_get_reg(SHR_SR, RC_GR_RMW);
         tmp2 = rcache_get_reg(GET_Rn(), RC_GR_READ);
         tmp3 = rcache_get_reg(GET_Rm(), RC_GR_READ);
@@ -2004,6 +2710,8 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
         emith_or_r_r(tmp, tmp2);
         goto end_op;
       case 0x0c: // CMP/STR Rm,Rn       0010nnnnmmmm1100
+        if (T_UNUSED())
+          goto end_op;
         tmp  = rcache_get_tmp();
         tmp2 = rcache_get_reg(GET_Rn(), RC_GR_READ);
         tmp3 = rcache_get_reg(GET_Rm(), RC_GR_READ);
@@ -2055,6 +2763,8 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
       case 0x03: // CMP/GE Rm,Rn        0011nnnnmmmm0011
       case 0x06: // CMP/HI Rm,Rn        0011nnnnmmmm0110
       case 0x07: // CMP/GT Rm,Rn        0011nnnnmmmm0111
+        if (T_UNUSED())
+          goto end_op;
         sr   = rcache_get_reg(SHR_SR, RC_GR_RMW);
         tmp2 = rcache_get_reg(GET_Rn(), RC_GR_READ);
         tmp3 = rcache_get_reg(GET_Rm(), RC_GR_READ);
@@ -2154,6 +2864,13 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
       case 0x0f: // ADDV    Rm,Rn       0011nnnnmmmm1111
         tmp  = rcache_get_reg(GET_Rn(), RC_GR_RMW);
         tmp2 = rcache_get_reg(GET_Rm(), RC_GR_READ);
+        if (T_UNUSED()) {
+          if (op & 4) {
+            emith_add_r_r(tmp, tmp2);
+          } else
+            emith_sub_r_r(tmp, tmp2);
+          goto end_op;
+        }
         sr   = rcache_get_reg(SHR_SR, RC_GR_RMW);
         emith_bic_r_imm(sr, T);
         if (op & 4) {
@@ -2184,6 +2901,10 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
         case 0: // SHLL Rn    0100nnnn00000000
         case 2: // SHAL Rn    0100nnnn00100000
           tmp = rcache_get_reg(GET_Rn(), RC_GR_RMW);
+          if (T_UNUSED()) {
+            emith_lsl(tmp, tmp, 1);
+            goto end_op;
+          }
           sr  = rcache_get_reg(SHR_SR, RC_GR_RMW);
           emith_tpop_carry(sr, 0); // dummy
           emith_lslf(tmp, tmp, 1);
@@ -2206,6 +2927,10 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
           }
 #endif
           tmp = rcache_get_reg(GET_Rn(), RC_GR_RMW);
+          if (T_UNUSED()) {
+            emith_sub_r_imm(tmp, 1);
+            goto end_op;
+          }
           emith_bic_r_imm(sr, T);
           emith_subf_r_imm(tmp, 1);
           emit_or_t_if_eq(sr);
@@ -2218,6 +2943,13 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
         case 0: // SHLR Rn    0100nnnn00000001
         case 2: // SHAR Rn    0100nnnn00100001
           tmp = rcache_get_reg(GET_Rn(), RC_GR_RMW);
+          if (T_UNUSED()) {
+            if (op & 0x20) {
+              emith_asr(tmp, tmp, 1);
+            } else
+              emith_lsr(tmp, tmp, 1);
+            goto end_op;
+          }
           sr  = rcache_get_reg(SHR_SR, RC_GR_RMW);
           emith_tpop_carry(sr, 0); // dummy
           if (op & 0x20) {
@@ -2227,6 +2959,8 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
           emith_tpush_carry(sr, 0);
           goto end_op;
         case 1: // CMP/PZ Rn  0100nnnn00010001
+          if (T_UNUSED())
+            goto end_op;
           tmp = rcache_get_reg(GET_Rn(), RC_GR_READ);
           sr  = rcache_get_reg(SHR_SR, RC_GR_RMW);
           emith_bic_r_imm(sr, T);
@@ -2278,6 +3012,13 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
         case 0x04: // ROTL   Rn          0100nnnn00000100
         case 0x05: // ROTR   Rn          0100nnnn00000101
           tmp = rcache_get_reg(GET_Rn(), RC_GR_RMW);
+          if (T_UNUSED()) {
+            if (op & 1) {
+              emith_ror(tmp, tmp, 1);
+            } else
+              emith_rol(tmp, tmp, 1);
+            goto end_op;
+          }
           sr  = rcache_get_reg(SHR_SR, RC_GR_RMW);
           emith_tpop_carry(sr, 0); // dummy
           if (op & 1) {
@@ -2298,6 +3039,8 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
           emith_tpush_carry(sr, 0);
           goto end_op;
         case 0x15: // CMP/PL Rn          0100nnnn00010101
+          if (T_UNUSED())
+            goto end_op;
           tmp = rcache_get_reg(GET_Rn(), RC_GR_RMW);
           sr  = rcache_get_reg(SHR_SR, RC_GR_RMW);
           emith_bic_r_imm(sr, T);
@@ -2577,6 +3320,8 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
         emit_memhandler_read_rr(SHR_R0, GET_Rm(), (op & 0x0f) << tmp, tmp);
         goto end_op;
       case 0x0800: // CMP/EQ #imm,R0       10001000iiiiiiii
+        if (T_UNUSED())
+          goto end_op;
         // XXX: could use cmn
         tmp  = rcache_get_tmp();
         tmp2 = rcache_get_reg(0, RC_GR_READ);
@@ -2628,9 +3373,11 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
         emit_memhandler_read_rr(SHR_PC, SHR_VBR, (op & 0xff) * 4, 2);
         // indirect jump -> back to dispatcher
         rcache_flush();
-        emith_jump(sh2_drc_dispatcher);
+        emit_xref(XREF_JUMP, XT_DISPATCHER);
         goto end_op;
       case 0x0800: // TST #imm,R0           11001000iiiiiiii
+        if (T_UNUSED())
+          goto end_op;
         tmp = rcache_get_reg(SHR_R0, RC_GR_READ);
         sr  = rcache_get_reg(SHR_SR, RC_GR_RMW);
         emith_bic_r_imm(sr, T);
@@ -2715,7 +3462,7 @@ static void REGPARM(2) *sh2_translate(SH2 *sh2, int tcache_id)
       emit_memhandler_read_rr(SHR_PC, SHR_VBR, v * 4, 2);
       // indirect jump -> back to dispatcher
       rcache_flush();
-      emith_jump(sh2_drc_dispatcher);
+      emit_xref(XREF_JUMP, XT_DISPATCHER);
       break;
     }
 
@@ -2736,7 +3483,7 @@ end_op:
       if (!drcf.pending_branch_indirect)
         emit_move_r_imm32(SHR_PC, pc);
       rcache_flush();
-      emith_call(sh2_drc_test_irq);
+      emit_xref(XREF_CALL, XT_TEST_IRQ);
       drcf.test_irq = 0;
     }
 
@@ -2792,7 +3539,8 @@ end_op:
         emit_move_r_imm32(SHR_PC, target_pc);
         rcache_clean();
 
-        target = dr_prepare_ext_branch(target_pc, sh2->is_slave, tcache_id);
+        target = dr_prepare_ext_branch(block, target_pc, sh2->is_slave,
+          tcache_id);
         if (target == NULL)
           return NULL;
       }
@@ -2812,13 +3560,14 @@ end_op:
       sr = rcache_get_reg(SHR_SR, RC_GR_RMW);
       FLUSH_CYCLES(sr);
       rcache_flush();
-      emith_jump(sh2_drc_dispatcher);
+      emit_xref(XREF_JUMP, XT_DISPATCHER);
       drcf.pending_branch_indirect = 0;
     }
 
     do_host_disasm(tcache_id);
   }
 
+  rcache_regs_live = ~0;
   tmp = rcache_get_reg(SHR_SR, RC_GR_RMW);
   FLUSH_CYCLES(tmp);
   rcache_flush();
@@ -2837,7 +3586,7 @@ end_op:
     emit_move_r_imm32(SHR_PC, pc);
     rcache_flush();
 
-    target = dr_prepare_ext_branch(pc, sh2->is_slave, tcache_id);
+    target = dr_prepare_ext_branch(block, pc, sh2->is_slave, tcache_id);
     if (target == NULL)
       return NULL;
     emith_jump_patchable(target);
@@ -2855,52 +3604,19 @@ end_op:
       target = tcache_ptr;
       emit_move_r_imm32(SHR_PC, branch_patch_pc[i]);
       rcache_flush();
-      emith_jump(sh2_drc_dispatcher);
+      emit_xref(XREF_JUMP, XT_DISPATCHER);
     }
     emith_jump_patch(branch_patch_ptr[i], target);
   }
 
-  // mark memory blocks as containing compiled code
-  // override any overlay blocks as they become unreachable anyway
-  if ((block->addr & 0xc7fc0000) == 0x06000000
-      || (block->addr & 0xfffff000) == 0xc0000000)
-  {
-    u16 *drc_ram_blk = NULL;
-    u32 addr, mask = 0, shift = 0;
-
-    if (tcache_id != 0) {
-      // data array, BIOS
-      drc_ram_blk = Pico32xMem->drcblk_da[sh2->is_slave];
-      shift = SH2_DRCBLK_DA_SHIFT;
-      mask = 0xfff;
-    }
-    else {
-      // SDRAM
-      drc_ram_blk = Pico32xMem->drcblk_ram;
-      shift = SH2_DRCBLK_RAM_SHIFT;
-      mask = 0x3ffff;
-    }
-
-    // mark recompiled insns
-    drc_ram_blk[(base_pc & mask) >> shift] = 1;
-    for (pc = base_pc; pc < end_pc; pc += 2)
-      drc_ram_blk[(pc & mask) >> shift] = 1;
-
-    // mark literals
-    for (i = 0; i < literal_addr_count; i++) {
-      tmp = literal_addr[i];
-      drc_ram_blk[(tmp & mask) >> shift] = 1;
-    }
-
-    // add to invalidation lookup lists
-    addr = base_pc & ~(INVAL_PAGE_SIZE - 1);
-    for (; addr < end_literals; addr += INVAL_PAGE_SIZE) {
-      i = (addr & mask) / INVAL_PAGE_SIZE;
-      add_to_block_list(&inval_lookup[tcache_id][i], block);
-    }
-  }
+  dr_mark_memory(block, sh2->is_slave, tcache_id,
+    literal_addr, literal_addr_count);
 
   tcache_ptrs[tcache_id] = tcache_ptr;
+#if DRC_CACHE
+  dr_cache_keep(block, tcache_id, blkid_main, dr_pc_base,
+    literal_addr, literal_addr_count);
+#endif
 
   host_instructions_updated(block_entry_ptr, tcache_ptr);
 
@@ -3257,7 +3973,11 @@ void block_stats(void)
 
   printf("block stats:\n");
   for (b = 0; b < ARRAY_SIZE(block_tables); b++)
-    for (i = 0; i < block_counts[b]; i++)
+    printf("tcache #%d: %d blocks, %d evicted, %d flushes\n", b,
+      block_counts[b], blocks_evicted[b], tcache_flushes[b]);
+
+  for (b = 0; b < ARRAY_SIZE(block_tables); b++)
+    for (i = 0; i < block_max_counts[b]; i++)
       if (block_tables[b][i].addr != 0)
         total += block_tables[b][i].refcount;
 
@@ -3265,7 +3985,7 @@ void block_stats(void)
     struct block_desc *blk, *maxb = NULL;
     int max = 0;
     for (b = 0; b < ARRAY_SIZE(block_tables); b++) {
-      for (i = 0; i < block_counts[b]; i++) {
+      for (i = 0; i < block_max_counts[b]; i++) {
         blk = &block_tables[b][i];
         if (blk->addr != 0 && blk->refcount > max) {
           max = blk->refcount;
@@ -3281,7 +4001,7 @@ void block_stats(void)
   }
 
   for (b = 0; b < ARRAY_SIZE(block_tables); b++)
-    for (i = 0; i < block_counts[b]; i++)
+    for (i = 0; i < block_max_counts[b]; i++)
       block_tables[b][i].refcount = 0;
 }
 #else
@@ -3304,6 +4024,8 @@ void sh2_drc_mem_setup(SH2 *sh2)
   sh2->p_da = sh2->data_array;
   sh2->p_sdram = Pico32xMem->sdram;
   sh2->p_rom = Pico.rom;
+  sh2->p_drcblk_da = Pico32xMem->drcblk_da[sh2->is_slave];
+  sh2->p_drcblk_ram = Pico32xMem->drcblk_ram;
 }
 
 void sh2_drc_frame(void)
@@ -3312,21 +4034,236 @@ void sh2_drc_frame(void)
     literal_disabled_frames--;
 }
 
-int sh2_drc_init(SH2 *sh2)
+#if DRC_CACHE
+// cache file: header, then for each block a struct block_save,
+// its xrefs, literal addresses and host code
+#define CACHE_MAGIC   "PDSH2TC"
+#define CACHE_VERSION 1
+
+struct cache_header {
+  char magic[8];
+  u32 version;
+  u32 build;                 // host code is only valid for the same build
+  u32 rom_crc;
+  u32 count;
+};
+
+static u32 dr_cache_build_id(void)
 {
+  static const char build[] = __DATE__ " " __TIME__;
+
+  return crc32(0, (const u8 *)build, sizeof(build)) ^ sizeof(SH2);
+}
+
+static int dr_cache_check(const struct block_save *bs)
+{
+  const struct block_xref *xr = BS_XREFS(bs);
+  int i;
+
+  for (i = 0; i < bs->entry_count; i++)
+    if (bs->entry_offs[i] >= bs->code_size)
+      return 0;
+  for (i = 0; i < bs->xref_count; i++, xr++) {
+    if (xr->type > XREF_EXIT || xr->offs + xr->size > bs->code_size)
+      return 0;
+    if (xr->type != XREF_EXIT && (xr->arg & 0xff) > XT_TEST_IRQ)
+      return 0;
+  }
+  return 1;
+}
+
+static void dr_cache_free_store(void)
+{
+  struct block_save *bs, *next;
   int i;
 
+  if (cache_store == NULL)
+    return;
+
+  for (i = 0; i < CACHE_STORE_HASH_SIZE; i++) {
+    for (bs = cache_store[i]; bs != NULL; bs = next) {
+      next = bs->next;
+      free(bs);
+    }
+  }
+  free(cache_store);
+  cache_store = NULL;
+}
+
+// start keeping translated blocks for the cache file of the current ROM,
+// blocks from the file are reused when the same SH2 code is run again
+int sh2_drc_cache_load(const char *fname, unsigned int rom_crc)
+{
+  struct cache_header hdr;
+  struct block_save tmp, *bs;
+  size_t size;
+  FILE *f;
+  u32 i;
+
+  dr_cache_free_store();
+  cache_enabled = 1;
+  cache_rom_crc = rom_crc;
+
+  f = fopen(fname, "rb");
+  if (f == NULL)
+    return -1;
+
+  if (fread(&hdr, sizeof(hdr), 1, f) != 1
+      || memcmp(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic))
+      || hdr.version != CACHE_VERSION || hdr.build != dr_cache_build_id()
+      || hdr.rom_crc != rom_crc)
+  {
+    elprintf(EL_STATUS, "drc cache: %s is outdated", fname);
+    fclose(f);
+    return -1;
+  }
+
+  cache_store = calloc(CACHE_STORE_HASH_SIZE, sizeof(cache_store[0]));
+  if (cache_store == NULL) {
+    fclose(f);
+    return -1;
+  }
+
+  for (i = 0; i < hdr.count; i++) {
+    if (fread(&tmp, sizeof(tmp), 1, f) != 1)
+      break;
+    if (tmp.tcache_id >= TCACHE_BUFFERS || tmp.entry_count == 0
+        || tmp.entry_count > MAX_BLOCK_ENTRIES
+        || tmp.xref_count > ARRAY_SIZE(block_xrefs)
+        || tmp.literal_count > MAX_LITERALS
+        || tmp.code_size > MAX_BLOCK_SIZE)
+      break;
+
+    size = tmp.xref_count * sizeof(struct block_xref)
+         + tmp.literal_count * sizeof(u32) + tmp.code_size;
+    bs = malloc(sizeof(*bs) + size);
+    if (bs == NULL)
+      break;
+    *bs = tmp;
+    if (fread(bs + 1, size, 1, f) != 1 || !dr_cache_check(bs)) {
+      free(bs);
+      break;
+    }
+
+    bs->next = CACHE_STORE_HASH(bs->addr);
+    CACHE_STORE_HASH(bs->addr) = bs;
+  }
+  fclose(f);
+
+  elprintf(EL_STATUS, "drc cache: %u/%u blocks from %s", i, hdr.count, fname);
+  return 0;
+}
+
+static int dr_cache_write(FILE *f, const struct block_save *bs, const u8 *code)
+{
+  size_t size = sizeof(*bs) + bs->xref_count * sizeof(struct block_xref)
+              + bs->literal_count * sizeof(u32);
+
+  if (fwrite(bs, size, 1, f) != 1)
+    return -1;
+  if (fwrite(code, bs->code_size, 1, f) != 1)
+    return -1;
+  return 0;
+}
+
+// write the translated blocks, and those from the loaded
+// cache file that weren't used, to a new cache file
+int sh2_drc_cache_save(const char *fname)
+{
+  struct cache_header hdr;
+  struct block_save *bs;
+  struct block_desc *bd;
+  int tcid, slot, max = 0;
+  int i, v;
+  FILE *f;
+
+  if (!cache_enabled || block_tables[0] == NULL)
+    return -1;
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic));
+  hdr.version = CACHE_VERSION;
+  hdr.build = dr_cache_build_id();
+  hdr.rom_crc = cache_rom_crc;
+
+  f = fopen(fname, "wb");
+  if (f == NULL) {
+    elprintf(EL_STATUS, "drc cache: can't write %s", fname);
+    return -1;
+  }
+  if (fwrite(&hdr, sizeof(hdr), 1, f) != 1)
+    goto fail;
+
+  for (tcid = 0; tcid < TCACHE_BUFFERS; tcid++) {
+    max += block_max_counts[tcid];
+    for (i = 0; i < block_counts[tcid]; i++) {
+      slot = (block_firsts[tcid] + i) % block_max_counts[tcid];
+      bd = &block_tables[tcid][slot];
+      bs = block_saves[tcid][slot];
+      // skip blocks killed by SMC or replaced by a newer translation
+      if (bs == NULL || bd->entry_count == 0
+          || dr_get_entry(bd->addr, tcid == 2, &v) != &bd->entryp[0])
+        continue;
+      if (dr_cache_write(f, bs, bd->entryp[0].tcache_ptr))
+        goto fail;
+      hdr.count++;
+    }
+  }
+
+  for (i = 0; cache_store != NULL && i < CACHE_STORE_HASH_SIZE; i++) {
+    for (bs = cache_store[i]; bs != NULL && hdr.count < max; bs = bs->next) {
+      if (dr_cache_write(f, bs, BS_CODE(bs)))
+        goto fail;
+      hdr.count++;
+    }
+  }
+
+  if (fseek(f, 0, SEEK_SET) || fwrite(&hdr, sizeof(hdr), 1, f) != 1)
+    goto fail;
+  fclose(f);
+
+  elprintf(EL_STATUS, "drc cache: %u blocks to %s", hdr.count, fname);
+  return 0;
+
+fail:
+  elprintf(EL_STATUS, "drc cache: write error on %s", fname);
+  fclose(f);
+  remove(fname);
+  return -1;
+}
+#else
+int sh2_drc_cache_load(const char *fname, unsigned int rom_crc)
+{
+  return -1;
+}
+
+int sh2_drc_cache_save(const char *fname)
+{
+  return -1;
+}
+#endif
+
+int sh2_drc_init(SH2 *sh2)
+{
+  int i, v;
+
   if (block_tables[0] == NULL)
   {
     for (i = 0; i < TCACHE_BUFFERS; i++) {
       block_tables[i] = calloc(block_max_counts[i], sizeof(*block_tables[0]));
       if (block_tables[i] == NULL)
         goto fail;
-      // max 2 block links (exits) per block
+      // 2 block links (exits) per block on average
       block_link_pool[i] = calloc(block_link_pool_max_counts[i],
                           sizeof(*block_link_pool[0]));
       if (block_link_pool[i] == NULL)
         goto fail;
+      block_link_free[i] = NULL;
+      for (v = block_link_pool_max_counts[i] - 1; v >= 0; v--) {
+        block_link_pool[i][v].next = block_link_free[i];
+        block_link_free[i] = &block_link_pool[i][v];
+      }
+      unresolved_links[i] = NULL;
 
       inval_lookup[i] = calloc(ram_sizes[i] / INVAL_PAGE_SIZE,
                                sizeof(inval_lookup[0]));
@@ -3336,9 +4273,15 @@ int sh2_drc_init(SH2 *sh2)
       hash_tables[i] = calloc(hash_table_sizes[i], sizeof(*hash_tables[0]));
       if (hash_tables[i] == NULL)
         goto fail;
+
+#if DRC_CACHE
+      block_saves[i] = calloc(block_max_counts[i], sizeof(*block_saves[0]));
+      if (block_saves[i] == NULL)
+        goto fail;
+#endif
     }
+    memset(block_firsts, 0, sizeof(block_firsts));
     memset(block_counts, 0, sizeof(block_counts));
-    memset(block_link_pool_counts, 0, sizeof(block_link_pool_counts));
 
     drc_cmn_init();
     tcache_ptr = tcache;
@@ -3346,6 +4289,7 @@ int sh2_drc_init(SH2 *sh2)
     host_instructions_updated(tcache, tcache_ptr);
 
     tcache_bases[0] = tcache_ptrs[0] = tcache_ptr;
+    tcache_sizes[0] = DRC_TCACHE_SIZE * 6 / 8 - (tcache_ptr - tcache);
     for (i = 1; i < ARRAY_SIZE(tcache_bases); i++)
       tcache_bases[i] = tcache_ptrs[i] = tcache_bases[i - 1] + tcache_sizes[i - 1];
 
@@ -3388,11 +4332,11 @@ void sh2_drc_finish(SH2 *sh2)
     if (block_tables[i] != NULL)
       free(block_tables[i]);
     block_tables[i] = NULL;
-    if (block_link_pool[i] == NULL)
+    if (block_link_pool[i] != NULL)
       free(block_link_pool[i]);
     block_link_pool[i] = NULL;
 
-    if (inval_lookup[i] == NULL)
+    if (inval_lookup[i] != NULL)
       free(inval_lookup[i]);
     inval_lookup[i] = NULL;
 
@@ -3400,8 +4344,19 @@ void sh2_drc_finish(SH2 *sh2)
       free(hash_tables[i]);
       hash_tables[i] = NULL;
     }
+
+#if DRC_CACHE
+    if (block_saves[i] != NULL)
+      free(block_saves[i]);
+    block_saves[i] = NULL;
+#endif
   }
 
+#if DRC_CACHE
+  dr_cache_free_store();
+  cache_enabled = 0;
+#endif
+
   drc_cmn_cleanup();
 }
 
@@ -3540,7 +4495,7 @@ void scan_block(u32 base_pc, int is_slave, u8 *op_flags, u32 *end_pc_out,
           opd->imm = 1;
           break;
         case 2: // CLRMAC             0000000000101000
-          opd->dest = BITMASK3(SHR_T, SHR_MACL, SHR_MACH);
+          opd->dest = BITMASK2(SHR_MACL, SHR_MACH);
           break;
         default:
           goto undefined;
@@ -3631,8 +4586,7 @@ void scan_block(u32 base_pc, int is_slave, u8 *op_flags, u32 *end_pc_out,
     /////////////////////////////////////////////
     case 0x01:
       // MOV.L Rm,@(disp,Rn) 0001nnnnmmmmdddd
-      opd->source = BITMASK1(GET_Rm());
-      opd->source = BITMASK1(GET_Rn());
+      opd->source = BITMASK2(GET_Rm(), GET_Rn());
       opd->imm = (op & 0x0f) * 4;
       break;
 
@@ -3643,8 +4597,7 @@ void scan_block(u32 base_pc, int is_slave, u8 *op_flags, u32 *end_pc_out,
       case 0x00: // MOV.B Rm,@Rn        0010nnnnmmmm0000
       case 0x01: // MOV.W Rm,@Rn        0010nnnnmmmm0001
       case 0x02: // MOV.L Rm,@Rn        0010nnnnmmmm0010
-        opd->source = BITMASK1(GET_Rm());
-        opd->source = BITMASK1(GET_Rn());
+        opd->source = BITMASK2(GET_Rm(), GET_Rn());
         break;
       case 0x04: // MOV.B Rm,@-Rn       0010nnnnmmmm0100
       case 0x05: // MOV.W Rm,@-Rn       0010nnnnmmmm0101
@@ -4180,6 +5133,8 @@ void scan_block(u32 base_pc, int is_slave, u8 *op_flags, u32 *end_pc_out,
     undefined:
       elprintf(EL_ANOMALY, "%csh2 drc: unhandled op %04x @ %08x",
         is_slave ? 's' : 'm', op, pc);
+      // raises an exception, pushing SR
+      opd->source = BITMASK2(SHR_SP, SHR_SR);
       break;
     }
 
@@ -7,10 +7,14 @@ void sh2_drc_wcheck_da(unsigned int a, int val, int cpuid);
 void sh2_drc_mem_setup(SH2 *sh2);
 void sh2_drc_flush_all(void);
 void sh2_drc_frame(void);
+int  sh2_drc_cache_load(const char *fname, unsigned int rom_crc);
+int  sh2_drc_cache_save(const char *fname);
 #else
 #define sh2_drc_mem_setup(x)
 #define sh2_drc_flush_all()
 #define sh2_drc_frame()
+#define sh2_drc_cache_load(fname, rom_crc) -1
+#define sh2_drc_cache_save(fname) -1
 #endif
 
 #define BLOCK_INSN_LIMIT 128
@@ -33,6 +33,8 @@ typedef struct SH2_
 	void		*p_da;
 	void		*p_sdram;	// 80
 	void		*p_rom;
+	void		*p_drcblk_da;	// smc marks for direct writes
+	void		*p_drcblk_ram;
 	unsigned int	pdb_io_csum[2];
 
 #define SH2_STATE_RUN   (1 << 0)	// to prevent recursion
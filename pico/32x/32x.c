@@ -9,8 +9,8 @@
 #include "../sound/ym2612.h"
 #include "../../cpu/sh2/compiler.h"
 
-struct Pico32x Pico32x;
-SH2 sh2s[2];
+PICO_TLS struct Pico32x Pico32x;
+PICO_TLS SH2 sh2s[2];
 
 #define SH2_IDLE_STATES (SH2_STATE_CPOLL|SH2_STATE_VPOLL|SH2_STATE_SLEEP)
 
@@ -216,17 +216,24 @@ void PicoReset32x(void)
 
 static void p32x_start_blank(void)
 {
-  if (Pico32xDrawMode != PDM32X_OFF && !PicoIn.skipFrame) {
+  if (Pico32xDrawMode != PDM32X_OFF && !PicoIn.skipFrame && !DrawHeld()) {
     int offs, lines;
 
     pprof_start(draw);
 
     offs = 8; lines = 224;
-    if ((Pico.video.reg[1] & 8) && !(PicoIn.opt & POPT_ALT_RENDERER)) {
+    if (Pico.video.reg[1] & 8) {
       offs = 0;
       lines = 240;
     }
 
+    // the frame was held back at the end of active display,
+    // but something changed before the layer could be drawn
+    if (DrawHold) {
+      DrawHold = 0;
+      PicoDrawSync(lines - 1, 0);
+    }
+
     // XXX: no proper handling of 32col mode..
     if ((Pico32x.vdp_regs[0] & P32XV_Mx) != 0 && // 32x not blanking
         (Pico.video.reg[12] & 1) && // 40col mode
@@ -294,8 +301,8 @@ static void hint_event(unsigned int now)
 typedef void (event_cb)(unsigned int now);
 
 /* times are in m68k (7.6MHz) cycles */
-unsigned int p32x_event_times[P32X_EVENT_COUNT];
-static unsigned int event_time_next;
+PICO_TLS unsigned int p32x_event_times[P32X_EVENT_COUNT];
+static PICO_TLS unsigned int event_time_next;
 static event_cb *p32x_event_cbs[P32X_EVENT_COUNT] = {
   p32x_pwm_irq_event, // P32X_EVENT_PWM
   fillend_event,      // P32X_EVENT_FILLEND
@@ -583,6 +590,18 @@ void Pico32xSetClocks(int msh2_hz, int ssh2_hz)
   }
 }
 
+// translated SH2 code is kept in a file for the next run of the same ROM,
+// call load after the ROM is loaded and save before it's unloaded
+int Pico32xDrcCacheLoad(const char *fname)
+{
+  return sh2_drc_cache_load(fname, rom_crc32());
+}
+
+int Pico32xDrcCacheSave(const char *fname)
+{
+  return sh2_drc_cache_save(fname);
+}
+
 void Pico32xStateLoaded(int is_early)
 {
   if (is_early) {
@@ -6,13 +6,512 @@
  * See COPYING file in the top-level directory.
  */
 #include "../pico_int.h"
+#include "../simd.h"
+
+PICO_TLS int (*PicoScan32xBegin)(unsigned int num);
+PICO_TLS int (*PicoScan32xEnd)(unsigned int num);
+PICO_TLS int Pico32xDrawMode;
+
+// PDF_RGB888: pal_native expanded, prio flag moved out of the color
+static PICO_TLS int draw32x_rgb888;
+static PICO_TLS unsigned int pal_native888[0x100];
+#define PAL888_PRIO 0x80000000
+
+// SIMD versions of the line loops below, for the cases that don't draw the
+// MD layer themselves. They work on a whole 320 pixel line: pixels are
+// looked up or expanded to a temporary line first, which then is blended
+// over the MD layer already in the output with vector masks.
+#if defined(HAVE_SSE2) || (defined(HAVE_NEON) && defined(__aarch64__))
+#define HAVE_32X_SIMD
+
+#ifdef HAVE_SSE2
+// 8 MD pixels with the backdrop color as 0xffff words
+static __inline __m128i md_bg_mask(const unsigned char *pmd, __m128i bg)
+{
+  __m128i md = _mm_loadl_epi64((const __m128i *)pmd);
+  md = _mm_unpacklo_epi8(md, _mm_setzero_si128());
+  return _mm_cmpeq_epi16(_mm_and_si128(md, _mm_set1_epi16(0x3f)), bg);
+}
+
+// 15bit 32X color (BGR555) to RGB565
+static __inline __m128i conv_555(__m128i t)
+{
+  __m128i r = _mm_slli_epi16(_mm_and_si128(t, _mm_set1_epi16(0x001f)), 11);
+  __m128i g = _mm_slli_epi16(_mm_and_si128(t, _mm_set1_epi16(0x03e0)), 1);
+  __m128i b = _mm_srli_epi16(_mm_and_si128(t, _mm_set1_epi16(0x7c00)), 10);
+  return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+// RGB565 in 32bit lanes to XRGB8888, as PicoRGB565To888()
+static __inline __m128i conv_888(__m128i t)
+{
+  __m128i r = _mm_and_si128(t, _mm_set1_epi32(0xf800));
+  __m128i g = _mm_and_si128(t, _mm_set1_epi32(0x07e0));
+  __m128i b = _mm_and_si128(t, _mm_set1_epi32(0x001f));
+  r = _mm_or_si128(_mm_slli_epi32(r, 8), _mm_slli_epi32(_mm_and_si128(r, _mm_set1_epi32(0xe000)), 3));
+  g = _mm_or_si128(_mm_slli_epi32(g, 5), _mm_srli_epi32(_mm_and_si128(g, _mm_set1_epi32(0x0600)), 1));
+  b = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(_mm_and_si128(b, _mm_set1_epi32(0x001c)), 2));
+  return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+#define vblend(m, t, d) _mm_or_si128(_mm_and_si128(m, t), _mm_andnot_si128(m, d))
+
+static void pal_conv_simd(unsigned short *pd, const unsigned short *ps, int inv)
+{
+  __m128i vinv = _mm_set1_epi16(inv ? 0x20 : 0);
+  int i;
+
+  // the prio bit ends up in the LS green bit
+  for (i = 0; i < 0x100; i += 8) {
+    __m128i t = _mm_loadu_si128((const __m128i *)(ps + i));
+    __m128i p = _mm_srli_epi16(_mm_and_si128(t, _mm_set1_epi16(0x8000)), 10);
+    t = _mm_xor_si128(_mm_or_si128(conv_555(t), p), vinv);
+    _mm_storeu_si128((__m128i *)(pd + i), t);
+  }
+}
+
+static void pal_conv888_simd(unsigned int *pd, const unsigned short *ps)
+{
+  int i;
+
+  for (i = 0; i < 0x100; i += 4) {
+    __m128i t = _mm_loadl_epi64((const __m128i *)(ps + i));
+    t = _mm_unpacklo_epi16(t, _mm_setzero_si128());
+    t = _mm_or_si128(conv_888(t), _mm_slli_epi32(_mm_and_si128(t, _mm_set1_epi32(0x20)), 26));
+    _mm_storeu_si128((__m128i *)(pd + i), t);
+  }
+}
+
+static void line_dc_simd(unsigned short *pd, const unsigned short *ps,
+  const unsigned char *pmd, int inv, int mdbg)
+{
+  __m128i bg = _mm_set1_epi16(mdbg), vinv = _mm_set1_epi16(inv);
+  int i;
 
-int (*PicoScan32xBegin)(unsigned int num);
-int (*PicoScan32xEnd)(unsigned int num);
-int Pico32xDrawMode;
+  for (i = 0; i < 320; i += 8) {
+    __m128i t = _mm_loadu_si128((const __m128i *)(ps + i));
+    __m128i d = _mm_loadu_si128((const __m128i *)(pd + i));
+    __m128i m = _mm_srai_epi16(_mm_xor_si128(t, vinv), 15);
+    m = _mm_or_si128(m, md_bg_mask(pmd + i, bg));
+    _mm_storeu_si128((__m128i *)(pd + i), vblend(m, conv_555(t), d));
+  }
+}
+
+static void line_dc888_simd(unsigned int *pd, const unsigned short *ps,
+  const unsigned char *pmd, int inv, int mdbg)
+{
+  __m128i bg = _mm_set1_epi16(mdbg), vinv = _mm_set1_epi16(inv);
+  __m128i z = _mm_setzero_si128();
+  int i;
+
+  for (i = 0; i < 320; i += 8) {
+    __m128i t = _mm_loadu_si128((const __m128i *)(ps + i));
+    __m128i m = _mm_srai_epi16(_mm_xor_si128(t, vinv), 15);
+    __m128i c, d;
+    m = _mm_or_si128(m, md_bg_mask(pmd + i, bg));
+    t = conv_555(t);
+    c = conv_888(_mm_unpacklo_epi16(t, z));
+    d = _mm_loadu_si128((const __m128i *)(pd + i));
+    _mm_storeu_si128((__m128i *)(pd + i), vblend(_mm_unpacklo_epi16(m, m), c, d));
+    c = conv_888(_mm_unpackhi_epi16(t, z));
+    d = _mm_loadu_si128((const __m128i *)(pd + i + 4));
+    _mm_storeu_si128((__m128i *)(pd + i + 4), vblend(_mm_unpackhi_epi16(m, m), c, d));
+  }
+}
+
+// packed pixel bytes, the frame buffer words are byteswapped
+static void line_pp_index(unsigned char *idx, const unsigned char *p32x)
+{
+  const unsigned char *ps = (void *)((uintptr_t)p32x & ~1);
+  int i;
+
+  for (i = 0; i < 320 + 16; i += 16) {
+    __m128i t = _mm_loadu_si128((const __m128i *)(ps + i));
+    t = _mm_or_si128(_mm_slli_epi16(t, 8), _mm_srli_epi16(t, 8));
+    _mm_storeu_si128((__m128i *)(idx + i), t);
+  }
+}
+
+// blend a looked up line, prio in the LS green bit
+static void line_blend_simd(unsigned short *pd, const unsigned short *ps,
+  const unsigned char *pmd, int mdbg)
+{
+  __m128i bg = _mm_set1_epi16(mdbg), prio = _mm_set1_epi16(0x20);
+  int i;
+
+  for (i = 0; i < 320; i += 8) {
+    __m128i t = _mm_loadu_si128((const __m128i *)(ps + i));
+    __m128i d = _mm_loadu_si128((const __m128i *)(pd + i));
+    __m128i m = _mm_cmpeq_epi16(_mm_and_si128(t, prio), prio);
+    m = _mm_or_si128(m, md_bg_mask(pmd + i, bg));
+    _mm_storeu_si128((__m128i *)(pd + i), vblend(m, t, d));
+  }
+}
+
+// same for 32bit, prio in bit 31
+static void line_blend888_simd(unsigned int *pd, const unsigned int *ps,
+  const unsigned char *pmd, int mdbg)
+{
+  __m128i bg = _mm_set1_epi16(mdbg), rgb = _mm_set1_epi32(0xffffff);
+  int i;
+
+  for (i = 0; i < 320; i += 8) {
+    __m128i mm = md_bg_mask(pmd + i, bg);
+    __m128i t = _mm_loadu_si128((const __m128i *)(ps + i));
+    __m128i d = _mm_loadu_si128((const __m128i *)(pd + i));
+    __m128i m = _mm_or_si128(_mm_unpacklo_epi16(mm, mm), _mm_srai_epi32(t, 31));
+    _mm_storeu_si128((__m128i *)(pd + i), vblend(m, _mm_and_si128(t, rgb), d));
+    t = _mm_loadu_si128((const __m128i *)(ps + i + 4));
+    d = _mm_loadu_si128((const __m128i *)(pd + i + 4));
+    m = _mm_or_si128(_mm_unpackhi_epi16(mm, mm), _mm_srai_epi32(t, 31));
+    _mm_storeu_si128((__m128i *)(pd + i + 4), vblend(m, _mm_and_si128(t, rgb), d));
+  }
+}
+
+// fill may write up to 7 pixels past len
+static __inline void fill16(unsigned short *pd, unsigned short t, int len)
+{
+  __m128i v = _mm_set1_epi16(t);
+  int i;
+  for (i = 0; i < len; i += 8)
+    _mm_storeu_si128((__m128i *)(pd + i), v);
+}
+
+static __inline void fill32(unsigned int *pd, unsigned int t, int len)
+{
+  __m128i v = _mm_set1_epi32(t);
+  int i;
+  for (i = 0; i < len; i += 8) {
+    _mm_storeu_si128((__m128i *)(pd + i), v);
+    _mm_storeu_si128((__m128i *)(pd + i + 4), v);
+  }
+}
+
+#ifdef HAVE_AVX2
+TARGET_AVX2
+static void pp_lookup_avx2(unsigned short *pd, const unsigned char *ps,
+  const unsigned short *pal)
+{
+  // see PicoClut555_avx2, pal_native is preceded by pal
+  const int *base = (const int *)(pal - 1);
+  int i;
+
+  for (i = 0; i < 320; i += 16) {
+    __m128i idx = _mm_loadu_si128((const __m128i *)(ps + i));
+    __m256i lo = _mm256_cvtepu8_epi32(idx);
+    __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(idx, 8));
+    lo = _mm256_srli_epi32(_mm256_i32gather_epi32(base, lo, 2), 16);
+    hi = _mm256_srli_epi32(_mm256_i32gather_epi32(base, hi, 2), 16);
+    lo = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), _MM_SHUFFLE(3,1,2,0));
+    _mm256_storeu_si256((__m256i *)(pd + i), lo);
+  }
+}
+
+TARGET_AVX2
+static void pp_lookup888_avx2(unsigned int *pd, const unsigned char *ps,
+  const unsigned int *pal)
+{
+  int i;
+
+  for (i = 0; i < 320; i += 8) {
+    __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(ps + i)));
+    _mm256_storeu_si256((__m256i *)(pd + i),
+      _mm256_i32gather_epi32((const int *)pal, idx, 4));
+  }
+}
+#endif
+
+#else // NEON
+
+static __inline uint16x8_t md_bg_mask(const unsigned char *pmd, uint16x8_t bg)
+{
+  uint16x8_t md = vmovl_u8(vld1_u8(pmd));
+  return vceqq_u16(vandq_u16(md, vdupq_n_u16(0x3f)), bg);
+}
+
+static __inline uint16x8_t conv_555(uint16x8_t t)
+{
+  uint16x8_t r = vshlq_n_u16(vandq_u16(t, vdupq_n_u16(0x001f)), 11);
+  uint16x8_t g = vshlq_n_u16(vandq_u16(t, vdupq_n_u16(0x03e0)), 1);
+  uint16x8_t b = vshrq_n_u16(vandq_u16(t, vdupq_n_u16(0x7c00)), 10);
+  return vorrq_u16(vorrq_u16(r, g), b);
+}
+
+static __inline uint32x4_t conv_888(uint32x4_t t)
+{
+  uint32x4_t r = vandq_u32(t, vdupq_n_u32(0xf800));
+  uint32x4_t g = vandq_u32(t, vdupq_n_u32(0x07e0));
+  uint32x4_t b = vandq_u32(t, vdupq_n_u32(0x001f));
+  r = vorrq_u32(vshlq_n_u32(r, 8), vshlq_n_u32(vandq_u32(r, vdupq_n_u32(0xe000)), 3));
+  g = vorrq_u32(vshlq_n_u32(g, 5), vshrq_n_u32(vandq_u32(g, vdupq_n_u32(0x0600)), 1));
+  b = vorrq_u32(vshlq_n_u32(b, 3), vshrq_n_u32(vandq_u32(b, vdupq_n_u32(0x001c)), 2));
+  return vorrq_u32(vorrq_u32(r, g), b);
+}
+
+// 16bit mask halves to 32bit masks
+#define mask_lo(m) vreinterpretq_u32_s32(vmovl_s16(vget_low_s16(vreinterpretq_s16_u16(m))))
+#define mask_hi(m) vreinterpretq_u32_s32(vmovl_s16(vget_high_s16(vreinterpretq_s16_u16(m))))
+
+static void pal_conv_simd(unsigned short *pd, const unsigned short *ps, int inv)
+{
+  uint16x8_t vinv = vdupq_n_u16(inv ? 0x20 : 0);
+  int i;
+
+  for (i = 0; i < 0x100; i += 8) {
+    uint16x8_t t = vld1q_u16(ps + i);
+    uint16x8_t p = vshrq_n_u16(vandq_u16(t, vdupq_n_u16(0x8000)), 10);
+    t = veorq_u16(vorrq_u16(conv_555(t), p), vinv);
+    vst1q_u16(pd + i, t);
+  }
+}
+
+static void pal_conv888_simd(unsigned int *pd, const unsigned short *ps)
+{
+  int i;
+
+  for (i = 0; i < 0x100; i += 4) {
+    uint32x4_t t = vmovl_u16(vld1_u16(ps + i));
+    t = vorrq_u32(conv_888(t), vshlq_n_u32(vandq_u32(t, vdupq_n_u32(0x20)), 26));
+    vst1q_u32(pd + i, t);
+  }
+}
+
+static void line_dc_simd(unsigned short *pd, const unsigned short *ps,
+  const unsigned char *pmd, int inv, int mdbg)
+{
+  uint16x8_t bg = vdupq_n_u16(mdbg), vinv = vdupq_n_u16(inv);
+  int i;
+
+  for (i = 0; i < 320; i += 8) {
+    uint16x8_t t = vld1q_u16(ps + i);
+    uint16x8_t m = vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(veorq_u16(t, vinv)), 15));
+    m = vorrq_u16(m, md_bg_mask(pmd + i, bg));
+    vst1q_u16(pd + i, vbslq_u16(m, conv_555(t), vld1q_u16(pd + i)));
+  }
+}
+
+static void line_dc888_simd(unsigned int *pd, const unsigned short *ps,
+  const unsigned char *pmd, int inv, int mdbg)
+{
+  uint16x8_t bg = vdupq_n_u16(mdbg), vinv = vdupq_n_u16(inv);
+  int i;
+
+  for (i = 0; i < 320; i += 8) {
+    uint16x8_t t = vld1q_u16(ps + i);
+    uint16x8_t m = vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(veorq_u16(t, vinv)), 15));
+    m = vorrq_u16(m, md_bg_mask(pmd + i, bg));
+    t = conv_555(t);
+    vst1q_u32(pd + i, vbslq_u32(mask_lo(m), conv_888(vmovl_u16(vget_low_u16(t))), vld1q_u32(pd + i)));
+    vst1q_u32(pd + i + 4, vbslq_u32(mask_hi(m), conv_888(vmovl_u16(vget_high_u16(t))), vld1q_u32(pd + i + 4)));
+  }
+}
+
+static void line_pp_index(unsigned char *idx, const unsigned char *p32x)
+{
+  const unsigned char *ps = (void *)((uintptr_t)p32x & ~1);
+  int i;
+
+  for (i = 0; i < 320 + 16; i += 16)
+    vst1q_u8(idx + i, vrev16q_u8(vld1q_u8(ps + i)));
+}
+
+static void line_blend_simd(unsigned short *pd, const unsigned short *ps,
+  const unsigned char *pmd, int mdbg)
+{
+  uint16x8_t bg = vdupq_n_u16(mdbg), prio = vdupq_n_u16(0x20);
+  int i;
+
+  for (i = 0; i < 320; i += 8) {
+    uint16x8_t t = vld1q_u16(ps + i);
+    uint16x8_t m = vorrq_u16(vtstq_u16(t, prio), md_bg_mask(pmd + i, bg));
+    vst1q_u16(pd + i, vbslq_u16(m, t, vld1q_u16(pd + i)));
+  }
+}
+
+static void line_blend888_simd(unsigned int *pd, const unsigned int *ps,
+  const unsigned char *pmd, int mdbg)
+{
+  uint16x8_t bg = vdupq_n_u16(mdbg);
+  uint32x4_t rgb = vdupq_n_u32(0xffffff);
+  int i;
+
+  for (i = 0; i < 320; i += 8) {
+    uint16x8_t mm = md_bg_mask(pmd + i, bg);
+    uint32x4_t t = vld1q_u32(ps + i);
+    uint32x4_t m = vorrq_u32(mask_lo(mm), vreinterpretq_u32_s32(vshrq_n_s32(vreinterpretq_s32_u32(t), 31)));
+    vst1q_u32(pd + i, vbslq_u32(m, vandq_u32(t, rgb), vld1q_u32(pd + i)));
+    t = vld1q_u32(ps + i + 4);
+    m = vorrq_u32(mask_hi(mm), vreinterpretq_u32_s32(vshrq_n_s32(vreinterpretq_s32_u32(t), 31)));
+    vst1q_u32(pd + i + 4, vbslq_u32(m, vandq_u32(t, rgb), vld1q_u32(pd + i + 4)));
+  }
+}
+
+static __inline void fill16(unsigned short *pd, unsigned short t, int len)
+{
+  uint16x8_t v = vdupq_n_u16(t);
+  int i;
+  for (i = 0; i < len; i += 8)
+    vst1q_u16(pd + i, v);
+}
+
+static __inline void fill32(unsigned int *pd, unsigned int t, int len)
+{
+  uint32x4_t v = vdupq_n_u32(t);
+  int i;
+  for (i = 0; i < len; i += 8) {
+    vst1q_u32(pd + i, v);
+    vst1q_u32(pd + i + 4, v);
+  }
+}
+
+// see PicoClut555_neon
+static void pp_lookup_neon(unsigned short *pd, const unsigned char *ps,
+  const unsigned short *pal)
+{
+  uint8x16x4_t tl[4], th[4];
+  int i, j;
+
+  for (j = 0; j < 16; j++) {
+    uint8x16x2_t v = vld2q_u8((const uint8_t *)(pal + j * 16));
+    tl[j >> 2].val[j & 3] = v.val[0];
+    th[j >> 2].val[j & 3] = v.val[1];
+  }
+
+  for (i = 0; i < 320; i += 16) {
+    uint8x16_t idx = vld1q_u8(ps + i);
+    uint8x16x2_t r;
+    r.val[0] = vqtbl4q_u8(tl[0], idx);
+    r.val[1] = vqtbl4q_u8(th[0], idx);
+    if (vmaxvq_u8(idx) >= 0x40) {
+      for (j = 1; j < 4; j++) {
+        uint8x16_t k = vsubq_u8(idx, vdupq_n_u8(j * 0x40));
+        r.val[0] = vqtbx4q_u8(r.val[0], tl[j], k);
+        r.val[1] = vqtbx4q_u8(r.val[1], th[j], k);
+      }
+    }
+    vst2q_u8((uint8_t *)(pd + i), r);
+  }
+}
+#endif // NEON
+
+static void pp_lookup_c(unsigned short *pd, const unsigned char *ps,
+  const unsigned short *pal)
+{
+  int i;
+  for (i = 0; i < 320; i++)
+    pd[i] = pal[ps[i]];
+}
+
+static void pp_lookup888_c(unsigned int *pd, const unsigned char *ps,
+  const unsigned int *pal)
+{
+  int i;
+  for (i = 0; i < 320; i++)
+    pd[i] = pal[ps[i]];
+}
+
+static PICO_TLS void (*pp_lookup)(unsigned short *pd, const unsigned char *ps,
+  const unsigned short *pal);
+static PICO_TLS void (*pp_lookup888)(unsigned int *pd, const unsigned char *ps,
+  const unsigned int *pal);
+
+static void line_pp_simd(unsigned short *pd, const unsigned char *p32x,
+  const unsigned char *pmd, const unsigned short *pal, int mdbg)
+{
+  unsigned char  idx[320 + 16];
+  unsigned short t[320];
+
+  line_pp_index(idx, p32x);
+  pp_lookup(t, idx + ((uintptr_t)p32x & 1), pal);
+  line_blend_simd(pd, t, pmd, mdbg);
+}
+
+static void line_pp888_simd(unsigned int *pd, const unsigned char *p32x,
+  const unsigned char *pmd, const unsigned int *pal, int mdbg)
+{
+  unsigned char idx[320 + 16];
+  unsigned int  t[320];
+
+  line_pp_index(idx, p32x);
+  pp_lookup888(t, idx + ((uintptr_t)p32x & 1), pal);
+  line_blend888_simd(pd, t, pmd, mdbg);
+}
+
+static void line_rl_simd(unsigned short *pd, const unsigned short *p32x,
+  const unsigned char *pmd, const unsigned short *pal, int mdbg)
+{
+  unsigned short t[320 + 8];
+  int i, len;
+
+  for (i = 0; i < 320; i += len, p32x++) {
+    len = (*p32x >> 8) + 1;
+    if (len > 320 - i)
+      len = 320 - i;
+    fill16(t + i, pal[*p32x & 0xff], len);
+  }
+  line_blend_simd(pd, t, pmd, mdbg);
+}
+
+static void line_rl888_simd(unsigned int *pd, const unsigned short *p32x,
+  const unsigned char *pmd, const unsigned int *pal, int mdbg)
+{
+  unsigned int t[320 + 8];
+  int i, len;
+
+  for (i = 0; i < 320; i += len, p32x++) {
+    len = (*p32x >> 8) + 1;
+    if (len > 320 - i)
+      len = 320 - i;
+    fill32(t + i, pal[*p32x & 0xff], len);
+  }
+  line_blend888_simd(pd, t, pmd, mdbg);
+}
+
+static void simd_init(void)
+{
+  pp_lookup = pp_lookup_c;
+  pp_lookup888 = pp_lookup888_c;
+#ifdef HAVE_AVX2
+  if (pico_cpu_features() & PCPU_AVX2) {
+    pp_lookup = pp_lookup_avx2;
+    pp_lookup888 = pp_lookup888_avx2;
+  }
+#endif
+#if defined(HAVE_NEON) && defined(__aarch64__)
+  pp_lookup = pp_lookup_neon;
+#endif
+}
+
+#define do_line_dc_simd(pd, p32x, pmd, inv, pmd_draw_code) { \
+  line_dc_simd(pd, p32x, pmd, inv, mdbg); pd += 320; pmd += 320; }
+#define do_line_pp_simd(pd, p32x, pmd, pmd_draw_code) { \
+  line_pp_simd(pd, p32x, pmd, pal, mdbg); pd += 320; pmd += 320; }
+#define do_line_rl_simd(pd, p32x, pmd, pmd_draw_code) { \
+  line_rl_simd(pd, p32x, pmd, pal, mdbg); pd += 320; pmd += 320; }
+#define do_line_dc888_simd(pd, p32x, pmd, inv, pmd_draw_code) { \
+  line_dc888_simd(pd, p32x, pmd, inv, mdbg); pd += 320; pmd += 320; }
+#define do_line_pp888_simd(pd, p32x, pmd, pmd_draw_code) { \
+  line_pp888_simd(pd, p32x, pmd, pal, mdbg); pd += 320; pmd += 320; }
+#define do_line_rl888_simd(pd, p32x, pmd, pmd_draw_code) { \
+  line_rl888_simd(pd, p32x, pmd, pal, mdbg); pd += 320; pmd += 320; }
+
+#else
+#define simd_init()
+#define do_line_dc_simd    do_line_dc
+#define do_line_pp_simd    do_line_pp
+#define do_line_rl_simd    do_line_rl
+#define do_line_dc888_simd do_line_dc888
+#define do_line_pp888_simd do_line_pp888
+#define do_line_rl888_simd do_line_rl888
+#endif // HAVE_32X_SIMD
 
 static void convert_pal555(int invert_prio)
 {
+#ifdef HAVE_32X_SIMD
+  pal_conv_simd(Pico32xMem->pal_native, Pico32xMem->pal, invert_prio);
+  if (draw32x_rgb888)
+    pal_conv888_simd(pal_native888, Pico32xMem->pal_native);
+#else
   unsigned int *ps = (void *)Pico32xMem->pal;
   unsigned int *pd = (void *)Pico32xMem->pal_native;
   unsigned int m1 = 0x001f001f;
@@ -30,6 +529,13 @@ static void convert_pal555(int invert_prio)
     *pd = (((t & m1) << 11) | ((t & m2) << 1) | ((t & m3) >> 10)) ^ inv;
   }
 
+  if (draw32x_rgb888) {
+    unsigned short *p = Pico32xMem->pal_native;
+    for (i = 0; i < 0x100; i++)
+      pal_native888[i] = PicoRGB565To888(p[i]) | ((p[i] & 0x20) ? PAL888_PRIO : 0);
+  }
+#endif
+
   Pico32x.dirty_pal = 0;
 }
 
@@ -82,6 +588,54 @@ static void convert_pal555(int invert_prio)
   }                                                               \
 }
 
+// 32bit output versions of the above
+#define do_line_dc888(pd, p32x, pmd, inv, pmd_draw_code)          \
+{                                                                 \
+  const unsigned int m1 = 0x001f;                                 \
+  const unsigned int m2 = 0x03e0;                                 \
+  const unsigned int m3 = 0x7c00;                                 \
+  int i;                                                          \
+                                                                  \
+  for (i = 320; i > 0; i--, pd++, p32x++, pmd++) {                \
+    unsigned short t = *p32x;                                     \
+    if ((*pmd & 0x3f) != mdbg && !((t ^ inv) & 0x8000)) {         \
+      pmd_draw_code;                                              \
+      continue;                                                   \
+    }                                                             \
+                                                                  \
+    *pd = PicoRGB565To888(((t & m1) << 11) | ((t & m2) << 1) | ((t & m3) >> 10)); \
+  }                                                               \
+}
+
+#define do_line_pp888(pd, p32x, pmd, pmd_draw_code)               \
+{                                                                 \
+  unsigned int t;                                                 \
+  int i;                                                          \
+  for (i = 320; i > 0; i--, pd++, p32x++, pmd++) {                \
+    t = pal[*(unsigned char *)((uintptr_t)p32x ^ 1)];             \
+    if ((t & PAL888_PRIO) || (*pmd & 0x3f) == mdbg)               \
+      *pd = t & 0xffffff;                                         \
+    else                                                          \
+      pmd_draw_code;                                              \
+  }                                                               \
+}
+
+#define do_line_rl888(pd, p32x, pmd, pmd_draw_code)               \
+{                                                                 \
+  unsigned short len;                                             \
+  unsigned int t;                                                 \
+  int i;                                                          \
+  for (i = 320; i > 0; p32x++) {                                  \
+    t = pal[*p32x & 0xff];                                        \
+    for (len = (*p32x >> 8) + 1; len > 0 && i > 0; len--, i--, pd++, pmd++) { \
+      if ((*pmd & 0x3f) == mdbg || (t & PAL888_PRIO))             \
+        *pd = t & 0xffffff;                                       \
+      else                                                        \
+        pmd_draw_code;                                            \
+    }                                                             \
+  }                                                               \
+}
+
 // this is almost never used (Wiz and menu bg gen only)
 void FinalizeLine32xRGB555(int sh, int line, struct PicoEState *est)
 {
@@ -107,7 +661,48 @@ void FinalizeLine32xRGB555(int sh, int line, struct PicoEState *est)
 
   if ((Pico32x.vdp_regs[0] & P32XV_Mx) == 2) { // Direct Color Mode
     int inv_bit = (Pico32x.vdp_regs[0] & P32XV_PRI) ? 0x8000 : 0;
-    do_line_dc(pd, p32x, pmd, inv_bit,);
+    do_line_dc_simd(pd, p32x, pmd, inv_bit,);
+    return;
+  }
+
+  if (Pico32x.dirty_pal)
+    convert_pal555(Pico32x.vdp_regs[0] & P32XV_PRI);
+
+  if ((Pico32x.vdp_regs[0] & P32XV_Mx) == 1) { // Packed Pixel Mode
+    unsigned char *p32xb = (void *)p32x;
+    if (Pico32x.vdp_regs[2 / 2] & P32XV_SFT)
+      p32xb++;
+    do_line_pp_simd(pd, p32xb, pmd,);
+  }
+  else { // Run Length Mode
+    do_line_rl_simd(pd, p32x, pmd,);
+  }
+}
+
+void FinalizeLine32xRGB888(int sh, int line, struct PicoEState *est)
+{
+  unsigned int   *pd = est->DrawLineDest;
+  unsigned int   *pal = pal_native888;
+  unsigned char  *pmd = est->HighCol + 8;
+  unsigned short *dram, *p32x;
+  unsigned char   mdbg;
+
+  FinalizeLine888(sh, line, est);
+
+  if ((Pico32x.vdp_regs[0] & P32XV_Mx) == 0 || // 32x blanking
+      !(Pico.video.reg[12] & 1) || // 32col mode
+      (Pico.video.debug_p & PVD_KILL_32X))
+  {
+    return;
+  }
+
+  dram = (void *)Pico32xMem->dram[Pico32x.vdp_regs[0x0a/2] & P32XV_FS];
+  p32x = dram + dram[line];
+  mdbg = Pico.video.reg[7] & 0x3f;
+
+  if ((Pico32x.vdp_regs[0] & P32XV_Mx) == 2) { // Direct Color Mode
+    int inv_bit = (Pico32x.vdp_regs[0] & P32XV_PRI) ? 0x8000 : 0;
+    do_line_dc888_simd(pd, p32x, pmd, inv_bit,);
     return;
   }
 
@@ -118,10 +713,10 @@ void FinalizeLine32xRGB555(int sh, int line, struct PicoEState *est)
     unsigned char *p32xb = (void *)p32x;
     if (Pico32x.vdp_regs[2 / 2] & P32XV_SFT)
       p32xb++;
-    do_line_pp(pd, p32xb, pmd,);
+    do_line_pp888_simd(pd, p32xb, pmd,);
   }
   else { // Run Length Mode
-    do_line_rl(pd, p32x, pmd,);
+    do_line_rl888_simd(pd, p32x, pmd,);
   }
 }
 
@@ -135,7 +730,7 @@ void FinalizeLine32xRGB555(int sh, int line, struct PicoEState *est)
 #define PICOSCAN_POST \
   PicoScan32xEnd(l + (lines_sft_offs & 0xff)); \
 
-#define make_do_loop(name, pre_code, post_code, md_code)        \
+#define make_do_loop(name, pre_code, post_code, md_code, simd)  \
 /* Direct Color Mode */                                         \
 static void do_loop_dc##name(unsigned short *dst,               \
     unsigned short *dram, int lines_sft_offs, int mdbg)         \
@@ -151,7 +746,7 @@ static void do_loop_dc##name(unsigned short *dst,               \
   for (l = 0; l < lines; l++, pmd += 8) {                       \
     pre_code;                                                   \
     p32x = dram + dram[l];                                      \
-    do_line_dc(dst, p32x, pmd, inv_bit, md_code);               \
+    do_line_dc##simd(dst, p32x, pmd, inv_bit, md_code);         \
     post_code;                                                  \
   }                                                             \
 }                                                               \
@@ -172,7 +767,7 @@ static void do_loop_pp##name(unsigned short *dst,               \
     pre_code;                                                   \
     p32x = (void *)(dram + dram[l]);                            \
     p32x += (lines_sft_offs >> 8) & 1;                          \
-    do_line_pp(dst, p32x, pmd, md_code);                        \
+    do_line_pp##simd(dst, p32x, pmd, md_code);                  \
     post_code;                                                  \
   }                                                             \
 }                                                               \
@@ -192,14 +787,14 @@ static void do_loop_rl##name(unsigned short *dst,               \
   for (l = 0; l < lines; l++, pmd += 8) {                       \
     pre_code;                                                   \
     p32x = dram + dram[l];                                      \
-    do_line_rl(dst, p32x, pmd, md_code);                        \
+    do_line_rl##simd(dst, p32x, pmd, md_code);                  \
     post_code;                                                  \
   }                                                             \
 }
 
 #ifdef _ASM_32X_DRAW
 #undef make_do_loop
-#define make_do_loop(name, pre_code, post_code, md_code) \
+#define make_do_loop(name, pre_code, post_code, md_code, simd) \
 extern void do_loop_dc##name(unsigned short *dst,        \
     unsigned short *dram, int lines_offs, int mdbg);     \
 extern void do_loop_pp##name(unsigned short *dst,        \
@@ -208,10 +803,10 @@ extern void do_loop_rl##name(unsigned short *dst,        \
     unsigned short *dram, int lines_offs, int mdbg);
 #endif
 
-make_do_loop(,,,)
-make_do_loop(_md, , , MD_LAYER_CODE)
-make_do_loop(_scan, PICOSCAN_PRE, PICOSCAN_POST, )
-make_do_loop(_scan_md, PICOSCAN_PRE, PICOSCAN_POST, MD_LAYER_CODE)
+make_do_loop(,,,, _simd)
+make_do_loop(_md, , , MD_LAYER_CODE, )
+make_do_loop(_scan, PICOSCAN_PRE, PICOSCAN_POST, , _simd)
+make_do_loop(_scan_md, PICOSCAN_PRE, PICOSCAN_POST, MD_LAYER_CODE, )
 
 typedef void (*do_loop_func)(unsigned short *dst, unsigned short *dram, int lines, int mdbg);
 enum { DO_LOOP, DO_LOOP_MD, DO_LOOP_SCAN, DO_LOOP_MD_SCAN };
@@ -220,10 +815,74 @@ static const do_loop_func do_loop_dc_f[] = { do_loop_dc, do_loop_dc_md, do_loop_
 static const do_loop_func do_loop_pp_f[] = { do_loop_pp, do_loop_pp_md, do_loop_pp_scan, do_loop_pp_scan_md };
 static const do_loop_func do_loop_rl_f[] = { do_loop_rl, do_loop_rl_md, do_loop_rl_scan, do_loop_rl_scan_md };
 
+// PDF_RGB888, always C, MD layer is drawn by FinalizeLine888
+#define make_do_loop888(name, pre_code, post_code)              \
+static void do_loop_dc888##name(unsigned int *dst,              \
+    unsigned short *dram, int lines_sft_offs, int mdbg)         \
+{                                                               \
+  int inv_bit = (Pico32x.vdp_regs[0] & P32XV_PRI) ? 0x8000 : 0; \
+  unsigned char  *pmd = Pico.est.Draw2FB +                      \
+                          328 * (lines_sft_offs & 0xff) + 8;    \
+  unsigned short *p32x;                                         \
+  int lines = lines_sft_offs >> 16;                             \
+  int l;                                                        \
+  for (l = 0; l < lines; l++, pmd += 8) {                       \
+    pre_code;                                                   \
+    p32x = dram + dram[l];                                      \
+    do_line_dc888_simd(dst, p32x, pmd, inv_bit,);               \
+    post_code;                                                  \
+  }                                                             \
+}                                                               \
+                                                                \
+static void do_loop_pp888##name(unsigned int *dst,              \
+    unsigned short *dram, int lines_sft_offs, int mdbg)         \
+{                                                               \
+  unsigned int   *pal = pal_native888;                          \
+  unsigned char  *pmd = Pico.est.Draw2FB +                      \
+                          328 * (lines_sft_offs & 0xff) + 8;    \
+  unsigned char  *p32x;                                         \
+  int lines = lines_sft_offs >> 16;                             \
+  int l;                                                        \
+  for (l = 0; l < lines; l++, pmd += 8) {                       \
+    pre_code;                                                   \
+    p32x = (void *)(dram + dram[l]);                            \
+    p32x += (lines_sft_offs >> 8) & 1;                          \
+    do_line_pp888_simd(dst, p32x, pmd,);                        \
+    post_code;                                                  \
+  }                                                             \
+}                                                               \
+                                                                \
+static void do_loop_rl888##name(unsigned int *dst,              \
+    unsigned short *dram, int lines_sft_offs, int mdbg)         \
+{                                                               \
+  unsigned int   *pal = pal_native888;                          \
+  unsigned char  *pmd = Pico.est.Draw2FB +                      \
+                          328 * (lines_sft_offs & 0xff) + 8;    \
+  unsigned short *p32x;                                         \
+  int lines = lines_sft_offs >> 16;                             \
+  int l;                                                        \
+  for (l = 0; l < lines; l++, pmd += 8) {                       \
+    pre_code;                                                   \
+    p32x = dram + dram[l];                                      \
+    do_line_rl888_simd(dst, p32x, pmd,);                        \
+    post_code;                                                  \
+  }                                                             \
+}
+
+make_do_loop888(,,)
+make_do_loop888(_scan, PICOSCAN_PRE, PICOSCAN_POST)
+
+typedef void (*do_loop888_func)(unsigned int *dst, unsigned short *dram, int lines, int mdbg);
+
+static const do_loop888_func do_loop_dc888_f[] = { do_loop_dc888, do_loop_dc888_scan };
+static const do_loop888_func do_loop_pp888_f[] = { do_loop_pp888, do_loop_pp888_scan };
+static const do_loop888_func do_loop_rl888_f[] = { do_loop_rl888, do_loop_rl888_scan };
+
 void PicoDraw32xLayer(int offs, int lines, int md_bg)
 {
   int have_scan = PicoScan32xBegin != NULL && PicoScan32xEnd != NULL;
   const do_loop_func *do_loop;
+  const do_loop888_func *do_loop888;
   unsigned short *dram;
   int lines_sft_offs;
   int which_func;
@@ -240,6 +899,7 @@ void PicoDraw32xLayer(int offs, int lines, int md_bg)
   {
     // Direct Color Mode
     do_loop = do_loop_dc_f;
+    do_loop888 = do_loop_dc888_f;
     goto do_it;
   }
 
@@ -250,11 +910,13 @@ void PicoDraw32xLayer(int offs, int lines, int md_bg)
   {
     // Packed Pixel Mode
     do_loop = do_loop_pp_f;
+    do_loop888 = do_loop_pp888_f;
   }
   else
   {
     // Run Length Mode
     do_loop = do_loop_rl_f;
+    do_loop888 = do_loop_rl888_f;
   }
 
 do_it:
@@ -266,7 +928,10 @@ do_it:
   if (Pico32x.vdp_regs[2 / 2] & P32XV_SFT)
     lines_sft_offs |= 1 << 8;
 
-  do_loop[which_func](Pico.est.DrawLineDest, dram, lines_sft_offs, md_bg);
+  if (draw32x_rgb888)
+    do_loop888[have_scan](Pico.est.DrawLineDest, dram, lines_sft_offs, md_bg);
+  else
+    do_loop[which_func](Pico.est.DrawLineDest, dram, lines_sft_offs, md_bg);
 }
 
 // mostly unused, games tend to keep 32X layer on
@@ -314,8 +979,15 @@ void PicoDrawSetOutFormat32x(pdso_t which, int use_32x_line_mode)
   Pico32xNativePal = Pico32xMem->pal_native;
 #endif
 
-  if (which == PDF_RGB555 && use_32x_line_mode) {
-    // we'll draw via FinalizeLine32xRGB555 (rare)
+  simd_init();
+
+  if (draw32x_rgb888 != (which == PDF_RGB888)) {
+    draw32x_rgb888 = (which == PDF_RGB888);
+    Pico32x.dirty_pal = 1;
+  }
+
+  if ((which == PDF_RGB555 || which == PDF_RGB888) && use_32x_line_mode) {
+    // we'll draw via FinalizeLine32xRGB555/888 (rare)
     PicoDrawSetInternalBuf(NULL, 0);
     Pico32xDrawMode = PDM32X_OFF;
     return;
@@ -323,7 +995,8 @@ void PicoDrawSetOutFormat32x(pdso_t which, int use_32x_line_mode)
 
   // use the same layout as alt renderer
   PicoDrawSetInternalBuf(Pico.est.Draw2FB, 328);
-  Pico32xDrawMode = (which == PDF_RGB555) ? PDM32X_32X_ONLY : PDM32X_BOTH;
+  Pico32xDrawMode = (which == PDF_RGB555 || which == PDF_RGB888)
+    ? PDM32X_32X_ONLY : PDM32X_BOTH;
 }
 
 // vim:shiftwidth=2:ts=2:expandtab
@@ -44,13 +44,13 @@
 
 static const char str_mars[] = "MARS";
 
-void *p32x_bios_g, *p32x_bios_m, *p32x_bios_s;
-struct Pico32xMem *Pico32xMem;
+PICO_TLS void *p32x_bios_g, *p32x_bios_m, *p32x_bios_s;
+PICO_TLS struct Pico32xMem *Pico32xMem;
 
 static void bank_switch_rom_68k(int b);
 
-static void (*m68k_write8_io)(u32 a, u32 d);
-static void (*m68k_write16_io)(u32 a, u32 d);
+static PICO_TLS void (*m68k_write8_io)(u32 a, u32 d);
+static PICO_TLS void (*m68k_write16_io)(u32 a, u32 d);
 
 // addressing byte in 16bit reg
 #define REG8IN16(ptr, offs) ((u8 *)ptr)[(offs) ^ 1]
@@ -58,7 +58,7 @@ static void (*m68k_write16_io)(u32 a, u32 d);
 // poll detection
 #define POLL_THRESHOLD 3
 
-static struct {
+static PICO_TLS struct {
   u32 addr, cycles;
   int cnt;
 } m68k_poll;
@@ -502,9 +502,13 @@ static void p32x_vdp_write8(u32 a, u32 d)
       // priority inversion is handled in palette
       if ((r[0] ^ d) & P32XV_PRI)
         Pico32x.dirty_pal = 1;
+      if ((r[0] ^ d) & 0xff)
+        DrawDirty = 1;
       r[0] = (r[0] & P32XV_nPAL) | (d & 0xff);
       break;
     case 0x03: // shift (for pp mode)
+      if (r[2 / 2] != (d & 1))
+        DrawDirty = 1;
       r[2 / 2] = d & 1;
       break;
     case 0x05: // fill len
@@ -874,7 +878,7 @@ static void PicoWrite8_32x_on(u32 a, u32 d)
     if ((a & 0xfe00) == 0x5200) { // a15200
       elprintf(EL_32X|EL_ANOMALY, "m68k 32x PAL w8  [%06x]   %02x @%06x", a, d & 0xff, SekPc);
       ((u8 *)Pico32xMem->pal)[(a & 0x1ff) ^ 1] = d;
-      Pico32x.dirty_pal = 1;
+      Pico32x.dirty_pal = DrawDirty = 1;
       return;
     }
   }
@@ -925,6 +929,8 @@ static void PicoWrite16_32x_on(u32 a, u32 d)
     }
 
     if ((a & 0xfe00) == 0x5200) { // a15200
+      if (Pico32xMem->pal[(a & 0x1ff) / 2] != (u16)d)
+        DrawDirty = 1;
       Pico32xMem->pal[(a & 0x1ff) / 2] = d;
       Pico32x.dirty_pal = 1;
       return;
@@ -1440,6 +1446,8 @@ static void REGPARM(3) sh2_write16_cs0(u32 a, u32 d, SH2 *sh2)
     }
 
     if ((a & 0x3fe00) == 0x4200) {
+      if (Pico32xMem->pal[(a & 0x1ff) / 2] != (u16)d)
+        DrawDirty = 1;
       Pico32xMem->pal[(a & 0x1ff) / 2] = d;
       Pico32x.dirty_pal = 1;
       return;
@@ -1787,12 +1795,15 @@ static void get_bios(void)
 #define MAP_MEMORY(m) ((uptr)(m) >> 1)
 #define MAP_HANDLER(h) ( ((uptr)(h) >> 1) | ((uptr)1 << (sizeof(uptr) * 8 - 1)) )
 
-static sh2_memmap sh2_read8_map[0x80], sh2_read16_map[0x80];
+static PICO_TLS sh2_memmap sh2_read8_map[0x80], sh2_read16_map[0x80];
 // for writes we are using handlers only
-static sh2_write_handler *sh2_write8_map[0x80], *sh2_write16_map[0x80];
+static PICO_TLS sh2_write_handler *sh2_write8_map[0x80], *sh2_write16_map[0x80];
 
+// the CPUs only see the frame buffer that is not displayed,
+// so this is also the only way for DRAM writes to reach the screen
 void Pico32xSwapDRAM(int b)
 {
+  DrawDirty = 1;
   cpu68k_map_set(m68k_read8_map,   0x840000, 0x85ffff, Pico32xMem->dram[b], 0);
   cpu68k_map_set(m68k_read16_map,  0x840000, 0x85ffff, Pico32xMem->dram[b], 0);
   cpu68k_map_set(m68k_read8_map,   0x860000, 0x87ffff, Pico32xMem->dram[b], 0);
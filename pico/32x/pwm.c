@@ -7,12 +7,12 @@
  */
 #include "../pico_int.h"
 
-static int pwm_cycles;
-static int pwm_mult;
-static int pwm_ptr;
-static int pwm_irq_reload;
-static int pwm_doing_fifo;
-static int pwm_silent;
+static PICO_TLS int pwm_cycles;
+static PICO_TLS int pwm_mult;
+static PICO_TLS int pwm_ptr;
+static PICO_TLS int pwm_irq_reload;
+static PICO_TLS int pwm_doing_fifo;
+static PICO_TLS int pwm_silent;
 
 void p32x_pwm_ctl_changed(void)
 {
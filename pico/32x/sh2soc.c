@@ -160,8 +160,8 @@ static void dmac_trigger(SH2 *sh2, struct dma_chan *chan)
 }
 
 // timer state - FIXME
-static int timer_cycles[2];
-static int timer_tick_cycles[2];
+static PICO_TLS int timer_cycles[2];
+static PICO_TLS int timer_tick_cycles[2];
 
 // timers
 void p32x_timers_recalc(void)
@@ -504,7 +504,7 @@ void p32x_dreq1_trigger(void)
   // debug
 #if (EL_LOGMASK & (EL_32XP|EL_ANOMALY))
   {
-    static int miss_count;
+    static PICO_TLS int miss_count;
     if (!hit) {
       if (++miss_count == 4)
         elprintf(EL_32XP|EL_ANOMALY, "dreq1: nobody cared");
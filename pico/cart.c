@@ -13,16 +13,16 @@
 #include <zlib.h>
 
 
-static int rom_alloc_size;
+static PICO_TLS int rom_alloc_size;
 static const char *rom_exts[] = { "bin", "gen", "smd", "iso", "sms", "gg", "sg" };
 
-void (*PicoCartUnloadHook)(void);
-void (*PicoCartMemSetup)(void);
+PICO_TLS void (*PicoCartUnloadHook)(void);
+PICO_TLS void (*PicoCartMemSetup)(void);
 
-void (*PicoCartLoadProgressCB)(int percent) = NULL;
-void (*PicoCDLoadProgressCB)(const char *fname, int percent) = NULL; // handled in Pico/cd/cd_file.c
+PICO_TLS void (*PicoCartLoadProgressCB)(int percent) = NULL;
+PICO_TLS void (*PicoCDLoadProgressCB)(const char *fname, int percent) = NULL; // handled in Pico/cd/cd_file.c
 
-int PicoGameLoaded;
+PICO_TLS int PicoGameLoaded;
 
 static void PicoCartDetect(const char *carthw_cfg);
 
@@ -692,7 +692,7 @@ void PicoCartUnload(void)
   PicoGameLoaded = 0;
 }
 
-static unsigned int rom_crc32(void)
+unsigned int rom_crc32(void)
 {
   unsigned int crc;
   elprintf(EL_STATUS, "caclulating CRC32..");
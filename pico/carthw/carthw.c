@@ -22,12 +22,12 @@ static int have_bank(u32 base)
 }
 
 /* standard/ssf2 mapper */
-int carthw_ssf2_active;
-unsigned char carthw_ssf2_banks[8];
+PICO_TLS int carthw_ssf2_active;
+PICO_TLS unsigned char carthw_ssf2_banks[8];
 
-static carthw_state_chunk carthw_ssf2_state[] =
+static PICO_TLS carthw_state_chunk carthw_ssf2_state[] =
 {
-  { CHUNK_CARTHW, sizeof(carthw_ssf2_banks), &carthw_ssf2_banks },
+  { CHUNK_CARTHW, sizeof(carthw_ssf2_banks), NULL }, // filled later
   { 0,            0,                         NULL }
 };
 
@@ -95,6 +95,7 @@ void carthw_ssf2_startup(void)
   PicoCartMemSetup   = carthw_ssf2_mem_setup;
   PicoLoadStateHook  = carthw_ssf2_statef;
   PicoCartUnloadHook = carthw_ssf2_unload;
+  carthw_ssf2_state[0].ptr = carthw_ssf2_banks;
   carthw_chunks      = carthw_ssf2_state;
   carthw_ssf2_active = 1;
 }
@@ -104,7 +105,7 @@ void carthw_ssf2_startup(void)
  * Switches banks based on addr lines when /TIME is set.
  * TODO: verify
  */
-static unsigned int carthw_Xin1_baddr = 0;
+static PICO_TLS unsigned int carthw_Xin1_baddr = 0;
 
 static void carthw_Xin1_do(u32 a, int mask, int shift)
 {
@@ -124,9 +125,9 @@ static void carthw_Xin1_do(u32 a, int mask, int shift)
 	cpu68k_map_set(m68k_read16_map, 0x000000, len - 1, Pico.rom + a, 0);
 }
 
-static carthw_state_chunk carthw_Xin1_state[] =
+static PICO_TLS carthw_state_chunk carthw_Xin1_state[] =
 {
-	{ CHUNK_CARTHW, sizeof(carthw_Xin1_baddr), &carthw_Xin1_baddr },
+	{ CHUNK_CARTHW, sizeof(carthw_Xin1_baddr), NULL }, // filled later
 	{ 0,            0,                         NULL }
 };
 
@@ -163,6 +164,7 @@ void carthw_Xin1_startup(void)
 	PicoCartMemSetup  = carthw_Xin1_mem_setup;
 	PicoResetHook     = carthw_Xin1_reset;
 	PicoLoadStateHook = carthw_Xin1_statef;
+	carthw_Xin1_state[0].ptr = &carthw_Xin1_baddr;
 	carthw_chunks     = carthw_Xin1_state;
 }
 
@@ -170,7 +172,7 @@ void carthw_Xin1_startup(void)
 /* Realtec, based on TascoDLX doc
  * http://www.sharemation.com/TascoDLX/REALTEC%20Cart%20Mapper%20-%20description%20v1.txt
  */
-static int realtec_bank = 0x80000000, realtec_size = 0x80000000;
+static PICO_TLS int realtec_bank = 0x80000000, realtec_size = 0x80000000;
 
 static void carthw_realtec_write8(u32 a, u32 d)
 {
@@ -291,13 +293,13 @@ void carthw_radica_startup(void)
 
 
 /* Pier Solar. Based on my own research */
-static unsigned char pier_regs[8];
-static unsigned char pier_dump_prot;
+static PICO_TLS unsigned char pier_regs[8];
+static PICO_TLS unsigned char pier_dump_prot;
 
-static carthw_state_chunk carthw_pier_state[] =
+static PICO_TLS carthw_state_chunk carthw_pier_state[] =
 {
-  { CHUNK_CARTHW,     sizeof(pier_regs),      pier_regs },
-  { CHUNK_CARTHW + 1, sizeof(pier_dump_prot), &pier_dump_prot },
+  { CHUNK_CARTHW,     sizeof(pier_regs),      NULL }, // filled later
+  { CHUNK_CARTHW + 1, sizeof(pier_dump_prot), NULL },
   { CHUNK_CARTHW + 2, 0,                      NULL }, // filled later
   { 0,                0,                      NULL }
 };
@@ -474,6 +476,8 @@ void carthw_pier_startup(void)
   Pico.sv.data = calloc(1, Pico.sv.size);
   if (!Pico.sv.data)
     Pico.sv.size = 0;
+  carthw_pier_state[0].ptr = pier_regs;
+  carthw_pier_state[1].ptr = &pier_dump_prot;
   carthw_pier_state[2].ptr = eeprom_state;
   carthw_pier_state[2].size = eeprom_size;
 
@@ -484,14 +488,14 @@ void carthw_pier_startup(void)
 }
 
 /* Simple unlicensed ROM protection emulation */
-static struct {
+static PICO_TLS struct {
   u32 addr;
   u32 mask;
   u16 val;
   u16 readonly;
 } *sprot_items;
-static int sprot_item_alloc;
-static int sprot_item_count;
+static PICO_TLS int sprot_item_alloc;
+static PICO_TLS int sprot_item_count;
 
 static u16 *carthw_sprot_get_val(u32 a, int rw_only)
 {
@@ -643,7 +647,7 @@ void carthw_sprot_startup(void)
 }
 
 /* Protection emulation for Lion King 3. Credits go to Haze */
-static u8 prot_lk3_cmd, prot_lk3_data;
+static PICO_TLS u8 prot_lk3_cmd, prot_lk3_data;
 
 static u32 PicoRead8_plk3(u32 a)
 {
@@ -8,15 +8,15 @@ typedef struct {
 	ssp1601_t ssp1601;
 } svp_t;
 
-extern svp_t *svp;
+extern PICO_TLS svp_t *svp;
 
 void PicoSVPInit(void);
 void PicoSVPStartup(void);
 void PicoSVPMemSetup(void);
 
 /* standard/ssf2 mapper */
-extern int carthw_ssf2_active;
-extern unsigned char carthw_ssf2_banks[8];
+extern PICO_TLS int carthw_ssf2_active;
+extern PICO_TLS unsigned char carthw_ssf2_banks[8];
 void carthw_ssf2_startup(void);
 void carthw_ssf2_write8(unsigned int a, unsigned int d);
 
@@ -1,11 +1,12 @@
 /*
- * SSP1601 to ARM recompiler
+ * SSP1601 to ARM and x86-64 recompiler
  * (C) notaz, 2008,2009,2010
  *
  * This work is licensed under the terms of MAME license.
  * See COPYING file in the top-level directory.
  */
 
+#include <stddef.h>
 #include "../../pico_int.h"
 #include "../../../cpu/drc/cmn.h"
 #include "compiler.h"
@@ -15,15 +16,13 @@
 #define SSP_BLOCKTAB_IRAM_ONE   (0x800/2) // table entries
 #define SSP_BLOCKTAB_IRAM_ENTS  (15*SSP_BLOCKTAB_IRAM_ONE)
 
-static u32 **ssp_block_table; // [0x5090/2];
-static u32 **ssp_block_table_iram; // [15][0x800/2];
+static PICO_TLS u32 **ssp_block_table; // [0x5090/2];
+static PICO_TLS u32 **ssp_block_table_iram; // [15][0x800/2];
 
-static u32 *tcache_ptr = NULL;
-
-static int nblocks = 0;
-static int n_in_ops = 0;
+static PICO_TLS int nblocks = 0;
+static PICO_TLS int n_in_ops = 0;
 
-extern ssp1601_t *ssp;
+extern PICO_TLS ssp1601_t *ssp;
 
 #define rPC    ssp->gr[SSP_PC].h
 #define rPMC   ssp->gr[SSP_PMC]
@@ -31,6 +30,15 @@ extern ssp1601_t *ssp;
 #define SSP_FLAG_Z (1<<0xd)
 #define SSP_FLAG_N (1<<0xf)
 
+#ifdef __x86_64__
+static PICO_TLS u8 *tcache_ptr = NULL;
+
+#define COUNT_OP
+#include <assert.h>
+#include "../../../cpu/drc/emit_x86.c"
+#else
+static u32 *tcache_ptr = NULL;
+
 #ifndef __arm__
 //#define DUMP_BLOCK 0x0c9a
 void ssp_drc_next(void){}
@@ -40,6 +48,7 @@ void ssp_drc_end(void){}
 
 #define COUNT_OP
 #include "../../../cpu/drc/emit_arm.c"
+#endif
 
 // -----------------------------------------------------
 
@@ -173,7 +182,7 @@ int ssp_get_iram_context(void)
 // -----------------------------------------------------
 
 /* regs with known values */
-static struct
+static PICO_TLS struct
 {
 	ssp_reg_t gr[8];
 	unsigned char r[8];
@@ -207,14 +216,14 @@ static struct
 #define KRREG_PM4W  (1 << 29)
 
 /* bitfield of known register values */
-static u32 known_regb = 0;
+static PICO_TLS u32 known_regb = 0;
 
 /* known vals, which need to be flushed
  * (only ST, P, r0-r7, PMCx, PMxR, PMxW)
  * ST means flags are being held in ARM PSR
  * P means that it needs to be recalculated
  */
-static u32 dirty_regb = 0;
+static PICO_TLS u32 dirty_regb = 0;
 
 /* known values of host regs.
  * -1            - unknown
@@ -222,7 +231,7 @@ static u32 dirty_regb = 0;
  * 100000-10ffff - base reg (r7) + 16bit val
  * 0r0000        - means reg (low) eq gr[r].h, r != AL
  */
-static int hostreg_r[4];
+static PICO_TLS int hostreg_r[4];
 
 static void hostreg_clear(void)
 {
@@ -251,6 +260,50 @@ void tr_unhandled(void)
 	//exit(1);
 }
 
+static int tr_detect_set_pm(unsigned int op, int *pc, int imm)
+{
+	u32 pmcv, tmpv;
+	if (!((op&0xfef0) == 0x08e0 && (PROGRAM(*pc)&0xfef0) == 0x08e0)) return 0;
+
+	// programming PMC:
+	// ldi PMC, imm1
+	// ldi PMC, imm2
+	(*pc)++;
+	pmcv = imm | (PROGRAM((*pc)++) << 16);
+	known_regs.pmc.v = pmcv;
+	known_regb |= KRREG_PMC;
+	dirty_regb |= KRREG_PMC;
+	known_regs.emu_status |= SSP_PMC_SET;
+	n_in_ops++;
+
+	// check for possible reg programming
+	tmpv = PROGRAM(*pc);
+	if ((tmpv & 0xfff8) == 0x08 || (tmpv & 0xff8f) == 0x80)
+	{
+		int is_write = (tmpv & 0xff8f) == 0x80;
+		int reg = is_write ? ((tmpv>>4)&0x7) : (tmpv&0x7);
+		if (reg > 4) tr_unhandled();
+		if ((tmpv & 0x0f) != 0 && (tmpv & 0xf0) != 0) tr_unhandled();
+		if (is_write)
+			known_regs.pmac_write[reg] = pmcv;
+		else
+			known_regs.pmac_read[reg] = pmcv;
+		known_regb |= is_write ? (1 << (reg+25)) : (1 << (reg+20));
+		dirty_regb |= is_write ? (1 << (reg+25)) : (1 << (reg+20));
+		known_regs.emu_status &= ~SSP_PMC_SET;
+		(*pc)++;
+		n_in_ops++;
+		return 5;
+	}
+
+	tr_unhandled();
+	return 4;
+}
+
+static const short pm0_block_seq[] = { 0x0880, 0, 0x0880, 0, 0x0840, 0x60 };
+
+#ifndef __x86_64__
+
 /* update P, if needed. Trashes r0 */
 static void tr_flush_dirty_P(void)
 {
@@ -1186,50 +1239,6 @@ static void tr_mac_load_XY(int op)
 	known_regb &= ~KRREG_Y;
 }
 
-// -----------------------------------------------------
-
-static int tr_detect_set_pm(unsigned int op, int *pc, int imm)
-{
-	u32 pmcv, tmpv;
-	if (!((op&0xfef0) == 0x08e0 && (PROGRAM(*pc)&0xfef0) == 0x08e0)) return 0;
-
-	// programming PMC:
-	// ldi PMC, imm1
-	// ldi PMC, imm2
-	(*pc)++;
-	pmcv = imm | (PROGRAM((*pc)++) << 16);
-	known_regs.pmc.v = pmcv;
-	known_regb |= KRREG_PMC;
-	dirty_regb |= KRREG_PMC;
-	known_regs.emu_status |= SSP_PMC_SET;
-	n_in_ops++;
-
-	// check for possible reg programming
-	tmpv = PROGRAM(*pc);
-	if ((tmpv & 0xfff8) == 0x08 || (tmpv & 0xff8f) == 0x80)
-	{
-		int is_write = (tmpv & 0xff8f) == 0x80;
-		int reg = is_write ? ((tmpv>>4)&0x7) : (tmpv&0x7);
-		if (reg > 4) tr_unhandled();
-		if ((tmpv & 0x0f) != 0 && (tmpv & 0xf0) != 0) tr_unhandled();
-		if (is_write)
-			known_regs.pmac_write[reg] = pmcv;
-		else
-			known_regs.pmac_read[reg] = pmcv;
-		known_regb |= is_write ? (1 << (reg+25)) : (1 << (reg+20));
-		dirty_regb |= is_write ? (1 << (reg+25)) : (1 << (reg+20));
-		known_regs.emu_status &= ~SSP_PMC_SET;
-		(*pc)++;
-		n_in_ops++;
-		return 5;
-	}
-
-	tr_unhandled();
-	return 4;
-}
-
-static const short pm0_block_seq[] = { 0x0880, 0, 0x0880, 0, 0x0840, 0x60 };
-
 static int tr_detect_pm0_block(unsigned int op, int *pc, int imm)
 {
 	// ldi ST, 0
@@ -1314,7 +1323,8 @@ static int translate_op(unsigned int op, int *pc, int imm, int *end_cond, int *j
 					(*pc)++; cnt++; ret++;
 					n_in_ops++;
 				}
-				tr_ptrr_mod(r, mod, 1, cnt); // skip
+				if ((r&3) != 3)
+					tr_ptrr_mod(r, mod, 1, cnt); // skip
 			}
 			tr_write_funcs[tmpv](-1);
 			if (tmpv == SSP_PC) {
@@ -1785,7 +1795,7 @@ void *ssp_translate_block(int pc)
 		if (ret & 0x10000) break;
 	}
 
-	if (ccount >= 100) {
+	if (ccount >= 100 && !(ret & 0x10000)) {
 		end_cond = A_COND_AL;
 		jump_pc = pc;
 		emith_move_r_imm(0, pc);
@@ -1826,83 +1836,1585 @@ void *ssp_translate_block(int pc)
 
 
 
-// -----------------------------------------------------
+#else // __x86_64__
 
-static void ssp1601_state_load(void)
+/*
+ * x86-64 backend.
+ * SSP state stays in ssp1601_t, which is followed/preceded by IRAM and DRAM
+ * in svp_t, so all of it (and ROM) is addressed relative to the context reg.
+ * host regs:
+ * rbp: ssp1601_t context
+ * ebx: cycles remaining
+ * esi: flags source while ST is dirty: N is it's sign bit, Z is set when 0
+ * eax: "r0", values are moved through it
+ * ecx, edx, edi: temporaries
+ */
+
+#define SSP_OFFS_GR(r)     (offsetof(ssp1601_t, gr) + (r) * sizeof(ssp_reg_t))
+#define SSP_OFFS_GRH(r)    (SSP_OFFS_GR(r) + 2)
+#define SSP_OFFS_PR(i)     (offsetof(ssp1601_t, r) + (i))
+#define SSP_OFFS_STACK     offsetof(ssp1601_t, stack)
+#define SSP_OFFS_PMAC_R(i) (offsetof(ssp1601_t, pmac_read) + (i) * 4)
+#define SSP_OFFS_PMAC_W(i) (offsetof(ssp1601_t, pmac_write) + (i) * 4)
+#define SSP_OFFS_EMUSTAT   offsetof(ssp1601_t, emu_status)
+#define SSP_OFFS_DRC(f)    offsetof(ssp1601_t, drc.f)
+#define SSP_OFFS_IRAM_ROM  ((int)offsetof(svp_t, iram_rom) - (int)offsetof(svp_t, ssp1601))
+#define SSP_OFFS_DRAM      ((int)offsetof(svp_t, dram) - (int)offsetof(svp_t, ssp1601))
+
+#define TR_COND_AL 0x10 // not a host condition
+#define SSP_BLOCK_MAX_SIZE 0x8000 // worst case tcache use of one block
+
+// dispatcher, emitted at the start of tcache
+static PICO_TLS int (*ssp_drc_entry)(ssp1601_t *ssp, int cycles);
+static PICO_TLS u8 *ssp_drc_next;
+static PICO_TLS u8 *ssp_drc_next_patch;
+static PICO_TLS u8 *ssp_drc_end;
+
+static PICO_TLS u8 *tcache_blocks;
+static PICO_TLS int tcache_flushes;
+static PICO_TLS int tr_rom_offs; // ROM, relative to ssp
+
+static void emith_call_c_func(void *target)
 {
-	ssp->drc.iram_dirty = 1;
-	ssp->drc.iram_context = 0;
+	intptr_t disp = (u8 *)target - (tcache_ptr + 5);
+	if (disp == (s32)disp) {
+		emith_call(target);
+	} else {
+		emith_move_r_ptr_imm(xAX, target);
+		emith_call_reg(xAX);
+	}
 }
 
-void ssp1601_dyn_exit(void)
+/* update P, if needed. Trashes eax, ecx */
+static void tr_flush_dirty_P(void)
 {
-	free(ssp_block_table);
-	free(ssp_block_table_iram);
-	ssp_block_table = ssp_block_table_iram = NULL;
+	if (!(dirty_regb & KRREG_P)) return;
+	emith_ctx_read_s16(xAX, SSP_OFFS_GRH(SSP_X));
+	emith_ctx_read_s16(xCX, SSP_OFFS_GRH(SSP_Y));
+	emith_mul(xAX, xAX, xCX);
+	emith_add_r_r(xAX, xAX);
+	emith_ctx_write(xAX, SSP_OFFS_GR(SSP_P));
+	dirty_regb &= ~KRREG_P;
+	hostreg_r[0] = -1;
+}
 
-	drc_cmn_cleanup();
+/* write dirty pr to memory. Nothing is trashed */
+static void tr_flush_dirty_pr(int r)
+{
+	if (!(dirty_regb & (1 << (r+8)))) return;
+	emith_ctx_write8_imm(SSP_OFFS_PR(r), known_regs.r[r]);
+	dirty_regb &= ~(1 << (r+8));
 }
 
-int ssp1601_dyn_startup(void)
+/* write all dirty pr0-pr7 to memory. Nothing is trashed */
+static void tr_flush_dirty_prs(void)
 {
-	drc_cmn_init();
+	int i;
+	for (i = 0; i < 8; i++)
+		tr_flush_dirty_pr(i);
+}
 
-	ssp_block_table = calloc(sizeof(ssp_block_table[0]), SSP_BLOCKTAB_ENTS);
-	if (ssp_block_table == NULL)
-		return -1;
-	ssp_block_table_iram = calloc(sizeof(ssp_block_table_iram[0]), SSP_BLOCKTAB_IRAM_ENTS);
-	if (ssp_block_table_iram == NULL) {
-		free(ssp_block_table);
-		return -1;
-	}
+/* write dirty pr and "forget" it. Nothing is trashed. */
+static void tr_release_pr(int r)
+{
+	tr_flush_dirty_pr(r);
+	known_regb &= ~(1 << (r+8));
+}
 
-	memset(tcache, 0, DRC_TCACHE_SIZE);
-	tcache_ptr = (void *)tcache;
+/* write flags from esi back to ST. Trashes ecx, edx */
+static void tr_flush_dirty_ST(void)
+{
+	if (!(dirty_regb & KRREG_ST)) return;
+	emith_move_r_r(xCX, xSI);
+	emith_and_r_imm(xCX, (u32)SSP_FLAG_N << 16);
+	emith_cmp_r_imm(xSI, 1);
+	emith_sbc_r_r(xDX, xDX);		// edx = esi == 0 ? -1 : 0
+	emith_and_r_imm(xDX, SSP_FLAG_Z << 16);
+	emith_or_r_r(xCX, xDX);
+	emith_ctx_read(xDX, SSP_OFFS_GR(SSP_ST));
+	emith_bic_r_imm(xDX, (u32)(SSP_FLAG_N|SSP_FLAG_Z) << 16);
+	emith_or_r_r(xCX, xDX);
+	emith_ctx_write(xCX, SSP_OFFS_GR(SSP_ST));
+	dirty_regb &= ~KRREG_ST;
+}
 
-	PicoLoadStateHook = ssp1601_state_load;
+/* inverse of above. Nothing is trashed */
+static void tr_make_dirty_ST(void)
+{
+	if (dirty_regb & KRREG_ST) return;
+	// N -> 0xa0000000, Z -> 0, neither -> 0x20000000
+	emith_ctx_read(xSI, SSP_OFFS_GR(SSP_ST));
+	emith_and_r_imm(xSI, (u32)(SSP_FLAG_N|SSP_FLAG_Z) << 16);
+	emith_eor_r_imm(xSI, SSP_FLAG_Z << 16);
+	dirty_regb |= KRREG_ST;
+}
 
-	n_in_ops = 0;
-#ifdef __arm__
-	// hle'd blocks
-	ssp_block_table[0x800/2] = (void *) ssp_hle_800;
-	ssp_block_table[0x902/2] = (void *) ssp_hle_902;
-	ssp_block_table_iram[ 7 * SSP_BLOCKTAB_IRAM_ONE + 0x030/2] = (void *) ssp_hle_07_030;
-	ssp_block_table_iram[ 7 * SSP_BLOCKTAB_IRAM_ONE + 0x036/2] = (void *) ssp_hle_07_036;
-	ssp_block_table_iram[ 7 * SSP_BLOCKTAB_IRAM_ONE + 0x6d6/2] = (void *) ssp_hle_07_6d6;
-	ssp_block_table_iram[11 * SSP_BLOCKTAB_IRAM_ONE + 0x12c/2] = (void *) ssp_hle_11_12c;
-	ssp_block_table_iram[11 * SSP_BLOCKTAB_IRAM_ONE + 0x384/2] = (void *) ssp_hle_11_384;
-	ssp_block_table_iram[11 * SSP_BLOCKTAB_IRAM_ONE + 0x38a/2] = (void *) ssp_hle_11_38a;
-#endif
+/* load 16bit val into host reg r0-r2. Nothing is trashed */
+static void tr_mov16(int r, int val)
+{
+	if (hostreg_r[r] != val) {
+		emith_move_r_imm(r, val);
+		hostreg_r[r] = val;
+	}
+}
 
-	return 0;
+/* write dirty PMC and PMAC regs. Nothing is trashed */
+static void tr_flush_dirty_pmcrs(void)
+{
+	int i;
+
+	if (!(dirty_regb & 0x3ff80000)) return;
+
+	if (dirty_regb & KRREG_PMC) {
+		emith_ctx_write_imm(SSP_OFFS_GR(SSP_PMC), known_regs.pmc.v);
+		if (known_regs.emu_status & (SSP_PMC_SET|SSP_PMC_HAVE_ADDR)) {
+			elprintf(EL_ANOMALY, "!! SSP_PMC_SET|SSP_PMC_HAVE_ADDR set on flush\n");
+			tr_unhandled();
+		}
+	}
+	for (i = 0; i < 5; i++)
+	{
+		if (dirty_regb & (1 << (20+i)))
+			emith_ctx_write_imm(SSP_OFFS_PMAC_R(i), known_regs.pmac_read[i]);
+		if (dirty_regb & (1 << (25+i)))
+			emith_ctx_write_imm(SSP_OFFS_PMAC_W(i), known_regs.pmac_write[i]);
+	}
+	dirty_regb &= ~0x3ff80000;
 }
 
+/* read bank word to eax. Nothing else is trashed */
+static void tr_bank_read(int addr) /* word addr 0-0x1ff */
+{
+	emith_ctx_read_u16(xAX, addr << 1);
+	hostreg_r[0] = -1;
+}
 
-void ssp1601_dyn_reset(ssp1601_t *ssp)
+/* write eax to bank. Nothing is trashed */
+static void tr_bank_write(int addr)
 {
-	ssp1601_reset(ssp);
-	ssp->drc.iram_dirty = 1;
-	ssp->drc.iram_context = 0;
-	// must do this here because ssp is not available @ startup()
-	ssp->drc.ptr_rom = (u32) Pico.rom;
-	ssp->drc.ptr_iram_rom = (u32) svp->iram_rom;
-	ssp->drc.ptr_dram = (u32) svp->dram;
-	ssp->drc.ptr_btable = (u32) ssp_block_table;
-	ssp->drc.ptr_btable_iram = (u32) ssp_block_table_iram;
+	emith_ctx_write16(xAX, addr << 1);
+}
 
-	// prevent new versions of IRAM from appearing
-	memset(svp->iram_rom, 0, 0x800);
+/* apply modulo mask in edx to pointer reg r, moved by count */
+static void tr_ptrr_mod_masked(int r, int mod, int count)
+{
+	emith_ctx_read_u8(xCX, SSP_OFFS_PR(r));
+	emith_add_r_r_imm(xDI, xCX, mod == 2 ? -count : count);
+	emith_eor_r_r(xDI, xCX);
+	emith_and_r_r(xDI, xDX);
+	emith_eor_r_r(xCX, xDI);		// only bits in mask changed
+	emith_ctx_write8(xCX, SSP_OFFS_PR(r));
 }
 
+/* handle RAM bank pointer modifiers. if need_modulo, trash ecx, edx, edi, else nothing */
+static void tr_ptrr_mod(int r, int mod, int need_modulo, int count)
+{
+	int modulo_shift = -1;	/* unknown */
+
+	if (mod == 0) return;
 
-void ssp1601_dyn_run(int cycles)
+	if (!need_modulo || mod == 1) // +!
+		modulo_shift = 8;
+	else if (need_modulo && (known_regb & KRREG_ST)) {
+		modulo_shift = known_regs.gr[SSP_ST].h & 7;
+		if (modulo_shift == 0) modulo_shift = 8;
+	}
+
+	if (modulo_shift == -1)
+	{
+		tr_release_pr(r);
+		emith_ctx_read(xCX, SSP_OFFS_GR(SSP_ST));
+		emith_lsr(xCX, xCX, 16);
+		emith_and_r_imm(xCX, 7);
+		EMITH_JMP_START(DCOND_NE);
+		emith_move_r_imm(xCX, 8);
+		EMITH_JMP_END(DCOND_NE);
+		emith_move_r_imm(xDX, 1);
+		emith_lsl_cl(xDX);
+		emith_sub_r_imm(xDX, 1);		// edx = modulo mask
+		tr_ptrr_mod_masked(r, mod, count);
+	}
+	else if (known_regb & (1 << (r + 8)))
+	{
+		int modulo = (1 << modulo_shift) - 1;
+		if (mod == 2)
+		     known_regs.r[r] = (known_regs.r[r] & ~modulo) | ((known_regs.r[r] - count) & modulo);
+		else known_regs.r[r] = (known_regs.r[r] & ~modulo) | ((known_regs.r[r] + count) & modulo);
+	}
+	else if (modulo_shift == 8)
+	{
+		emith_ctx_arith8_imm(mod == 2 ? 5 : 0, SSP_OFFS_PR(r), count); // sub/add
+	}
+	else
+	{
+		emith_move_r_imm(xDX, (1 << modulo_shift) - 1);
+		tr_ptrr_mod_masked(r, mod, count);
+	}
+}
+
+/* handle writes eax to (rX). Trashes ecx */
+static void tr_rX_write(int op)
 {
-	if (ssp->emu_status & SSP_WAIT_MASK) return;
+	if ((op&3) == 3)
+	{
+		int mod = (op>>2) & 3; // direct addressing
+		tr_bank_write((op & 0x100) + mod);
+	}
+	else
+	{
+		int r = (op&3) | ((op>>6)&4);
+		if (known_regb & (1 << (r + 8))) {
+			tr_bank_write((op&0x100) | known_regs.r[r]);
+		} else {
+			emith_ctx_read_u8(xCX, SSP_OFFS_PR(r));
+			emith_ctx_write16_idx(xAX, xCX, (op&0x100) << 1);
+		}
+		tr_ptrr_mod(r, (op>>2) & 3, 0, 1);
+	}
+}
 
-#ifdef DUMP_BLOCK
-	ssp_translate_block(DUMP_BLOCK >> 1);
+/* read (rX) to eax. Trashes ecx, edx, edi */
+static void tr_rX_read(int r, int mod)
+{
+	if ((r&3) == 3)
+	{
+		tr_bank_read(((r << 6) & 0x100) + mod); // direct addressing
+	}
+	else
+	{
+		if (known_regb & (1 << (r + 8))) {
+			tr_bank_read(((r << 6) & 0x100) | known_regs.r[r]);
+		} else {
+			emith_ctx_read_u8(xCX, SSP_OFFS_PR(r));
+			emith_ctx_read_u16_idx(xAX, xCX, (r << 7) & 0x200);
+			hostreg_r[0] = -1;
+		}
+		tr_ptrr_mod(r, mod, 1, 1);
+	}
+}
+
+/* read ((rX)) to eax. Trashes ecx, edx */
+static void tr_rX_read2(int op)
+{
+	int r = (op&3) | ((op>>6)&4); // src
+	int addr = -1;
+
+	if ((r&3) == 3) {
+		addr = (op&0x100) | ((op>>2)&3);
+	} else if (known_regb & (1 << (r+8))) {
+		addr = (op&0x100) | known_regs.r[r];
+	}
+
+	if (addr >= 0) {
+		emith_ctx_read_u16(xAX, addr << 1);
+		emith_add_r_r_imm(xDX, xAX, 1);
+		emith_ctx_write16(xDX, addr << 1);
+	} else {
+		emith_ctx_read_u8(xCX, SSP_OFFS_PR(r));
+		emith_ctx_read_u16_idx(xAX, xCX, (op&0x100) << 1);
+		emith_add_r_r_imm(xDX, xAX, 1);
+		emith_ctx_write16_idx(xDX, xCX, (op&0x100) << 1);
+	}
+	emith_ctx_read_u16_idx(xAX, xAX, SSP_OFFS_IRAM_ROM);
+	hostreg_r[0] = -1;
+}
+
+// -----------------------------------------------------
+
+// SSP condition -> host condition, emits a test if needed
+static int tr_cond_check(int op)
+{
+	int f = (op & 0x100) >> 8;
+	switch (op&0xf0) {
+		case 0x00: return TR_COND_AL;	/* always true */
+		case 0x50:			/* Z matches f(?) bit */
+			if (dirty_regb & KRREG_ST) {
+				emith_tst_r_r(xSI, xSI);
+				return f ? DCOND_EQ : DCOND_NE;
+			}
+			emith_ctx_tst_imm(SSP_OFFS_GR(SSP_ST), SSP_FLAG_Z << 16);
+			return f ? DCOND_NE : DCOND_EQ;
+		case 0x70:			/* N matches f(?) bit */
+			if (dirty_regb & KRREG_ST) {
+				emith_tst_r_r(xSI, xSI);
+				return f ? DCOND_MI : DCOND_PL;
+			}
+			emith_ctx_tst_imm(SSP_OFFS_GR(SSP_ST), (u32)SSP_FLAG_N << 16);
+			return f ? DCOND_NE : DCOND_EQ;
+		default:
+			elprintf(EL_ANOMALY, "unimplemented cond?\n");
+			tr_unhandled();
+			return TR_COND_AL;
+	}
+}
+
+static int tr_neg_cond(int cond)
+{
+	// x86 conditions come in pairs differing in bit 0
+	return cond ^ 1;
+}
+
+/* SSP ALU op -> x86 arith op */
+static int tr_aop_ssp2x86(int op)
+{
+	switch (op) {
+		case 1: return 5;	/* SUB */
+		case 3: return 7;	/* CMP */
+		case 4: return 0;	/* ADD */
+		case 5: return 4;	/* AND */
+		case 6: return 1;	/* OR  */
+		case 7: return 6;	/* EOR */
+	}
+
+	tr_unhandled();
+	return 0;
+}
+
+static void tr_aop_done(void)
+{
+	hostreg_sspreg_changed(SSP_A);
+	hostreg_sspreg_changed(SSP_AL);
+	dirty_regb |= KRREG_ST;
+	known_regb &= ~(KRREG_A|KRREG_AL|KRREG_ST);
+}
+
+/* A = A <aop> r, flags result in esi */
+static void tr_aop_r(int aop, int r)
+{
+	// CMP is done as SUB, esi must hold the result for the flags
+	emith_ctx_read(xSI, SSP_OFFS_GR(SSP_A));
+	emith_arith_r_r(aop == 7 ? 5 : aop, xSI, r);
+	if (aop != 7) // not CMP
+		emith_ctx_write(xSI, SSP_OFFS_GR(SSP_A));
+	tr_aop_done();
+}
+
+/* A = A <aop> imm */
+static void tr_aop_imm(int aop, u32 imm)
+{
+	emith_ctx_read(xSI, SSP_OFFS_GR(SSP_A));
+	emith_arith_r_imm(aop == 7 ? 5 : aop, xSI, imm);
+	if (aop != 7)
+		emith_ctx_write(xSI, SSP_OFFS_GR(SSP_A));
+	tr_aop_done();
+}
+
+/* A = A <aop> (eax << 16) */
+static void tr_aop_r0(int aop)
+{
+	emith_lsl(xCX, xAX, 16);
+	tr_aop_r(aop, xCX);
+}
+
+// -----------------------------------------------------
+
+//@ r0-r2: temps
+//@ ebx: cycles
+//@ esi: flags
+//@ rbp: ssp
+
+static void tr_GR0_to_r0(int op)
+{
+	tr_mov16(0, 0xffff);
+}
+
+static void tr_X_to_r0(int op)
+{
+	if (hostreg_r[0] != (SSP_X<<16)) {
+		emith_ctx_read_u16(xAX, SSP_OFFS_GRH(SSP_X));
+		hostreg_r[0] = SSP_X<<16;
+	}
+}
+
+static void tr_Y_to_r0(int op)
+{
+	if (hostreg_r[0] != (SSP_Y<<16)) {
+		emith_ctx_read_u16(xAX, SSP_OFFS_GRH(SSP_Y));
+		hostreg_r[0] = SSP_Y<<16;
+	}
+}
+
+static void tr_A_to_r0(int op)
+{
+	if (hostreg_r[0] != (SSP_A<<16)) {
+		emith_ctx_read_u16(xAX, SSP_OFFS_GRH(SSP_A));
+		hostreg_r[0] = SSP_A<<16;
+	}
+}
+
+static void tr_ST_to_r0(int op)
+{
+	tr_flush_dirty_ST();
+	emith_ctx_read_u16(xAX, SSP_OFFS_GRH(SSP_ST));
+	hostreg_r[0] = -1;
+}
+
+static void tr_STACK_to_r0(int op)
+{
+	// stack underflow wraps like in interpreter
+	emith_ctx_read_u16(xCX, SSP_OFFS_GRH(SSP_STACK));
+	emith_subf_r_imm(xCX, 1);
+	EMITH_JMP_START(DCOND_PL);
+	emith_move_r_imm(xCX, 5);
+	EMITH_JMP_END(DCOND_PL);
+	emith_ctx_write16(xCX, SSP_OFFS_GRH(SSP_STACK));
+	emith_ctx_read_u16_idx(xAX, xCX, SSP_OFFS_STACK);
+	hostreg_r[0] = -1;
+}
+
+static void tr_PC_to_r0(int op)
+{
+	tr_mov16(0, known_regs.gr[SSP_PC].h);
+}
+
+static void tr_P_to_r0(int op)
+{
+	tr_flush_dirty_P();
+	emith_ctx_read_u16(xAX, SSP_OFFS_GRH(SSP_P));
+	hostreg_r[0] = -1;
+}
+
+static void tr_AL_to_r0(int op)
+{
+	if (op == 0x000f) {
+		if (known_regb & KRREG_PMC) {
+			known_regs.emu_status &= ~(SSP_PMC_SET|SSP_PMC_HAVE_ADDR);
+		} else {
+			emith_ctx_arith_imm(4, SSP_OFFS_EMUSTAT, ~(SSP_PMC_SET|SSP_PMC_HAVE_ADDR)); // and
+		}
+	}
+
+	if (hostreg_r[0] != (SSP_AL<<16)) {
+		emith_ctx_read_u16(xAX, SSP_OFFS_GR(SSP_A));
+		hostreg_r[0] = SSP_AL<<16;
+	}
+}
+
+static void tr_PMX_to_r0(int reg)
+{
+	if ((known_regb & KRREG_PMC) && (known_regs.emu_status & SSP_PMC_SET))
+	{
+		known_regs.pmac_read[reg] = known_regs.pmc.v;
+		known_regs.emu_status &= ~SSP_PMC_SET;
+		known_regb |= 1 << (20+reg);
+		dirty_regb |= 1 << (20+reg);
+		return;
+	}
+
+	if ((known_regb & KRREG_PMC) && (known_regb & (1 << (20+reg))))
+	{
+		u32 pmcv = known_regs.pmac_read[reg];
+		int mode = pmcv>>16;
+		known_regs.emu_status &= ~SSP_PMC_HAVE_ADDR;
+
+		if      ((mode & 0xfff0) == 0x0800)
+		{
+			emith_ctx_read_u16(xAX, tr_rom_offs + ((pmcv&0xfffff)<<1));
+			known_regs.pmac_read[reg] += 1;
+		}
+		else if ((mode & 0x47ff) == 0x0018) // DRAM
+		{
+			int inc = get_inc(mode);
+			emith_ctx_read_u16(xAX, SSP_OFFS_DRAM + ((pmcv&0xffff)<<1));
+			if (reg == 4 && (pmcv == 0x187f03 || pmcv == 0x187f04)) // wait loop detection
+			{
+				int flag = (pmcv == 0x187f03) ? SSP_WAIT_30FE06 : SSP_WAIT_30FE08;
+				emith_tst_r_r(xAX, xAX);
+				EMITH_JMP_START(DCOND_NE);
+				emith_sub_r_imm(xBX, 1024);
+				emith_ctx_arith_imm(1, SSP_OFFS_EMUSTAT, flag); // or
+				EMITH_JMP_END(DCOND_NE);
+			}
+			known_regs.pmac_read[reg] += inc;
+		}
+		else
+		{
+			tr_unhandled();
+		}
+		known_regs.pmc.v = known_regs.pmac_read[reg];
+		//known_regb |= KRREG_PMC;
+		dirty_regb |= KRREG_PMC;
+		dirty_regb |= 1 << (20+reg);
+		hostreg_r[0] = -1;
+		return;
+	}
+
+	// let the C code deal with it, it expects everything in ssp1601_t
+	tr_flush_dirty_ST();
+	tr_flush_dirty_pmcrs();
+	known_regb &= ~KRREG_PMC;
+	known_regb &= ~(1 << (20+reg));
+	known_regs.emu_status &= ~(SSP_PMC_SET|SSP_PMC_HAVE_ADDR);
+
+	{
+		int arg0;
+		host_arg2reg(arg0, 0);
+		emith_move_r_imm(arg0, reg);
+		emith_call_c_func(ssp_pm_read);
+	}
+	hostreg_clear();
+}
+
+static void tr_PM0_to_r0(int op)
+{
+	tr_PMX_to_r0(0);
+}
+
+static void tr_PM1_to_r0(int op)
+{
+	tr_PMX_to_r0(1);
+}
+
+static void tr_PM2_to_r0(int op)
+{
+	tr_PMX_to_r0(2);
+}
+
+static void tr_XST_to_r0(int op)
+{
+	emith_ctx_read_u16(xAX, SSP_OFFS_GRH(SSP_XST));
+	hostreg_r[0] = -1;
+}
+
+static void tr_PM4_to_r0(int op)
+{
+	tr_PMX_to_r0(4);
+}
+
+static void tr_PMC_to_r0(int op)
+{
+	if (known_regb & KRREG_PMC)
+	{
+		if (known_regs.emu_status & SSP_PMC_HAVE_ADDR) {
+			known_regs.emu_status |= SSP_PMC_SET;
+			known_regs.emu_status &= ~SSP_PMC_HAVE_ADDR;
+			// do nothing - this is handled elsewhere
+		} else {
+			tr_mov16(0, known_regs.pmc.l);
+			known_regs.emu_status |= SSP_PMC_HAVE_ADDR;
+		}
+	}
+	else
+	{
+		emith_ctx_read(xCX, SSP_OFFS_EMUSTAT);
+		if (op != 0x000e)
+			emith_ctx_read_u16(xAX, SSP_OFFS_GR(SSP_PMC));
+		emith_tst_r_imm(xCX, SSP_PMC_HAVE_ADDR);
+		EMITH_JMP3_START(DCOND_NE);
+		emith_or_r_imm(xCX, SSP_PMC_HAVE_ADDR);
+		EMITH_JMP3_MID(DCOND_NE);
+		emith_bic_r_imm(xCX, SSP_PMC_HAVE_ADDR);
+		emith_or_r_imm(xCX, SSP_PMC_SET);
+		EMITH_JMP3_END();
+		emith_ctx_write(xCX, SSP_OFFS_EMUSTAT);
+		hostreg_r[0] = -1;
+	}
+}
+
+
+typedef void (tr_read_func)(int op);
+
+static tr_read_func *tr_read_funcs[16] =
+{
+	tr_GR0_to_r0,
+	tr_X_to_r0,
+	tr_Y_to_r0,
+	tr_A_to_r0,
+	tr_ST_to_r0,
+	tr_STACK_to_r0,
+	tr_PC_to_r0,
+	tr_P_to_r0,
+	tr_PM0_to_r0,
+	tr_PM1_to_r0,
+	tr_PM2_to_r0,
+	tr_XST_to_r0,
+	tr_PM4_to_r0,
+	(tr_read_func *)tr_unhandled,
+	tr_PMC_to_r0,
+	tr_AL_to_r0
+};
+
+
+// write r0 to general reg handlers. Trashes ecx, edx, edi unless noted
+#define TR_WRITE_R0_TO_REG(reg) \
+{ \
+	hostreg_sspreg_changed(reg); \
+	hostreg_r[0] = (reg)<<16; \
+	if (const_val != -1) { \
+		known_regs.gr[reg].h = const_val; \
+		known_regb |= 1 << (reg); \
+	} else { \
+		known_regb &= ~(1 << (reg)); \
+	} \
+}
+
+static void tr_r0_to_GR0(int const_val)
+{
+	// do nothing
+}
+
+static void tr_r0_to_X(int const_val)
+{
+	emith_ctx_write16(xAX, SSP_OFFS_GRH(SSP_X));
+	dirty_regb |= KRREG_P;	// touching X or Y makes P dirty.
+	TR_WRITE_R0_TO_REG(SSP_X);
+}
+
+static void tr_r0_to_Y(int const_val)
+{
+	emith_ctx_write16(xAX, SSP_OFFS_GRH(SSP_Y));
+	dirty_regb |= KRREG_P;
+	TR_WRITE_R0_TO_REG(SSP_Y);
+}
+
+static void tr_r0_to_A(int const_val)
+{
+	// AL is left alone, a single 16bit store is cheap here
+	emith_ctx_write16(xAX, SSP_OFFS_GRH(SSP_A));
+	TR_WRITE_R0_TO_REG(SSP_A);
+}
+
+static void tr_r0_to_ST(int const_val)
+{
+	// VR doesn't need much accuracy here..
+	emith_ctx_write16(xAX, SSP_OFFS_GRH(SSP_ST));
+	dirty_regb &= ~KRREG_ST;
+	TR_WRITE_R0_TO_REG(SSP_ST);
+}
+
+static void tr_r0_to_STACK(int const_val)
+{
+	// stack overflow wraps like in interpreter
+	emith_ctx_read_u16(xCX, SSP_OFFS_GRH(SSP_STACK));
+	emith_cmp_r_imm(xCX, 6);
+	EMITH_JMP_START(DCOND_LO);
+	emith_move_r_imm(xCX, 0);
+	EMITH_JMP_END(DCOND_LO);
+	emith_ctx_write16_idx(xAX, xCX, SSP_OFFS_STACK);
+	emith_add_r_r_imm(xCX, xCX, 1);
+	emith_ctx_write16(xCX, SSP_OFFS_GRH(SSP_STACK));
+}
+
+static void tr_r0_to_PC(int const_val)
+{
+	// eax is the next PC, the block epilogue takes it from there
+}
+
+static void tr_r0_to_AL(int const_val)
+{
+	emith_ctx_write16(xAX, SSP_OFFS_GR(SSP_A));
+	hostreg_sspreg_changed(SSP_AL);
+	if (const_val != -1) {
+		known_regs.gr[SSP_A].l = const_val;
+		known_regb |= 1 << SSP_AL;
+	} else
+		known_regb &= ~(1 << SSP_AL);
+}
+
+static void tr_r0_to_PMX(int reg)
+{
+	if ((known_regb & KRREG_PMC) && (known_regs.emu_status & SSP_PMC_SET))
+	{
+		known_regs.pmac_write[reg] = known_regs.pmc.v;
+		known_regs.emu_status &= ~SSP_PMC_SET;
+		known_regb |= 1 << (25+reg);
+		dirty_regb |= 1 << (25+reg);
+		return;
+	}
+
+	if ((known_regb & KRREG_PMC) && (known_regb & (1 << (25+reg))))
+	{
+		int mode, addr;
+
+		known_regs.emu_status &= ~SSP_PMC_HAVE_ADDR;
+
+		mode = known_regs.pmac_write[reg]>>16;
+		addr = known_regs.pmac_write[reg]&0xffff;
+		if      ((mode & 0x43ff) == 0x0018 && !(mode & 0x0400)) // DRAM
+		{
+			int inc = get_inc(mode);
+			emith_ctx_write16(xAX, SSP_OFFS_DRAM + (addr << 1));
+			known_regs.pmac_write[reg] += inc;
+		}
+		else if ((mode & 0xfbff) == 0x4018 && !(mode & 0x0400)) // DRAM, cell inc
+		{
+			emith_ctx_write16(xAX, SSP_OFFS_DRAM + (addr << 1));
+			known_regs.pmac_write[reg] += (addr&1) ? 31 : 1;
+		}
+		else if ((mode & 0x47ff) == 0x001c) // IRAM
+		{
+			int inc = get_inc(mode);
+			emith_ctx_write16(xAX, SSP_OFFS_IRAM_ROM + ((addr&0x3ff) << 1));
+			emith_ctx_write_imm(SSP_OFFS_DRC(iram_dirty), 1);
+			known_regs.pmac_write[reg] += inc;
+		}
+		else
+			goto slow; // overwrite mode or something unexpected
+
+		known_regs.pmc.v = known_regs.pmac_write[reg];
+		//known_regb |= KRREG_PMC;
+		dirty_regb |= KRREG_PMC;
+		dirty_regb |= 1 << (25+reg);
+		hostreg_r[0] = -1;
+		return;
+	}
+
+slow:
+	tr_flush_dirty_ST();
+	tr_flush_dirty_pmcrs();
+	known_regb &= ~KRREG_PMC;
+	known_regb &= ~(1 << (25+reg));
+	known_regs.emu_status &= ~(SSP_PMC_SET|SSP_PMC_HAVE_ADDR);
+
+	{
+		int arg0, arg1;
+		host_arg2reg(arg0, 0);
+		host_arg2reg(arg1, 1);
+		emith_move_r_r(arg0, xAX);
+		emith_move_r_imm(arg1, reg);
+		emith_call_c_func(ssp_pm_write);
+	}
+	hostreg_clear();
+}
+
+static void tr_r0_to_PM0(int const_val)
+{
+	tr_r0_to_PMX(0);
+}
+
+static void tr_r0_to_PM1(int const_val)
+{
+	tr_r0_to_PMX(1);
+}
+
+static void tr_r0_to_PM2(int const_val)
+{
+	tr_r0_to_PMX(2);
+}
+
+static void tr_r0_to_PM4(int const_val)
+{
+	tr_r0_to_PMX(4);
+}
+
+static void tr_r0_to_PMC(int const_val)
+{
+	if ((known_regb & KRREG_PMC) && const_val != -1)
+	{
+		if (known_regs.emu_status & SSP_PMC_HAVE_ADDR) {
+			known_regs.emu_status |= SSP_PMC_SET;
+			known_regs.emu_status &= ~SSP_PMC_HAVE_ADDR;
+			known_regs.pmc.h = const_val;
+		} else {
+			known_regs.emu_status |= SSP_PMC_HAVE_ADDR;
+			known_regs.pmc.l = const_val;
+		}
+	}
+	else
+	{
+		if (known_regb & KRREG_PMC) {
+			// move the whole PMC state to memory
+			emith_ctx_write_imm(SSP_OFFS_GR(SSP_PMC), known_regs.pmc.v);
+			emith_ctx_arith_imm(4, SSP_OFFS_EMUSTAT, ~(SSP_PMC_SET|SSP_PMC_HAVE_ADDR));
+			if (known_regs.emu_status & (SSP_PMC_SET|SSP_PMC_HAVE_ADDR))
+				emith_ctx_arith_imm(1, SSP_OFFS_EMUSTAT,
+					known_regs.emu_status & (SSP_PMC_SET|SSP_PMC_HAVE_ADDR));
+			known_regs.emu_status &= ~(SSP_PMC_SET|SSP_PMC_HAVE_ADDR);
+			known_regb &= ~KRREG_PMC;
+			dirty_regb &= ~KRREG_PMC;
+		}
+		emith_ctx_read(xCX, SSP_OFFS_EMUSTAT);
+		emith_tst_r_imm(xCX, SSP_PMC_HAVE_ADDR);
+		EMITH_JMP3_START(DCOND_NE);
+		emith_ctx_write16(xAX, SSP_OFFS_GR(SSP_PMC));
+		emith_or_r_imm(xCX, SSP_PMC_HAVE_ADDR);
+		EMITH_JMP3_MID(DCOND_NE);
+		emith_ctx_write16(xAX, SSP_OFFS_GRH(SSP_PMC));
+		emith_bic_r_imm(xCX, SSP_PMC_HAVE_ADDR);
+		emith_or_r_imm(xCX, SSP_PMC_SET);
+		EMITH_JMP3_END();
+		emith_ctx_write(xCX, SSP_OFFS_EMUSTAT);
+	}
+}
+
+typedef void (tr_write_func)(int const_val);
+
+static tr_write_func *tr_write_funcs[16] =
+{
+	tr_r0_to_GR0,
+	tr_r0_to_X,
+	tr_r0_to_Y,
+	tr_r0_to_A,
+	tr_r0_to_ST,
+	tr_r0_to_STACK,
+	tr_r0_to_PC,
+	(tr_write_func *)tr_unhandled,
+	tr_r0_to_PM0,
+	tr_r0_to_PM1,
+	tr_r0_to_PM2,
+	(tr_write_func *)tr_unhandled,
+	tr_r0_to_PM4,
+	(tr_write_func *)tr_unhandled,
+	tr_r0_to_PMC,
+	tr_r0_to_AL
+};
+
+// known_regb bits 8+ are pointer regs, not gr
+#define TR_KNOWN_GR(r) ((r) < 8 && (known_regb & (1 << (r))))
+
+static void tr_mac_load_XY(int op)
+{
+	tr_rX_read(op&3, (op>>2)&3); // X
+	emith_ctx_write16(xAX, SSP_OFFS_GRH(SSP_X));
+	tr_rX_read(((op>>4)&3)|4, (op>>6)&3);
+	emith_ctx_write16(xAX, SSP_OFFS_GRH(SSP_Y));
+	dirty_regb |= KRREG_P;
+	hostreg_sspreg_changed(SSP_X);
+	hostreg_sspreg_changed(SSP_Y);
+	known_regb &= ~KRREG_X;
+	known_regb &= ~KRREG_Y;
+}
+
+/* A = A <mod op>, repeated count times */
+static void tr_mod_a(int op, int count)
+{
+	emith_ctx_read(xSI, SSP_OFFS_GR(SSP_A));
+	switch (op & 7) {
+		case 2: // shr (arithmetic)
+			emith_asr(xSI, xSI, count > 31 ? 31 : count);
+			break;
+		case 3: // shl
+			if (count > 31)
+				emith_move_r_imm(xSI, 0);
+			else
+				emith_lsl(xSI, xSI, count);
+			break;
+		case 6: // neg
+			emith_neg_r_r(xSI, xSI);
+			break;
+		case 7: // abs
+			emith_move_r_r(xCX, xSI);
+			emith_asr(xCX, xCX, 31);
+			emith_eor_r_r(xSI, xCX);
+			emith_sub_r_r(xSI, xCX);
+			break;
+		default:
+			tr_unhandled();
+	}
+	emith_ctx_write(xSI, SSP_OFFS_GR(SSP_A));
+}
+
+// -----------------------------------------------------
+
+static int tr_detect_pm0_block(unsigned int op, int *pc, int imm)
+{
+	// ldi ST, 0
+	// ldi PM0, 0
+	// ldi PM0, 0
+	// ldi ST, 60h
+	unsigned short *pp;
+	if (op != 0x0840 || imm != 0) return 0;
+	pp = PROGRAM_P(*pc);
+	if (memcmp(pp, pm0_block_seq, sizeof(pm0_block_seq)) != 0) return 0;
+
+	tr_mov16(0, 0);
+	emith_ctx_write16(xAX, SSP_OFFS_GRH(SSP_PM0));
+	tr_mov16(0, 0x60);
+	emith_ctx_write16(xAX, SSP_OFFS_GRH(SSP_ST));
+	hostreg_sspreg_changed(SSP_ST);
+	known_regs.gr[SSP_ST].h = 0x60;
+	known_regb |= 1 << SSP_ST;
+	dirty_regb &= ~KRREG_ST;
+	(*pc) += 3*2;
+	n_in_ops += 3;
+	return 4*2;
+}
+
+static int tr_detect_rotate(unsigned int op, int *pc, int imm)
+{
+	// @ 3DA2 and 426A
+	// ld PMC, (r3|00)
+	// ld (r3|00), PMC
+	// ld -, AL
+	if (op != 0x02e3 || PROGRAM(*pc) != 0x04e3 || PROGRAM(*pc + 1) != 0x000f) return 0;
+
+	tr_bank_read(0);
+	emith_move_r_r(xCX, xAX);
+	emith_lsl(xAX, xAX, 4);
+	emith_lsr(xCX, xCX, 12);
+	emith_or_r_r(xAX, xCX);
+	tr_bank_write(0);
+	(*pc) += 2;
+	n_in_ops += 2;
+	return 3;
+}
+
+// -----------------------------------------------------
+
+/* end_cond:
+ * 0: unconditional direct jump
+ * >0: conditional direct jump, SSP condition bits of the op
+ * <0: indirect jump, PC in eax
+ */
+static int translate_op(unsigned int op, int *pc, int imm, int *end_cond, int *jump_pc)
+{
+	u32 tmpv, tmpv2;
+	int ret = 0;
+	known_regs.gr[SSP_PC].h = *pc;
+
+	switch (op >> 9)
+	{
+		// ld d, s
+		case 0x00:
+			if (op == 0) { ret++; break; } // nop
+			tmpv  = op & 0xf; // src
+			tmpv2 = (op >> 4) & 0xf; // dst
+			if (tmpv2 == SSP_A && tmpv == SSP_P) { // ld A, P
+				tr_flush_dirty_P();
+				emith_ctx_read(xCX, SSP_OFFS_GR(SSP_P));
+				emith_ctx_write(xCX, SSP_OFFS_GR(SSP_A));
+				hostreg_sspreg_changed(SSP_A);
+				hostreg_sspreg_changed(SSP_AL);
+				known_regb &= ~(KRREG_A|KRREG_AL);
+				ret++; break;
+			}
+			tr_read_funcs[tmpv](op);
+			tr_write_funcs[tmpv2](TR_KNOWN_GR(tmpv) ? known_regs.gr[tmpv].h : -1);
+			if (tmpv2 == SSP_PC) {
+				ret |= 0x10000;
+				*end_cond = -1;
+			}
+			ret++; break;
+
+		// ld d, (ri)
+		case 0x01: {
+			int r = (op&3) | ((op>>6)&4);
+			int mod = (op>>2)&3;
+			tmpv = (op >> 4) & 0xf; // dst
+			ret = tr_detect_rotate(op, pc, imm);
+			if (ret > 0) break;
+			if (tmpv != 0)
+				tr_rX_read(r, mod);
+			else {
+				int cnt = 1;
+				while (PROGRAM(*pc) == op) {
+					(*pc)++; cnt++; ret++;
+					n_in_ops++;
+				}
+				if ((r&3) != 3)
+					tr_ptrr_mod(r, mod, 1, cnt); // skip
+			}
+			tr_write_funcs[tmpv](-1);
+			if (tmpv == SSP_PC) {
+				ret |= 0x10000;
+				*end_cond = -1;
+			}
+			ret++; break;
+		}
+
+		// ld (ri), s
+		case 0x02:
+			tmpv = (op >> 4) & 0xf; // src
+			tr_read_funcs[tmpv](op);
+			tr_rX_write(op);
+			ret++; break;
+
+		// ld a, adr
+		case 0x03:
+			tr_bank_read(op&0x1ff);
+			tr_r0_to_A(-1);
+			ret++; break;
+
+		// ldi d, imm
+		case 0x04:
+			tmpv = (op & 0xf0) >> 4; // dst
+			ret = tr_detect_pm0_block(op, pc, imm);
+			if (ret > 0) break;
+			ret = tr_detect_set_pm(op, pc, imm);
+			if (ret > 0) break;
+			tr_mov16(0, imm);
+			tr_write_funcs[tmpv](imm);
+			if (tmpv == SSP_PC) {
+				ret |= 0x10000;
+				*jump_pc = imm;
+			}
+			ret += 2; break;
+
+		// ld d, ((ri))
+		case 0x05:
+			tmpv2 = (op >> 4) & 0xf;  // dst
+			tr_rX_read2(op);
+			tr_write_funcs[tmpv2](-1);
+			if (tmpv2 == SSP_PC) {
+				ret |= 0x10000;
+				*end_cond = -1;
+			}
+			ret += 3; break;
+
+		// ldi (ri), imm
+		case 0x06:
+			tr_mov16(0, imm);
+			tr_rX_write(op);
+			ret += 2; break;
+
+		// ld adr, a
+		case 0x07:
+			tr_A_to_r0(op);
+			tr_bank_write(op&0x1ff);
+			ret++; break;
+
+		// ld d, ri
+		case 0x09: {
+			int r;
+			r = (op&3) | ((op>>6)&4); // src
+			tmpv2 = (op >> 4) & 0xf;  // dst
+			if ((r&3) == 3) tr_unhandled();
+
+			if (known_regb & (1 << (r+8))) {
+				tr_mov16(0, known_regs.r[r]);
+				tr_write_funcs[tmpv2](known_regs.r[r]);
+			} else {
+				emith_ctx_read_u8(xAX, SSP_OFFS_PR(r));
+				hostreg_r[0] = -1;
+				tr_write_funcs[tmpv2](-1);
+			}
+			ret++; break;
+		}
+
+		// ld ri, s
+		case 0x0a: {
+			int r;
+			r = (op&3) | ((op>>6)&4); // dst
+			tmpv = (op >> 4) & 0xf;   // src
+			if ((r&3) == 3) tr_unhandled();
+
+			if (TR_KNOWN_GR(tmpv)) {
+				known_regs.r[r] = known_regs.gr[tmpv].h;
+				known_regb |= 1 << (r + 8);
+				dirty_regb |= 1 << (r + 8);
+			} else {
+				tr_read_funcs[tmpv](op);
+				emith_ctx_write8(xAX, SSP_OFFS_PR(r));
+				known_regb &= ~(1 << (r+8));
+				dirty_regb &= ~(1 << (r+8));
+			}
+			ret++; break;
+		}
+
+		// ldi ri, simm
+		case 0x0c: case 0x0d: case 0x0e: case 0x0f:
+			tmpv = (op>>8)&7;
+			known_regs.r[tmpv] = op;
+			known_regb |= 1 << (tmpv + 8);
+			dirty_regb |= 1 << (tmpv + 8);
+			ret++; break;
+
+		// call cond, addr
+		case 0x24: {
+			int cond = tr_cond_check(op);
+			if (cond != TR_COND_AL) {
+				EMITH_JMP_START(tr_neg_cond(cond));
+				tr_mov16(0, *pc);
+				tr_r0_to_STACK(*pc);
+				EMITH_JMP_END(tr_neg_cond(cond));
+				hostreg_r[0] = -1;
+			} else {
+				tr_mov16(0, *pc);
+				tr_r0_to_STACK(*pc);
+			}
+			ret |= 0x10000;
+			*end_cond = (cond == TR_COND_AL) ? 0 : (op & 0x1f0);
+			*jump_pc = imm;
+			ret += 2; break;
+		}
+
+		// ld d, (a)
+		case 0x25:
+			tmpv2 = (op >> 4) & 0xf;  // dst
+			emith_ctx_read_u16(xCX, SSP_OFFS_GRH(SSP_A));
+			emith_ctx_read_u16_idx(xAX, xCX, SSP_OFFS_IRAM_ROM);
+			hostreg_r[0] = -1;
+			tr_write_funcs[tmpv2](-1);
+			if (tmpv2 == SSP_PC) {
+				ret |= 0x10000;
+				*end_cond = -1;
+			}
+			ret += 3; break;
+
+		// bra cond, addr
+		case 0x26: {
+			int cond = tr_cond_check(op);
+			ret |= 0x10000;
+			*end_cond = (cond == TR_COND_AL) ? 0 : (op & 0x1f0);
+			*jump_pc = imm;
+			ret += 2; break;
+		}
+
+		// mod cond, op
+		case 0x48: {
+			int cond;
+			// check for repeats of this op
+			tmpv = 1; // count
+			while (PROGRAM(*pc) == op && (op & 7) != 6) {
+				(*pc)++; tmpv++;
+				n_in_ops++;
+			}
+			if ((op&0xf0) != 0) // !always
+				tr_make_dirty_ST();
+
+			cond = tr_cond_check(op);
+			if (cond != TR_COND_AL) {
+				EMITH_JMP_START(tr_neg_cond(cond));
+				tr_mod_a(op, tmpv);
+				EMITH_JMP_END(tr_neg_cond(cond));
+			} else
+				tr_mod_a(op, tmpv);
+			hostreg_sspreg_changed(SSP_A);
+			hostreg_sspreg_changed(SSP_AL);
+			dirty_regb |=  KRREG_ST;
+			known_regb &= ~(KRREG_A|KRREG_AL|KRREG_ST);
+			ret += tmpv; break;
+		}
+
+		// mpys?
+		case 0x1b:
+			tr_flush_dirty_P();
+			tr_mac_load_XY(op);
+			emith_ctx_read(xCX, SSP_OFFS_GR(SSP_P));
+			tr_aop_r(5, xCX); // sub
+			ret++; break;
+
+		// mpya (rj), (ri), b
+		case 0x4b:
+			tr_flush_dirty_P();
+			tr_mac_load_XY(op);
+			emith_ctx_read(xCX, SSP_OFFS_GR(SSP_P));
+			tr_aop_r(0, xCX); // add
+			ret++; break;
+
+		// mld (rj), (ri), b
+		case 0x5b:
+			emith_ctx_write_imm(SSP_OFFS_GR(SSP_A), 0);
+			emith_move_r_imm(xSI, 0); // Z
+			hostreg_sspreg_changed(SSP_A);
+			hostreg_sspreg_changed(SSP_AL);
+			known_regs.gr[SSP_A].v = 0;
+			known_regb |= (KRREG_A|KRREG_AL);
+			dirty_regb |= KRREG_ST;
+			known_regb &= ~KRREG_ST;
+			tr_mac_load_XY(op);
+			ret++; break;
+
+		// OP a, s
+		case 0x10:
+		case 0x30:
+		case 0x40:
+		case 0x50:
+		case 0x60:
+		case 0x70:
+			tmpv = op & 0xf; // src
+			tmpv2 = tr_aop_ssp2x86(op>>13); // op
+			if (tmpv == SSP_P) {
+				tr_flush_dirty_P();
+				emith_ctx_read(xCX, SSP_OFFS_GR(SSP_P));
+				tr_aop_r(tmpv2, xCX);
+			} else if (tmpv == SSP_A) {
+				emith_ctx_read(xCX, SSP_OFFS_GR(SSP_A));
+				tr_aop_r(tmpv2, xCX);
+			} else {
+				tr_read_funcs[tmpv](op);
+				tr_aop_r0(tmpv2);
+			}
+			ret++; break;
+
+		// OP a, (ri)
+		case 0x11:
+		case 0x31:
+		case 0x41:
+		case 0x51:
+		case 0x61:
+		case 0x71:
+			tmpv2 = tr_aop_ssp2x86(op>>13); // op
+			tr_rX_read((op&3)|((op>>6)&4), (op>>2)&3);
+			tr_aop_r0(tmpv2);
+			ret++; break;
+
+		// OP a, adr
+		case 0x13:
+		case 0x33:
+		case 0x43:
+		case 0x53:
+		case 0x63:
+		case 0x73:
+			tmpv2 = tr_aop_ssp2x86(op>>13); // op
+			tr_bank_read(op&0x1ff);
+			tr_aop_r0(tmpv2);
+			ret++; break;
+
+		// OP a, imm
+		case 0x14:
+		case 0x34:
+		case 0x44:
+		case 0x54:
+		case 0x64:
+		case 0x74:
+			tmpv2 = tr_aop_ssp2x86(op>>13); // op
+			tr_aop_imm(tmpv2, imm << 16);
+			ret += 2; break;
+
+		// OP a, ((ri))
+		case 0x15:
+		case 0x35:
+		case 0x45:
+		case 0x55:
+		case 0x65:
+		case 0x75:
+			tmpv2 = tr_aop_ssp2x86(op>>13); // op
+			tr_rX_read2(op);
+			tr_aop_r0(tmpv2);
+			ret += 3; break;
+
+		// OP a, ri
+		case 0x19:
+		case 0x39:
+		case 0x49:
+		case 0x59:
+		case 0x69:
+		case 0x79: {
+			int r;
+			tmpv2 = tr_aop_ssp2x86(op>>13); // op
+			r = (op&3) | ((op>>6)&4); // src
+			if ((r&3) == 3) tr_unhandled();
+
+			if (known_regb & (1 << (r+8))) {
+				tr_aop_imm(tmpv2, known_regs.r[r] << 16);
+			} else {
+				emith_ctx_read_u8(xAX, SSP_OFFS_PR(r));
+				hostreg_r[0] = -1;
+				tr_aop_r0(tmpv2);
+			}
+			ret++; break;
+		}
+
+		// OP simm
+		case 0x1c:
+		case 0x3c:
+		case 0x4c:
+		case 0x5c:
+		case 0x6c:
+		case 0x7c:
+			tmpv2 = tr_aop_ssp2x86(op>>13); // op
+			tr_aop_imm(tmpv2, (op & 0xff) << 16);
+			ret++; break;
+	}
+
+	n_in_ops++;
+
+	return ret;
+}
+
+static void emit_block_prologue(void)
+{
+	// check if there are enough cycles..
+	// note: eax must contain PC of current block
+	emith_cmp_r_imm(xBX, 0);
+	emith_jump_cond(DCOND_LE, ssp_drc_end);
+}
+
+/* jump to block at pc, linking directly when possible */
+static void emit_jump_block(int pc, int via_dispatcher)
+{
+	u32 *target = NULL;
+
+	tr_mov16(0, pc);
+	if (!via_dispatcher)
+		target = (pc < 0x400) ?
+			ssp_block_table_iram[ssp->drc.iram_context * SSP_BLOCKTAB_IRAM_ONE + pc] :
+			ssp_block_table[pc];
+
+	if (via_dispatcher) {
+		emith_jump(ssp_drc_next);
+	} else if (target != NULL) {
+		emith_jump(target);
+	} else {
+		// gets patched to a jump once the target is translated
+		emith_call(ssp_drc_next_patch);
+	}
+}
+
+static void emit_block_epilogue(int cycles, int cond, int pc, int end_pc)
+{
+	// rom -> iram jump, must use dispatcher as IRAM context may change
+	int rom_to_iram = end_pc >= 0x400 && pc < 0x400;
+
+	emith_sub_r_imm(xBX, cycles);
+
+	if (cond < 0) {
+		// indirect jump
+		emith_jump(ssp_drc_next);
+	}
+	else if (cond == 0) {
+		emit_jump_block(pc, rom_to_iram);
+	}
+	else {
+		cond = tr_cond_check(cond);
+		EMITH_JMP_START(cond);
+		emit_jump_block(end_pc, 0);
+		EMITH_JMP_END(cond);
+		hostreg_r[0] = -1;
+		emit_jump_block(pc, rom_to_iram);
+	}
+}
+
+static void tr_flush_tcache(void)
+{
+	elprintf(EL_STATUS|EL_SVP, "svp drc: tcache flush");
+	memset(ssp_block_table, 0, sizeof(ssp_block_table[0]) * SSP_BLOCKTAB_ENTS);
+	memset(ssp_block_table_iram, 0, sizeof(ssp_block_table_iram[0]) * SSP_BLOCKTAB_IRAM_ENTS);
+	tcache_ptr = tcache_blocks;
+	tcache_flushes++;
+}
+
+void *ssp_translate_block(int pc)
+{
+	unsigned int op, op1, imm, ccount = 0;
+	u8 *block_start;
+	int ret, end_cond = 0, jump_pc = -1;
+
+	if (tcache_ptr - tcache > DRC_TCACHE_SIZE - SSP_BLOCK_MAX_SIZE)
+		tr_flush_tcache();
+
+	block_start = tcache_ptr;
+	known_regb = 0;
+	dirty_regb = KRREG_P;
+	known_regs.emu_status = 0;
+	hostreg_clear();
+	tr_rom_offs = (u8 *)Pico.rom - (u8 *)ssp;
+
+	emit_block_prologue();
+
+	for (; ccount < 100;)
+	{
+		op = PROGRAM(pc++);
+		op1 = op >> 9;
+		imm = (u32)-1;
+
+		if ((op1 & 0xf) == 4 || (op1 & 0xf) == 6)
+			imm = PROGRAM(pc++); // immediate
+
+		ret = translate_op(op, &pc, imm, &end_cond, &jump_pc);
+		if (ret <= 0)
+		{
+			elprintf(EL_ANOMALY, "NULL func! op=%08x (%02x)\n", op, op1);
+			//exit(1);
+		}
+
+		ccount += ret & 0xffff;
+		if (ret & 0x10000) break;
+	}
+
+	if (ccount >= 100 && !(ret & 0x10000)) {
+		end_cond = 0;
+		jump_pc = pc;
+	}
+
+	tr_flush_dirty_prs();
+	tr_flush_dirty_ST();
+	tr_flush_dirty_pmcrs();
+	emit_block_epilogue(ccount, end_cond, jump_pc, pc);
+
+	// stats
+	nblocks++;
+
+	return block_start;
+}
+
+/* find or translate the block at pc, called from the dispatcher */
+static void *ssp_drc_lookup(int pc)
+{
+	u32 **entry;
+
+	if (pc < 0x400) {
+		if (ssp->drc.iram_dirty) {
+			ssp->drc.iram_context = ssp_get_iram_context();
+			ssp->drc.iram_dirty = 0;
+		}
+		entry = &ssp_block_table_iram[ssp->drc.iram_context * SSP_BLOCKTAB_IRAM_ONE + pc];
+	}
+	else
+		entry = &ssp_block_table[pc];
+
+	if (*entry == NULL)
+		*entry = ssp_translate_block(pc);
+
+	return *entry;
+}
+
+/* same, but also turn the calling call insn into a direct jump */
+static void *ssp_drc_lookup_patch(int pc, u8 *ret_addr)
+{
+	int flushes = tcache_flushes;
+	void *target = ssp_drc_lookup(pc);
+
+	// caller is gone if tcache got flushed
+	if (flushes == tcache_flushes)
+		emith_jump_at(ret_addr - 5, target);
+
+	return target;
+}
+
+static void emit_dispatcher(void)
+{
+	u8 *jmp_iram, *jmp_miss1, *jmp_miss2, *jmp_miss3;
+	int arg0, arg1;
+
+	host_arg2reg(arg0, 0);
+	host_arg2reg(arg1, 1);
+
+	// int ssp_drc_entry(ssp1601_t *ssp, int cycles)
+	ssp_drc_entry = (void *)tcache_ptr;
+	emith_sh2_drc_entry();
+	emith_move_r_r_ptr(CONTEXT_REG, arg0);
+	emith_move_r_r(xBX, arg1);
+	emith_ctx_read_u16(xAX, SSP_OFFS_GRH(SSP_PC));
+
+	// eax: PC of the next block
+	ssp_drc_next = tcache_ptr;
+	emith_cmp_r_imm(xAX, 0x400);
+	JMP8_POS(jmp_iram);
+	emith_move_r_ptr_imm(xCX, ssp_block_table);
+	emith_read_r_r_idx_ptr(xCX, xCX, xAX);
+	emith_tst_r_r_ptr(xCX, xCX);
+	JMP8_POS(jmp_miss1);
+	emith_jump_reg(xCX);
+
+	JMP8_EMIT(DCOND_LO, jmp_iram);
+	emith_ctx_cmp_imm(SSP_OFFS_DRC(iram_dirty), 0);
+	JMP8_POS(jmp_miss2);
+	emith_ctx_read(xCX, SSP_OFFS_DRC(iram_context));
+	emith_lsl(xCX, xCX, 10); // * SSP_BLOCKTAB_IRAM_ONE
+	emith_add_r_r(xCX, xAX);
+	emith_move_r_ptr_imm(xDX, ssp_block_table_iram);
+	emith_read_r_r_idx_ptr(xCX, xDX, xCX);
+	emith_tst_r_r_ptr(xCX, xCX);
+	JMP8_POS(jmp_miss3);
+	emith_jump_reg(xCX);
+
+	// not translated yet, or IRAM context needs to be found
+	JMP8_EMIT(DCOND_EQ, jmp_miss1);
+	JMP8_EMIT(DCOND_NE, jmp_miss2);
+	JMP8_EMIT(DCOND_EQ, jmp_miss3);
+	emith_ctx_write(xAX, SSP_OFFS_DRC(tmp0));
+	emith_move_r_r(arg0, xAX);
+	emith_call_c_func(ssp_drc_lookup);
+	emith_move_r_r_ptr(xCX, xAX);
+	emith_ctx_read(xAX, SSP_OFFS_DRC(tmp0));
+	emith_jump_reg(xCX);
+
+	// called from a block, same as above + link the caller
+	ssp_drc_next_patch = tcache_ptr;
+	emith_pop(arg1);
+	emith_ctx_write(xAX, SSP_OFFS_DRC(tmp0));
+	emith_move_r_r(arg0, xAX);
+	emith_call_c_func(ssp_drc_lookup_patch);
+	emith_move_r_r_ptr(xCX, xAX);
+	emith_ctx_read(xAX, SSP_OFFS_DRC(tmp0));
+	emith_jump_reg(xCX);
+
+	// out of cycles, eax: PC
+	ssp_drc_end = tcache_ptr;
+	emith_lsl(xAX, xAX, 16);
+	emith_ctx_write(xAX, SSP_OFFS_GR(SSP_PC));
+	emith_move_r_r(xAX, xBX);
+	emith_sh2_drc_exit();
+
+	tcache_blocks = tcache_ptr;
+}
+
+#endif // __x86_64__
+
+// -----------------------------------------------------
+
+static void ssp1601_state_load(void)
+{
+	ssp->drc.iram_dirty = 1;
+	ssp->drc.iram_context = 0;
+}
+
+void ssp1601_dyn_exit(void)
+{
+	free(ssp_block_table);
+	free(ssp_block_table_iram);
+	ssp_block_table = ssp_block_table_iram = NULL;
+
+	drc_cmn_cleanup();
+}
+
+int ssp1601_dyn_startup(void)
+{
+	drc_cmn_init();
+
+	ssp_block_table = calloc(sizeof(ssp_block_table[0]), SSP_BLOCKTAB_ENTS);
+	if (ssp_block_table == NULL)
+		return -1;
+	ssp_block_table_iram = calloc(sizeof(ssp_block_table_iram[0]), SSP_BLOCKTAB_IRAM_ENTS);
+	if (ssp_block_table_iram == NULL) {
+		free(ssp_block_table);
+		return -1;
+	}
+
+	memset(tcache, 0, DRC_TCACHE_SIZE);
+	tcache_ptr = (void *)tcache;
+
+	PicoLoadStateHook = ssp1601_state_load;
+
+	n_in_ops = 0;
+#ifdef __x86_64__
+	emit_dispatcher();
 #endif
 #ifdef __arm__
+	// hle'd blocks
+	ssp_block_table[0x800/2] = (void *) ssp_hle_800;
+	ssp_block_table[0x902/2] = (void *) ssp_hle_902;
+	ssp_block_table_iram[ 7 * SSP_BLOCKTAB_IRAM_ONE + 0x030/2] = (void *) ssp_hle_07_030;
+	ssp_block_table_iram[ 7 * SSP_BLOCKTAB_IRAM_ONE + 0x036/2] = (void *) ssp_hle_07_036;
+	ssp_block_table_iram[ 7 * SSP_BLOCKTAB_IRAM_ONE + 0x6d6/2] = (void *) ssp_hle_07_6d6;
+	ssp_block_table_iram[11 * SSP_BLOCKTAB_IRAM_ONE + 0x12c/2] = (void *) ssp_hle_11_12c;
+	ssp_block_table_iram[11 * SSP_BLOCKTAB_IRAM_ONE + 0x384/2] = (void *) ssp_hle_11_384;
+	ssp_block_table_iram[11 * SSP_BLOCKTAB_IRAM_ONE + 0x38a/2] = (void *) ssp_hle_11_38a;
+#endif
+
+	return 0;
+}
+
+
+void ssp1601_dyn_reset(ssp1601_t *ssp)
+{
+	ssp1601_reset(ssp);
+	ssp->drc.iram_dirty = 1;
+	ssp->drc.iram_context = 0;
+#ifndef __x86_64__
+	// must do this here because ssp is not available @ startup()
+	ssp->drc.ptr_rom = (u32) Pico.rom;
+	ssp->drc.ptr_iram_rom = (u32) svp->iram_rom;
+	ssp->drc.ptr_dram = (u32) svp->dram;
+	ssp->drc.ptr_btable = (u32) ssp_block_table;
+	ssp->drc.ptr_btable_iram = (u32) ssp_block_table_iram;
+#endif
+
+	// prevent new versions of IRAM from appearing
+	memset(svp->iram_rom, 0, 0x800);
+}
+
+
+void ssp1601_dyn_run(int cycles)
+{
+	if (ssp->emu_status & SSP_WAIT_MASK) return;
+
+#ifdef DUMP_BLOCK
+	ssp_translate_block(DUMP_BLOCK >> 1);
+#endif
+#if defined(__arm__) || defined(__x86_64__)
 	ssp_drc_entry(ssp, cycles);
 #endif
 }
@@ -82,7 +82,7 @@ static u32 PicoRead16_svpr(u32 a)
 
 #if EL_LOGMASK & EL_SVP
     {
-      static int a15004_looping = 0;
+      static PICO_TLS int a15004_looping = 0;
       if (a == 0xa15004 && (d & 1))
         a15004_looping = 0;
 
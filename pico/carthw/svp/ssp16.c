@@ -379,13 +379,13 @@
 #define CHECK_ST(d)
 #endif
 
-ssp1601_t *ssp = NULL;
-static unsigned short *PC;
-static int g_cycles;
+PICO_TLS ssp1601_t *ssp = NULL;
+static PICO_TLS unsigned short *PC;
+static PICO_TLS int g_cycles;
 
 #ifdef USE_DEBUGGER
-static int running = 0;
-static int last_iram = 0;
+static PICO_TLS int running = 0;
+static PICO_TLS int last_iram = 0;
 #endif
 
 // -----------------------------------------------------
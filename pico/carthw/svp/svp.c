@@ -32,8 +32,8 @@
 
 #define SVP_CYCLES_LINE 850
 
-svp_t *svp = NULL;
-static int svp_dyn_ready = 0;
+PICO_TLS svp_t *svp = NULL;
+static PICO_TLS int svp_dyn_ready = 0;
 
 /* save state stuff */
 typedef enum {
@@ -42,7 +42,7 @@ typedef enum {
 	CHUNK_SSP
 } chunk_name_e;
 
-static carthw_state_chunk svp_states[] =
+static PICO_TLS carthw_state_chunk svp_states[] =
 {
 	{ CHUNK_IRAM, 0x800,                 NULL },
 	{ CHUNK_DRAM, sizeof(svp->dram),     NULL },
@@ -69,7 +69,7 @@ static void PicoSVPLine(void)
 	int count = 1;
 #if defined(__arm__) || defined(PSP)
 	// performance hack
-	static int delay_lines = 0;
+	static PICO_TLS int delay_lines = 0;
 	delay_lines++;
 	if ((Pico.m.scanline&0xf) != 0xf && Pico.m.scanline != 261 && Pico.m.scanline != 311)
 		return;
@@ -93,7 +93,7 @@ typedef struct
   uint8 ram[0x4000 + 2352]; /* 16K external RAM (with one block overhead to handle buffer overrun) */
 } cdc_t; 
 
-static cdc_t cdc;
+static PICO_TLS cdc_t cdc;
 
 void cdc_init(void)
 {
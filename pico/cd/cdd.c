@@ -47,7 +47,7 @@
 #define SUPPORTED_EXT 10
 #endif
 
-cdd_t cdd;
+PICO_TLS cdd_t cdd;
 
 /* BCD conversion lookup tables */
 static const uint8 lut_BCD_8[100] =
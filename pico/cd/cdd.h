@@ -93,6 +93,6 @@ typedef struct
   int16 audio[2];
 } cdd_t; 
 
-extern cdd_t cdd;
+extern PICO_TLS cdd_t cdd;
 
 #endif
@@ -55,7 +55,7 @@ typedef struct
   uint8 lut_cell[0x100];            /* Graphics operation stamp offset lookup table */
 } gfx_t;
 
-static gfx_t gfx;
+static PICO_TLS gfx_t gfx;
 
 static void gfx_schedule(void);
 
@@ -33,6 +33,8 @@ PICO_INTERNAL void DmaSlowCell(unsigned int source, unsigned int a, int len, uns
         asrc |= source & 2;
         // if(a&1) d=(d<<8)|(d>>8); // ??
         r[a>>1] = *(u16 *)(base + asrc);
+        VramMark(a);
+        DrawDirty = 1;
 	source += 2;
         // AutoIncrement
         a=(u16)(a+inc);
@@ -41,7 +43,7 @@ PICO_INTERNAL void DmaSlowCell(unsigned int source, unsigned int a, int len, uns
       break;
 
     case 3: // cram
-      Pico.m.dirtyPal = 1;
+      Pico.m.dirtyPal = DrawDirty = 1;
       r = PicoMem.cram;
       for(a2=a&0x7f; len; len--)
       {
@@ -58,6 +60,7 @@ PICO_INTERNAL void DmaSlowCell(unsigned int source, unsigned int a, int len, uns
       break;
 
     case 5: // vsram[a&0x003f]=d;
+      DrawDirty = 1;
       r = PicoMem.vsram;
       for(a2=a&0x7f; len; len--)
       {
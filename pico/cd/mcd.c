@@ -11,9 +11,9 @@
 
 extern unsigned char formatted_bram[4*0x10];
 
-static unsigned int mcd_m68k_cycle_mult;
-static unsigned int mcd_m68k_cycle_base;
-static unsigned int mcd_s68k_cycle_base;
+static PICO_TLS unsigned int mcd_m68k_cycle_mult;
+static PICO_TLS unsigned int mcd_m68k_cycle_base;
+static PICO_TLS unsigned int mcd_s68k_cycle_base;
 
 
 PICO_INTERNAL void PicoInitMCD(void)
@@ -194,8 +194,8 @@ static void pcd_dma_event(unsigned int now)
 typedef void (event_cb)(unsigned int now);
 
 /* times are in s68k (12.5MHz) cycles */
-unsigned int pcd_event_times[PCD_EVENT_COUNT];
-static unsigned int event_time_next;
+PICO_TLS unsigned int pcd_event_times[PCD_EVENT_COUNT];
+static PICO_TLS unsigned int event_time_next;
 static event_cb *pcd_event_cbs[PCD_EVENT_COUNT] = {
   pcd_cdc_event,            // PCD_EVENT_CDC
   pcd_int3_timer_event,     // PCD_EVENT_TIMER3
@@ -9,10 +9,10 @@
 #include "../pico_int.h"
 #include "../memory.h"
 
-uptr s68k_read8_map  [0x1000000 >> M68K_MEM_SHIFT];
-uptr s68k_read16_map [0x1000000 >> M68K_MEM_SHIFT];
-uptr s68k_write8_map [0x1000000 >> M68K_MEM_SHIFT];
-uptr s68k_write16_map[0x1000000 >> M68K_MEM_SHIFT];
+PICO_TLS uptr s68k_read8_map  [0x1000000 >> M68K_MEM_SHIFT];
+PICO_TLS uptr s68k_read16_map [0x1000000 >> M68K_MEM_SHIFT];
+PICO_TLS uptr s68k_write8_map [0x1000000 >> M68K_MEM_SHIFT];
+PICO_TLS uptr s68k_write16_map[0x1000000 >> M68K_MEM_SHIFT];
 
 MAKE_68K_READ8(s68k_read8, s68k_read8_map)
 MAKE_68K_READ16(s68k_read16, s68k_read16_map)
@@ -9,8 +9,8 @@
 #include "../pico_int.h"
 
 
-unsigned int SekCycleCntS68k;
-unsigned int SekCycleAimS68k;
+PICO_TLS unsigned int SekCycleCntS68k;
+PICO_TLS unsigned int SekCycleAimS68k;
 
 
 /* context */
@@ -24,7 +24,7 @@ m68ki_cpu_core PicoCpuMS68k;
 #endif
 // FAME 68000
 #ifdef EMU_F68K
-M68K_CONTEXT PicoCpuFS68k;
+PICO_TLS M68K_CONTEXT PicoCpuFS68k;
 #endif
 
 
@@ -15,7 +15,7 @@
 #define MVP dstrp+=strlen(dstrp)
 void z80_debug(char *dstr);
 
-static char dstr[1024*8];
+static PICO_TLS char dstr[1024*8];
 
 char *PDebugMain(void)
 {
@@ -29,21 +29,26 @@
  */
 
 #include "pico_int.h"
+#include "simd.h"
 
-int (*PicoScanBegin)(unsigned int num) = NULL;
-int (*PicoScanEnd)  (unsigned int num) = NULL;
+PICO_TLS int (*PicoScanBegin)(unsigned int num) = NULL;
+PICO_TLS int (*PicoScanEnd)  (unsigned int num) = NULL;
 
-static unsigned char DefHighCol[8+320+8];
-static unsigned char *HighColBase = DefHighCol;
-static int HighColIncrement;
+static PICO_TLS unsigned char DefHighCol[8+320+8];
+static PICO_TLS unsigned char *HighColBase;
+static PICO_TLS int HighColIncrement;
 
-static unsigned int DefOutBuff[320*2/2];
-void *DrawLineDestBase = DefOutBuff;
-int DrawLineDestIncrement;
+static PICO_TLS unsigned int DefOutBuff[320*2/2];
+PICO_TLS void *DrawLineDestBase;
+PICO_TLS int DrawLineDestIncrement;
 
-static int  HighCacheA[41+1];   // caches for high layers
-static int  HighCacheB[41+1];
-static int  HighPreSpr[80*2+1]; // slightly preprocessed sprites
+static PICO_TLS int  HighCacheA[41+1];   // caches for high layers
+static PICO_TLS int  HighCacheB[41+1];
+static PICO_TLS int  HighPreSpr[80*2+1]; // slightly preprocessed sprites
+static PICO_TLS unsigned char HighPreSprIdx[80]; // SAT entry of each HighPreSpr
+static PICO_TLS int  HighPreSprCount;
+static PICO_TLS int  HighPreSprKey = -1; // VDP setup it was built for, -1: stale
+PICO_TLS unsigned int SatDirty[0x10000 >> 8]; // 8 byte SAT entries written
 
 #define LF_PLANE_1 (1 << 0)
 #define LF_SH      (1 << 1) // must be = 2
@@ -53,12 +58,12 @@ static int  HighPreSpr[80*2+1]; // slightly preprocessed sprites
 #define SPRL_HAVE_LO     0x40 // *lo*
 #define SPRL_MAY_HAVE_OP 0x20 // may have operator sprites on the line
 #define SPRL_LO_ABOVE_HI 0x10 // low priority sprites may be on top of hi
-unsigned char HighLnSpr[240][3 + MAX_LINE_SPRITES]; // sprite_count, ^flags, tile_count, [spritep]...
+PICO_TLS unsigned char HighLnSpr[240][3 + MAX_LINE_SPRITES]; // sprite_count, ^flags, tile_count, [spritep]...
 
-int rendstatus_old;
-int rendlines;
+PICO_TLS int rendstatus_old;
+PICO_TLS int rendlines;
 
-static int skip_next_line=0;
+static PICO_TLS int skip_next_line=0;
 
 struct TileStrip
 {
@@ -94,97 +99,137 @@ void blockcpy_or(void *dst, void *src, size_t n, int pat)
 #define blockcpy memcpy
 #endif
 
-#define TileNormMaker_(pix_func)                             \
-{                                                            \
-  unsigned int t;                                            \
-                                                             \
-  t = (pack&0x0000f000)>>12; pix_func(0);                    \
-  t = (pack&0x00000f00)>> 8; pix_func(1);                    \
-  t = (pack&0x000000f0)>> 4; pix_func(2);                    \
-  t = (pack&0x0000000f)    ; pix_func(3);                    \
-  t = (pack&0xf0000000)>>28; pix_func(4);                    \
-  t = (pack&0x0f000000)>>24; pix_func(5);                    \
-  t = (pack&0x00f00000)>>20; pix_func(6);                    \
-  t = (pack&0x000f0000)>>16; pix_func(7);                    \
+#ifdef HAVE_V8
+
+// 8 pixels of a tile line are processed at once in the low half of a vector,
+// pixel values t are 0..0xf, mb bytes are 0 or 0xff
+#ifdef HAVE_SSE2
+static __inline v8 v8_unpack(unsigned int pack, int flip)
+{
+  v8 x = _mm_cvtsi32_si128(pack);
+  v8 h = v8_and(_mm_srli_epi16(x, 4), v8_dup(0x0f));
+  v8 l = v8_and(x, v8_dup(0x0f));
+  // vram words are byteswapped, pixel 0 is in the high nibble of byte 1
+  if (flip)
+    return _mm_shufflelo_epi16(_mm_unpacklo_epi8(l, h), _MM_SHUFFLE(1,0,3,2));
+  else
+    return _mm_shufflelo_epi16(_mm_unpacklo_epi8(h, l), _MM_SHUFFLE(2,3,0,1));
 }
+#else
+static __inline v8 v8_unpack(unsigned int pack, int flip)
+{
+  v8 x = vreinterpret_u8_u32(vdup_n_u32(pack));
+  v8 h = vshr_n_u8(x, 4);
+  v8 l = vand_u8(x, vdup_n_u8(0x0f));
+  if (flip)
+    return vreinterpret_u8_u32(vrev64_u32(vreinterpret_u32_u8(vzip_u8(l, h).val[0])));
+  else
+    return vreinterpret_u8_u16(vrev32_u16(vreinterpret_u16_u8(vzip_u8(h, l).val[0])));
+}
+#endif
 
-#define TileFlipMaker_(pix_func)                             \
+#define TileRowMaker_(pix_func)                              \
 {                                                            \
-  unsigned int t;                                            \
-                                                             \
-  t = (pack&0x000f0000)>>16; pix_func(0);                    \
-  t = (pack&0x00f00000)>>20; pix_func(1);                    \
-  t = (pack&0x0f000000)>>24; pix_func(2);                    \
-  t = (pack&0xf0000000)>>28; pix_func(3);                    \
-  t = (pack&0x0000000f)    ; pix_func(4);                    \
-  t = (pack&0x000000f0)>> 4; pix_func(5);                    \
-  t = (pack&0x00000f00)>> 8; pix_func(6);                    \
-  t = (pack&0x0000f000)>>12; pix_func(7);                    \
+  v8 t = v8_load(tr);                                        \
+  pix_func();                                                \
 }
 
-#define TileNormMaker(funcname, pix_func) \
-static void funcname(unsigned char *pd, unsigned int pack, int pal) \
-TileNormMaker_(pix_func)
+#define pix_just_write() \
+  v8 p = v8_load(pd); \
+  v8_store(pd, v8_sel(v8_eq(t, v8_dup(0)), p, v8_or(t, v8_dup(pal))))
+
+// operator pixel value: c0 shadow, 80 hilight
+#define pix_opval() \
+  v8_or(v8_and(v8_eq(t, v8_dup(0xf)), v8_dup(0x40)), v8_dup(0x80))
+
+#define pix_sh() \
+  v8 p = v8_load(pd); \
+  v8_store(pd, v8_sel(v8_eq(t, v8_dup(0)), p, \
+    v8_sel(v8_gt(t, v8_dup(0xd)), v8_or(v8_and(p, v8_dup(0x3f)), pix_opval()), \
+      v8_or(t, v8_dup(pal)))))
+
+#define pix_sh_markop() \
+  v8 p = v8_load(pd); \
+  v8_store(pd, v8_sel(v8_eq(t, v8_dup(0)), p, \
+    v8_sel(v8_gt(t, v8_dup(0xd)), v8_or(p, v8_dup(0x80)), v8_or(t, v8_dup(pal)))))
+
+// m: pixels to apply operators to
+#define pix_onlyop_m(m) \
+  v8_store(pd, v8_sel(v8_andn(v8_and(m, v8_gt(t, v8_dup(0xd))), \
+                              v8_eq(v8_and(p, v8_dup(0xc0)), v8_dup(0))), \
+    v8_or(v8_and(p, v8_dup(0x3f)), pix_opval()), p))
+
+#define pix_sh_onlyop() \
+  v8 p = v8_load(pd); \
+  pix_onlyop_m(v8_dup(0xff))
+
+// c: sprite pixels not covered by earlier sprites (AS)
+#define pix_as_c(c) \
+  v8 c = v8_andn(v8_load(mb), v8_eq(t, v8_dup(0))); \
+  v8_store(mb, v8_andn(v8_load(mb), c)); \
+  v8 p = v8_load(pd)
+
+#define pix_as() \
+  pix_as_c(c); \
+  v8_store(pd, v8_sel(c, v8_or(t, v8_dup(pal)), p))
+
+#define pix_sh_as() \
+  pix_as_c(c); \
+  v8_store(pd, v8_sel(c, \
+    v8_sel(v8_gt(t, v8_dup(0xd)), v8_or(v8_and(p, v8_dup(0x3f)), pix_opval()), \
+      v8_or(t, v8_dup(pal))), p))
+
+#define pix_sh_as_onlyop() \
+  pix_as_c(c); \
+  pix_onlyop_m(c)
+
+#define pix_sh_as_onlymark() \
+  v8_store(mb, v8_and(v8_load(mb), v8_eq(t, v8_dup(0))))
+
+#define pix_and() \
+  v8 p = v8_load(pd); \
+  v8_store(pd, v8_or(v8_and(p, v8_dup(0xc0)), v8_and(p, v8_or(t, v8_dup(pal)))))
 
-#define TileFlipMaker(funcname, pix_func) \
-static void funcname(unsigned char *pd, unsigned int pack, int pal) \
-TileFlipMaker_(pix_func)
-
-#define TileNormMakerAS(funcname, pix_func) \
-static void funcname(unsigned char *pd, unsigned char *mb, unsigned int pack, int pal) \
-TileNormMaker_(pix_func)
+#else
 
-#define TileFlipMakerAS(funcname, pix_func) \
-static void funcname(unsigned char *pd, unsigned char *mb, unsigned int pack, int pal) \
-TileFlipMaker_(pix_func)
+#define TileRowMaker_(pix_func)                              \
+{                                                            \
+  unsigned int t;                                            \
+                                                             \
+  t = tr[0]; pix_func(0);                                    \
+  t = tr[1]; pix_func(1);                                    \
+  t = tr[2]; pix_func(2);                                    \
+  t = tr[3]; pix_func(3);                                    \
+  t = tr[4]; pix_func(4);                                    \
+  t = tr[5]; pix_func(5);                                    \
+  t = tr[6]; pix_func(6);                                    \
+  t = tr[7]; pix_func(7);                                    \
+}
 
 #define pix_just_write(x) \
   if (t) pd[x]=pal|t
 
-TileNormMaker(TileNorm,pix_just_write)
-TileFlipMaker(TileFlip,pix_just_write)
-
-#ifndef _ASM_DRAW_C
-
 // draw a sprite pixel, process operator colors
 #define pix_sh(x) \
   if (!t); \
   else if (t>=0xe) pd[x]=(pd[x]&0x3f)|(t<<6); /* c0 shadow, 80 hilight */ \
   else pd[x]=pal|t
 
-TileNormMaker(TileNormSH, pix_sh)
-TileFlipMaker(TileFlipSH, pix_sh)
-
 // draw a sprite pixel, mark operator colors
 #define pix_sh_markop(x) \
   if (!t); \
   else if (t>=0xe) pd[x]|=0x80; \
   else pd[x]=pal|t
 
-TileNormMaker(TileNormSH_markop, pix_sh_markop)
-TileFlipMaker(TileFlipSH_markop, pix_sh_markop)
-
-#endif
-
 // process operator pixels only, apply only on low pri tiles and other op pixels
 #define pix_sh_onlyop(x) \
   if (t>=0xe && (pd[x]&0xc0)) \
     pd[x]=(pd[x]&0x3f)|(t<<6); /* c0 shadow, 80 hilight */ \
 
-#ifndef _ASM_DRAW_C
-
-TileNormMaker(TileNormSH_onlyop_lp, pix_sh_onlyop)
-TileFlipMaker(TileFlipSH_onlyop_lp, pix_sh_onlyop)
-
-#endif
-
 // draw a sprite pixel (AS)
 #define pix_as(x) \
   if (t & mb[x]) mb[x] = 0, pd[x] = pal | t
 
-TileNormMakerAS(TileNormAS, pix_as)
-TileFlipMakerAS(TileFlipAS, pix_as)
-
 // draw a sprite pixel, process operator colors (AS)
 #define pix_sh_as(x) \
   if (t & mb[x]) { \
@@ -193,31 +238,106 @@ TileFlipMakerAS(TileFlipAS, pix_as)
     else pd[x] = pal | t; \
   }
 
-TileNormMakerAS(TileNormSH_AS, pix_sh_as)
-TileFlipMakerAS(TileFlipSH_AS, pix_sh_as)
-
 #define pix_sh_as_onlyop(x) \
   if (t & mb[x]) { \
     mb[x] = 0; \
     pix_sh_onlyop(x); \
   }
 
-TileNormMakerAS(TileNormSH_AS_onlyop_lp, pix_sh_as_onlyop)
-TileFlipMakerAS(TileFlipSH_AS_onlyop_lp, pix_sh_as_onlyop)
-
 // mark pixel as sprite pixel (AS)
 #define pix_sh_as_onlymark(x) \
   if (t) mb[x] = 0
 
-TileNormMakerAS(TileNormAS_onlymark, pix_sh_as_onlymark)
-TileFlipMakerAS(TileFlipAS_onlymark, pix_sh_as_onlymark)
-
 // forced both layer draw (through debug reg)
 #define pix_and(x) \
   pd[x] = (pd[x] & 0xc0) | (pd[x] & (pal | t))
 
-TileNormMaker(TileNorm_and, pix_and)
-TileFlipMaker(TileFlip_and, pix_and)
+#endif
+
+// tr: 8 decoded pixels from the tile cache, already x-flipped if needed
+#define TileRowMaker(funcname, pix_func) \
+static void funcname(unsigned char *pd, const unsigned char *tr, int pal) \
+TileRowMaker_(pix_func)
+
+#define TileRowMakerAS(funcname, pix_func) \
+static void funcname(unsigned char *pd, unsigned char *mb, const unsigned char *tr, int pal) \
+TileRowMaker_(pix_func)
+
+TileRowMaker(TileRow, pix_just_write)
+
+#ifndef _ASM_DRAW_C
+
+TileRowMaker(TileRowSH, pix_sh)
+TileRowMaker(TileRowSH_markop, pix_sh_markop)
+TileRowMaker(TileRowSH_onlyop_lp, pix_sh_onlyop)
+
+#endif
+
+TileRowMakerAS(TileRowAS, pix_as)
+TileRowMakerAS(TileRowSH_AS, pix_sh_as)
+TileRowMakerAS(TileRowSH_AS_onlyop_lp, pix_sh_as_onlyop)
+TileRowMakerAS(TileRowAS_onlymark, pix_sh_as_onlymark)
+
+TileRowMaker(TileRow_and, pix_and)
+
+// --------------------------------------------
+
+// Decoded tile cache: the 8 pixels of every 32bit tile row, followed by
+// the same x-flipped. Tiles are decoded on first use, VRAM writes
+// invalidate them through TileCacheInvalidate().
+union TileCacheRow {
+  unsigned char p[16];
+  unsigned int w[4];
+};
+
+static PICO_TLS union TileCacheRow TileCache[0x10000 / 4];
+PICO_TLS unsigned int TileCacheValid[0x10000 >> 10];
+
+static NOINLINE void TileCacheDecode(unsigned int tile)
+{
+  const unsigned int *ps = (unsigned int *)PicoMem.vram + tile * 8;
+  union TileCacheRow *r = &TileCache[tile * 8];
+  int i;
+
+  for (i = 0; i < 8; i++, r++)
+  {
+    unsigned int pack = ps[i];
+#ifdef HAVE_V8
+    v8_store(r->p, v8_unpack(pack, 0));
+    v8_store(r->p + 8, v8_unpack(pack, 1));
+#else
+    // vram words are byteswapped, pixel 0 is in bits 12-15
+    static const unsigned char shift[8] = { 12, 8, 4, 0, 28, 24, 20, 16 };
+    int x;
+    for (x = 0; x < 8; x++)
+      r->p[x] = r->p[15 - x] = (pack >> shift[x]) & 0xf;
+#endif
+  }
+  TileCacheValid[tile >> 5] |= 1u << (tile & 0x1f);
+}
+
+// addr: vram word address of a tile row
+static __inline const union TileCacheRow *TileCacheGet(unsigned int addr)
+{
+  unsigned int tile = (addr >> 4) & 0x7ff;
+
+  if (!(TileCacheValid[tile >> 5] & (1u << (tile & 0x1f))))
+    TileCacheDecode(tile);
+  return &TileCache[(addr >> 1) & 0x3fff];
+}
+
+#define TileCacheBlank(r)     (((r)->w[0] | (r)->w[1]) == 0)
+#define TileCachePix(r, code) ((r)->p + (((code) >> 8) & 8)) // x-flip bit
+
+// for the VRAM writes the VDP doesn't see, like state loading
+void PicoDrawInvalidateVram(void)
+{
+  memset(TileCacheValid, 0, sizeof(TileCacheValid));
+  HighPreSprKey = -1;
+#ifdef PICO_THREAD_SAFE
+  memset(DrawThreadVramDirty, 0xff, sizeof(DrawThreadVramDirty));
+#endif
+}
 
 // --------------------------------------------
 
@@ -225,6 +345,7 @@ TileFlipMaker(TileFlip_and, pix_and)
 static void DrawStrip(struct TileStrip *ts, int lflags, int cellskip)
 {
   unsigned char *pd = Pico.est.HighCol;
+  const union TileCacheRow *tr=NULL;
   int tilex,dx,ty,code=0,addr=0,cells;
   int oldcode=-1,blank=-1; // The tile we know is blank
   int pal=0,sh;
@@ -240,8 +361,6 @@ static void DrawStrip(struct TileStrip *ts, int lflags, int cellskip)
 
   for (; cells > 0; dx+=8, tilex++, cells--)
   {
-    unsigned int pack;
-
     code = PicoMem.vram[ts->nametab + (tilex & ts->xmask)];
     if (code == blank)
       continue;
@@ -260,16 +379,15 @@ static void DrawStrip(struct TileStrip *ts, int lflags, int cellskip)
       if (code&0x1000) addr^=0xe; // Y-flip
 
       pal=((code>>9)&0x30)|sh;
+      tr=TileCacheGet(addr);
     }
 
-    pack = *(unsigned int *)(PicoMem.vram + addr);
-    if (!pack) {
+    if (TileCacheBlank(tr)) {
       blank = code;
       continue;
     }
 
-    if (code & 0x0800) TileFlip(pd + dx, pack, pal);
-    else               TileNorm(pd + dx, pack, pal);
+    TileRow(pd + dx, TileCachePix(tr, code), pal);
   }
 
   // terminate the cache list
@@ -282,6 +400,7 @@ static void DrawStrip(struct TileStrip *ts, int lflags, int cellskip)
 static void DrawStripVSRam(struct TileStrip *ts, int plane_sh, int cellskip)
 {
   unsigned char *pd = Pico.est.HighCol;
+  const union TileCacheRow *tr=NULL;
   int tilex,dx,code=0,addr=0,cell=0;
   int oldcode=-1,blank=-1; // The tile we know is blank
   int pal=0,scan=Pico.est.DrawScanline;
@@ -301,7 +420,6 @@ static void DrawStripVSRam(struct TileStrip *ts, int plane_sh, int cellskip)
   for (; cell < ts->cells; dx+=8,tilex++,cell++)
   {
     int nametabadd, ty;
-    unsigned int pack;
 
     //if((cell&1)==0)
     {
@@ -330,16 +448,15 @@ static void DrawStripVSRam(struct TileStrip *ts, int plane_sh, int cellskip)
       if (code&0x1000) addr+=14-ty; else addr+=ty; // Y-flip
 
       pal=((code>>9)&0x30)|((plane_sh<<5)&0x40);
+      tr=TileCacheGet(addr);
     }
 
-    pack = *(unsigned int *)(PicoMem.vram + addr);
-    if (!pack) {
+    if (TileCacheBlank(tr)) {
       blank = code;
       continue;
     }
 
-    if (code & 0x0800) TileFlip(pd + dx, pack, pal);
-    else               TileNorm(pd + dx, pack, pal);
+    TileRow(pd + dx, TileCachePix(tr, code), pal);
   }
 
   // terminate the cache list
@@ -354,6 +471,7 @@ static
 void DrawStripInterlace(struct TileStrip *ts)
 {
   unsigned char *pd = Pico.est.HighCol;
+  const union TileCacheRow *tr=NULL;
   int tilex=0,dx=0,ty=0,code=0,addr=0,cells;
   int oldcode=-1,blank=-1; // The tile we know is blank
   int pal=0;
@@ -367,8 +485,6 @@ void DrawStripInterlace(struct TileStrip *ts)
 
   for (; cells; dx+=8,tilex++,cells--)
   {
-    unsigned int pack;
-
     code = PicoMem.vram[ts->nametab + (tilex & ts->xmask)];
     if (code==blank) continue;
     if (code>>15) { // high priority tile
@@ -382,21 +498,20 @@ void DrawStripInterlace(struct TileStrip *ts)
     if (code!=oldcode) {
       oldcode = code;
       // Get tile address/2:
-      addr=(code&0x7ff)<<5;
+      addr=(code&0x3ff)<<5; // wraps at 64k like cached hi prio tiles
       if (code&0x1000) addr+=30-ty; else addr+=ty; // Y-flip
 
 //      pal=Pico.cram+((code>>9)&0x30);
       pal=((code>>9)&0x30);
+      tr=TileCacheGet(addr);
     }
 
-    pack = *(unsigned int *)(PicoMem.vram + addr);
-    if (!pack) {
+    if (TileCacheBlank(tr)) {
       blank = code;
       continue;
     }
 
-    if (code & 0x0800) TileFlip(pd + dx, pack, pal);
-    else               TileNorm(pd + dx, pack, pal);
+    TileRow(pd + dx, TileCachePix(tr, code), pal);
   }
 
   // terminate the cache list
@@ -510,7 +625,7 @@ static void DrawWindow(int tstart, int tend, int prio, int sh,
   {
     for (; tilex < tend; tilex++)
     {
-      unsigned int pack;
+      const union TileCacheRow *tr;
       int dx, addr;
       int pal;
 
@@ -525,8 +640,8 @@ static void DrawWindow(int tstart, int tend, int prio, int sh,
       addr=(code&0x7ff)<<4;
       if (code&0x1000) addr+=14-ty; else addr+=ty; // Y-flip
 
-      pack = *(unsigned int *)(PicoMem.vram + addr);
-      if (!pack) {
+      tr = TileCacheGet(addr);
+      if (TileCacheBlank(tr)) {
         blank = code;
         continue;
       }
@@ -534,15 +649,14 @@ static void DrawWindow(int tstart, int tend, int prio, int sh,
       pal = ((code >> 9) & 0x30);
       dx = 8 + (tilex << 3);
 
-      if (code & 0x0800) TileFlip(pd + dx, pack, pal);
-      else               TileNorm(pd + dx, pack, pal);
+      TileRow(pd + dx, TileCachePix(tr, code), pal);
     }
   }
   else
   {
     for (; tilex < tend; tilex++)
     {
-      unsigned int pack;
+      const union TileCacheRow *tr;
       int dx, addr;
       int pal;
 
@@ -567,16 +681,15 @@ static void DrawWindow(int tstart, int tend, int prio, int sh,
       addr=(code&0x7ff)<<4;
       if (code&0x1000) addr+=14-ty; else addr+=ty; // Y-flip
 
-      pack = *(unsigned int *)(PicoMem.vram + addr);
-      if (!pack) {
+      tr = TileCacheGet(addr);
+      if (TileCacheBlank(tr)) {
         blank = code;
         continue;
       }
 
       dx = 8 + (tilex << 3);
 
-      if (code & 0x0800) TileFlip(pd + dx, pack, pal);
-      else               TileNorm(pd + dx, pack, pal);
+      TileRow(pd + dx, TileCachePix(tr, code), pal);
     }
   }
 }
@@ -599,8 +712,8 @@ static void DrawTilesFromCacheShPrep(void)
 static void DrawTilesFromCache(int *hc, int sh, int rlim, struct PicoEState *est)
 {
   unsigned char *pd = Pico.est.HighCol;
+  const union TileCacheRow *tr;
   int code, addr, dx;
-  unsigned int pack;
   int pal;
 
   // *ts->hc++ = code | (dx<<16) | (ty<<25); // cache it
@@ -622,8 +735,8 @@ static void DrawTilesFromCache(int *hc, int sh, int rlim, struct PicoEState *est
       addr = (code & 0x7ff) << 4;
       addr += code >> 25; // y offset into tile
 
-      pack = *(unsigned int *)(PicoMem.vram + addr);
-      if (!pack) {
+      tr = TileCacheGet(addr);
+      if (TileCacheBlank(tr)) {
         blank = (short)code;
         continue;
       }
@@ -633,8 +746,7 @@ static void DrawTilesFromCache(int *hc, int sh, int rlim, struct PicoEState *est
       if (rlim-dx < 0)
         goto last_cut_tile;
 
-      if (code & 0x0800) TileFlip(pd + dx, pack, pal);
-      else               TileNorm(pd + dx, pack, pal);
+      TileRow(pd + dx, TileCachePix(tr, code), pal);
     }
   }
   else
@@ -650,16 +762,15 @@ static void DrawTilesFromCache(int *hc, int sh, int rlim, struct PicoEState *est
       *zb++ &= 0xbf; *zb++ &= 0xbf; *zb++ &= 0xbf; *zb++ &= 0xbf;
       *zb++ &= 0xbf; *zb++ &= 0xbf; *zb++ &= 0xbf; *zb++ &= 0xbf;
 
-      pack = *(unsigned int *)(PicoMem.vram + addr);
-      if (!pack)
+      tr = TileCacheGet(addr);
+      if (TileCacheBlank(tr))
         continue;
 
       pal = ((code >> 9) & 0x30);
       if (rlim - dx < 0)
         goto last_cut_tile;
 
-      if (code & 0x0800) TileFlip(pd + dx, pack, pal);
-      else               TileNorm(pd + dx, pack, pal);
+      TileRow(pd + dx, TileCachePix(tr, code), pal);
     }
   }
   return;
@@ -667,37 +778,13 @@ static void DrawTilesFromCache(int *hc, int sh, int rlim, struct PicoEState *est
 last_cut_tile:
   // for vertical window cutoff
   {
-    unsigned int t;
+    const unsigned char *ps = TileCachePix(tr, code);
+    int x, len = rlim - dx + 8;
 
     pd += dx;
-    if (code&0x0800)
-    {
-      switch (rlim-dx+8)
-      {
-        case 7: t=pack&0x00000f00; if (t) pd[6]=(unsigned char)(pal|(t>> 8)); // "break" is left out intentionally
-        case 6: t=pack&0x000000f0; if (t) pd[5]=(unsigned char)(pal|(t>> 4));
-        case 5: t=pack&0x0000000f; if (t) pd[4]=(unsigned char)(pal|(t    ));
-        case 4: t=pack&0xf0000000; if (t) pd[3]=(unsigned char)(pal|(t>>28));
-        case 3: t=pack&0x0f000000; if (t) pd[2]=(unsigned char)(pal|(t>>24));
-        case 2: t=pack&0x00f00000; if (t) pd[1]=(unsigned char)(pal|(t>>20));
-        case 1: t=pack&0x000f0000; if (t) pd[0]=(unsigned char)(pal|(t>>16));
-        default: break;
-      }
-    }
-    else
-    {
-      switch (rlim-dx+8)
-      {
-        case 7: t=pack&0x00f00000; if (t) pd[6]=(unsigned char)(pal|(t>>20));
-        case 6: t=pack&0x0f000000; if (t) pd[5]=(unsigned char)(pal|(t>>24));
-        case 5: t=pack&0xf0000000; if (t) pd[4]=(unsigned char)(pal|(t>>28));
-        case 4: t=pack&0x0000000f; if (t) pd[3]=(unsigned char)(pal|(t    ));
-        case 3: t=pack&0x000000f0; if (t) pd[2]=(unsigned char)(pal|(t>> 4));
-        case 2: t=pack&0x00000f00; if (t) pd[1]=(unsigned char)(pal|(t>> 8));
-        case 1: t=pack&0x0000f000; if (t) pd[0]=(unsigned char)(pal|(t>>12));
-        default: break;
-      }
-    }
+    for (x = 0; x < len; x++)
+      if (ps[x])
+        pd[x] = (unsigned char)(pal | ps[x]);
   }
 }
 
@@ -708,7 +795,7 @@ last_cut_tile:
 
 static void DrawSprite(int *sprite, int sh)
 {
-  void (*fTileFunc)(unsigned char *pd, unsigned int pack, int pal);
+  void (*fTileFunc)(unsigned char *pd, const unsigned char *tr, int pal);
   unsigned char *pd = Pico.est.HighCol;
   int width=0,height=0;
   int row=0,code=0;
@@ -738,23 +825,20 @@ static void DrawSprite(int *sprite, int sh)
   pal=(code>>9)&0x30;
   pal|=sh<<6;
 
-  if (sh && (code&0x6000) == 0x6000) {
-    if(code&0x0800) fTileFunc=TileFlipSH_markop;
-    else            fTileFunc=TileNormSH_markop;
-  } else {
-    if(code&0x0800) fTileFunc=TileFlip;
-    else            fTileFunc=TileNorm;
-  }
+  if (sh && (code&0x6000) == 0x6000)
+       fTileFunc=TileRowSH_markop;
+  else fTileFunc=TileRow;
 
   for (; width; width--,sx+=8,tile+=delta)
   {
-    unsigned int pack;
+    const union TileCacheRow *tr;
 
     if(sx<=0)   continue;
     if(sx>=328) break; // Offscreen
 
-    pack = *(unsigned int *)(PicoMem.vram + (tile & 0x7fff));
-    fTileFunc(pd + sx, pack, pal);
+    tr = TileCacheGet(tile);
+    if (!TileCacheBlank(tr))
+      fTileFunc(pd + sx, TileCachePix(tr, code), pal);
   }
 }
 #endif
@@ -763,7 +847,6 @@ static NOINLINE void DrawTilesFromCacheForced(const int *hc)
 {
   unsigned char *pd = Pico.est.HighCol;
   int code, addr, dx;
-  unsigned int pack;
   int pal;
 
   // *ts->hc++ = code | (dx<<16) | (ty<<25);
@@ -774,10 +857,8 @@ static NOINLINE void DrawTilesFromCacheForced(const int *hc)
 
     dx = (code >> 16) & 0x1ff;
     pal = ((code >> 9) & 0x30);
-    pack = *(unsigned int *)(PicoMem.vram + addr);
 
-    if (code & 0x0800) TileFlip_and(pd + dx, pack, pal);
-    else               TileNorm_and(pd + dx, pack, pal);
+    TileRow_and(pd + dx, TileCachePix(TileCacheGet(addr), code), pal);
   }
 }
 
@@ -816,14 +897,14 @@ static void DrawSpriteInterlace(unsigned int *sprite)
 
   for (; width; width--,sx+=8,tile+=delta)
   {
-    unsigned int pack;
+    const union TileCacheRow *tr;
 
     if(sx<=0)   continue;
     if(sx>=328) break; // Offscreen
 
-    pack = *(unsigned int *)(PicoMem.vram + (tile & 0x7fff));
-    if (code & 0x0800) TileFlip(pd + sx, pack, pal);
-    else               TileNorm(pd + sx, pack, pal);
+    tr = TileCacheGet(tile);
+    if (!TileCacheBlank(tr))
+      TileRow(pd + sx, TileCachePix(tr, code), pal);
   }
 }
 
@@ -885,7 +966,7 @@ static NOINLINE void DrawAllSpritesInterlace(int pri, int sh)
  */
 static void DrawSpritesSHi(unsigned char *sprited, const struct PicoEState *est)
 {
-  void (*fTileFunc)(unsigned char *pd, unsigned int pack, int pal);
+  void (*fTileFunc)(unsigned char *pd, const unsigned char *tr, int pal);
   unsigned char *pd = Pico.est.HighCol;
   unsigned char *p;
   int cnt;
@@ -909,17 +990,11 @@ static void DrawSpritesSHi(unsigned char *sprited, const struct PicoEState *est)
     if (pal == 0x30)
     {
       if (code & 0x8000) // hi priority
-      {
-        if (code&0x800) fTileFunc=TileFlipSH;
-        else            fTileFunc=TileNormSH;
-      } else {
-        if (code&0x800) fTileFunc=TileFlipSH_onlyop_lp;
-        else            fTileFunc=TileNormSH_onlyop_lp;
-      }
+           fTileFunc=TileRowSH;
+      else fTileFunc=TileRowSH_onlyop_lp;
     } else {
       if (!(code & 0x8000)) continue; // non-operator low sprite, already drawn
-      if (code&0x800) fTileFunc=TileFlip;
-      else            fTileFunc=TileNorm;
+      fTileFunc=TileRow;
     }
 
     // parse remaining sprite data
@@ -942,13 +1017,14 @@ static void DrawSpritesSHi(unsigned char *sprited, const struct PicoEState *est)
 
     for (; width; width--,sx+=8,tile+=delta)
     {
-      unsigned int pack;
+      const union TileCacheRow *tr;
 
       if(sx<=0)   continue;
       if(sx>=328) break; // Offscreen
 
-      pack = *(unsigned int *)(PicoMem.vram + (tile & 0x7fff));
-      fTileFunc(pd + sx, pack, pal);
+      tr = TileCacheGet(tile);
+      if (!TileCacheBlank(tr))
+        fTileFunc(pd + sx, TileCachePix(tr, code), pal);
     }
   }
 }
@@ -957,7 +1033,7 @@ static void DrawSpritesSHi(unsigned char *sprited, const struct PicoEState *est)
 static void DrawSpritesHiAS(unsigned char *sprited, int sh)
 {
   void (*fTileFunc)(unsigned char *pd, unsigned char *mb,
-                    unsigned int pack, int pal);
+                    const unsigned char *tr, int pal);
   unsigned char *pd = Pico.est.HighCol;
   unsigned char mb[8+320+8];
   unsigned char *p;
@@ -983,22 +1059,12 @@ static void DrawSpritesHiAS(unsigned char *sprited, int sh)
     if (sh && pal == 0x30)
     {
       if (code & 0x8000) // hi priority
-      {
-        if (code&0x800) fTileFunc = TileFlipSH_AS;
-        else            fTileFunc = TileNormSH_AS;
-      } else {
-        if (code&0x800) fTileFunc = TileFlipSH_AS_onlyop_lp;
-        else            fTileFunc = TileNormSH_AS_onlyop_lp;
-      }
+           fTileFunc = TileRowSH_AS;
+      else fTileFunc = TileRowSH_AS_onlyop_lp;
     } else {
       if (code & 0x8000) // hi priority
-      {
-        if (code&0x800) fTileFunc = TileFlipAS;
-        else            fTileFunc = TileNormAS;
-      } else {
-        if (code&0x800) fTileFunc = TileFlipAS_onlymark;
-        else            fTileFunc = TileNormAS_onlymark;
-      }
+           fTileFunc = TileRowAS;
+      else fTileFunc = TileRowAS_onlymark;
     }
 
     // parse remaining sprite data
@@ -1021,13 +1087,14 @@ static void DrawSpritesHiAS(unsigned char *sprited, int sh)
 
     for (; width; width--,sx+=8,tile+=delta)
     {
-      unsigned int pack;
+      const union TileCacheRow *tr;
 
       if(sx<=0)   continue;
       if(sx>=328) break; // Offscreen
 
-      pack = *(unsigned int *)(PicoMem.vram + (tile & 0x7fff));
-      fTileFunc(pd + sx, mb + sx, pack, pal);
+      tr = TileCacheGet(tile);
+      if (!TileCacheBlank(tr))
+        fTileFunc(pd + sx, mb + sx, TileCachePix(tr, code), pal);
     }
   }
 }
@@ -1039,6 +1106,95 @@ static void DrawSpritesHiAS(unsigned char *sprited, int sh)
 // Index + 0  :    hhhhvvvv ----hhvv yyyyyyyy yyyyyyyy // v, h: vert./horiz. size
 // Index + 4  :    xxxxxxxx xxxxxxxx pccvhnnn nnnnnnnn // x: x coord + 8
 
+static __inline void PrepareSprite(int *pd, const unsigned int *sprite)
+{
+  int code = sprite[0], code2 = sprite[1];
+  int sy = (code&0x1ff)-0x80;
+  int hv = (code>>24)&0xf;
+  int height = (hv&3)+1;
+  int width  = (hv>>2)+1;
+
+  pd[0] = (width<<28)|(height<<24)|(hv<<16)|((unsigned short)sy);
+  code2 &= ~0xfe000000;
+  code2 -=  0x00780000; // Get X coordinate + 8 in upper 16 bits
+  pd[1] = code2;
+}
+
+// (re)build HighLnSpr lines y0 to y1-1 from HighPreSpr
+static void PrepareSpriteLines(int y0, int y1, int max_line_sprites, int max_width, int sh)
+{
+  const int *pd, *end = HighPreSpr + HighPreSprCount*2;
+  int u;
+
+  for (u = y0; u < y1; u++)
+    *((int *)&HighLnSpr[u][0]) = 0;
+
+  for (pd = HighPreSpr; pd < end; pd += 2)
+  {
+    int pack = pd[0], code2 = pd[1];
+    int sy = (pack << 16) >> 16;
+    int height = (pack >> 24) & 0xf;
+    int width  = (pack >> 28) & 0xf;
+    int sx = code2 >> 16;
+    int entry, y, y_end, sx_min, onscr_x, maybe_op = 0;
+
+    y = (sy >= y0) ? sy : y0;
+    y_end = sy + (height<<3);
+    if (y_end > y1) y_end = y1;
+    if (y >= y_end) continue; // sprite not on these lines
+
+    sx_min = 8-(width<<3);
+    onscr_x = sx_min < sx && sx < max_width;
+    if (sh && (code2 & 0x6000) == 0x6000)
+      maybe_op = SPRL_MAY_HAVE_OP;
+
+    entry = ((pd - HighPreSpr) / 2) | ((code2>>8)&0x80);
+    for (; y < y_end; y++)
+    {
+      unsigned char *p = &HighLnSpr[y][0];
+      int cnt = p[0];
+      if (cnt >= max_line_sprites) continue;              // sprite limit?
+
+      if (p[2] >= max_line_sprites*2) {        // tile limit?
+        p[0] |= 0x80;
+        continue;
+      }
+      p[2] += width;
+
+      if (sx == -0x78) {
+        if (cnt > 0)
+          p[0] |= 0x80; // masked, no more sprites for this line
+        continue;
+      }
+      // must keep the first sprite even if it's offscreen, for masking
+      if (cnt > 0 && !onscr_x) continue; // offscreen x
+
+      p[3+cnt] = entry;
+      p[0] = cnt + 1;
+      p[1] |= (entry & 0x80) ? SPRL_HAVE_HI : SPRL_HAVE_LO;
+      p[1] |= maybe_op; // there might be op sprites on this line
+      if (cnt > 0 && (code2 & 0x8000) && !(p[3+cnt-1]&0x80))
+        p[1] |= SPRL_LO_ABOVE_HI;
+    }
+  }
+}
+
+// extend lines *y0 to *y1-1 by the ones a HighPreSpr entry covers
+static __inline void SpriteLineRange(int pack, int *y0, int *y1, int max_lines)
+{
+  int sy = (pack << 16) >> 16;
+  int sy_end = sy + (((pack >> 24) & 0xf) << 3);
+
+  if (sy < 0) sy = 0;
+  if (sy_end > max_lines) sy_end = max_lines;
+  if (sy >= sy_end) return;
+  if (sy < *y0) *y0 = sy;
+  if (sy_end > *y1) *y1 = sy_end;
+}
+
+// full: SAT contents changed. HighPreSpr and HighLnSpr are then updated for
+// just the entries marked in SatDirty since the last call, or rebuilt if
+// the sprite chain or the VDP setup changed.
 static NOINLINE void PrepareSprites(int full)
 {
   const struct PicoVideo *pvid=&Pico.video;
@@ -1048,6 +1204,7 @@ static NOINLINE void PrepareSprites(int full)
   int *pd = HighPreSpr;
   int max_lines = 224, max_sprites = 80, max_width = 328;
   int max_line_sprites = 20; // 20 sprites, 40 tiles
+  int key;
 
   if (!(Pico.video.reg[12]&1))
     max_sprites = 64, max_line_sprites = 16, max_width = 264;
@@ -1061,6 +1218,9 @@ static NOINLINE void PrepareSprites(int full)
   if (pvid->reg[12]&1) table&=0x7e; // Lowest bit 0 in 40-cell mode
   table<<=8; // Get sprite table address/2
 
+  key = table | ((max_lines == 240) << 16) | ((max_sprites == 80) << 17)
+        | (!!sh << 18) | (max_line_sprites << 19);
+
   if (!full)
   {
     int pack;
@@ -1112,79 +1272,79 @@ found:;
       link=(sprite[0]>>16)&0x7f;
       if (!link) break; // End of sprites
     }
+    // HighLnSpr is no longer what the SAT gives
+    HighPreSprKey = -1;
   }
-  else
+  else if (key == HighPreSprKey)
   {
-    for (u = 0; u < max_lines; u++)
-      *((int *)&HighLnSpr[u][0]) = 0;
+    int count = HighPreSprCount;
+    int y0 = max_lines, y1 = 0;
 
-    for (u = 0; u < max_sprites; u++)
+    for (u = 0; u < count; u++, pd += 2)
     {
+      unsigned int a = (table + (HighPreSprIdx[u] << 2)) & 0x7ffc;
       unsigned int *sprite;
-      int code, code2, sx, sy, hv, height, width;
+      int pre[2];
 
-      sprite=(unsigned int *)(PicoMem.vram+((table+(link<<2))&0x7ffc)); // Find sprite
+      if (!(SatDirty[a >> 7] & (1u << ((a >> 2) & 0x1f))))
+        continue;
 
-      // parse sprite info
-      code = sprite[0];
-      sy = (code&0x1ff)-0x80;
-      hv = (code>>24)&0xf;
-      height = (hv&3)+1;
+      sprite = (unsigned int *)(PicoMem.vram + a);
+      link = (sprite[0] >> 16) & 0x7f;
+      if (u + 1 < count ? link != HighPreSprIdx[u + 1] :
+                          (link != 0 && count < max_sprites))
+        goto rebuild; // sprite chain changed
 
-      width  = (hv>>2)+1;
-      code2 = sprite[1];
-      sx = (code2>>16)&0x1ff;
-      sx -= 0x78; // Get X coordinate + 8
+      PrepareSprite(pre, sprite);
+      if (pre[0] == pd[0] && pre[1] == pd[1])
+        continue;
 
-      if (sy < max_lines && sy + (height<<3) > est->DrawScanline) // sprite onscreen (y)?
-      {
-        int entry, y, sx_min, onscr_x, maybe_op = 0;
+      SpriteLineRange(pd[0], &y0, &y1, max_lines);
+      SpriteLineRange(pre[0], &y0, &y1, max_lines);
+      pd[0] = pre[0];
+      pd[1] = pre[1];
+    }
 
-        sx_min = 8-(width<<3);
-        onscr_x = sx_min < sx && sx < max_width;
-        if (sh && (code2 & 0x6000) == 0x6000)
-          maybe_op = SPRL_MAY_HAVE_OP;
+    for (u = 0; u < 4; u++)
+      SatDirty[((table >> 7) + u) & 0xff] = 0;
 
-        entry = ((pd - HighPreSpr) / 2) | ((code2>>8)&0x80);
-        y = (sy >= est->DrawScanline) ? sy : est->DrawScanline;
-        for (; y < sy + (height<<3) && y < max_lines; y++)
-        {
-	  unsigned char *p = &HighLnSpr[y][0];
-          int cnt = p[0];
-          if (cnt >= max_line_sprites) continue;              // sprite limit?
+    if (y0 < y1)
+      PrepareSpriteLines(y0, y1, max_line_sprites, max_width, sh);
+  }
+  else
+  {
+    unsigned int seen[0x80 / 32];
+    int dup;
+
+rebuild:
+    memset(seen, 0, sizeof(seen));
+    dup = 0;
+    pd = HighPreSpr;
+    link = 0;
+    for (u = 0; u < max_sprites; u++)
+    {
+      unsigned int *sprite;
 
-          if (p[2] >= max_line_sprites*2) {        // tile limit?
-            p[0] |= 0x80;
-            continue;
-          }
-          p[2] += width;
-
-          if (sx == -0x78) {
-            if (cnt > 0)
-              p[0] |= 0x80; // masked, no more sprites for this line
-            continue;
-          }
-          // must keep the first sprite even if it's offscreen, for masking
-          if (cnt > 0 && !onscr_x) continue; // offscreen x
-
-          p[3+cnt] = entry;
-          p[0] = cnt + 1;
-          p[1] |= (entry & 0x80) ? SPRL_HAVE_HI : SPRL_HAVE_LO;
-          p[1] |= maybe_op; // there might be op sprites on this line
-          if (cnt > 0 && (code2 & 0x8000) && !(p[3+cnt-1]&0x80))
-            p[1] |= SPRL_LO_ABOVE_HI;
-        }
-      }
+      sprite=(unsigned int *)(PicoMem.vram+((table+(link<<2))&0x7ffc)); // Find sprite
+      PrepareSprite(pd, sprite);
+      pd += 2;
 
-      *pd++ = (width<<28)|(height<<24)|(hv<<16)|((unsigned short)sy);
-      *pd++ = (sx<<16)|((unsigned short)code2);
+      HighPreSprIdx[u] = link;
+      if (seen[link >> 5] & (1u << (link & 0x1f)))
+        dup = 1; // looped chain, can't track that by entry
+      seen[link >> 5] |= 1u << (link & 0x1f);
 
       // Find next sprite
-      link=(code>>16)&0x7f;
+      link=(sprite[0]>>16)&0x7f;
       if (!link) break; // End of sprites
     }
     *pd = 0;
 
+    HighPreSprCount = (pd - HighPreSpr) / 2;
+    HighPreSprKey = dup ? -1 : key;
+    memset(SatDirty, 0, sizeof(SatDirty));
+    PrepareSpriteLines(0, max_lines, max_line_sprites, max_width, sh);
+
 #if 0
     for (u = 0; u < max_lines; u++)
     {
@@ -1239,6 +1399,122 @@ void BackFill(int reg7, int sh, struct PicoEState *est)
 
 // --------------------------------------------
 
+// Output scaling. A finished line is converted to DrawOutLine[] instead of
+// the output, then expanded from there to all output rows of the line. Each
+// 16 byte chunk of an output row is a byte shuffle of 16 bytes of the
+// converted line, the table of those is made for the current line size.
+PICO_TLS int DrawOutScale;   // as set by PicoDrawSetOutScale()
+PICO_TLS int DrawOutPitch;   // output line pitch from PicoDrawSetOutBuf()
+PICO_TLS int DrawOutScaled;  // lines go through PicoDrawOutLine()
+PICO_TLS unsigned int DrawOutLine[320];
+static PICO_TLS int out_bpp;   // output bytes per pixel, 0: 8bit or none
+static PICO_TLS int out_scale; // in effect, 1-4
+static PICO_TLS int out_key;   // line setup the table was made for
+static PICO_TLS unsigned short out_offs[320*4*4 / 16];
+static PICO_TLS unsigned char out_shuf[320*4*4 / 16][16];
+static PICO_TLS void (*OutChunks)(unsigned char *pd, const unsigned char *ps,
+  int chunks, int rows);
+
+static void OutChunks_c(unsigned char *pd, const unsigned char *ps,
+  int chunks, int rows)
+{
+  unsigned char *p = pd;
+  int c, i;
+
+  for (c = 0; c < chunks; c++, p += 16)
+    for (i = 0; i < 16; i++)
+      p[i] = ps[out_offs[c] + out_shuf[c][i]];
+  for (i = 1; i < rows; i++)
+    memcpy(pd + i * DrawOutPitch, pd, chunks * 16);
+}
+
+#ifdef HAVE_SSSE3
+TARGET_SSSE3
+static void OutChunks_ssse3(unsigned char *pd, const unsigned char *ps,
+  int chunks, int rows)
+{
+  int pitch = DrawOutPitch;
+  int c, r;
+
+  for (c = 0; c < chunks; c++, pd += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(ps + out_offs[c]));
+    v = _mm_shuffle_epi8(v, _mm_loadu_si128((const __m128i *)out_shuf[c]));
+    for (r = 0; r < rows; r++)
+      _mm_storeu_si128((__m128i *)(pd + r * pitch), v);
+  }
+}
+#endif
+
+#if defined(HAVE_NEON) && defined(__aarch64__)
+static void OutChunks_neon(unsigned char *pd, const unsigned char *ps,
+  int chunks, int rows)
+{
+  int pitch = DrawOutPitch;
+  int c, r;
+
+  for (c = 0; c < chunks; c++, pd += 16) {
+    uint8x16_t v = vqtbl1q_u8(vld1q_u8(ps + out_offs[c]), vld1q_u8(out_shuf[c]));
+    for (r = 0; r < rows; r++)
+      vst1q_u8(pd + r * pitch, v);
+  }
+}
+#endif
+
+// source pixel of output pixel x
+static __inline int out_src(int x, int scale, int norm)
+{
+  x /= scale;
+  return norm ? x * 4 / 5 : x;
+}
+
+// write len pixels of bpp bytes from DrawOutLine[] to the line at pd
+void PicoDrawOutLine(void *pd, int len, int bpp)
+{
+  int norm = (DrawOutScale & PDSS_NORM) && len == 256;
+  int scale = out_scale;
+  int key = len | (bpp << 9) | (scale << 12) | (norm << 15);
+  int olen = (norm ? 320 : len) * scale * bpp;
+  int c, i, s;
+
+  if (key != out_key) {
+    // a chunk never needs more than 16 source bytes, the last ones are
+    // loaded from the end of the line so that nothing past it is read
+    for (c = 0; c < olen / 16; c++) {
+      s = out_src(c * 16 / bpp, scale, norm) * bpp;
+      if (s > len * bpp - 16)
+        s = len * bpp - 16;
+      out_offs[c] = s;
+      for (i = 0; i < 16; i++)
+        out_shuf[c][i] = out_src((c * 16 + i) / bpp, scale, norm) * bpp + i % bpp - s;
+    }
+    out_key = key;
+  }
+
+  if (len == 256 && !norm && !(PicoIn.opt & POPT_DIS_32C_BORDER))
+    pd = (char *)pd + 32 * scale * bpp;
+  OutChunks(pd, (unsigned char *)DrawOutLine, olen / 16, scale);
+}
+
+// recheck if lines can be scaled, the 32X layer renderer and 8bit output
+// always write unscaled lines
+void PicoDrawOutUpdate(void)
+{
+  int scale = DrawOutScale & 7;
+
+  if (scale < 1) scale = 1;
+  if (scale > 4) scale = 4;
+  DrawOutScaled = (scale > 1 || (DrawOutScale & PDSS_NORM)) && out_bpp != 0
+    && !(PicoIn.AHW & PAHW_32X);
+#ifdef _ASM_DRAW_C
+  if (out_bpp == 2)
+    DrawOutScaled = 0; // FinalizeLine555 doesn't know about it
+#endif
+  out_scale = DrawOutScaled ? scale : 1;
+  DrawLineDestIncrement = DrawOutPitch * out_scale;
+}
+
+// --------------------------------------------
+
 #ifndef _ASM_DRAW_C
 void PicoDoHighPal555(int sh, int line, struct PicoEState *est)
 {
@@ -1278,6 +1554,76 @@ void PicoDoHighPal555(int sh, int line, struct PicoEState *est)
   }
 }
 
+static void PicoClut555(unsigned short *pd, const unsigned char *ps,
+  const unsigned short *pal, int len)
+{
+  int i;
+
+  for (i = 0; i < len; i++)
+    pd[i] = pal[ps[i]];
+}
+
+#ifdef HAVE_AVX2
+TARGET_AVX2
+static void PicoClut555_avx2(unsigned short *pd, const unsigned char *ps,
+  const unsigned short *pal, int len)
+{
+  // gather dwords at pal-1 and keep the upper halves, so that no read goes
+  // past pal[0xff] (pal[-1] still is inside struct PicoEState)
+  const int *base = (const int *)(pal - 1);
+  int i;
+
+  for (i = 0; i + 16 <= len; i += 16) {
+    __m128i idx = _mm_loadu_si128((const __m128i *)(ps + i));
+    __m256i lo = _mm256_cvtepu8_epi32(idx);
+    __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(idx, 8));
+    lo = _mm256_srli_epi32(_mm256_i32gather_epi32(base, lo, 2), 16);
+    hi = _mm256_srli_epi32(_mm256_i32gather_epi32(base, hi, 2), 16);
+    lo = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), _MM_SHUFFLE(3,1,2,0));
+    _mm256_storeu_si256((__m256i *)(pd + i), lo);
+  }
+  for (; i < len; i++)
+    pd[i] = pal[ps[i]];
+}
+#endif
+
+#if defined(HAVE_NEON) && defined(__aarch64__)
+static void PicoClut555_neon(unsigned short *pd, const unsigned char *ps,
+  const unsigned short *pal, int len)
+{
+  // the palette is split into low and high byte tables of 64 entries each,
+  // entries above 0x3f are only looked up if there are such pixels
+  uint8x16x4_t tl[4], th[4];
+  int i, j;
+
+  for (j = 0; j < 16; j++) {
+    uint8x16x2_t v = vld2q_u8((const uint8_t *)(pal + j * 16));
+    tl[j >> 2].val[j & 3] = v.val[0];
+    th[j >> 2].val[j & 3] = v.val[1];
+  }
+
+  for (i = 0; i + 16 <= len; i += 16) {
+    uint8x16_t idx = vld1q_u8(ps + i);
+    uint8x16x2_t r;
+    r.val[0] = vqtbl4q_u8(tl[0], idx);
+    r.val[1] = vqtbl4q_u8(th[0], idx);
+    if (vmaxvq_u8(idx) >= 0x40) {
+      for (j = 1; j < 4; j++) {
+        uint8x16_t k = vsubq_u8(idx, vdupq_n_u8(j * 0x40));
+        r.val[0] = vqtbx4q_u8(r.val[0], tl[j], k);
+        r.val[1] = vqtbx4q_u8(r.val[1], th[j], k);
+      }
+    }
+    vst2q_u8((uint8_t *)(pd + i), r);
+  }
+  for (; i < len; i++)
+    pd[i] = pal[ps[i]];
+}
+#endif
+
+static PICO_TLS void (*Clut555)(unsigned short *pd, const unsigned char *ps,
+  const unsigned short *pal, int len);
+
 void FinalizeLine555(int sh, int line, struct PicoEState *est)
 {
   unsigned short *pd=est->DrawLineDest;
@@ -1288,19 +1634,18 @@ void FinalizeLine555(int sh, int line, struct PicoEState *est)
   if (Pico.m.dirtyPal)
     PicoDoHighPal555(sh, line, est);
 
-  if (Pico.video.reg[12]&1) {
-    len = 320;
-  } else {
-    if (!(PicoIn.opt&POPT_DIS_32C_BORDER)) pd+=32;
-    len = 256;
+  len = (Pico.video.reg[12]&1) ? 320 : 256;
+  if (DrawOutScaled) {
+    Clut555((unsigned short *)DrawOutLine, ps, pal, len);
+    PicoDrawOutLine(pd, len, 2);
+    return;
   }
+  if (len == 256 && !(PicoIn.opt&POPT_DIS_32C_BORDER))
+    pd+=32;
 
   {
 #if 1
-    int i;
-
-    for (i = 0; i < len; i++)
-      pd[i] = pal[ps[i]];
+    Clut555(pd, ps, pal, len);
 #else
     extern void amips_clut(unsigned short *dst, unsigned char *src, unsigned short *pal, int count);
     extern void amips_clut_6bit(unsigned short *dst, unsigned char *src, unsigned short *pal, int count);
@@ -1312,11 +1657,51 @@ void FinalizeLine555(int sh, int line, struct PicoEState *est)
 }
 #endif
 
+static PICO_TLS unsigned int HighPal888[0x100];
+
+// for 32bit output, needs to follow every HighPal rebuild
+void PicoDoHighPal888(void)
+{
+  const unsigned short *spal = Pico.est.HighPal;
+  int i;
+
+  for (i = 0; i < 0x100; i++)
+    HighPal888[i] = PicoRGB565To888(spal[i]);
+}
+
+void FinalizeLine888(int sh, int line, struct PicoEState *est)
+{
+  unsigned int  *pd=est->DrawLineDest;
+  unsigned char *ps=est->HighCol+8;
+  int i, len;
+
+  if (Pico.m.dirtyPal) {
+    PicoDoHighPal555(sh, line, est);
+    PicoDoHighPal888();
+  }
+
+  len = (Pico.video.reg[12]&1) ? 320 : 256;
+  if (DrawOutScaled)
+    pd = DrawOutLine;
+  else if (len == 256 && !(PicoIn.opt&POPT_DIS_32C_BORDER))
+    pd+=32;
+
+  for (i = 0; i < len; i += 4) {
+    pd[i + 0] = HighPal888[ps[i + 0]];
+    pd[i + 1] = HighPal888[ps[i + 1]];
+    pd[i + 2] = HighPal888[ps[i + 2]];
+    pd[i + 3] = HighPal888[ps[i + 3]];
+  }
+
+  if (DrawOutScaled)
+    PicoDrawOutLine(est->DrawLineDest, len, 4);
+}
+
 static void FinalizeLine8bit(int sh, int line, struct PicoEState *est)
 {
   unsigned char *pd = est->DrawLineDest;
   int len, rs = est->rendstatus;
-  static int dirty_count;
+  static PICO_TLS int dirty_count;
 
   if (!sh && Pico.m.dirtyPal == 1)
   {
@@ -1352,7 +1737,7 @@ static void FinalizeLine8bit(int sh, int line, struct PicoEState *est)
   }
 }
 
-static void (*FinalizeLine)(int sh, int line, struct PicoEState *est);
+static PICO_TLS void (*FinalizeLine)(int sh, int line, struct PicoEState *est);
 
 // --------------------------------------------
 
@@ -1474,10 +1859,105 @@ static int DrawDisplay(int sh)
   return 0;
 }
 
+// Frame damage tracking. Every write that may change the picture sets
+// DrawDirty; a frame that starts with nothing changed since the last drawn
+// frame is held back and only drawn if something changes before its end
+// (the lazy renderer draws the lines before the write with the old state).
+// Changed lines of drawn frames are found by comparing output line hashes.
+PICO_TLS int DrawDirty;
+PICO_TLS int DrawHold;
+static PICO_TLS int damage_valid;   // output holds a frame of the current state
+static PICO_TLS int damage_changed; // last frame touched the output
+static PICO_TLS int damage_offs;    // output line of the first visible line
+static PICO_TLS int damage_lines;   // valid entries in damage_hash
+static PICO_TLS unsigned long long damage_hash[240];
+static PICO_TLS unsigned int damage_map[256 / 32];
+static PICO_TLS struct {
+  void *dest, *hcol;
+  int increment, scale, opt, ahw, debug_p;
+} damage_cfg;
+
+// at frame start, offs: output line of the first visible line
+void PicoDrawDamageStart(int offs)
+{
+  if (damage_cfg.dest != DrawLineDestBase || damage_cfg.hcol != HighColBase ||
+      damage_cfg.increment != DrawLineDestIncrement ||
+      damage_cfg.scale != DrawOutScale ||
+      damage_cfg.opt != PicoIn.opt || damage_cfg.ahw != PicoIn.AHW ||
+      damage_cfg.debug_p != Pico.video.debug_p || damage_offs != offs)
+  {
+    damage_cfg.dest = DrawLineDestBase;
+    damage_cfg.hcol = HighColBase;
+    damage_cfg.increment = DrawLineDestIncrement;
+    damage_cfg.scale = DrawOutScale;
+    damage_cfg.opt = PicoIn.opt;
+    damage_cfg.ahw = PicoIn.AHW;
+    damage_cfg.debug_p = Pico.video.debug_p;
+    damage_offs = offs;
+    damage_valid = damage_lines = 0;
+  }
+
+  DrawHold = (PicoIn.opt & POPT_EN_DAMAGE) && damage_valid && !DrawDirty
+    && !PicoIn.skipFrame;
+  DrawDirty = 0;
+}
+
+// at the end of the active display, returns 1 if the frame is unchanged
+// and the rest of it doesn't have to be drawn
+int PicoDrawDamageEnd(void)
+{
+  damage_valid = !DrawDirty && (damage_valid || !PicoIn.skipFrame);
+  DrawHold = DrawHeld();
+  return DrawHold;
+}
+
+// after the frame is complete, find the changed lines
+void PicoDrawDamageFinish(void)
+{
+  const unsigned int *p;
+  unsigned long long h;
+  int i, x, words;
+
+  if (!(PicoIn.opt & POPT_EN_DAMAGE))
+    return;
+
+  memset(damage_map, 0, sizeof(damage_map));
+  damage_changed = !DrawHold && !PicoIn.skipFrame;
+  if (!damage_changed)
+    return;
+
+  if (out_bpp == 0 || PicoScanBegin != NULL || PicoScan32xBegin != NULL) {
+    for (i = 0; i < rendlines; i++)
+      damage_map[i >> 5] |= 1u << (i & 31);
+    damage_lines = 0;
+    return;
+  }
+
+  words = (Pico.est.rendstatus & PDRAW_32_COLS) && (PicoIn.opt & POPT_DIS_32C_BORDER)
+    && !(DrawOutScaled && (DrawOutScale & PDSS_NORM)) ? 256 : 320;
+  words = words * out_scale * out_bpp / 4;
+  for (i = 0; i < rendlines; i++) {
+    p = (void *)((char *)DrawLineDestBase + (damage_offs + i) * DrawLineDestIncrement);
+    for (h = 0xcbf29ce484222325ull, x = 0; x < words; x++)
+      h = (h ^ p[x]) * 0x100000001b3ull; // FNV-1a over words
+    if (i >= damage_lines || h != damage_hash[i])
+      damage_map[i >> 5] |= 1u << (i & 31);
+    damage_hash[i] = h;
+  }
+  damage_lines = rendlines;
+}
+
+int PicoDrawGetDamage(unsigned int lines[256 / 32])
+{
+  if (lines != NULL)
+    memcpy(lines, damage_map, sizeof(damage_map));
+  return damage_changed;
+}
+
 // MUST be called every frame
 PICO_INTERNAL void PicoFrameStart(void)
 {
-  int offs = 8, lines = 224;
+  int lines = 224;
 
   // prepare to do this frame
   Pico.est.rendstatus = 0;
@@ -1485,10 +1965,9 @@ PICO_INTERNAL void PicoFrameStart(void)
     Pico.est.rendstatus |= PDRAW_INTERLACE; // interlace mode
   if (!(Pico.video.reg[12] & 1))
     Pico.est.rendstatus |= PDRAW_32_COLS;
-  if (Pico.video.reg[1] & 8) {
-    offs = 0;
+  if (Pico.video.reg[1] & 8)
     lines = 240;
-  }
+  PicoDrawOutUpdate();
 
   if (Pico.est.rendstatus != rendstatus_old || lines != rendlines) {
     rendlines = lines;
@@ -1497,15 +1976,29 @@ PICO_INTERNAL void PicoFrameStart(void)
       lines, (Pico.video.reg[12] & 1) ? 0 : 1);
     rendstatus_old = Pico.est.rendstatus;
   }
+  PicoDrawDamageStart((lines == 240) ? 0 : 8);
+
+  // the render thread only does the plain line renderer to a buffer
+  if ((PicoIn.opt & (POPT_EN_DRAW_THREAD|POPT_ALT_RENDERER)) == POPT_EN_DRAW_THREAD
+      && !(PicoIn.AHW & (PAHW_32X|PAHW_SMS)) && !PicoIn.skipFrame
+      && (FinalizeLine == FinalizeLine555 || FinalizeLine == FinalizeLine888)
+      && PicoScanBegin == NULL && PicoScanEnd == NULL
+      && PicoDrawThreadFrameStart(FinalizeLine == FinalizeLine888 ? PDF_RGB888 : PDF_RGB555))
+    return;
+
+  PicoDrawFrameStart();
+}
+
+// renderer part of PicoFrameStart, rendstatus and rendlines are set up
+void PicoDrawFrameStart(void)
+{
+  int offs = (rendlines == 240) ? 0 : 8;
 
   Pico.est.HighCol = HighColBase + offs * HighColIncrement;
   Pico.est.DrawLineDest = (char *)DrawLineDestBase + offs * DrawLineDestIncrement;
   Pico.est.DrawScanline = 0;
   skip_next_line = 0;
 
-  if (PicoIn.opt & POPT_ALT_RENDERER)
-    return;
-
   if (Pico.m.dirtyPal)
     Pico.m.dirtyPal = 2; // reset dirty if needed
   PrepareSprites(1);
@@ -1564,12 +2057,353 @@ static void PicoLine(int line, int offs, int sh, int bgc)
   Pico.est.DrawLineDest = (char *)Pico.est.DrawLineDest + DrawLineDestIncrement;
 }
 
+// --------------------------------------------
+
+/*
+ * frame batch renderer (POPT_ALT_RENDERER)
+ * PicoDrawSync() is called before any VDP change that affects drawing,
+ * so all lines it is asked for share the same state. Those are drawn
+ * layer by layer in the order DrawDisplay() uses, with the planes and the
+ * window done a tile at a time for all the lines of a tile row, which
+ * gives the same result as PicoLine(). Sprites and FinalizeLine still go
+ * line by line. s/h, interlace, 2-cell vscroll, forced layers and scan
+ * callbacks are left to PicoLine().
+ */
+
+// n rows of a tile starting at row ty, rlen: pixels to draw if < 8
+static void DrawBatchTile(unsigned char *pd, int code, int ty, int n, int rlen)
+{
+  const union TileCacheRow *tr = TileCacheGet((code & 0x7ff) << 4);
+  int pal = (code >> 9) & 0x30;
+  int step = 1, x;
+
+  if (code & 0x1000) { // Y-flip
+    ty = 7 - ty;
+    step = -1;
+  }
+  for (tr += ty; n > 0; n--, tr += step, pd += HighColIncrement)
+  {
+    const unsigned char *ps = TileCachePix(tr, code);
+    if (TileCacheBlank(tr))
+      continue;
+    if (rlen >= 8)
+      TileRow(pd, ps, pal);
+    else for (x = 0; x < rlen; x++)
+      if (ps[x])
+        pd[x] = (unsigned char)(pal | ps[x]);
+  }
+}
+
+static int BatchHscroll(int plane, int line)
+{
+  struct PicoVideo *pvid = &Pico.video;
+  int htab;
+
+  htab=pvid->reg[13]<<9; // Horizontal scroll table address
+  if ( pvid->reg[11]&2)     htab+=line<<1; // Offset by line
+  if ((pvid->reg[11]&1)==0) htab&=~0xf; // Offset by tile
+  htab+=plane; // A or B
+
+  return PicoMem.vram[htab & 0x7fff];
+}
+
+// plane tiles of priority prio for lines y0 to y1-1, see DrawLayer and
+// DrawStrip. Hi tiles past rlim are cut like in DrawTilesFromCache.
+static void DrawBatchPlane(unsigned char *pd, int y0, int y1, int plane,
+  int prio, int cellskip, int maxcells, int rlim)
+{
+  struct PicoVideo *pvid=&Pico.video;
+  const char shift[4]={5,6,5,7}; // 32,64 or 128 sized tilemaps (2 is invalid)
+  int width, height, ymask, xmask, nametab, vscroll;
+  int y, n;
+
+  // Work out the name table size: 32 64 or 128 tiles (0-3)
+  width=pvid->reg[16];
+  height=(width>>4)&3; width&=3;
+
+  xmask=(1<<shift[width])-1; // X Mask in tiles (0x1f-0x7f)
+  ymask=(height<<8)|0xff;    // Y Mask in pixels
+  switch (width) {
+    case 1: ymask &= 0x1ff; break;
+    case 2: ymask =  0x007; break;
+    case 3: ymask =  0x0ff; break;
+  }
+
+  // Find name table:
+  if (plane) nametab=(pvid->reg[4]&0x07)<<12; // B
+  else       nametab=(pvid->reg[2]&0x38)<< 9; // A
+
+  vscroll = PicoMem.vsram[plane];
+
+  for (y = y0; y < y1; y += n, pd += n * HighColIncrement)
+  {
+    int line = (vscroll + y) & ymask;
+    int hscroll = BatchHscroll(plane, y);
+    int nametab_row = nametab + ((line >> 3) << shift[width]);
+    int tilex, dx, cells, code;
+
+    // lines in the same tile row with the same hscroll
+    for (n = 1; y + n < y1 && ((line + n) & 7); n++)
+      if ((pvid->reg[11] & 3) && BatchHscroll(plane, y + n) != hscroll)
+        break;
+
+    tilex=((-hscroll)>>3)+cellskip;
+    dx=((hscroll-1)&7)+1;
+    cells = maxcells - cellskip;
+    if(dx != 8) cells++; // have hscroll, need to draw 1 cell more
+    dx+=cellskip<<3;
+
+    for (; cells > 0; dx+=8, tilex++, cells--)
+    {
+      code = PicoMem.vram[nametab_row + (tilex & xmask)];
+      if ((code >> 15) != prio)
+        continue;
+      if (prio && rlim - dx < 0) {
+        // for vertical window cutoff
+        if (rlim - dx + 8 > 0)
+          DrawBatchTile(pd + dx, code, line & 7, n, rlim - dx + 8);
+        break;
+      }
+      DrawBatchTile(pd + dx, code, line & 7, n, 8);
+    }
+  }
+}
+
+// window tiles of priority prio for lines y0 to y1-1, see DrawWindow.
+// wskip has 1 << prio set for the lines DrawWindow would have skipped.
+static void DrawBatchWindow(unsigned char *pd, int y0, int y1,
+  int tstart, int tend, int prio, const unsigned char *wskip)
+{
+  struct PicoVideo *pvid = &Pico.video;
+  int nametab, y, n;
+
+  for (y = y0; y < y1; y += n, pd += n * HighColIncrement)
+  {
+    int tilex, code;
+
+    for (n = 1; y + n < y1 && ((y + n) & 7); n++)
+      if ((wskip[y + n] ^ wskip[y]) & (1 << prio))
+        break;
+    if (wskip[y] & (1 << prio))
+      continue;
+
+    // Find name table line:
+    if (pvid->reg[12]&1)
+    {
+      nametab=(pvid->reg[3]&0x3c)<<9; // 40-cell mode
+      nametab+=(y>>3)<<6;
+    }
+    else
+    {
+      nametab=(pvid->reg[3]&0x3e)<<9; // 32-cell mode
+      nametab+=(y>>3)<<5;
+    }
+
+    for (tilex = tstart << 1; tilex < tend << 1; tilex++)
+    {
+      code = PicoMem.vram[nametab + tilex];
+      if ((code >> 15) == prio)
+        DrawBatchTile(pd + 8 + (tilex << 3), code, y & 7, n, 8);
+    }
+  }
+}
+
+// window setup of a line as in DrawDisplay: 0 none, 1 full, 2 vertical
+static int BatchWindowMode(int line, int maxcells)
+{
+  struct PicoVideo *pvid = &Pico.video;
+  int win, edge;
+
+  win=pvid->reg[0x12];
+  edge=(win&0x1f)<<3;
+
+  if (win&0x80) { if (line>=edge) return 1; }
+  else          { if (line< edge) return 1; }
+
+  win=pvid->reg[0x11];
+  edge=win&0x1f;
+  if (win&0x80) {
+    if (!edge) return 1;
+    else if(edge < (maxcells>>1)) return 2;
+  } else {
+    if (!edge);
+    else if(edge < (maxcells>>1)) return 2;
+    else return 1;
+  }
+  return 0;
+}
+
+// layer A and/or window of priority prio for lines of the same window mode
+static void DrawBatchLayerA(unsigned char *pd, int y0, int y1, int mode,
+  int prio, int maxcells, int maxw, const unsigned char *wskip)
+{
+  int win = Pico.video.reg[0x11], edge = win & 0x1f;
+
+  if (mode == 1)
+    DrawBatchWindow(pd, y0, y1, 0, maxcells>>1, prio, wskip);
+  else if (mode == 2) {
+    DrawBatchPlane(pd, y0, y1, 0, prio, (win&0x80) ? 0 : edge<<1,
+      (win&0x80) ? edge<<1 : maxcells, (win&0x80) ? edge<<4 : maxw);
+    DrawBatchWindow(pd, y0, y1, (win&0x80) ? edge : 0,
+      (win&0x80) ? maxcells>>1 : edge, prio, wskip);
+  }
+  else
+    DrawBatchPlane(pd, y0, y1, 0, prio, 0, maxcells, maxw);
+}
+
+static void DrawDisplayBatch(int y0, int y1)
+{
+  struct PicoEState *est=&Pico.est;
+  struct PicoVideo *pvid=&Pico.video;
+  unsigned char *hc = est->HighCol, *pd;
+  unsigned char wskip[240];
+  int mode[2], ys, maxw, maxcells, y;
+
+  if (est->rendstatus & (PDRAW_SPRITES_MOVED|PDRAW_DIRTY_SPRITES)) {
+    PrepareSprites(est->rendstatus & PDRAW_DIRTY_SPRITES);
+    est->rendstatus &= ~(PDRAW_SPRITES_MOVED|PDRAW_DIRTY_SPRITES);
+  }
+
+  est->rendstatus &= ~(PDRAW_SHHI_DONE|PDRAW_PLANE_HI_PRIO);
+
+  if (pvid->reg[12]&1) {
+    maxw = 328; maxcells = 40;
+  } else {
+    maxw = 264; maxcells = 32;
+  }
+
+  // the lines before and after the horizontal window edge
+  ys = (pvid->reg[0x12]&0x1f)<<3;
+  if (ys < y0) ys = y0;
+  if (ys > y1) ys = y1;
+  mode[0] = BatchWindowMode(y0, maxcells);
+  mode[1] = BatchWindowMode(y1 - 1, maxcells);
+
+  // DrawWindow skips a line if the 1st tile has the other priority, until
+  // it has seen both priorities. Find out what it would have done.
+  memset(wskip + y0, 0, y1 - y0);
+  for (y = y0; y < y1 && !(est->rendstatus & PDRAW_WND_DIFF_PRIO); y++)
+  {
+    int m = mode[y >= ys], win = pvid->reg[0x11], edge = win & 0x1f;
+    int tstart = 0, tend = maxcells >> 1, nametab, prio, tilex;
+
+    if (m == 0 || (pvid->debug_p & PVD_KILL_A))
+      continue;
+    if (m == 2) {
+      tstart = (win&0x80) ? edge : 0;
+      tend = (win&0x80) ? maxcells>>1 : edge;
+    }
+    if (pvid->reg[12]&1)
+      nametab = ((pvid->reg[3]&0x3c)<<9) + ((y>>3)<<6);
+    else
+      nametab = ((pvid->reg[3]&0x3e)<<9) + ((y>>3)<<5);
+
+    for (prio = 0; prio < 2; prio++) {
+      if ((PicoMem.vram[nametab + (tstart<<1)] >> 15) != prio) {
+        if (!(est->rendstatus & PDRAW_WND_DIFF_PRIO))
+          wskip[y] |= 1 << prio;
+        continue;
+      }
+      for (tilex = tstart<<1; tilex < tend<<1; tilex++)
+        if ((PicoMem.vram[nametab + tilex] >> 15) != prio)
+          est->rendstatus |= PDRAW_WND_DIFF_PRIO;
+    }
+  }
+
+  /* - layer B low - */
+  if (!(pvid->debug_p & PVD_KILL_B))
+    DrawBatchPlane(hc, y0, y1, 1, 0, 0, maxcells, maxw);
+  /* - layer A low - */
+  if (!(pvid->debug_p & PVD_KILL_A)) {
+    DrawBatchLayerA(hc, y0, ys, mode[0], 0, maxcells, maxw, wskip);
+    DrawBatchLayerA(hc + (ys - y0) * HighColIncrement, ys, y1, mode[1], 0,
+      maxcells, maxw, wskip);
+  }
+  /* - sprites low - */
+  if (!(pvid->debug_p & PVD_KILL_S_LO)) {
+    for (y = y0, pd = hc; y < y1; y++, pd += HighColIncrement) {
+      unsigned char *sprited = &HighLnSpr[y][0];
+      est->HighCol = pd;
+      est->DrawScanline = y;
+      if (sprited[1] & SPRL_HAVE_LO)
+        DrawAllSprites(sprited, 0, 0, est);
+    }
+  }
+
+  /* - layer B hi - */
+  if (!(pvid->debug_p & PVD_KILL_B))
+    DrawBatchPlane(hc, y0, y1, 1, 1, 0, maxcells, maxw);
+  /* - layer A hi - */
+  if (!(pvid->debug_p & PVD_KILL_A)) {
+    DrawBatchLayerA(hc, y0, ys, mode[0], 1, maxcells, maxw, wskip);
+    DrawBatchLayerA(hc + (ys - y0) * HighColIncrement, ys, y1, mode[1], 1,
+      maxcells, maxw, wskip);
+  }
+  /* - sprites hi - */
+  if (!(pvid->debug_p & PVD_KILL_S_HI)) {
+    for (y = y0, pd = hc; y < y1; y++, pd += HighColIncrement) {
+      unsigned char *sprited = &HighLnSpr[y][0];
+      est->HighCol = pd;
+      est->DrawScanline = y;
+      // have sprites without layer pri bit ontop of sprites with that bit
+      if ((sprited[1] & 0xd0) == 0xd0 && (PicoIn.opt & POPT_ACC_SPRITES))
+        DrawSpritesHiAS(sprited, 0);
+      else if (sprited[1] & SPRL_HAVE_HI)
+        DrawAllSprites(sprited, 1, 0, est);
+    }
+  }
+
+  est->HighCol = hc;
+  est->DrawScanline = y0;
+}
+
+static int PicoLinesBatchOk(void)
+{
+  struct PicoVideo *pvid = &Pico.video;
+
+  return HighColIncrement != 0 && PicoScanBegin == NULL && PicoScanEnd == NULL
+    && !(pvid->reg[12] & 8) && (pvid->reg[12] & 6) != 6 && !(pvid->reg[11] & 4)
+    && !(Pico.est.rendstatus & PDRAW_INTERLACE)
+    && !(pvid->debug_p & (PVD_FORCE_A | PVD_FORCE_B));
+}
+
+// lines y0 to y1-1, like PicoLine() on each
+static void PicoLinesBatch(int y0, int y1, int bgc)
+{
+  struct PicoEState *est = &Pico.est;
+  unsigned char *hc = est->HighCol;
+  int y;
+
+  for (y = y0; y < y1; y++) {
+    est->HighCol = hc + (y - y0) * HighColIncrement;
+    BackFill(bgc, 0, est);
+  }
+  est->HighCol = hc;
+  est->DrawScanline = y0;
+
+  if (Pico.video.reg[1]&0x40)
+    DrawDisplayBatch(y0, y1);
+
+  for (y = y0; y < y1; y++) {
+    est->DrawScanline = y;
+    if (FinalizeLine != NULL)
+      FinalizeLine(0, y, est);
+    est->HighCol += HighColIncrement;
+    est->DrawLineDest = (char *)est->DrawLineDest + DrawLineDestIncrement;
+  }
+}
+
 void PicoDrawSync(int to, int blank_last_line)
 {
   int line, offs = 0;
   int sh = (Pico.video.reg[0xC] & 8) >> 3; // shadow/hilight?
   int bgc = Pico.video.reg[7];
 
+  if (DrawThreadActive) {
+    PicoDrawThreadSync(to, blank_last_line);
+    return;
+  }
+
   pprof_start(draw);
 
   if (rendlines != 240) {
@@ -1578,7 +2412,16 @@ void PicoDrawSync(int to, int blank_last_line)
       to = 223;
   }
 
-  for (line = Pico.est.DrawScanline; line < to; line++)
+  line = Pico.est.DrawScanline;
+  if ((PicoIn.opt & POPT_ALT_RENDERER) && PicoLinesBatchOk()) {
+    int end = blank_last_line ? to : to + 1;
+    if (end - line >= 3) { // shorter runs are faster line by line
+      PicoLinesBatch(line, end, bgc);
+      line = end;
+    }
+  }
+
+  for (; line < to; line++)
     PicoLine(line, offs, sh, bgc);
 
   // last line
@@ -1599,8 +2442,6 @@ void PicoDrawUpdateHighPal(void)
 {
   struct PicoEState *est = &Pico.est;
   int sh = (Pico.video.reg[0xC] & 8) >> 3; // shadow/hilight?
-  if (PicoIn.opt & POPT_ALT_RENDERER)
-    sh = 0; // no s/h support
 
   PicoDoHighPal555(sh, 0, &Pico.est);
   if (est->rendstatus & PDRAW_SONIC_MODE) {
@@ -1608,6 +2449,7 @@ void PicoDrawUpdateHighPal(void)
     memcpy(est->HighPal + 0x40, est->HighPal, 0x40*2);
     memcpy(est->HighPal + 0x80, est->HighPal, 0x40*2);
   }
+  PicoDoHighPal888();
 }
 
 void PicoDrawSetOutFormat(pdso_t which, int use_32x_line_mode)
@@ -1625,10 +2467,20 @@ void PicoDrawSetOutFormat(pdso_t which, int use_32x_line_mode)
         FinalizeLine = FinalizeLine555;
       break;
 
+    case PDF_RGB888:
+      if ((PicoIn.AHW & PAHW_32X) && use_32x_line_mode)
+        FinalizeLine = FinalizeLine32xRGB888;
+      else
+        FinalizeLine = FinalizeLine888;
+      break;
+
     default:
       FinalizeLine = NULL;
       break;
   }
+  out_bpp = (which == PDF_RGB555) ? 2 : (which == PDF_RGB888) ? 4 : 0;
+  damage_valid = damage_lines = 0;
+  PicoDrawOutUpdate();
   PicoDrawSetOutFormat32x(which, use_32x_line_mode);
   PicoDrawSetOutputMode4(which);
   rendstatus_old = -1;
@@ -1638,8 +2490,18 @@ void PicoDrawSetOutFormat(pdso_t which, int use_32x_line_mode)
 void PicoDrawSetOutBuf(void *dest, int increment)
 {
   DrawLineDestBase = dest;
-  DrawLineDestIncrement = increment;
-  Pico.est.DrawLineDest = (char *)DrawLineDestBase + Pico.est.DrawScanline * increment;
+  DrawOutPitch = increment;
+  PicoDrawOutUpdate();
+  Pico.est.DrawLineDest = (char *)DrawLineDestBase
+    + Pico.est.DrawScanline * DrawLineDestIncrement;
+}
+
+void PicoDrawSetOutScale(int scale)
+{
+  DrawOutScale = scale;
+  PicoDrawOutUpdate();
+  Pico.est.DrawLineDest = (char *)DrawLineDestBase
+    + Pico.est.DrawScanline * DrawLineDestIncrement;
 }
 
 void PicoDrawSetInternalBuf(void *dest, int increment)
@@ -1662,7 +2524,8 @@ void PicoDrawSetCallbacks(int (*begin)(unsigned int num), int (*end)(unsigned in
   PicoScan32xBegin = NULL;
   PicoScan32xEnd = NULL;
 
-  if ((PicoIn.AHW & PAHW_32X) && FinalizeLine != FinalizeLine32xRGB555) {
+  if ((PicoIn.AHW & PAHW_32X) && FinalizeLine != FinalizeLine32xRGB555
+      && FinalizeLine != FinalizeLine32xRGB888) {
     PicoScan32xBegin = begin;
     PicoScan32xEnd = end;
   }
@@ -1674,10 +2537,37 @@ void PicoDrawSetCallbacks(int (*begin)(unsigned int num), int (*end)(unsigned in
 
 void PicoDrawInit(void)
 {
+  // not static initializers as these may be thread local
+  if (HighColBase == NULL)
+    HighColBase = DefHighCol;
+  if (DrawLineDestBase == NULL)
+    DrawLineDestBase = DefOutBuff;
+
   Pico.est.DrawLineDest = DefOutBuff;
   Pico.est.HighCol = HighColBase;
   Pico.est.HighPreSpr = HighPreSpr;
   rendstatus_old = -1;
+  PicoDrawInvalidateVram();
+
+#ifndef _ASM_DRAW_C
+  Clut555 = PicoClut555;
+#ifdef HAVE_AVX2
+  if (pico_cpu_features() & PCPU_AVX2)
+    Clut555 = PicoClut555_avx2;
+#endif
+#if defined(HAVE_NEON) && defined(__aarch64__)
+  Clut555 = PicoClut555_neon;
+#endif
+#endif
+  OutChunks = OutChunks_c;
+#ifdef HAVE_SSSE3
+  if (pico_cpu_features() & PCPU_SSSE3)
+    OutChunks = OutChunks_ssse3;
+#endif
+#if defined(HAVE_NEON) && defined(__aarch64__)
+  OutChunks = OutChunks_neon;
+#endif
+  out_key = 0;
 }
 
 // vim:ts=2:sw=2:expandtab
@@ -20,13 +20,13 @@
 #define LINE_WIDTH 328
 #endif
 
-static unsigned char PicoDraw2FB_[(8+320) * (8+240+8)];
+static PICO_TLS unsigned char PicoDraw2FB_[(8+320) * (8+240+8)];
 
-static int HighCache2A[41*(TILE_ROWS+1)+1+1]; // caches for high layers
-static int HighCache2B[41*(TILE_ROWS+1)+1+1];
+static PICO_TLS int HighCache2A[41*(TILE_ROWS+1)+1+1]; // caches for high layers
+static PICO_TLS int HighCache2B[41*(TILE_ROWS+1)+1+1];
 
-unsigned short *PicoCramHigh=PicoMem.cram; // pointer to CRAM buff (0x40 shorts), converted to native device color (works only with 16bit for now)
-void (*PicoPrepareCram)()=0;            // prepares PicoCramHigh for renderer to use
+PICO_TLS unsigned short *PicoCramHigh; // pointer to CRAM buff (0x40 shorts), converted to native device color (works only with 16bit for now)
+PICO_TLS void (*PicoPrepareCram)()=0;            // prepares PicoCramHigh for renderer to use
 
 
 // stuff available in asm:
@@ -626,4 +626,6 @@ PICO_INTERNAL void PicoFrameFull()
 void PicoDraw2Init(void)
 {
 	Pico.est.Draw2FB = PicoDraw2FB_;
+	if (PicoCramHigh == NULL)
+		PicoCramHigh = PicoMem.cram;
 }
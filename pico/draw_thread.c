@@ -0,0 +1,330 @@
+/*
+ * PicoDrive - threaded line renderer
+ *
+ * This work is licensed under the terms of MAME license.
+ * See COPYING file in the top-level directory.
+ *
+ * The emulating thread doesn't draw, it records what the line renderer
+ * would look at (VRAM changes, VDP registers, CRAM and VSRAM) into a
+ * command log whenever draw.c would have synced, and a renderer thread
+ * replays that into its own copy of the state and draws the lines while
+ * the CPUs keep going. Mid-frame changes end up in the log in the same
+ * order as they would have been seen by PicoDrawSync(), so raster effects
+ * come out the same. The frame is complete when PicoFrame() returns.
+ * Only the VRAM blocks written since the last sync are sent, which also
+ * keeps the renderer's decoded tile cache valid across frames.
+ *
+ * Only the thread safe build has this, the renderer thread has its own
+ * thread local renderer state.
+ */
+
+#include <pthread.h>
+#include "pico_int.h"
+
+#define LOG_WORDS   (512 * 1024 / 4)
+#define VRAM_BLOCKS (0x10000 >> 6)
+
+// commands, a 2 word header (cmd | arg << 8) followed by data
+enum {
+  DTC_VRAM_ALL,
+  DTC_VRAM,     // arg: 64 byte block
+  DTC_STATE,
+  DTC_FRAME,
+  DTC_DRAW,     // arg: last line | blank << 8
+};
+
+#define DT_WORDS(size) ((((size) + 7) & ~7) / 4)
+
+struct dt_state {
+  struct PicoVideo video;
+  unsigned short cram[0x40];
+  unsigned short vsram[0x40];
+  int rendstatus;
+  int dirty_pal;
+};
+
+struct dt_frame {
+  void *dest;
+  int increment;
+  int scale;
+  int format;
+  unsigned int opt;
+  unsigned int ahw;
+  int rendstatus;
+  int lines;
+};
+
+struct draw_thread {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  unsigned int wpos; // published part of the log
+  unsigned int rpos; // replayed part of the log
+  int quit;
+  unsigned int log[LOG_WORDS] __attribute__((aligned(8)));
+};
+
+PICO_TLS int DrawThreadActive;
+PICO_TLS unsigned int DrawThreadVramDirty[VRAM_BLOCKS / 32];
+
+static PICO_TLS struct draw_thread *dt;
+static PICO_TLS unsigned int dt_wpos;
+
+/* renderer thread */
+
+static int dt_replay(const unsigned int *p)
+{
+  const void *d = p + 2;
+
+  switch (p[0] & 0xff)
+  {
+    case DTC_VRAM_ALL:
+      memcpy(PicoMem.vram, d, sizeof(PicoMem.vram));
+      PicoDrawInvalidateVram();
+      return 2 + DT_WORDS(sizeof(PicoMem.vram));
+
+    case DTC_VRAM: {
+      unsigned int a = (p[0] >> 8) * 64;
+      memcpy((char *)PicoMem.vram + a, d, 64);
+      TileCacheInvalidate(a);
+      TileCacheInvalidate(a + 32);
+      SatDirty[(a >> 8) & 0xff] |= 0xffu << ((a >> 3) & 0x18);
+      return 2 + DT_WORDS(64);
+    }
+
+    case DTC_STATE: {
+      const struct dt_state *s = d;
+      Pico.video = s->video;
+      memcpy(PicoMem.cram, s->cram, sizeof(PicoMem.cram));
+      memcpy(PicoMem.vsram, s->vsram, sizeof(PicoMem.vsram));
+      Pico.est.rendstatus |= s->rendstatus;
+      if (s->dirty_pal)
+        Pico.m.dirtyPal = s->dirty_pal;
+      return 2 + DT_WORDS(sizeof(*s));
+    }
+
+    case DTC_FRAME: {
+      const struct dt_frame *f = d;
+      PicoIn.opt = f->opt;
+      PicoIn.AHW = f->ahw;
+      Pico.est.rendstatus = f->rendstatus;
+      rendlines = f->lines;
+      PicoDrawSetOutFormat(f->format, 0);
+      PicoDrawSetOutScale(f->scale);
+      PicoDrawSetOutBuf(f->dest, f->increment);
+      // HighPal here hasn't seen earlier frames
+      Pico.m.dirtyPal = 1;
+      PicoDrawFrameStart();
+      return 2 + DT_WORDS(sizeof(*f));
+    }
+
+    case DTC_DRAW:
+      PicoDrawSync((p[0] >> 8) & 0xff, p[0] >> 16);
+      return 2;
+  }
+
+  elprintf(EL_STATUS, "draw thread: bad cmd %08x", p[0]);
+  return LOG_WORDS;
+}
+
+static void *dt_main(void *arg)
+{
+  struct draw_thread *t = arg;
+  unsigned int pos, end;
+
+  Pico.est.Pico = &Pico;
+  Pico.est.PicoMem_vram = PicoMem.vram;
+  Pico.est.PicoMem_cram = PicoMem.cram;
+  Pico.est.PicoOpt = &PicoIn.opt;
+  PicoDrawInit();
+
+  pthread_mutex_lock(&t->lock);
+  for (;;)
+  {
+    while (t->rpos == t->wpos && !t->quit)
+      pthread_cond_wait(&t->cond, &t->lock);
+    if (t->rpos == t->wpos)
+      break;
+
+    pos = t->rpos;
+    end = t->wpos;
+    pthread_mutex_unlock(&t->lock);
+
+    while (pos < end)
+      pos += dt_replay(&t->log[pos]);
+
+    pthread_mutex_lock(&t->lock);
+    t->rpos = end;
+    pthread_cond_broadcast(&t->cond);
+  }
+  pthread_mutex_unlock(&t->lock);
+
+  return NULL;
+}
+
+/* emu thread */
+
+static void dt_publish(void)
+{
+  pthread_mutex_lock(&dt->lock);
+  dt->wpos = dt_wpos;
+  pthread_cond_broadcast(&dt->cond);
+  pthread_mutex_unlock(&dt->lock);
+}
+
+// wait for the renderer to catch up, then rewind the log
+static void dt_drain(void)
+{
+  pthread_mutex_lock(&dt->lock);
+  dt->wpos = dt_wpos;
+  pthread_cond_broadcast(&dt->cond);
+  while (dt->rpos != dt->wpos)
+    pthread_cond_wait(&dt->cond, &dt->lock);
+  dt->rpos = dt->wpos = dt_wpos = 0;
+  pthread_mutex_unlock(&dt->lock);
+}
+
+static void *dt_cmd(int cmd, unsigned int arg, int size)
+{
+  unsigned int *p;
+  int words = 2 + DT_WORDS(size);
+
+  if (dt_wpos + words > LOG_WORDS)
+    dt_drain();
+
+  p = &dt->log[dt_wpos];
+  dt_wpos += words;
+  p[0] = cmd | (arg << 8);
+  return p + 2;
+}
+
+static void dt_send_vram(void)
+{
+  unsigned int bits;
+  int i, b, count = 0;
+
+  for (i = 0; i < VRAM_BLOCKS / 32; i++)
+    for (bits = DrawThreadVramDirty[i]; bits; bits &= bits - 1)
+      count++;
+
+  if (count > VRAM_BLOCKS / 2)
+    memcpy(dt_cmd(DTC_VRAM_ALL, 0, sizeof(PicoMem.vram)),
+      PicoMem.vram, sizeof(PicoMem.vram));
+  else if (count > 0) {
+    for (i = 0; i < VRAM_BLOCKS / 32; i++) {
+      bits = DrawThreadVramDirty[i];
+      for (b = i * 32; bits; b++, bits >>= 1)
+        if (bits & 1)
+          memcpy(dt_cmd(DTC_VRAM, b, 64), (char *)PicoMem.vram + b * 64, 64);
+    }
+  }
+
+  memset(DrawThreadVramDirty, 0, sizeof(DrawThreadVramDirty));
+}
+
+static void dt_send_state(void)
+{
+  struct dt_state *s = dt_cmd(DTC_STATE, 0, sizeof(*s));
+
+  s->video = Pico.video;
+  memcpy(s->cram, PicoMem.cram, sizeof(s->cram));
+  memcpy(s->vsram, PicoMem.vsram, sizeof(s->vsram));
+  s->rendstatus = Pico.est.rendstatus & (PDRAW_DIRTY_SPRITES|PDRAW_SPRITES_MOVED);
+  s->dirty_pal = Pico.m.dirtyPal;
+
+  // these are consumed by the renderer
+  Pico.est.rendstatus &= ~(PDRAW_DIRTY_SPRITES|PDRAW_SPRITES_MOVED);
+  Pico.m.dirtyPal = 0;
+}
+
+// called instead of the renderer frame start, returns 0 if the
+// thread can't be used
+int PicoDrawThreadFrameStart(pdso_t which)
+{
+  struct dt_frame *f;
+
+  if (dt == NULL) {
+    dt = calloc(1, sizeof(*dt));
+    if (dt == NULL)
+      return 0;
+    pthread_mutex_init(&dt->lock, NULL);
+    pthread_cond_init(&dt->cond, NULL);
+    if (pthread_create(&dt->thread, NULL, dt_main, dt) != 0) {
+      elprintf(EL_STATUS, "draw thread: can't create thread");
+      pthread_cond_destroy(&dt->cond);
+      pthread_mutex_destroy(&dt->lock);
+      free(dt);
+      dt = NULL;
+      return 0;
+    }
+    dt_wpos = 0;
+    // the renderer has nothing yet
+    memset(DrawThreadVramDirty, 0xff, sizeof(DrawThreadVramDirty));
+  }
+
+  dt_send_vram();
+  dt_send_state();
+
+  f = dt_cmd(DTC_FRAME, 0, sizeof(*f));
+  f->dest = DrawLineDestBase;
+  f->increment = DrawOutPitch;
+  f->scale = DrawOutScale;
+  f->format = which;
+  f->opt = PicoIn.opt;
+  f->ahw = PicoIn.AHW;
+  f->rendstatus = Pico.est.rendstatus;
+  f->lines = rendlines;
+  dt_publish();
+
+  Pico.est.DrawScanline = 0;
+  DrawThreadActive = 1;
+  return 1;
+}
+
+// PicoDrawSync() replacement, only keeps track of the line count
+void PicoDrawThreadSync(int to, int blank_last_line)
+{
+  if (rendlines != 240 && to > 223)
+    to = 223;
+  if (Pico.est.DrawScanline > to)
+    return;
+
+  dt_send_vram();
+  dt_send_state();
+  dt_cmd(DTC_DRAW, to | (!!blank_last_line << 8), 0);
+  dt_publish();
+
+  Pico.est.DrawScanline = to + 1;
+}
+
+// wait until the frame is complete
+void PicoDrawThreadFinish(void)
+{
+  if (!DrawThreadActive)
+    return;
+
+  dt_drain();
+  DrawThreadActive = 0;
+  // this side's HighPal didn't follow
+  Pico.m.dirtyPal = 1;
+}
+
+void PicoDrawThreadExit(void)
+{
+  if (dt == NULL)
+    return;
+
+  PicoDrawThreadFinish();
+  pthread_mutex_lock(&dt->lock);
+  dt->quit = 1;
+  pthread_cond_broadcast(&dt->cond);
+  pthread_mutex_unlock(&dt->lock);
+  pthread_join(dt->thread, NULL);
+
+  pthread_cond_destroy(&dt->cond);
+  pthread_mutex_destroy(&dt->lock);
+  free(dt);
+  dt = NULL;
+}
+
+// vim:ts=2:sw=2:expandtab
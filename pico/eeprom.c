@@ -11,7 +11,7 @@
 
 #include "pico_int.h"
 
-static unsigned int last_write = 0xffff0000;
+static PICO_TLS unsigned int last_write = 0xffff0000;
 
 // eeprom_status: LA.. s.la (L=pending SCL, A=pending SDA,
 //                           s=started, l=old SCL, a=old SDA)
@@ -10,7 +10,7 @@
 #include "pico_int.h"
 #include "cd/cue.h"
 
-unsigned char media_id_header[0x100];
+PICO_TLS unsigned char media_id_header[0x100];
 
 static void strlwr_(char *string)
 {
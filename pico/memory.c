@@ -15,10 +15,10 @@
 
 extern unsigned int lastSSRamWrite; // used by serial eeprom code
 
-uptr m68k_read8_map  [0x1000000 >> M68K_MEM_SHIFT];
-uptr m68k_read16_map [0x1000000 >> M68K_MEM_SHIFT];
-uptr m68k_write8_map [0x1000000 >> M68K_MEM_SHIFT];
-uptr m68k_write16_map[0x1000000 >> M68K_MEM_SHIFT];
+PICO_TLS uptr m68k_read8_map  [0x1000000 >> M68K_MEM_SHIFT];
+PICO_TLS uptr m68k_read16_map [0x1000000 >> M68K_MEM_SHIFT];
+PICO_TLS uptr m68k_write8_map [0x1000000 >> M68K_MEM_SHIFT];
+PICO_TLS uptr m68k_write16_map[0x1000000 >> M68K_MEM_SHIFT];
 
 static void xmap_set(uptr *map, int shift, int start_addr, int end_addr,
     const void *func_or_mh, int is_func)
@@ -70,8 +70,11 @@ void cpu68k_map_set(uptr *map, int start_addr, int end_addr,
     int shiftout = 24 - FAMEC_FETCHBITS;
     int i = start_addr >> shiftout;
     uptr base = (uptr)func_or_mh - (i << shiftout);
-    for (; i <= (end_addr >> shiftout); i++)
+    for (; i <= (end_addr >> shiftout); i++) {
+      if (PicoCpuFM68k.Fetch[i] != base)
+        fm68k_drc_fetch_changed(i);
       PicoCpuFM68k.Fetch[i] = base;
+    }
   }
 #endif
 }
@@ -107,8 +110,11 @@ void cpu68k_map_all_ram(int start_addr, int end_addr, void *ptr, int is_sub)
     int shiftout = 24 - FAMEC_FETCHBITS;
     i = start_addr >> shiftout;
     addr = (uptr)ptr - (i << shiftout);
-    for (; i <= (end_addr >> shiftout); i++)
+    for (; i <= (end_addr >> shiftout); i++) {
+      if (!is_sub && ctx->Fetch[i] != addr)
+        fm68k_drc_fetch_changed(i);
       ctx->Fetch[i] = addr;
+    }
   }
 #endif
 }
@@ -539,6 +545,7 @@ static void PicoWrite8_z80(u32 a, u32 d)
 
   if ((a & 0x4000) == 0x0000) { // z80 RAM
     PicoMem.zram[a & 0x1fff] = (u8)d;
+    cz80_drc_wcheck_ram(a & 0x1fff);
     return;
   }
   if ((a & 0x6000) == 0x4000) { // FM Sound
@@ -1253,6 +1260,7 @@ static void z80_md_bank_write(unsigned int a, unsigned char data)
 
   elprintf(EL_Z80BNK, "z80->68k w8 [%06x] %02x", addr68k, data);
   m68k_write8(addr68k, data);
+  fm68k_drc_wcheck_ram(addr68k);
 }
 
 // -----------------------------------------------------------------
@@ -1292,6 +1300,7 @@ static void z80_mem_setup(void)
   Cz80_Set_INPort(&CZ80, z80_md_in);
   Cz80_Set_OUTPort(&CZ80, z80_md_out);
 #endif
+  cz80_drc_flush();
 }
 
 // vim:shiftwidth=2:ts=2:expandtab
@@ -12,15 +12,15 @@ typedef uintptr_t      uptr; // unsigned pointer-sized int
 #define M68K_BANK_SIZE (1 << M68K_MEM_SHIFT)
 #define M68K_BANK_MASK (M68K_BANK_SIZE - 1)
 
-extern uptr m68k_read8_map  [0x1000000 >> M68K_MEM_SHIFT];
-extern uptr m68k_read16_map [0x1000000 >> M68K_MEM_SHIFT];
-extern uptr m68k_write8_map [0x1000000 >> M68K_MEM_SHIFT];
-extern uptr m68k_write16_map[0x1000000 >> M68K_MEM_SHIFT];
+extern PICO_TLS uptr m68k_read8_map  [0x1000000 >> M68K_MEM_SHIFT];
+extern PICO_TLS uptr m68k_read16_map [0x1000000 >> M68K_MEM_SHIFT];
+extern PICO_TLS uptr m68k_write8_map [0x1000000 >> M68K_MEM_SHIFT];
+extern PICO_TLS uptr m68k_write16_map[0x1000000 >> M68K_MEM_SHIFT];
 
-extern uptr s68k_read8_map  [0x1000000 >> M68K_MEM_SHIFT];
-extern uptr s68k_read16_map [0x1000000 >> M68K_MEM_SHIFT];
-extern uptr s68k_write8_map [0x1000000 >> M68K_MEM_SHIFT];
-extern uptr s68k_write16_map[0x1000000 >> M68K_MEM_SHIFT];
+extern PICO_TLS uptr s68k_read8_map  [0x1000000 >> M68K_MEM_SHIFT];
+extern PICO_TLS uptr s68k_read16_map [0x1000000 >> M68K_MEM_SHIFT];
+extern PICO_TLS uptr s68k_write8_map [0x1000000 >> M68K_MEM_SHIFT];
+extern PICO_TLS uptr s68k_write16_map[0x1000000 >> M68K_MEM_SHIFT];
 
 // top-level handlers that cores can use
 // (or alternatively build them into themselves)
@@ -35,8 +35,8 @@ extern void m68k_write16(u32 a, u16 d);
 
 // z80
 #define Z80_MEM_SHIFT 13
-extern uptr z80_read_map [0x10000 >> Z80_MEM_SHIFT];
-extern uptr z80_write_map[0x10000 >> Z80_MEM_SHIFT];
+extern PICO_TLS uptr z80_read_map [0x10000 >> Z80_MEM_SHIFT];
+extern PICO_TLS uptr z80_write_map[0x10000 >> Z80_MEM_SHIFT];
 typedef unsigned char (z80_read_f)(unsigned short a);
 typedef void (z80_write_f)(unsigned int a, unsigned char data);
 
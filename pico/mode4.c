@@ -14,10 +14,61 @@
  * - doubled sprites
  */
 #include "pico_int.h"
+#include "simd.h"
 
-static void (*FinalizeLineM4)(int line);
-static int skip_next_line;
-static int screen_offset;
+static PICO_TLS void (*FinalizeLineM4)(int line);
+static PICO_TLS int skip_next_line;
+static PICO_TLS int screen_offset;
+
+#ifdef HAVE_V8
+
+// planar to chunky: byte n of pack is bitplane n, pixel 0 is in bit 7
+#ifdef HAVE_SSE2
+static __inline v8 m4_unpack(unsigned int pack, int flip)
+{
+  v8 bits = _mm_set1_epi64x(flip ? 0x8040201008040201ll : 0x0102040810204080ll);
+  v8 x = _mm_cvtsi32_si128(pack);
+  v8 p01, p23;
+
+  x = _mm_unpacklo_epi8(x, x);
+  x = _mm_unpacklo_epi16(x, x);
+  p01 = _mm_unpacklo_epi32(x, x); // plane 0 in bytes 0-7, plane 1 in 8-15
+  p23 = _mm_unpackhi_epi32(x, x);
+  p01 = v8_and(v8_eq(v8_and(p01, bits), bits),
+               _mm_set_epi64x(0x0202020202020202ll, 0x0101010101010101ll));
+  p23 = v8_and(v8_eq(v8_and(p23, bits), bits),
+               _mm_set_epi64x(0x0808080808080808ll, 0x0404040404040404ll));
+  x = v8_or(p01, p23);
+  return v8_or(x, _mm_srli_si128(x, 8));
+}
+#else
+static __inline v8 m4_unpack(unsigned int pack, int flip)
+{
+  v8 bits = vcreate_u8(flip ? 0x8040201008040201ull : 0x0102040810204080ull);
+  v8 x = vreinterpret_u8_u32(vdup_n_u32(pack));
+  v8 t;
+
+  t =          v8_and(vtst_u8(vdup_lane_u8(x, 0), bits), v8_dup(1));
+  t = v8_or(t, v8_and(vtst_u8(vdup_lane_u8(x, 1), bits), v8_dup(2)));
+  t = v8_or(t, v8_and(vtst_u8(vdup_lane_u8(x, 2), bits), v8_dup(4)));
+  t = v8_or(t, v8_and(vtst_u8(vdup_lane_u8(x, 3), bits), v8_dup(8)));
+  return t;
+}
+#endif
+
+// merge 8 pixels into the line, 0 is transparent
+static __inline void TileM4(int sx, unsigned int pack, int pal, int flip)
+{
+  unsigned char *pd = Pico.est.HighCol + sx;
+  v8 t = m4_unpack(pack, flip);
+
+  v8_store(pd, v8_sel(v8_eq(t, v8_dup(0)), v8_load(pd), v8_or(t, v8_dup(pal))));
+}
+
+#define TileNormM4(sx, pack, pal) TileM4(sx, pack, pal, 0)
+#define TileFlipM4(sx, pack, pal) TileM4(sx, pack, pal, 1)
+
+#else
 
 #define PLANAR_PIXEL(x,p) \
   t = pack & (0x80808080 >> p); \
@@ -56,6 +107,8 @@ static void TileFlipM4(int sx, unsigned int pack, int pal)
   PLANAR_PIXEL(7, 0)
 }
 
+#endif // HAVE_V8
+
 static void draw_sprites(int scanline)
 {
   struct PicoVideo *pv = &Pico.video;
@@ -219,7 +272,9 @@ void PicoFrameStartMode4(void)
     rendlines = lines;
   }
 
+  PicoDrawOutUpdate();
   Pico.est.DrawLineDest = (char *)DrawLineDestBase + screen_offset * DrawLineDestIncrement;
+  PicoDrawDamageStart(screen_offset);
 }
 
 void PicoLineMode4(int line)
@@ -229,6 +284,12 @@ void PicoLineMode4(int line)
     return;
   }
 
+  // unchanged frame, the last one is still there
+  if (DrawHeld()) {
+    Pico.est.DrawLineDest = (char *)Pico.est.DrawLineDest + DrawLineDestIncrement;
+    return;
+  }
+
   if (PicoScanBegin != NULL)
     skip_next_line = PicoScanBegin(line + screen_offset);
 
@@ -280,6 +341,160 @@ static void FinalizeLineRGB555M4(int line)
   FinalizeLine555(0, line, &Pico.est);
 }
 
+static void FinalizeLineRGB888M4(int line)
+{
+  if (Pico.m.dirtyPal) {
+    PicoDoHighPal555M4();
+    PicoDoHighPal888();
+  }
+
+  FinalizeLine888(0, line, &Pico.est);
+}
+
+#if defined(HAVE_AVX2) || (defined(HAVE_NEON) && defined(__aarch64__))
+#define HAVE_CLUT_M4
+
+// mode 4 only has colours 0-0x1f and 0xe0 (masked column, black), so the
+// palette fits in 32 entry byte tables for table lookup instructions, which
+// return 0 for out of range indices
+static PICO_TLS void (*ClutM4)(void *pd, const unsigned char *ps, int len);
+static PICO_TLS unsigned short clut_pal[0x20];
+static PICO_TLS unsigned char clut_tab[3][0x20]; // bytes 0-2 of the colours
+static PICO_TLS int clut_bpp, clut_valid;
+
+#ifdef HAVE_AVX2
+#define CLUT_TAB_AVX2(t) \
+  _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(t)))
+#define CLUT_AVX2(t0, t1, k, s) \
+  _mm256_blendv_epi8(_mm256_shuffle_epi8(t0, k), _mm256_shuffle_epi8(t1, k), s)
+
+TARGET_AVX2
+static void ClutM4_555_avx2(void *pd, const unsigned char *ps, int len)
+{
+  __m256i l0 = CLUT_TAB_AVX2(clut_tab[0]), l1 = CLUT_TAB_AVX2(clut_tab[0] + 16);
+  __m256i h0 = CLUT_TAB_AVX2(clut_tab[1]), h1 = CLUT_TAB_AVX2(clut_tab[1] + 16);
+  __m256i *d = pd;
+  int i;
+
+  for (i = 0; i < len; i += 32, d += 2) {
+    __m256i idx = _mm256_loadu_si256((const __m256i *)(ps + i));
+    __m256i k = _mm256_adds_epu8(idx, _mm256_set1_epi8(0x60)); // >= 0x20: 0
+    __m256i s = _mm256_slli_epi16(idx, 3); // bit 4 selects the table
+    __m256i l = CLUT_AVX2(l0, l1, k, s);
+    __m256i h = CLUT_AVX2(h0, h1, k, s);
+    __m256i a = _mm256_unpacklo_epi8(l, h); // pixels 0-7, 16-23
+    __m256i b = _mm256_unpackhi_epi8(l, h); // pixels 8-15, 24-31
+    _mm256_storeu_si256(d + 0, _mm256_permute2x128_si256(a, b, 0x20));
+    _mm256_storeu_si256(d + 1, _mm256_permute2x128_si256(a, b, 0x31));
+  }
+}
+
+TARGET_AVX2
+static void ClutM4_888_avx2(void *pd, const unsigned char *ps, int len)
+{
+  __m256i r0 = CLUT_TAB_AVX2(clut_tab[0]), r1 = CLUT_TAB_AVX2(clut_tab[0] + 16);
+  __m256i g0 = CLUT_TAB_AVX2(clut_tab[1]), g1 = CLUT_TAB_AVX2(clut_tab[1] + 16);
+  __m256i b0 = CLUT_TAB_AVX2(clut_tab[2]), b1 = CLUT_TAB_AVX2(clut_tab[2] + 16);
+  __m256i z = _mm256_setzero_si256();
+  __m256i *d = pd;
+  int i;
+
+  for (i = 0; i < len; i += 32, d += 4) {
+    __m256i idx = _mm256_loadu_si256((const __m256i *)(ps + i));
+    __m256i k = _mm256_adds_epu8(idx, _mm256_set1_epi8(0x60));
+    __m256i s = _mm256_slli_epi16(idx, 3);
+    __m256i c0 = CLUT_AVX2(r0, r1, k, s);
+    __m256i c1 = CLUT_AVX2(g0, g1, k, s);
+    __m256i c2 = CLUT_AVX2(b0, b1, k, s);
+    __m256i l = _mm256_unpacklo_epi8(c0, c1), lz = _mm256_unpacklo_epi8(c2, z);
+    __m256i h = _mm256_unpackhi_epi8(c0, c1), hz = _mm256_unpackhi_epi8(c2, z);
+    __m256i p0 = _mm256_unpacklo_epi16(l, lz); // pixels 0-3, 16-19
+    __m256i p1 = _mm256_unpackhi_epi16(l, lz); // pixels 4-7, 20-23
+    __m256i p2 = _mm256_unpacklo_epi16(h, hz); // pixels 8-11, 24-27
+    __m256i p3 = _mm256_unpackhi_epi16(h, hz); // pixels 12-15, 28-31
+    _mm256_storeu_si256(d + 0, _mm256_permute2x128_si256(p0, p1, 0x20));
+    _mm256_storeu_si256(d + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+    _mm256_storeu_si256(d + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+    _mm256_storeu_si256(d + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+  }
+}
+#endif
+
+#if defined(HAVE_NEON) && defined(__aarch64__)
+static void ClutM4_555_neon(void *pd, const unsigned char *ps, int len)
+{
+  uint8x16x2_t tl = { { vld1q_u8(clut_tab[0]), vld1q_u8(clut_tab[0] + 16) } };
+  uint8x16x2_t th = { { vld1q_u8(clut_tab[1]), vld1q_u8(clut_tab[1] + 16) } };
+  uint8_t *d = pd;
+  int i;
+
+  for (i = 0; i < len; i += 16, d += 16*2) {
+    uint8x16_t idx = vld1q_u8(ps + i);
+    uint8x16x2_t r;
+    r.val[0] = vqtbl2q_u8(tl, idx);
+    r.val[1] = vqtbl2q_u8(th, idx);
+    vst2q_u8(d, r);
+  }
+}
+
+static void ClutM4_888_neon(void *pd, const unsigned char *ps, int len)
+{
+  uint8x16x2_t t0 = { { vld1q_u8(clut_tab[0]), vld1q_u8(clut_tab[0] + 16) } };
+  uint8x16x2_t t1 = { { vld1q_u8(clut_tab[1]), vld1q_u8(clut_tab[1] + 16) } };
+  uint8x16x2_t t2 = { { vld1q_u8(clut_tab[2]), vld1q_u8(clut_tab[2] + 16) } };
+  uint8_t *d = pd;
+  int i;
+
+  for (i = 0; i < len; i += 16, d += 16*4) {
+    uint8x16_t idx = vld1q_u8(ps + i);
+    uint8x16x4_t r;
+    r.val[0] = vqtbl2q_u8(t0, idx);
+    r.val[1] = vqtbl2q_u8(t1, idx);
+    r.val[2] = vqtbl2q_u8(t2, idx);
+    r.val[3] = vdupq_n_u8(0);
+    vst4q_u8(d, r);
+  }
+}
+#endif
+
+// whole line palette lookup for 16 and 32 bit output
+static void FinalizeLineClutM4(int line)
+{
+  unsigned char *pd = Pico.est.DrawLineDest;
+  const unsigned short *pal = Pico.est.HighPal;
+  int i, len = 256;
+
+  if (Pico.m.dirtyPal) {
+    PicoDoHighPal555M4();
+    if (clut_bpp == 4)
+      PicoDoHighPal888();
+  }
+
+  if (!clut_valid || memcmp(clut_pal, pal, sizeof(clut_pal))) {
+    memcpy(clut_pal, pal, sizeof(clut_pal));
+    for (i = 0; i < 0x20; i++) {
+      unsigned int c = clut_bpp == 4 ? PicoRGB565To888(pal[i]) : pal[i];
+      clut_tab[0][i] = c;
+      clut_tab[1][i] = c >> 8;
+      clut_tab[2][i] = c >> 16;
+    }
+    clut_valid = 1;
+  }
+
+  if (Pico.video.reg[12] & 1)
+    len = 320;
+  if (DrawOutScaled) {
+    ClutM4(DrawOutLine, Pico.est.HighCol + 8, len);
+    PicoDrawOutLine(pd, len, clut_bpp);
+    return;
+  }
+  if (len == 256 && !(PicoIn.opt & POPT_DIS_32C_BORDER))
+    pd += 32 * clut_bpp;
+
+  ClutM4(pd, Pico.est.HighCol + 8, len);
+}
+#endif // HAVE_CLUT_M4
+
 static void FinalizeLine8bitM4(int line)
 {
   unsigned char *pd = Pico.est.DrawLineDest;
@@ -296,8 +511,26 @@ void PicoDrawSetOutputMode4(pdso_t which)
   {
     case PDF_8BIT:   FinalizeLineM4 = FinalizeLine8bitM4; break;
     case PDF_RGB555: FinalizeLineM4 = FinalizeLineRGB555M4; break;
+    case PDF_RGB888: FinalizeLineM4 = FinalizeLineRGB888M4; break;
     default:         FinalizeLineM4 = NULL; break;
   }
+
+#ifdef HAVE_CLUT_M4
+  ClutM4 = NULL;
+#ifdef HAVE_AVX2
+  if (pico_cpu_features() & PCPU_AVX2)
+    ClutM4 = which == PDF_RGB555 ? ClutM4_555_avx2 :
+             which == PDF_RGB888 ? ClutM4_888_avx2 : NULL;
+#else
+  ClutM4 = which == PDF_RGB555 ? ClutM4_555_neon :
+           which == PDF_RGB888 ? ClutM4_888_neon : NULL;
+#endif
+  if (ClutM4 != NULL) {
+    FinalizeLineM4 = FinalizeLineClutM4;
+    clut_bpp = which == PDF_RGB888 ? 4 : 2;
+    clut_valid = 0;
+  }
+#endif
 }
 
 // vim:shiftwidth=2:ts=2:expandtab
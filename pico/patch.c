@@ -32,8 +32,8 @@ struct patch
    unsigned char comp;
 };
 
-struct patch_inst *PicoPatches = NULL;
-int PicoPatchCount = 0;
+PICO_TLS struct patch_inst *PicoPatches = NULL;
+PICO_TLS int PicoPatchCount = 0;
 
 static char genie_chars_md[] = "AaBbCcDdEeFfGgHhJjKkLlMmNnPpRrSsTtVvWwXxYyZz0O1I2233445566778899";
 
@@ -457,7 +457,7 @@ void PicoPatchPrepare(void)
 
 void PicoPatchApply(void)
 {
-   int i, u;
+   int i, u, rom_changed = 0;
    unsigned int addr;
 
    for (i = 0; i < PicoPatchCount; i++)
@@ -468,8 +468,10 @@ void PicoPatchApply(void)
       {
          if (PicoPatches[i].active)
          {
-            if (!(PicoIn.AHW & PAHW_SMS))
+            if (!(PicoIn.AHW & PAHW_SMS)) {
+               rom_changed |= *(unsigned short *)(Pico.rom + addr) != PicoPatches[i].data;
                *(unsigned short *)(Pico.rom + addr) = PicoPatches[i].data;
+            }
             else if (!PicoPatches[i].comp || PicoPatches[i].comp == *(char *)(Pico.rom + addr))
                *(char *)(Pico.rom + addr) = (char) PicoPatches[i].data;
          }
@@ -480,8 +482,10 @@ void PicoPatchApply(void)
                if (PicoPatches[u].addr == addr) break;
             if (u == i)
             {
-               if (!(PicoIn.AHW & PAHW_SMS))
+               if (!(PicoIn.AHW & PAHW_SMS)) {
+                  rom_changed |= *(unsigned short *)(Pico.rom + addr) != PicoPatches[i].data_old;
                   *(unsigned short *)(Pico.rom + addr) = PicoPatches[i].data_old;
+               }
                else
                   *(char *)(Pico.rom + addr) = (char) PicoPatches[i].data_old;
             }
@@ -493,8 +497,10 @@ void PicoPatchApply(void)
       {
          if (PicoPatches[i].active)
          {
-            if (!(PicoIn.AHW & PAHW_SMS))
+            if (!(PicoIn.AHW & PAHW_SMS)) {
               m68k_write16(addr,PicoPatches[i].data);
+              fm68k_drc_wcheck_ram(addr);
+            }
             else
               ;// wrong: PicoWrite8_z80(addr,PicoPatches[i].data);
          }
@@ -505,13 +511,19 @@ void PicoPatchApply(void)
                if (PicoPatches[u].addr == addr) break;
             if (u == i)
             {
-              if (!(PicoIn.AHW & PAHW_SMS))
+              if (!(PicoIn.AHW & PAHW_SMS)) {
                  m68k_write16(PicoPatches[i].addr,PicoPatches[i].data_old);
+                 fm68k_drc_wcheck_ram(PicoPatches[i].addr);
+              }
               else
                 ;// wrong: PicoWrite8_z80(PicoPatches[i].addr,PicoPatches[i].data_old);
             }
          }
       }
    }
+
+   // translated code may have the old ROM words built in
+   if (rom_changed)
+      fm68k_drc_flush();
 }
 
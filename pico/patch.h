@@ -1,6 +1,8 @@
 #ifndef _GENIE_DECODE_H__
 #define _GENIE_DECODE_H__
 
+#include "pico_port.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -16,8 +18,8 @@ struct patch_inst
 	unsigned char comp;
 };
 
-extern struct patch_inst *PicoPatches;
-extern int PicoPatchCount;
+extern PICO_TLS struct patch_inst *PicoPatches;
+extern PICO_TLS int PicoPatchCount;
 
 int  PicoPatchLoad(const char *fname);
 void PicoPatchUnload(void);
@@ -10,12 +10,21 @@
 #include "pico_int.h"
 #include "sound/ym2612.h"
 
-struct Pico Pico;
-struct PicoMem PicoMem;
-PicoInterface PicoIn;
-
-void (*PicoResetHook)(void) = NULL;
-void (*PicoLineHook)(void) = NULL;
+PICO_TLS struct Pico Pico;
+PICO_TLS struct PicoMem PicoMem;
+PICO_TLS PicoInterface PicoIn;
+
+PICO_TLS void (*PicoResetHook)(void) = NULL;
+PICO_TLS void (*PicoLineHook)(void) = NULL;
+
+#ifdef PICO_THREAD_SAFE
+// rand() state is process wide, keep each instance reproducible instead
+static PICO_TLS unsigned int rand_seed;
+#define pico_rand() \
+  ((rand_seed = rand_seed * 1103515245 + 12345) >> 16)
+#else
+#define pico_rand() rand()
+#endif
 
 // to be called once on emu init
 void PicoInit(void)
@@ -46,10 +55,14 @@ void PicoInit(void)
 // to be called once on emu exit
 void PicoExit(void)
 {
+  PicoDrawThreadExit();
   if (PicoIn.AHW & PAHW_MCD)
     PicoExitMCD();
   PicoCartUnload();
   z80_exit();
+#ifdef EMU_F68K
+  fm68k_drc_finish();
+#endif
 
   free(Pico.sv.data);
   Pico.sv.data = NULL;
@@ -59,11 +72,15 @@ void PicoExit(void)
 
 void PicoPower(void)
 {
+#ifdef PICO_THREAD_SAFE
+  rand_seed = 1;
+#endif
   Pico.m.frame_count = 0;
   Pico.t.m68c_cnt = Pico.t.m68c_aim = 0;
 
   // clear all memory of the emulated machine
   memset(&PicoMem,0,sizeof(PicoMem));
+  PicoDrawInvalidateVram();
 
   memset(&Pico.video,0,sizeof(Pico.video));
   memset(&Pico.m,0,sizeof(Pico.m));
@@ -159,6 +176,7 @@ int PicoReset(void)
     PicoResetHook();
 
   memset(&PicoIn.padInt, 0, sizeof(PicoIn.padInt));
+  DrawDirty = 1;
 
   if (PicoIn.AHW & PAHW_SMS) {
     PicoResetMS();
@@ -183,7 +201,7 @@ int PicoReset(void)
 
   // create an empty "dma" to cause 68k exec start at random frame location
   if (Pico.m.dma_xfers == 0 && !(PicoIn.opt & POPT_DIS_VDP_FIFO))
-    Pico.m.dma_xfers = rand() & 0x1fff;
+    Pico.m.dma_xfers = pico_rand() & 0x1fff;
 
   SekFinishIdleDet();
 
@@ -219,6 +237,7 @@ void PicoLoopPrepare(void)
     Pico.m.pal = (PicoIn.regionOverride == 2 || PicoIn.regionOverride == 8) ? 1 : 0;
 
   Pico.m.dirtyPal = 1;
+  DrawDirty = 1;
   rendstatus_old = -1;
 }
 
@@ -319,6 +338,8 @@ void PicoFrame(void)
   PicoFrameHints();
 
 end:
+  PicoDrawThreadFinish();
+  PicoDrawDamageFinish();
   pprof_end(frame);
 }
 
@@ -327,9 +348,11 @@ void PicoFrameDrawOnly(void)
   if (!(PicoIn.AHW & PAHW_SMS)) {
     PicoFrameStart();
     PicoDrawSync(223, 0);
+    PicoDrawThreadFinish();
   } else {
     PicoFrameDrawOnlyMS();
   }
+  DrawDirty = 1; // may be incomplete, draw the next frame in full
 }
 
 void PicoGetInternal(pint_t which, pint_ret_t *r)
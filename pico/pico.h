@@ -11,6 +11,7 @@
 #define PICO_H
 
 #include <stdlib.h> // size_t
+#include "pico_port.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,7 +48,7 @@ extern void emu_32x_startup(void);
 
 // optional 32X BIOS, should be left NULL if not used
 // must be 256, 2048, 1024 bytes
-extern void *p32x_bios_g, *p32x_bios_m, *p32x_bios_s;
+extern PICO_TLS void *p32x_bios_g, *p32x_bios_m, *p32x_bios_s;
 
 // Pico.c
 #define POPT_EN_FM          (1<< 0) // 00 000x
@@ -55,7 +56,7 @@ extern void *p32x_bios_g, *p32x_bios_m, *p32x_bios_s;
 #define POPT_EN_Z80         (1<< 2)
 #define POPT_EN_STEREO      (1<< 3)
 #define POPT_ALT_RENDERER   (1<< 4) // 00 00x0
-// unused                   (1<< 5)
+#define POPT_EN_DAMAGE      (1<< 5) // don't redraw unchanged frames, see PicoDrawGetDamage()
 // unused                   (1<< 6)
 #define POPT_ACC_SPRITES    (1<< 7)
 #define POPT_DIS_32C_BORDER (1<< 8) // 00 0x00
@@ -72,6 +73,7 @@ extern void *p32x_bios_g, *p32x_bios_m, *p32x_bios_s;
 #define POPT_DIS_IDLE_DET   (1<<19)
 #define POPT_EN_32X         (1<<20)
 #define POPT_EN_PWM         (1<<21)
+#define POPT_EN_DRAW_THREAD (1<<22) // render on a separate thread (thread safe build only)
 
 #define PAHW_MCD  (1<<0)
 #define PAHW_32X  (1<<1)
@@ -108,7 +110,7 @@ typedef struct
 	void (*mcdTrayClose)(void);
 } PicoInterface;
 
-extern PicoInterface PicoIn;
+extern PICO_TLS PicoInterface PicoIn;
 
 void PicoInit(void);
 void PicoExit(void);
@@ -138,14 +140,14 @@ typedef struct
 	unsigned char xpcm_buffer[XPCM_BUFFER_SIZE+4];
 	unsigned char *xpcm_ptr;
 } picohw_state;
-extern picohw_state PicoPicohw;
+extern PICO_TLS picohw_state PicoPicohw;
 
 // area.c
 int PicoState(const char *fname, int is_save);
 int PicoStateLoadGfx(const char *fname);
 void *PicoTmpStateSave(void);
 void  PicoTmpStateRestore(void *data);
-extern void (*PicoStateProgressCB)(const char *str);
+extern PICO_TLS void (*PicoStateProgressCB)(const char *str);
 
 // cd/cdd.c
 int cdd_load(const char *filename, int type);
@@ -173,9 +175,9 @@ int      pm_close(pm_file *fp);
 int PicoCartLoad(pm_file *f,unsigned char **prom,unsigned int *psize,int is_sms);
 int PicoCartInsert(unsigned char *rom, unsigned int romsize, const char *carthw_cfg);
 void PicoCartUnload(void);
-extern void (*PicoCartLoadProgressCB)(int percent);
-extern void (*PicoCDLoadProgressCB)(const char *fname, int percent);
-extern int PicoGameLoaded;
+extern PICO_TLS void (*PicoCartLoadProgressCB)(int percent);
+extern PICO_TLS void (*PicoCDLoadProgressCB)(const char *fname, int percent);
+extern PICO_TLS int PicoGameLoaded;
 
 // Draw.c
 // for line-based renderer, set conversion
@@ -185,10 +187,22 @@ typedef enum
 	PDF_NONE = 0,    // no conversion
 	PDF_RGB555,      // RGB/BGR output, depends on compile options
 	PDF_8BIT,        // 8-bit out (handles shadow/hilight mode, sonic water)
+	PDF_RGB888,      // 32-bit XRGB, XBGR with the same options as PDF_RGB555
 } pdso_t;
 void PicoDrawSetOutFormat(pdso_t which, int use_32x_line_mode);
 void PicoDrawSetOutBuf(void *dest, int increment);
+// scale (1-4) the MD and SMS line renderer output: every line is written to
+// scale output rows of increment bytes, pixels are repeated scale times.
+// With PDSS_NORM 256 pixel wide modes are widened to 320 pixels first.
+// Only for PDF_RGB555 and PDF_RGB888, the 32X is always drawn unscaled.
+#define PDSS_NORM (1 << 4)
+void PicoDrawSetOutScale(int scale);
 void PicoDrawSetCallbacks(int (*begin)(unsigned int num), int (*end)(unsigned int num));
+// with POPT_EN_DAMAGE: returns 0 if the last PicoFrame() left the output
+// buffer untouched (frame identical to the previous one), else 1 and a bit
+// per changed line in lines[] (bit 0 of lines[0] is the first visible line;
+// all lines are reported if the output can't be checked). lines may be NULL
+int  PicoDrawGetDamage(unsigned int lines[256 / 32]);
 // utility
 #ifdef _ASM_DRAW_C
 void vidConvCpyRGB565(void *to, void *from, int pixels);
@@ -203,8 +217,8 @@ void PicoDoHighPal555(int sh, int line, struct PicoEState *est);
 #define PDRAW_PLANE_HI_PRIO (1<<6) // have layer with all hi prio tiles (mk3)
 #define PDRAW_SHHI_DONE     (1<<7) // layer sh/hi already processed
 #define PDRAW_32_COLS       (1<<8) // 32 column mode
-extern int rendstatus_old;
-extern int rendlines;
+extern PICO_TLS int rendstatus_old;
+extern PICO_TLS int rendlines;
 
 // draw.c
 void PicoDrawUpdateHighPal(void);
@@ -212,17 +226,21 @@ void PicoDrawSetInternalBuf(void *dest, int line_increment);
 
 // draw2.c
 // stuff below is optional
-extern unsigned short *PicoCramHigh; // pointer to CRAM buff (0x40 shorts), converted to native device color (works only with 16bit for now)
-extern void (*PicoPrepareCram)();    // prepares PicoCramHigh for renderer to use
+extern PICO_TLS unsigned short *PicoCramHigh; // pointer to CRAM buff (0x40 shorts), converted to native device color (works only with 16bit for now)
+extern PICO_TLS void (*PicoPrepareCram)();    // prepares PicoCramHigh for renderer to use
 
 // pico.c (32x)
 #ifndef NO_32X
 
 void Pico32xSetClocks(int msh2_hz, int ssh2_hz);
+int  Pico32xDrcCacheLoad(const char *fname);
+int  Pico32xDrcCacheSave(const char *fname);
 
 #else
 
 #define Pico32xSetClocks(msh2_khz, ssh2_khz)
+#define Pico32xDrcCacheLoad(fname) -1
+#define Pico32xDrcCacheSave(fname) -1
 
 #endif
 
@@ -232,7 +250,7 @@ void Pico32xSetClocks(int msh2_hz, int ssh2_hz);
 #define PICO_SSH2_HZ ((int)(7670442.0 * 2.4))
 
 // sound.c
-extern void (*PsndMix_32_to_16l)(short *dest, int *src, int count);
+extern PICO_TLS void (*PsndMix_32_to_16l)(short *dest, int *src, int count);
 void PsndRerate(int preserve_state);
 
 // media.c
@@ -260,7 +278,7 @@ enum media_type_e PicoLoadMedia(const char *filename,
   void (*do_region_override)(const char *media_filename));
 int PicoCdCheck(const char *fname_in, int *pregion);
 
-extern unsigned char media_id_header[0x100];
+extern PICO_TLS unsigned char media_id_header[0x100];
 
 // memory.c
 enum input_device {
@@ -10,10 +10,10 @@
 // x: 0x03c - 0x19d
 // y: 0x1fc - 0x2f7
 //    0x2f8 - 0x3f3
-picohw_state PicoPicohw;
+PICO_TLS picohw_state PicoPicohw;
 
-static int prev_line_cnt_irq3 = 0, prev_line_cnt_irq5 = 0;
-static int fifo_bytes_line = (16000<<16)/60/262/2;
+static PICO_TLS int prev_line_cnt_irq3 = 0, prev_line_cnt_irq5 = 0;
+static PICO_TLS int fifo_bytes_line = (16000<<16)/60/262/2;
 
 static const int guessed_rates[] = { 8000, 14000, 12000, 14000, 16000, 18000, 16000, 16000 }; // ?
 
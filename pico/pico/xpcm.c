@@ -37,8 +37,8 @@ static const int TableQuant[8] =
 //static const int quant_mul[16] = { 1, 3, 5, 7, 9, 11, 13, 15, -1, -3, -5, -7, -9, -11, -13, -15 };
 static const int quant_mul[16]   = { 1, 3, 5, 7, 9, 11, 13, -1, -1, -3, -5, -7, -9, -11, -13, -15 };
 
-static int sample = 0, quant = 0, sgn = 0;
-static int stepsamples = (44100<<10)/16000;
+static PICO_TLS int sample = 0, quant = 0, sgn = 0;
+static PICO_TLS int stepsamples = (44100<<10)/16000;
 
 
 PICO_INTERNAL void PicoPicoPCMReset(void)
@@ -38,6 +38,11 @@ static void SekSyncM68k(void)
 #elif defined(EMU_M68K)
     Pico.t.m68c_cnt += m68k_execute(cyc_do) - cyc_do;
 #elif defined(EMU_F68K)
+#ifdef DRC_M68K
+    if (SekUseDrc())
+      Pico.t.m68c_cnt += fm68k_drc_emulate(&PicoCpuFM68k, cyc_do) - cyc_do;
+    else
+#endif
     Pico.t.m68c_cnt += fm68k_emulate(&PicoCpuFM68k, cyc_do, 0) - cyc_do;
 #endif
   }
@@ -97,16 +102,7 @@ static int PicoFrameHints(void)
 
   pevt_log_m68k_o(EVT_FRAME_START);
 
-  if ((PicoIn.opt&POPT_ALT_RENDERER) && !PicoIn.skipFrame && (pv->reg[1]&0x40)) { // fast rend., display enabled
-    // draw a frame just after vblank in alternative render mode
-    // yes, this will cause 1 frame lag, but this is inaccurate mode anyway.
-    PicoFrameFull();
-#ifdef DRAW_FINISH_FUNC
-    DRAW_FINISH_FUNC();
-#endif
-    skip = 1;
-  }
-  else skip=PicoIn.skipFrame;
+  skip=PicoIn.skipFrame;
 
   Pico.t.m68c_frame_start = Pico.t.m68c_aim;
   pv->v_counter = Pico.m.scanline = 0;
@@ -137,19 +133,6 @@ static int PicoFrameHints(void)
       do_hint(pv);
     }
 
-    // decide if we draw this line
-    if (!skip && (PicoIn.opt & POPT_ALT_RENDERER))
-    {
-      // find the right moment for frame renderer, when display is no longer blanked
-      if ((pv->reg[1]&0x40) || y > 100) {
-        PicoFrameFull();
-#ifdef DRAW_FINISH_FUNC
-        DRAW_FINISH_FUNC();
-#endif
-        skip = 1;
-      }
-    }
-
     // get samples from sound chips
     if ((y == 224 || y == line_sample) && PicoIn.sndOut)
     {
@@ -167,6 +150,10 @@ static int PicoFrameHints(void)
       PsndGetSamples(y);
     }
 
+    // keep the render thread busy
+    if (DrawThreadActive && !skip && y > 0 && !(y & 7) && !DrawHeld())
+      PicoDrawSync(y - 1, 0);
+
     // Run scanline:
     Pico.t.m68c_line_start = Pico.t.m68c_aim;
     do_timing_hacks_as(pv, vdp_slots);
@@ -180,7 +167,7 @@ static int PicoFrameHints(void)
   if (y == lines_vis)
     pv->status &= ~PVS_ACTIVE;
 
-  if (!skip)
+  if (!PicoDrawDamageEnd() && !skip)
   {
     if (Pico.est.DrawScanline < y)
       PicoDrawSync(y - 1, 0);
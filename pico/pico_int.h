@@ -28,6 +28,14 @@
 
 // to select core, define EMU_C68K, EMU_M68K or EMU_F68K in your makefile or project
 
+// asm and musashi access emu state as plain globals, so can't be per-thread
+#if defined(PICO_THREAD_SAFE) && (defined(EMU_C68K) || defined(EMU_M68K) || \
+    defined(_USE_DRZ80) || (defined(_SVP_DRC) && !defined(__x86_64__)) || \
+    defined(_ASM_DRAW_C) || defined(_ASM_MEMORY_C) || defined(_ASM_YM2612_C) || \
+    defined(_ASM_MISC_C) || defined(_ASM_CD_MEMORY_C) || defined(_ASM_32X_DRAW))
+#error PICO_THREAD_SAFE needs the C cores and renderers
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -61,7 +69,7 @@ extern struct Cyclone PicoCpuCM68k, PicoCpuCS68k;
 
 #ifdef EMU_F68K
 #include "../cpu/fame/fame.h"
-extern M68K_CONTEXT PicoCpuFM68k, PicoCpuFS68k;
+extern PICO_TLS M68K_CONTEXT PicoCpuFM68k, PicoCpuFS68k;
 #define SekCyclesLeft     PicoCpuFM68k.io_cycle_counter
 #define SekCyclesLeftS68k PicoCpuFS68k.io_cycle_counter
 #define SekPc     fm68k_get_pc(&PicoCpuFM68k)
@@ -88,8 +96,15 @@ extern M68K_CONTEXT PicoCpuFM68k, PicoCpuFS68k;
 #define SekInterrupt(irq) PicoCpuFM68k.interrupts[0]=irq
 #define SekIrqLevel       PicoCpuFM68k.interrupts[0]
 
+// main 68k recompiler, FAME stays in use for the sub cpu and 32X
+#define SekUseDrc() \
+	((PicoIn.opt & POPT_EN_DRC) && !(PicoIn.AHW & (PAHW_MCD|PAHW_32X)))
+
 #endif
 
+// 68k recompiler hooks, these are no-ops without it
+#include "../cpu/fame/compiler.h"
+
 #ifdef EMU_M68K
 #include "../cpu/musashi/m68kcpu.h"
 extern m68ki_cpu_core PicoCpuMM68k, PicoCpuMS68k;
@@ -139,8 +154,8 @@ extern m68ki_cpu_core PicoCpuMM68k, PicoCpuMS68k;
   SekCyclesLeft = after; \
 }
 
-extern unsigned int SekCycleCntS68k;
-extern unsigned int SekCycleAimS68k;
+extern PICO_TLS unsigned int SekCycleCntS68k;
+extern PICO_TLS unsigned int SekCycleAimS68k;
 
 #define SekEndRunS68k(after) { \
   if (SekCyclesLeftS68k > (after)) { \
@@ -179,7 +194,15 @@ extern struct DrZ80 drZ80;
 #elif defined(_USE_CZ80)
 #include "../cpu/cz80/cz80.h"
 
+#ifdef DRC_Z80
+// MD sound code only, SMS runs its code from ROM
+#define Z80UseDrc() \
+	((PicoIn.opt & POPT_EN_DRC) && !(PicoIn.AHW & PAHW_SMS))
+#define z80_run(cycles)    (Z80UseDrc() ? \
+	cz80_drc_exec(&CZ80, cycles) : Cz80_Exec(&CZ80, cycles))
+#else
 #define z80_run(cycles)    Cz80_Exec(&CZ80, cycles)
+#endif
 #define z80_run_nr(cycles) Cz80_Exec(&CZ80, cycles)
 #define z80_int()          Cz80_Set_IRQ(&CZ80, 0, HOLD_LINE)
 #define z80_int_assert(a)  Cz80_Set_IRQ(&CZ80, 0, (a) ? ASSERT_LINE : CLEAR_LINE)
@@ -199,6 +222,9 @@ extern struct DrZ80 drZ80;
 
 #endif
 
+// Z80 recompiler hooks, these are no-ops without it
+#include "../cpu/cz80/compiler.h"
+
 #define Z80_STATE_SIZE 0x60
 
 #define z80_resetCycles() \
@@ -213,7 +239,7 @@ extern struct DrZ80 drZ80;
 
 #include "cpu/sh2/sh2.h"
 
-extern SH2 sh2s[2];
+extern PICO_TLS SH2 sh2s[2];
 #define msh2 sh2s[0]
 #define ssh2 sh2s[1]
 
@@ -623,21 +649,22 @@ struct Pico32xMem
 };
 
 // area.c
-extern void (*PicoLoadStateHook)(void);
+extern PICO_TLS void (*PicoLoadStateHook)(void);
 
 typedef struct {
 	int chunk;
 	int size;
 	void *ptr;
 } carthw_state_chunk;
-extern carthw_state_chunk *carthw_chunks;
+extern PICO_TLS carthw_state_chunk *carthw_chunks;
 #define CHUNK_CARTHW 64
 
 // cart.c
 extern int PicoCartResize(int newsize);
 extern void Byteswap(void *dst, const void *src, int len);
-extern void (*PicoCartMemSetup)(void);
-extern void (*PicoCartUnloadHook)(void);
+extern unsigned int rom_crc32(void);
+extern PICO_TLS void (*PicoCartMemSetup)(void);
+extern PICO_TLS void (*PicoCartUnloadHook)(void);
 
 // debug.c
 int CM_compareRun(int cyc, int is_sub);
@@ -648,12 +675,80 @@ PICO_INTERNAL void PicoFrameStart(void);
 void PicoDrawSync(int to, int blank_last_line);
 void BackFill(int reg7, int sh, struct PicoEState *est);
 void FinalizeLine555(int sh, int line, struct PicoEState *est);
-extern int (*PicoScanBegin)(unsigned int num);
-extern int (*PicoScanEnd)(unsigned int num);
+void FinalizeLine888(int sh, int line, struct PicoEState *est);
+void PicoDoHighPal888(void);
+extern PICO_TLS int (*PicoScanBegin)(unsigned int num);
+extern PICO_TLS int (*PicoScanEnd)(unsigned int num);
 #define MAX_LINE_SPRITES 29
-extern unsigned char HighLnSpr[240][3 + MAX_LINE_SPRITES];
-extern void *DrawLineDestBase;
-extern int DrawLineDestIncrement;
+extern PICO_TLS unsigned char HighLnSpr[240][3 + MAX_LINE_SPRITES];
+extern PICO_TLS void *DrawLineDestBase;
+extern PICO_TLS int DrawLineDestIncrement; // DrawOutPitch * scale
+// output scaling, see PicoDrawSetOutScale()
+extern PICO_TLS int DrawOutScale;
+extern PICO_TLS int DrawOutPitch;
+extern PICO_TLS int DrawOutScaled;
+extern PICO_TLS unsigned int DrawOutLine[320];
+void PicoDrawOutLine(void *pd, int len, int bpp);
+void PicoDrawOutUpdate(void);
+void PicoDrawFrameStart(void);
+void PicoDrawInvalidateVram(void);
+// frame damage tracking, anything that can change the picture sets DrawDirty
+extern PICO_TLS int DrawDirty;
+extern PICO_TLS int DrawHold; // frame started unchanged, drawing is held back
+#define DrawHeld() (DrawHold && !DrawDirty)
+void PicoDrawDamageStart(int offs);
+int  PicoDrawDamageEnd(void);
+void PicoDrawDamageFinish(void);
+extern PICO_TLS unsigned int TileCacheValid[0x10000 >> 10];
+#define TileCacheInvalidate(a) \
+  TileCacheValid[((a) >> 10) & 0x3f] &= ~(1u << (((a) >> 5) & 0x1f))
+extern PICO_TLS unsigned int SatDirty[0x10000 >> 8];
+#define SatMark(a) \
+  SatDirty[((a) >> 8) & 0xff] |= 1u << (((a) >> 3) & 0x1f)
+
+// 16bit HighPal color to 32bit, low bits are filled from the high ones
+static __inline unsigned int PicoRGB565To888(unsigned int t)
+{
+  return ((t & 0xf800) << 8) | ((t & 0xe000) << 3) |
+         ((t & 0x07e0) << 5) | ((t & 0x0600) >> 1) |
+         ((t & 0x001f) << 3) | ((t & 0x001c) >> 2);
+}
+
+// draw_thread.c
+#ifdef PICO_THREAD_SAFE
+extern PICO_TLS int DrawThreadActive;
+extern PICO_TLS unsigned int DrawThreadVramDirty[0x10000 >> 11];
+#define DrawThreadVramMark(a) \
+  DrawThreadVramDirty[((a) >> 11) & 0x1f] |= 1u << (((a) >> 6) & 0x1f)
+int  PicoDrawThreadFrameStart(pdso_t which);
+void PicoDrawThreadSync(int to, int blank_last_line);
+void PicoDrawThreadFinish(void);
+void PicoDrawThreadExit(void);
+#else
+#define DrawThreadActive 0
+#define DrawThreadVramMark(a)
+#define PicoDrawThreadFrameStart(which) 0
+#define PicoDrawThreadSync(to, blank_last_line)
+#define PicoDrawThreadFinish()
+#define PicoDrawThreadExit()
+#endif
+
+// VDP side VRAM write tracking, a: byte address
+#define VramMark(a) do { \
+  TileCacheInvalidate(a); \
+  DrawThreadVramMark(a); \
+  SatMark(a); \
+} while (0)
+
+static __inline void VramMarkRange(unsigned int a, unsigned int len)
+{
+  unsigned int e = a + len;
+  for (a &= ~0x1f; a < e; a += 0x20) {
+    TileCacheInvalidate(a);
+    DrawThreadVramMark(a);
+    SatDirty[(a >> 8) & 0xff] |= 0xfu << ((a >> 3) & 0x1c);
+  }
+}
 
 // draw2.c
 void PicoDraw2Init(void);
@@ -719,10 +814,10 @@ void PicoWrite16_mcd_io(unsigned int a, unsigned int d);
 void pcd_state_loaded_mem(void);
 
 // pico.c
-extern struct Pico Pico;
-extern struct PicoMem PicoMem;
-extern void (*PicoResetHook)(void);
-extern void (*PicoLineHook)(void);
+extern PICO_TLS struct Pico Pico;
+extern PICO_TLS struct PicoMem PicoMem;
+extern PICO_TLS void (*PicoResetHook)(void);
+extern PICO_TLS void (*PicoLineHook)(void);
 PICO_INTERNAL int  CheckDMA(void);
 PICO_INTERNAL void PicoDetectRegion(void);
 PICO_INTERNAL void PicoSyncZ80(unsigned int m68k_cycles_done);
@@ -748,7 +843,7 @@ enum pcd_event {
   PCD_EVENT_DMA,
   PCD_EVENT_COUNT,
 };
-extern unsigned int pcd_event_times[PCD_EVENT_COUNT];
+extern PICO_TLS unsigned int pcd_event_times[PCD_EVENT_COUNT];
 void pcd_event_schedule(unsigned int now, enum pcd_event event, int after);
 void pcd_event_schedule_s68k(enum pcd_event event, int after);
 void pcd_prepare_frame(void);
@@ -796,7 +891,7 @@ PICO_INTERNAL int  SekInterruptS68k(int irq);
 void SekInterruptClearS68k(int irq);
 
 // sound/sound.c
-extern short cdda_out_buffer[2*1152];
+extern PICO_TLS short cdda_out_buffer[2*1152];
 
 void cdda_start_play(int lba_base, int lba_offset, int lb_len);
 
@@ -832,7 +927,7 @@ unsigned char PicoVideoRead8CtlH(void);
 unsigned char PicoVideoRead8CtlL(void);
 unsigned char PicoVideoRead8HV_H(void);
 unsigned char PicoVideoRead8HV_L(void);
-extern int (*PicoDmaHook)(unsigned int source, int len, unsigned short **base, unsigned int *mask);
+extern PICO_TLS int (*PicoDmaHook)(unsigned int source, int len, unsigned short **base, unsigned int *mask);
 
 // misc.c
 PICO_INTERNAL_ASM void memcpy16bswap(unsigned short *dest, void *src, int count);
@@ -882,14 +977,14 @@ void PicoFrameDrawOnlyMS(void);
 
 // 32x/32x.c
 #ifndef NO_32X
-extern struct Pico32x Pico32x;
+extern PICO_TLS struct Pico32x Pico32x;
 enum p32x_event {
   P32X_EVENT_PWM,
   P32X_EVENT_FILLEND,
   P32X_EVENT_HINT,
   P32X_EVENT_COUNT,
 };
-extern unsigned int p32x_event_times[P32X_EVENT_COUNT];
+extern PICO_TLS unsigned int p32x_event_times[P32X_EVENT_COUNT];
 
 void Pico32xInit(void);
 void PicoPower32x(void);
@@ -909,7 +1004,7 @@ void p32x_event_schedule_sh2(SH2 *sh2, enum p32x_event event, int after);
 void p32x_schedule_hint(SH2 *sh2, int m68k_cycles);
 
 // 32x/memory.c
-extern struct Pico32xMem *Pico32xMem;
+extern PICO_TLS struct Pico32xMem *Pico32xMem;
 unsigned int PicoRead8_32x(unsigned int a);
 unsigned int PicoRead16_32x(unsigned int a);
 void PicoWrite8_32x(unsigned int a, unsigned int d);
@@ -924,16 +1019,17 @@ void p32x_sh2_poll_event(SH2 *sh2, unsigned int flags, unsigned int m68k_cycles)
 // 32x/draw.c
 void PicoDrawSetOutFormat32x(pdso_t which, int use_32x_line_mode);
 void FinalizeLine32xRGB555(int sh, int line, struct PicoEState *est);
+void FinalizeLine32xRGB888(int sh, int line, struct PicoEState *est);
 void PicoDraw32xLayer(int offs, int lines, int mdbg);
 void PicoDraw32xLayerMdOnly(int offs, int lines);
-extern int (*PicoScan32xBegin)(unsigned int num);
-extern int (*PicoScan32xEnd)(unsigned int num);
+extern PICO_TLS int (*PicoScan32xBegin)(unsigned int num);
+extern PICO_TLS int (*PicoScan32xEnd)(unsigned int num);
 enum {
   PDM32X_OFF,
   PDM32X_32X_ONLY,
   PDM32X_BOTH,
 };
-extern int Pico32xDrawMode;
+extern PICO_TLS int Pico32xDrawMode;
 
 // 32x/pwm.c
 unsigned int p32x_pwm_read16(unsigned int a, SH2 *sh2,
@@ -969,6 +1065,7 @@ void REGPARM(3) sh2_peripheral_write32(unsigned int a, unsigned int d, SH2 *sh2)
 #define PicoUnload32x()
 #define Pico32xStateLoaded()
 #define FinalizeLine32xRGB555 NULL
+#define FinalizeLine32xRGB888 NULL
 #define p32x_pwm_update(...)
 #define p32x_timers_recalc()
 #endif
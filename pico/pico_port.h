@@ -23,6 +23,16 @@
 #define unlikely(x) (x)
 #endif
 
+// with PICO_THREAD_SAFE all emulator state is thread local,
+// so every thread that does PicoInit() drives its own console
+#if !defined(PICO_THREAD_SAFE)
+#define PICO_TLS
+#elif defined(_MSC_VER)
+#define PICO_TLS __declspec(thread)
+#else
+#define PICO_TLS __thread
+#endif
+
 #ifdef _MSC_VER
 #define snprintf _snprintf
 #define strcasecmp _stricmp
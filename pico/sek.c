@@ -21,7 +21,7 @@ m68ki_cpu_core PicoCpuMM68k;
 #endif
 // FAME 68000
 #ifdef EMU_F68K
-M68K_CONTEXT PicoCpuFM68k;
+PICO_TLS M68K_CONTEXT PicoCpuFM68k;
 #endif
 
 
@@ -130,6 +130,7 @@ PICO_INTERNAL void SekInit(void)
 #ifdef EMU_F68K
   memset(&PicoCpuFM68k, 0, sizeof(PicoCpuFM68k));
   fm68k_init();
+  fm68k_drc_init();
   PicoCpuFM68k.iack_handler = SekIntAckF68K;
   PicoCpuFM68k.sr = 0x2704; // Z flag
 #endif
@@ -153,6 +154,7 @@ PICO_INTERNAL int SekReset(void)
 #endif
 #ifdef EMU_F68K
   fm68k_reset(&PicoCpuFM68k);
+  fm68k_drc_flush();
 #endif
 
   return 0;
@@ -256,6 +258,8 @@ PICO_INTERNAL void SekUnpackCpu(const unsigned char *cpu, int is_sub)
   context->interrupts[0] = cpu[0x4c];
   context->execinfo &= ~FM68K_HALTED;
   if (cpu[0x4d]&1) context->execinfo |= FM68K_HALTED;
+  if (!is_sub)
+    fm68k_drc_flush(); // RAM was replaced
 #endif
   if (is_sub)
     SekCycleCntS68k = *(unsigned int *)(cpu+0x50);
@@ -269,9 +273,9 @@ PICO_INTERNAL void SekUnpackCpu(const unsigned char *cpu, int is_sub)
 #include "cpu/cyclone/tools/idle.h"
 #endif
 
-static unsigned short **idledet_ptrs = NULL;
-static int idledet_count = 0, idledet_bads = 0;
-static int idledet_start_frame = 0;
+static PICO_TLS unsigned short **idledet_ptrs = NULL;
+static PICO_TLS int idledet_count = 0, idledet_bads = 0;
+static PICO_TLS int idledet_start_frame = 0;
 
 #if 0
 #define IDLE_STATS 1
@@ -313,6 +317,7 @@ void SekInitIdleDet(void)
 #endif
 #ifdef EMU_F68K
   fm68k_idle_install();
+  fm68k_drc_idle_install();
 #endif
 }
 
@@ -424,6 +429,7 @@ void SekFinishIdleDet(void)
 #endif
 #ifdef EMU_F68K
   fm68k_idle_remove();
+  fm68k_drc_idle_remove();
 #endif
   while (idledet_count > 0)
   {
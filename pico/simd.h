@@ -0,0 +1,78 @@
+#ifndef PICO_SIMD_H
+#define PICO_SIMD_H
+
+// SIMD support: HAVE_SSE2/HAVE_NEON are known at compile time (baseline of
+// x86-64 and aarch64), anything above that needs a runtime check with
+// pico_cpu_features() before calling code built with the TARGET_* attribute.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAVE_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__clang__) || __GNUC__ >= 5)
+#define HAVE_SSSE3
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#include <tmmintrin.h>
+#define HAVE_AVX2
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+// 8 byte vectors, in the low half of a register on SSE2
+#if defined(HAVE_SSE2)
+#define HAVE_V8
+typedef __m128i v8;
+#define v8_load(p)      _mm_loadl_epi64((const __m128i *)(p))
+#define v8_store(p, v)  _mm_storel_epi64((__m128i *)(p), v)
+#define v8_dup(c)       _mm_set1_epi8((char)(c))
+#define v8_and(a, b)    _mm_and_si128(a, b)
+#define v8_or(a, b)     _mm_or_si128(a, b)
+#define v8_andn(a, b)   _mm_andnot_si128(b, a) // a & ~b
+#define v8_eq(a, b)     _mm_cmpeq_epi8(a, b)
+#define v8_gt(a, b)     _mm_cmpgt_epi8(a, b)   // signed
+#elif defined(HAVE_NEON)
+#define HAVE_V8
+typedef uint8x8_t v8;
+#define v8_load(p)      vld1_u8(p)
+#define v8_store(p, v)  vst1_u8(p, v)
+#define v8_dup(c)       vdup_n_u8(c)
+#define v8_and(a, b)    vand_u8(a, b)
+#define v8_or(a, b)     vorr_u8(a, b)
+#define v8_andn(a, b)   vbic_u8(a, b)
+#define v8_eq(a, b)     vceq_u8(a, b)
+#define v8_gt(a, b)     vcgt_u8(a, b)
+#endif
+#ifdef HAVE_V8
+#define v8_sel(m, a, b) v8_or(v8_and(m, a), v8_andn(b, m)) // m ? a : b
+#endif
+
+#define PCPU_SSE2 (1 << 0)
+#define PCPU_AVX2 (1 << 1)
+#define PCPU_NEON (1 << 2)
+#define PCPU_SSSE3 (1 << 3)
+
+static __inline int pico_cpu_features(void)
+{
+  int f = 0;
+#ifdef HAVE_SSE2
+  f |= PCPU_SSE2;
+#endif
+#ifdef HAVE_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("ssse3"))
+    f |= PCPU_SSSE3;
+  if (__builtin_cpu_supports("avx2"))
+    f |= PCPU_AVX2;
+#endif
+#ifdef HAVE_NEON
+  f |= PCPU_NEON;
+#endif
+  return f;
+}
+
+#endif // PICO_SIMD_H
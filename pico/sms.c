@@ -46,9 +46,13 @@ static void vdp_data_write(unsigned char d)
   struct PicoVideo *pv = &Pico.video;
 
   if (pv->type == 3) {
+    if (PicoMem.cram[pv->addr & 0x1f] != d)
+      DrawDirty = 1;
     PicoMem.cram[pv->addr & 0x1f] = d;
     Pico.m.dirtyPal = 1;
   } else {
+    if (PicoMem.vramb[pv->addr] != d)
+      DrawDirty = 1;
     PicoMem.vramb[pv->addr] = d;
   }
   pv->addr = (pv->addr + 1) & 0x3fff;
@@ -61,6 +65,7 @@ static NOINLINE void vdp_reg_write(struct PicoVideo *pv, u8 a, u8 d)
   int l;
 
   pv->reg[a] = d;
+  DrawDirty = 1;
   switch (a) {
   case 0:
     l = pv->pending_ints & (d >> 3) & 2;
@@ -167,7 +172,7 @@ static void z80_sms_out(unsigned short a, unsigned char d)
   }
 }
 
-static int bank_mask;
+static PICO_TLS int bank_mask;
 
 static void write_bank(unsigned short a, unsigned char d)
 {
@@ -299,6 +304,8 @@ void PicoFrameMS(void)
 
     if (y < lines_vis && !skip)
       PicoLineMode4(y);
+    if (y == lines_vis)
+      PicoDrawDamageEnd();
 
     if (y <= lines_vis)
     {
@@ -338,6 +345,7 @@ void PicoFrameDrawOnlyMS(void)
   int y;
 
   PicoFrameStartMode4();
+  DrawHold = 0;
 
   for (y = 0; y < lines_vis; y++)
     PicoLineMode4(y);
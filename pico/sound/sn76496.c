@@ -20,6 +20,7 @@
 #pragma warning (disable:4244)
 #endif
 
+#include "../pico_port.h"
 #include "sn76496.h"
 
 #define MAX_OUTPUT 0x47ff // was 0x7fff
@@ -66,8 +67,8 @@ struct SN76496
 	int pad[1];
 };
 
-static struct SN76496 ono_sn; // one and only SN76496
-int *sn76496_regs;
+static PICO_TLS struct SN76496 ono_sn; // one and only SN76496
+PICO_TLS int *sn76496_regs;
 
 //static
 void SN76496Write(int data)
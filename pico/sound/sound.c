@@ -14,19 +14,19 @@
 #include "../cd/cue.h"
 #include "mix.h"
 
-void (*PsndMix_32_to_16l)(short *dest, int *src, int count) = mix_32_to_16l_stereo;
+PICO_TLS void (*PsndMix_32_to_16l)(short *dest, int *src, int count) = mix_32_to_16l_stereo;
 
 // master int buffer to mix to
-static int PsndBuffer[2*(44100+100)/50];
+static PICO_TLS int PsndBuffer[2*(44100+100)/50];
 
 // dac, psg
-static unsigned short dac_info[312+4]; // pos in sample buffer
+static PICO_TLS unsigned short dac_info[312+4]; // pos in sample buffer
 
 // cdda output buffer
-short cdda_out_buffer[2*1152];
+PICO_TLS short cdda_out_buffer[2*1152];
 
 // sn76496
-extern int *sn76496_regs;
+extern PICO_TLS int *sn76496_regs;
 
 
 static void dac_recalculate(void)
@@ -329,7 +329,7 @@ static int PsndRender(int offset, int length)
 // to be called on 224 or line_sample scanlines only
 PICO_INTERNAL void PsndGetSamples(int y)
 {
-  static int curr_pos = 0;
+  static PICO_TLS int curr_pos = 0;
 
   if (ym2612.dacen && Pico.snd.dac_line < y)
     PsndDoDAC(y - 1);
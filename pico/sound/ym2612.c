@@ -112,11 +112,12 @@
 #include <math.h>
 
 #include "ym2612.h"
+#include "../simd.h"
 
 #ifndef EXTERNAL_YM2612
 #include <stdlib.h>
 // let it be 1 global to simplify things
-YM2612 ym2612;
+PICO_TLS YM2612 ym2612;
 
 #else
 extern YM2612 *ym2612_940;
@@ -189,15 +190,15 @@ void memset32(int *dest, int c, int count);
 */
 //#define TL_TAB_LEN (13*2*TL_RES_LEN)
 #define TL_TAB_LEN (13*TL_RES_LEN*256/8) // 106496*2
-UINT16 ym_tl_tab[TL_TAB_LEN];
+PICO_TLS UINT16 ym_tl_tab[TL_TAB_LEN + 2]; // +2: dword gathers of the last entry
 
 /* ~3K wasted but oh well */
-UINT16 ym_tl_tab2[13*TL_RES_LEN];
+PICO_TLS UINT16 ym_tl_tab2[13*TL_RES_LEN];
 
 #define ENV_QUIET		(2*13*TL_RES_LEN/8)
 
 /* sin waveform table in 'decibel' scale (use only period/4 values) */
-static UINT16 ym_sin_tab[256];
+static PICO_TLS UINT16 ym_sin_tab[256];
 
 /* sustain level table (3dB per step) */
 /* bit0, bit1, bit2, bit3, bit4, bit5, bit6 */
@@ -511,13 +512,13 @@ static const UINT8 lfo_pm_output[7*8][8]={ /* 7 bits meaningful (of F-NUMBER), 8
 };
 
 /* all 128 LFO PM waveforms */
-static INT32 lfo_pm_table[128*8*32]; /* 128 combinations of 7 bits meaningful (of F-NUMBER), 8 LFO depths, 32 LFO output levels per one depth */
+static PICO_TLS INT32 lfo_pm_table[128*8*32]; /* 128 combinations of 7 bits meaningful (of F-NUMBER), 8 LFO depths, 32 LFO output levels per one depth */
 
 /* there are 2048 FNUMs that can be generated using FNUM/BLK registers
 	but LFO works with one more bit of a precision so we really need 4096 elements */
-static UINT32 fn_table[4096];	/* fnumber->increment counter */
+static PICO_TLS UINT32 fn_table[4096];	/* fnumber->increment counter */
 
-static int g_lfo_ampm = 0;
+static PICO_TLS int g_lfo_ampm = 0;
 
 /* register number to channel number , slot offset */
 #define OPN_CHAN(N) (N&3)
@@ -1059,7 +1060,7 @@ static void chan_render_loop(chan_rend_context *ct, int *buffer, int length)
 void chan_render_loop(chan_rend_context *ct, int *buffer, unsigned short length);
 #endif
 
-static chan_rend_context crct;
+static PICO_TLS chan_rend_context crct;
 
 static void chan_render_prep(void)
 {
@@ -1075,6 +1076,48 @@ static void chan_render_finish(void)
 	ym2612.OPN.lfo_cnt = crct.lfo_cnt;
 }
 
+/* phase increments of SLOT1-SLOT4, with LFO phase modulation if any */
+static void chan_calc_incr(FM_CH *CH, UINT32 *incr, int lfo_pm)
+{
+	if(CH->pms)
+	{
+		/* add support for 3 slot mode */
+		UINT32 block_fnum = CH->block_fnum;
+
+		UINT32 fnum_lfo   = ((block_fnum & 0x7f0) >> 4) * 32 * 8;
+		INT32  lfo_fn_table_index_offset = lfo_pm_table[ fnum_lfo + CH->pms + lfo_pm ];
+
+		if (lfo_fn_table_index_offset)	/* LFO phase modulation active */
+		{
+			UINT8  blk;
+			UINT32 fn;
+			int kc,fc;
+
+			blk = block_fnum >> 11;
+			block_fnum = block_fnum*2 + lfo_fn_table_index_offset;
+
+			fn  = block_fnum & 0xfff;
+
+			/* keyscale code */
+			kc = (blk<<2) | opn_fktable[fn >> 8];
+			/* phase increment counter */
+			fc = fn_table[fn]>>(7-blk);
+
+			incr[0] = ((fc+CH->SLOT[SLOT1].DT[kc])*CH->SLOT[SLOT1].mul) >> 1;
+			incr[1] = ((fc+CH->SLOT[SLOT2].DT[kc])*CH->SLOT[SLOT2].mul) >> 1;
+			incr[2] = ((fc+CH->SLOT[SLOT3].DT[kc])*CH->SLOT[SLOT3].mul) >> 1;
+			incr[3] = ((fc+CH->SLOT[SLOT4].DT[kc])*CH->SLOT[SLOT4].mul) >> 1;
+			return;
+		}
+	}
+
+	/* no LFO phase modulation */
+	incr[0] = CH->SLOT[SLOT1].Incr;
+	incr[1] = CH->SLOT[SLOT2].Incr;
+	incr[2] = CH->SLOT[SLOT3].Incr;
+	incr[3] = CH->SLOT[SLOT4].Incr;
+}
+
 static int chan_render(int *buffer, int length, int c, UINT32 flags) // flags: stereo, ?, disabled, ?, pan_r, pan_l
 {
 	crct.CH = &ym2612.CH[c];
@@ -1112,50 +1155,7 @@ static int chan_render(int *buffer, int length, int c, UINT32 flags) // flags: s
 	crct.op1_out = crct.CH->op1_out;
 	crct.algo = crct.CH->ALGO & 7;
 
-	if(crct.CH->pms)
-	{
-		/* add support for 3 slot mode */
-		UINT32 block_fnum = crct.CH->block_fnum;
-
-		UINT32 fnum_lfo   = ((block_fnum & 0x7f0) >> 4) * 32 * 8;
-		INT32  lfo_fn_table_index_offset = lfo_pm_table[ fnum_lfo + crct.CH->pms + ((crct.pack>>16)&0xff) ];
-
-		if (lfo_fn_table_index_offset)	/* LFO phase modulation active */
-		{
-			UINT8  blk;
-			UINT32 fn;
-			int kc,fc;
-
-			blk = block_fnum >> 11;
-			block_fnum = block_fnum*2 + lfo_fn_table_index_offset;
-
-			fn  = block_fnum & 0xfff;
-
-			/* keyscale code */
-			kc = (blk<<2) | opn_fktable[fn >> 8];
-			/* phase increment counter */
-			fc = fn_table[fn]>>(7-blk);
-
-			crct.incr1 = ((fc+crct.CH->SLOT[SLOT1].DT[kc])*crct.CH->SLOT[SLOT1].mul) >> 1;
-			crct.incr2 = ((fc+crct.CH->SLOT[SLOT2].DT[kc])*crct.CH->SLOT[SLOT2].mul) >> 1;
-			crct.incr3 = ((fc+crct.CH->SLOT[SLOT3].DT[kc])*crct.CH->SLOT[SLOT3].mul) >> 1;
-			crct.incr4 = ((fc+crct.CH->SLOT[SLOT4].DT[kc])*crct.CH->SLOT[SLOT4].mul) >> 1;
-		}
-		else	/* LFO phase modulation  = zero */
-		{
-			crct.incr1 = crct.CH->SLOT[SLOT1].Incr;
-			crct.incr2 = crct.CH->SLOT[SLOT2].Incr;
-			crct.incr3 = crct.CH->SLOT[SLOT3].Incr;
-			crct.incr4 = crct.CH->SLOT[SLOT4].Incr;
-		}
-	}
-	else	/* no LFO phase modulation */
-	{
-		crct.incr1 = crct.CH->SLOT[SLOT1].Incr;
-		crct.incr2 = crct.CH->SLOT[SLOT2].Incr;
-		crct.incr3 = crct.CH->SLOT[SLOT3].Incr;
-		crct.incr4 = crct.CH->SLOT[SLOT4].Incr;
-	}
+	chan_calc_incr(crct.CH, &crct.incr1, (crct.pack>>16)&0xff);
 
 	chan_render_loop(&crct, buffer, length);
 
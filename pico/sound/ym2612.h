@@ -5,6 +5,8 @@
 #ifndef _H_FM_FM_
 #define _H_FM_FM_
 
+#include "../pico_port.h"
+
 /* compiler dependence */
 #ifndef UINT8
 typedef unsigned char	UINT8;   /* unsigned  8bit */
@@ -151,7 +153,7 @@ typedef struct
 #endif
 
 #ifndef EXTERNAL_YM2612
-extern YM2612 ym2612;
+extern PICO_TLS YM2612 ym2612;
 #endif
 
 void YM2612Init_(int baseclock, int rate);
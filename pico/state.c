@@ -14,17 +14,17 @@
 #include "state.h"
 
 // sn76496
-extern int *sn76496_regs;
+extern PICO_TLS int *sn76496_regs;
 
-static arearw    *areaRead;
-static arearw    *areaWrite;
-static areaeof   *areaEof;
-static areaseek  *areaSeek;
-static areaclose *areaClose;
+static PICO_TLS arearw    *areaRead;
+static PICO_TLS arearw    *areaWrite;
+static PICO_TLS areaeof   *areaEof;
+static PICO_TLS areaseek  *areaSeek;
+static PICO_TLS areaclose *areaClose;
 
-carthw_state_chunk *carthw_chunks;
-void (*PicoStateProgressCB)(const char *str);
-void (*PicoLoadStateHook)(void);
+PICO_TLS carthw_state_chunk *carthw_chunks;
+PICO_TLS void (*PicoStateProgressCB)(const char *str);
+PICO_TLS void (*PicoLoadStateHook)(void);
 
 
 /* I/O functions */
@@ -340,7 +340,7 @@ out:
   return retval;
 }
 
-static int g_read_offs = 0;
+static PICO_TLS int g_read_offs = 0;
 
 #define R_ERROR_RETURN(error) \
 { \
@@ -428,7 +428,7 @@ static int state_load(void *file)
         break;
 
       case CHUNK_RAM:     CHECKED_READ_BUFF(PicoMem.ram); break;
-      case CHUNK_VRAM:    CHECKED_READ_BUFF(PicoMem.vram); break;
+      case CHUNK_VRAM:    CHECKED_READ_BUFF(PicoMem.vram); PicoDrawInvalidateVram(); break;
       case CHUNK_ZRAM:    CHECKED_READ_BUFF(PicoMem.zram); break;
       case CHUNK_CRAM:    CHECKED_READ_BUFF(PicoMem.cram); break;
       case CHUNK_VSRAM:   CHECKED_READ_BUFF(PicoMem.vsram); break;
@@ -569,6 +569,7 @@ readend:
   }
 
   Pico.m.dirtyPal = 1;
+  DrawDirty = 1;
   Pico.video.status &= ~(SR_VB | SR_F);
   Pico.video.status |= ((Pico.video.reg[1] >> 3) ^ SR_VB) & SR_VB;
   Pico.video.status |= (Pico.video.pending_ints << 2) & SR_F;
@@ -604,7 +605,7 @@ static int state_load_gfx(void *file)
 
     switch (buff[0])
     {
-      case CHUNK_VRAM:  CHECKED_READ_BUFF(PicoMem.vram);  found++; break;
+      case CHUNK_VRAM:  CHECKED_READ_BUFF(PicoMem.vram);  PicoDrawInvalidateVram(); found++; break;
       case CHUNK_CRAM:  CHECKED_READ_BUFF(PicoMem.cram);  found++; break;
       case CHUNK_VSRAM: CHECKED_READ_BUFF(PicoMem.vsram); found++; break;
       case CHUNK_VIDEO: CHECKED_READ_BUFF(Pico.video); found++; break;
@@ -688,6 +689,7 @@ int PicoStateLoadGfx(const char *fname)
     // assume legacy
     areaSeek(afile, 0x10020, SEEK_SET);  // skip header and RAM
     areaRead(PicoMem.vram, 1, sizeof(PicoMem.vram), afile);
+    PicoDrawInvalidateVram();
     areaSeek(afile, 0x2000, SEEK_CUR);
     areaRead(PicoMem.cram, 1, sizeof(PicoMem.cram), afile);
     areaRead(PicoMem.vsram, 1, sizeof(PicoMem.vsram), afile);
@@ -746,10 +748,12 @@ void PicoTmpStateRestore(void *data)
     return;
 
   memcpy(PicoMem.vram, t->vram, sizeof(PicoMem.vram));
+  PicoDrawInvalidateVram();
   memcpy(PicoMem.cram, t->cram, sizeof(PicoMem.cram));
   memcpy(PicoMem.vsram, t->vsram, sizeof(PicoMem.vsram));
   memcpy(&Pico.video, &t->video, sizeof(Pico.video));
   Pico.m.dirtyPal = 1;
+  DrawDirty = 1;
 
 #ifndef NO_32X
   if (PicoIn.AHW & PAHW_32X) {
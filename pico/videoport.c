@@ -21,7 +21,7 @@ typedef unsigned int   u32;
 #define UTYPES_DEFINED
 #endif
 
-int (*PicoDmaHook)(unsigned int source, int len, unsigned short **base, unsigned int *mask) = NULL;
+PICO_TLS int (*PicoDmaHook)(unsigned int source, int len, unsigned short **base, unsigned int *mask) = NULL;
 
 static __inline void AutoIncrement(void)
 {
@@ -33,6 +33,8 @@ static NOINLINE void VideoWrite128(u32 a, u16 d)
   // nasty
   a = ((a & 2) >> 1) | ((a & 0x400) >> 9) | (a & 0x3FC) | ((a & 0x1F800) >> 1);
   ((u8 *)PicoMem.vram)[a] = d;
+  VramMark(a);
+  DrawDirty = 1;
 }
 
 static void VideoWrite(u16 d)
@@ -43,13 +45,20 @@ static void VideoWrite(u16 d)
   {
     case 1: if (a & 1)
               d = (u16)((d << 8) | (d >> 8));
+            if (PicoMem.vram[(a >> 1) & 0x7fff] != d)
+              DrawDirty = 1;
             PicoMem.vram [(a >> 1) & 0x7fff] = d;
+            VramMark(a);
             if (a - ((unsigned)(Pico.video.reg[5]&0x7f) << 9) < 0x400)
               Pico.est.rendstatus |= PDRAW_DIRTY_SPRITES;
             break;
     case 3: Pico.m.dirtyPal = 1;
+            if (PicoMem.cram[(a >> 1) & 0x3f] != d)
+              DrawDirty = 1;
             PicoMem.cram [(a >> 1) & 0x3f] = d; break;
-    case 5: PicoMem.vsram[(a >> 1) & 0x3f] = d; break;
+    case 5: if (PicoMem.vsram[(a >> 1) & 0x3f] != d)
+              DrawDirty = 1;
+            PicoMem.vsram[(a >> 1) & 0x3f] = d; break;
     case 0x81:
       a |= Pico.video.addr_u << 16;
       VideoWrite128(a, d);
@@ -159,7 +168,11 @@ static void DmaSlow(int len, unsigned int source)
           && !(((source + len - 1) ^ source) & ~mask))
       {
         // most used DMA mode
+        // (many games send their sprite table every frame, same or not)
+        if (!DrawDirty && memcmp((char *)r + a, base + (source & mask), len * 2))
+          DrawDirty = 1;
         memcpy((char *)r + a, base + (source & mask), len * 2);
+        VramMarkRange(a, len * 2);
         a += len * 2;
       }
       else
@@ -168,7 +181,10 @@ static void DmaSlow(int len, unsigned int source)
         {
           u16 d = base[source++ & mask];
           if(a & 1) d=(d<<8)|(d>>8);
+          if (r[a >> 1] != d)
+            DrawDirty = 1;
           r[a >> 1] = d;
+          VramMark(a);
           // AutoIncrement
           a = (u16)(a + inc);
         }
@@ -181,7 +197,10 @@ static void DmaSlow(int len, unsigned int source)
       r = PicoMem.cram;
       for (; len; len--)
       {
-        r[(a / 2) & 0x3f] = base[source++ & mask];
+        u16 d = base[source++ & mask];
+        if (r[(a / 2) & 0x3f] != d)
+          DrawDirty = 1;
+        r[(a / 2) & 0x3f] = d;
         // AutoIncrement
         a += inc;
       }
@@ -191,7 +210,10 @@ static void DmaSlow(int len, unsigned int source)
       r = PicoMem.vsram;
       for (; len; len--)
       {
-        r[(a / 2) & 0x3f] = base[source++ & mask];
+        u16 d = base[source++ & mask];
+        if (r[(a / 2) & 0x3f] != d)
+          DrawDirty = 1;
+        r[(a / 2) & 0x3f] = d;
         // AutoIncrement
         a += inc;
       }
@@ -236,6 +258,8 @@ static void DmaCopy(int len)
   for (; len; len--)
   {
     vr[a] = vr[source++ & 0xffff];
+    VramMark(a);
+    DrawDirty = 1;
     // AutoIncrement
     a=(u16)(a+inc);
   }
@@ -268,6 +292,8 @@ static NOINLINE void DmaFill(int data)
         // Write upper byte to adjacent address
         // (here we are byteswapped, so address is already 'adjacent')
         vr[a] = high;
+        VramMark(a);
+        DrawDirty = 1;
 
         // Increment address register
         a = (u16)(a + inc);
@@ -276,7 +302,7 @@ static NOINLINE void DmaFill(int data)
     case 3:   // cram
     case 5: { // vsram
       // TODO: needs fifo; anyone using these?
-      static int once;
+      static PICO_TLS int once;
       if (!once++)
         elprintf(EL_STATUS|EL_ANOMALY|EL_VDPDMA, "TODO: cram/vsram fill");
     }
@@ -348,9 +374,12 @@ static NOINLINE void CommandChange(void)
   pvid->addr_u = (u8)((cmd >> 2) & 1);
 }
 
+// active display lines, 240 in V30 mode
+#define VisibleLines(pvid) (((pvid)->reg[1] & 8) ? 240 : 224)
+
 static void DrawSync(int blank_on)
 {
-  if (Pico.m.scanline < 224 && !(PicoIn.opt & POPT_ALT_RENDERER) &&
+  if (Pico.m.scanline < VisibleLines(&Pico.video) &&
       !PicoIn.skipFrame && Pico.est.DrawScanline <= Pico.m.scanline) {
     //elprintf(EL_ANOMALY, "sync");
     PicoDrawSync(Pico.m.scanline, blank_on);
@@ -369,9 +398,9 @@ PICO_INTERNAL_ASM void PicoVideoWrite(unsigned int a,unsigned short d)
   {
   case 0x00: // Data port 0 or 2
     // try avoiding the sync..
-    if (Pico.m.scanline < 224 && (pvid->reg[1]&0x40) &&
+    if (Pico.m.scanline < VisibleLines(pvid) && (pvid->reg[1]&0x40) &&
         !(!pvid->pending &&
-          ((pvid->command & 0xc00000f0) == 0x40000010 && PicoMem.vsram[pvid->addr>>1] == d))
+          ((pvid->command & 0xc00000f0) == 0x40000010 && PicoMem.vsram[(pvid->addr>>1) & 0x3f] == d))
        )
       DrawSync(0);
 
@@ -428,6 +457,8 @@ PICO_INTERNAL_ASM void PicoVideoWrite(unsigned int a,unsigned short d)
           blank_on = 1;
         DrawSync(blank_on);
         pvid->reg[num]=(unsigned char)d;
+        if (((d ^ dold) & 0xff) && num != 0x0a && num != 0x0f && num < 0x13)
+          DrawDirty = 1; // not hint counter, autoinc, DMA
         switch (num)
         {
           case 0x00:
@@ -487,6 +518,7 @@ update_irq:
   case 0x1c: // 1c 1e - debug
     pvid->debug = d;
     pvid->debug_p = 0;
+    DrawDirty = 1;
     if (d & (1 << 6)) {
       pvid->debug_p |= PVD_KILL_A | PVD_KILL_B;
       pvid->debug_p |= PVD_KILL_S_LO | PVD_KILL_S_HI;
@@ -10,8 +10,8 @@
 #include "pico_int.h"
 #include "memory.h"
 
-uptr z80_read_map [0x10000 >> Z80_MEM_SHIFT];
-uptr z80_write_map[0x10000 >> Z80_MEM_SHIFT];
+PICO_TLS uptr z80_read_map [0x10000 >> Z80_MEM_SHIFT];
+PICO_TLS uptr z80_write_map[0x10000 >> Z80_MEM_SHIFT];
 
 #ifdef _USE_DRZ80
 // this causes trouble in some cases, like doukutsu putting sp in bank area
@@ -122,6 +122,7 @@ void z80_reset(void)
   if (PicoIn.AHW & PAHW_SMS)
     Cz80_Set_Reg(&CZ80, CZ80_SP, 0xdff0);
 #endif
+  cz80_drc_flush();
 }
 
 struct z80sr_main {
@@ -256,6 +257,7 @@ int z80_unpack(const void *data)
     Cz80_Set_Reg(&CZ80, CZ80_IFF2, s->iff2);
     zIM = s->im;
     Cz80_Set_Reg(&CZ80, CZ80_IRQ, s->irq_pending ? HOLD_LINE : CLEAR_LINE);
+    cz80_drc_flush();
     return 0;
   }
 #else
@@ -265,6 +267,7 @@ int z80_unpack(const void *data)
 
 void z80_exit(void)
 {
+  cz80_drc_finish();
 }
 
 void z80_debug(char *dstr)
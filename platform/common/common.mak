@@ -36,6 +36,10 @@ else
 DEFINES += CPU_CMP_R
 endif # cpu_cmp_w
 endif
+ifeq "$(thread_safe)" "1"
+DEFINES += PICO_THREAD_SAFE
+SRCS_COMMON += $(R)pico/draw_thread.c
+endif
 ifeq "$(pprof)" "1"
 DEFINES += PPROF
 SRCS_COMMON += $(R)platform/linux/pprof.c
@@ -108,7 +112,9 @@ SRCS_COMMON += $(R)pico/carthw/svp/svp.c $(R)pico/carthw/svp/memory.c \
 	$(R)pico/carthw/svp/ssp16.c
 ifeq "$(use_svpdrc)" "1"
 DEFINES += _SVP_DRC
+ifeq "$(ARCH)" "arm"
 SRCS_COMMON += $(R)pico/carthw/svp/stub_arm.S
+endif
 SRCS_COMMON += $(R)pico/carthw/svp/compiler.c
 endif
 # sound
@@ -133,6 +139,10 @@ endif
 ifeq "$(use_fame)" "1"
 DEFINES += EMU_F68K
 SRCS_COMMON += $(R)cpu/fame/famec.c
+ifeq "$(use_m68kdrc)" "1"
+DEFINES += DRC_M68K
+SRCS_COMMON += $(R)cpu/fame/compiler.c
+endif
 endif
 
 # --- Z80 ---
@@ -143,8 +153,13 @@ endif
 #
 ifeq "$(use_cz80)" "1"
 DEFINES += _USE_CZ80
+ifeq "$(use_z80drc)" "1"
+DEFINES += DRC_Z80
+SRCS_COMMON += $(R)cpu/cz80/compiler.c
+else
 SRCS_COMMON += $(R)cpu/cz80/cz80.c
 endif
+endif
 
 # --- SH2 ---
 SRCS_COMMON += $(R)cpu/drc/cmn.c
@@ -351,6 +351,21 @@ static void do_region_override(const char *media_fname)
 	if (!ret) emu_read_config(NULL, 0);
 }
 
+// recompiled 32X code for the loaded ROM
+static void emu_save_load_drc_cache(int load)
+{
+	char fname[512];
+
+	if (!(currentConfig.EmuOpt & EOPT_DRC_CACHE) || !(PicoIn.opt & POPT_EN_DRC))
+		return;
+
+	romfname_ext(fname, sizeof(fname), "cache"PATH_SEP, ".sh2");
+	if (load)
+		Pico32xDrcCacheLoad(fname);
+	else
+		Pico32xDrcCacheSave(fname);
+}
+
 int emu_reload_rom(const char *rom_fname_in)
 {
 	// use setting before rom config is loaded
@@ -431,6 +446,9 @@ int emu_reload_rom(const char *rom_fname_in)
 
 	emu_make_path(carthw_path, "carthw.cfg", sizeof(carthw_path));
 
+	if (PicoGameLoaded)
+		emu_save_load_drc_cache(0);
+
 	media_type = PicoLoadMedia(rom_fname, carthw_path,
 			find_bios, do_region_override);
 
@@ -497,6 +515,9 @@ int emu_reload_rom(const char *rom_fname_in)
 	if (currentConfig.EmuOpt & EOPT_EN_SRAM)
 		emu_save_load_game(1, 1);
 
+	if (!(PicoIn.AHW & PAHW_MCD))
+		emu_save_load_drc_cache(1);
+
 	// state autoload?
 	if (autoload) {
 		int time, newest = 0, newest_slot = -1;
@@ -1250,6 +1271,7 @@ void emu_init(void)
 	mkdir_path(path, pos, "srm");
 	mkdir_path(path, pos, "brm");
 	mkdir_path(path, pos, "cfg");
+	mkdir_path(path, pos, "cache");
 
 	pprof_init();
 
@@ -1283,6 +1305,9 @@ void emu_finish(void)
 
 	pprof_finish();
 
+	if (PicoGameLoaded)
+		emu_save_load_drc_cache(0);
+
 	PicoExit();
 	sndout_exit();
 }
@@ -34,6 +34,7 @@ extern int g_screen_ppitch; // pitch in pixels
 #define EOPT_NO_FRMLIMIT  (1<<18)
 #define EOPT_WIZ_TEAR_FIX (1<<19)
 #define EOPT_EXT_FRMLIMIT (1<<20) // no internal frame limiter (limited by snd, etc)
+#define EOPT_DRC_CACHE    (1<<21) // keep 32X recompiled code in cache/
 
 enum {
 	EOPT_SCALE_NONE = 0,
@@ -463,6 +463,8 @@ static const char h_pwm[]        = "Disabling may improve performance, but break
 static const char h_sh2cycles[]  = "Cycles/millisecond (similar to DOSBox)\n"
 				   "lower values speed up emulation but break games\n"
 				   "at least 11000 recommended for compatibility";
+static const char h_drc_cache[]  = "Keep recompiled SH2 code in a file,\n"
+				   "so that games start up faster next time";
 
 static menu_entry e_menu_32x_options[] =
 {
@@ -471,6 +473,7 @@ static menu_entry e_menu_32x_options[] =
 	mee_onoff_h   ("PWM sound",         MA_32XOPT_PWM,         PicoIn.opt, POPT_EN_PWM, h_pwm),
 	mee_cust_h    ("Master SH2 cycles", MA_32XOPT_MSH2_CYCLES, mh_opt_sh2cycles, mgn_opt_sh2cycles, h_sh2cycles),
 	mee_cust_h    ("Slave SH2 cycles",  MA_32XOPT_SSH2_CYCLES, mh_opt_sh2cycles, mgn_opt_sh2cycles, h_sh2cycles),
+	mee_onoff_h   ("SH2 code cache",    MA_32XOPT_DRC_CACHE,   currentConfig.EmuOpt, EOPT_DRC_CACHE, h_drc_cache),
 	mee_end,
 };
 
@@ -12,10 +12,10 @@
 #include <pico/sound/mix.h>
 #include "mp3.h"
 
-static FILE *mp3_current_file;
-static int mp3_file_len, mp3_file_pos;
-static int cdda_out_pos;
-static int decoder_active;
+static PICO_TLS FILE *mp3_current_file;
+static PICO_TLS int mp3_file_len, mp3_file_pos;
+static PICO_TLS int cdda_out_pos;
+static PICO_TLS int decoder_active;
 
 unsigned short mpeg1_l3_bitrates[16] = {
 	0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320
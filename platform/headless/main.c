@@ -0,0 +1,494 @@
+/*
+ * PicoDrive - headless batch runner
+ *
+ * This work is licensed under the terms of MAME license.
+ * See COPYING file in the top-level directory.
+ *
+ * Runs a list of jobs without any UI or frame limiting, spread over a pool
+ * of worker threads, each of them driving its own emulator instance
+ * (this needs the PICO_THREAD_SAFE build, see Makefile).
+ *
+ * job file: one job per line, '#' starts a comment:
+ *   <rom> [frames [input [output]]]
+ * "-" may be used to skip input or output.
+ *
+ * input: raw pad stream, 2 little endian 16bit words (pad 1, pad 2) per
+ *  frame, in PicoIn.pad[] bit order. No buttons are pressed once it ends.
+ * output: a "<frame> <hash>" text line per frame, or with -f raw 320x240
+ *  RGB565 framebuffers (XRGB8888 with -x), one per frame.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <pico/pico_int.h>
+
+#ifndef PICO_THREAD_SAFE
+#error headless runner needs the thread safe build
+#endif
+
+struct job {
+	char *rom;
+	char *input;
+	char *output;
+	int frames;
+	// results
+	int done_frames;
+	unsigned int hash;
+	double time;
+	int failed;
+};
+
+static struct job *jobs;
+static int job_count;
+static int job_next;
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int opt_frames = 600;
+static int opt_sound;
+static int opt_raw_frames;
+static int opt_verbose;
+static int opt_interp;
+static int opt_draw_thread;
+static int opt_batch;
+static int opt_rgb888;
+static int opt_damage;
+static int opt_scale = 1;
+static int opt_norm;
+static const char *opt_bios_dir = ".";
+
+// per worker
+static PICO_TLS unsigned int *vout_buf; // 16 or 32bit pixels, vout_pitch wide
+static PICO_TLS int vout_pitch;
+static PICO_TLS short snd_buf[2 * 44100 / 50];
+static PICO_TLS int vout_width = 320, vout_start, vout_height = 224;
+static PICO_TLS unsigned int snd_hash;
+
+#define FNV_INIT 2166136261u
+#define FNV_STEP(h, v) (((h) ^ (v)) * 16777619u)
+
+/* platform glue */
+
+void lprintf(const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!opt_verbose)
+		return;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+void cache_flush_d_inval_i(void *start_addr, void *end_addr)
+{
+	__builtin___clear_cache(start_addr, end_addr);
+}
+
+void *plat_mmap(unsigned long addr, size_t size, int need_exec, int is_fixed)
+{
+	int prot = PROT_READ | PROT_WRITE | (need_exec ? PROT_EXEC : 0);
+	void *ret;
+
+	ret = mmap((void *)addr, size, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return ret == MAP_FAILED ? NULL : ret;
+}
+
+void *plat_mremap(void *ptr, size_t oldsize, size_t newsize)
+{
+	void *ret = mremap(ptr, oldsize, newsize, MREMAP_MAYMOVE);
+	return ret == MAP_FAILED ? NULL : ret;
+}
+
+void plat_munmap(void *ptr, size_t size)
+{
+	if (ptr != NULL)
+		munmap(ptr, size);
+}
+
+void *plat_mem_get_for_drc(size_t size)
+{
+	return NULL;
+}
+
+int plat_mem_set_exec(void *ptr, size_t size)
+{
+	return mprotect(ptr, size, PROT_READ | PROT_WRITE | PROT_EXEC);
+}
+
+void emu_video_mode_change(int start_line, int line_count, int is_32cols)
+{
+	vout_width = (is_32cols && !opt_norm ? 256 : 320) * opt_scale;
+	vout_start = start_line * opt_scale;
+	vout_height = line_count * opt_scale;
+}
+
+void emu_32x_startup(void)
+{
+}
+
+static const char *find_bios(int *region, const char *cd_fname)
+{
+	static PICO_TLS char path[512];
+	const char *name;
+	FILE *f;
+
+	switch (*region) {
+	case 4: name = "bios_CD_U"; break;
+	case 8: name = "bios_CD_E"; break;
+	case 1:
+	case 2: name = "bios_CD_J"; break;
+	default: return NULL;
+	}
+
+	snprintf(path, sizeof(path), "%s/%s.bin", opt_bios_dir, name);
+	f = fopen(path, "rb");
+	if (f == NULL)
+		return NULL;
+	fclose(f);
+	return path;
+}
+
+static void snd_write(int len)
+{
+	unsigned int h = snd_hash;
+	int i;
+
+	for (i = 0; i < len / 2; i++)
+		h = FNV_STEP(h, (unsigned short)snd_buf[i]);
+	snd_hash = h;
+}
+
+/* workers */
+
+static unsigned char *load_input(const char *fname, int *frames)
+{
+	unsigned char *buf = NULL;
+	long size;
+	FILE *f;
+
+	*frames = 0;
+	if (fname == NULL)
+		return NULL;
+
+	f = fopen(fname, "rb");
+	if (f == NULL) {
+		fprintf(stderr, "can't open input %s\n", fname);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if (size > 0 && (buf = malloc(size)) != NULL) {
+		size = fread(buf, 1, size, f);
+		*frames = size / 4;
+	}
+	fclose(f);
+	return buf;
+}
+
+static double get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static void run_job(struct job *job)
+{
+	unsigned char *input;
+	unsigned int frame_hash, hash = FNV_INIT;
+	int input_frames;
+	FILE *out = NULL;
+	double start;
+	int i, x, y;
+
+	switch (PicoLoadMedia(job->rom, "carthw.cfg", find_bios, NULL)) {
+	case PM_BAD_DETECT:
+	case PM_BAD_CD:
+	case PM_BAD_CD_NO_BIOS:
+	case PM_ERROR:
+		fprintf(stderr, "%s: load failed\n", job->rom);
+		job->failed = 1;
+		return;
+	default:
+		break;
+	}
+
+	if (job->output != NULL) {
+		out = fopen(job->output, "wb");
+		if (out == NULL)
+			fprintf(stderr, "%s: can't open %s\n", job->rom, job->output);
+	}
+	input = load_input(job->input, &input_frames);
+
+	PicoLoopPrepare();
+	if (opt_sound) {
+		PicoIn.writeSound = snd_write;
+		PicoIn.sndOut = snd_buf;
+		PsndRerate(0);
+	}
+	memset(vout_buf, 0, vout_pitch * 240 * opt_scale * 4);
+
+	start = get_time();
+	for (i = 0; i < job->frames; i++)
+	{
+		if (i < input_frames) {
+			const unsigned char *p = input + i * 4;
+			PicoIn.pad[0] = p[0] | (p[1] << 8);
+			PicoIn.pad[1] = p[2] | (p[3] << 8);
+		}
+		else
+			PicoIn.pad[0] = PicoIn.pad[1] = 0;
+
+		snd_hash = FNV_INIT;
+		PicoFrame();
+
+		// hash only the visible area, the rest may hold leftovers
+		frame_hash = snd_hash;
+		for (y = vout_start; y < vout_start + vout_height && y < 240 * opt_scale; y++) {
+			if (opt_rgb888) {
+				const unsigned int *l = vout_buf + y * vout_pitch;
+				for (x = 0; x < vout_width; x++)
+					frame_hash = FNV_STEP(frame_hash, l[x]);
+			} else {
+				const unsigned short *l = (unsigned short *)vout_buf + y * vout_pitch;
+				for (x = 0; x < vout_width; x++)
+					frame_hash = FNV_STEP(frame_hash, l[x]);
+			}
+		}
+		hash = FNV_STEP(hash, frame_hash);
+
+		if (out != NULL) {
+			if (opt_raw_frames)
+				fwrite(vout_buf, 1, vout_pitch * 240 * opt_scale * (opt_rgb888 ? 4 : 2), out);
+			else
+				fprintf(out, "%d %08x\n", i, frame_hash);
+		}
+	}
+	job->time = get_time() - start;
+	job->done_frames = i;
+	job->hash = hash;
+
+	if (out != NULL)
+		fclose(out);
+	free(input);
+	PicoIn.writeSound = NULL;
+	PicoIn.sndOut = NULL;
+}
+
+static void *worker(void *arg)
+{
+	struct job *job;
+	int n;
+
+	PicoIn.opt = POPT_EN_STEREO|POPT_EN_FM|POPT_EN_PSG|POPT_EN_Z80
+		| POPT_EN_MCD_PCM|POPT_EN_MCD_CDDA|POPT_EN_MCD_GFX
+		| POPT_EN_32X|POPT_EN_PWM
+		| POPT_ACC_SPRITES|POPT_DIS_32C_BORDER|POPT_EN_DRC;
+	if (opt_interp)
+		PicoIn.opt &= ~POPT_EN_DRC;
+	if (opt_draw_thread)
+		PicoIn.opt |= POPT_EN_DRAW_THREAD;
+	if (opt_batch)
+		PicoIn.opt |= POPT_ALT_RENDERER;
+	if (opt_damage)
+		PicoIn.opt |= POPT_EN_DAMAGE;
+	PicoIn.sndRate = 44100;
+	PicoIn.autoRgnOrder = 0x184; // US, EU, JP
+
+	vout_pitch = 320 * opt_scale;
+	vout_buf = malloc(vout_pitch * 240 * opt_scale * 4);
+	if (vout_buf == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return NULL;
+	}
+
+	PicoInit();
+	PicoDrawSetOutFormat(opt_rgb888 ? PDF_RGB888 : PDF_RGB555, 0);
+	PicoDrawSetOutScale(opt_scale | (opt_norm ? PDSS_NORM : 0));
+	PicoDrawSetOutBuf(vout_buf, vout_pitch * (opt_rgb888 ? 4 : 2));
+
+	for (;;) {
+		pthread_mutex_lock(&job_lock);
+		n = job_next++;
+		pthread_mutex_unlock(&job_lock);
+		if (n >= job_count)
+			break;
+
+		job = &jobs[n];
+		run_job(job);
+
+		pthread_mutex_lock(&job_lock);
+		if (job->failed)
+			printf("%s: failed\n", job->rom);
+		else
+			printf("%s: %d frames, hash %08x, %.1f fps\n", job->rom,
+				job->done_frames, job->hash,
+				job->time > 0 ? job->done_frames / job->time : 0.0);
+		fflush(stdout);
+		pthread_mutex_unlock(&job_lock);
+	}
+
+	PicoExit();
+	free(vout_buf);
+	return NULL;
+}
+
+/* setup */
+
+static char *job_field(char **s)
+{
+	char *ret;
+
+	*s += strspn(*s, " \t\r\n");
+	if (**s == 0 || **s == '#')
+		return NULL;
+	ret = *s;
+	*s += strcspn(*s, " \t\r\n");
+	if (**s != 0)
+		*(*s)++ = 0;
+	if (strcmp(ret, "-") == 0)
+		return "";
+	return ret;
+}
+
+static int parse_jobs(FILE *f)
+{
+	char line[1024], *s, *rom, *frames, *input, *output;
+	struct job *job;
+
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		s = line;
+		rom = job_field(&s);
+		if (rom == NULL || *rom == 0)
+			continue;
+		frames = job_field(&s);
+		input  = job_field(&s);
+		output = job_field(&s);
+
+		job = realloc(jobs, (job_count + 1) * sizeof(*jobs));
+		if (job == NULL)
+			return -1;
+		jobs = job;
+		job = &jobs[job_count++];
+		memset(job, 0, sizeof(*job));
+		job->rom = strdup(rom);
+		job->frames = (frames && *frames) ? atoi(frames) : opt_frames;
+		job->input = (input && *input) ? strdup(input) : NULL;
+		job->output = (output && *output) ? strdup(output) : NULL;
+	}
+	return 0;
+}
+
+static void usage(const char *argv0)
+{
+	printf("usage: %s [options] <jobfile|->\n"
+		"  -j <n>    worker threads (default: one per CPU)\n"
+		"  -n <n>    frames for jobs that don't specify it (%d)\n"
+		"  -a        emulate sound and include it in hashes\n"
+		"  -f        write raw frames instead of hashes to job output\n"
+		"  -b <dir>  where to look for bios_CD_[UEJ].bin\n"
+		"  -i        interpreters only, for checking the recompilers\n"
+		"  -r        render on a separate thread for each worker\n"
+		"  -t        use the frame batch renderer\n"
+		"  -x        render to 32bit XRGB8888 instead of RGB565\n"
+		"  -d        don't redraw unchanged frames (damage tracking)\n"
+		"  -s <n>    scale the output n times (1-4) in the core, not 32X\n"
+		"  -w        widen 256 pixel wide modes to 320 in the core\n"
+		"  -v        print emulator log\n", argv0, opt_frames);
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t *threads;
+	int workers = 0;
+	long frames = 0;
+	double start, time;
+	FILE *f;
+	int i, c;
+
+	while ((c = getopt(argc, argv, "j:n:afb:irtxds:wv")) != -1) {
+		switch (c) {
+		case 'j': workers = atoi(optarg); break;
+		case 'n': opt_frames = atoi(optarg); break;
+		case 'a': opt_sound = 1; break;
+		case 'f': opt_raw_frames = 1; break;
+		case 'b': opt_bios_dir = optarg; break;
+		case 'i': opt_interp = 1; break;
+		case 'r': opt_draw_thread = 1; break;
+		case 't': opt_batch = 1; break;
+		case 'x': opt_rgb888 = 1; break;
+		case 'd': opt_damage = 1; break;
+		case 's': opt_scale = atoi(optarg); break;
+		case 'w': opt_norm = 1; break;
+		case 'v': opt_verbose = 1; break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind != argc - 1 || opt_scale < 1 || opt_scale > 4) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (strcmp(argv[optind], "-") == 0)
+		f = stdin;
+	else if ((f = fopen(argv[optind], "r")) == NULL) {
+		fprintf(stderr, "can't open %s\n", argv[optind]);
+		return 1;
+	}
+	if (parse_jobs(f) != 0) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	if (f != stdin)
+		fclose(f);
+	if (job_count == 0) {
+		fprintf(stderr, "no jobs\n");
+		return 1;
+	}
+
+	if (workers <= 0)
+		workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (workers <= 0)
+		workers = 1;
+	if (workers > job_count)
+		workers = job_count;
+
+	threads = calloc(workers, sizeof(*threads));
+	if (threads == NULL)
+		return 1;
+
+	start = get_time();
+	for (i = 0; i < workers; i++) {
+		if (pthread_create(&threads[i], NULL, worker, NULL) != 0) {
+			fprintf(stderr, "can't create worker %d\n", i);
+			workers = i;
+			break;
+		}
+	}
+	for (i = 0; i < workers; i++)
+		pthread_join(threads[i], NULL);
+	time = get_time() - start;
+
+	for (c = i = 0; i < job_count; i++) {
+		frames += jobs[i].done_frames;
+		c += jobs[i].failed;
+	}
+	printf("%d jobs (%d failed), %ld frames in %.2fs on %d workers: %.1f fps\n",
+		job_count, c, frames, time, workers, time > 0 ? frames / time : 0.0);
+
+	free(threads);
+	return c ? 2 : 0;
+}
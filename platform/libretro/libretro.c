@@ -77,6 +77,7 @@ bool show_overscan = false;
 
 static void *vout_buf;
 static int vout_width, vout_height, vout_offset;
+static int vout_bpp = 2; // 4 with XRGB8888 output
 static float user_vout_width = 0.0;
 
 static short ALIGNED(4) sndBuffer[2*44100/50];
@@ -484,9 +485,9 @@ void emu_video_mode_change(int start_line, int line_count, int is_32cols)
 {
    struct retro_system_av_info av_info;
 
-   memset(vout_buf, 0, 320 * 240 * 2);
+   memset(vout_buf, 0, 320 * 240 * vout_bpp);
    vout_width = is_32cols ? 256 : 320;
-   PicoDrawSetOutBuf(vout_buf, vout_width * 2);
+   PicoDrawSetOutBuf(vout_buf, vout_width * vout_bpp);
    if (show_overscan == true) line_count += 16;
    if (show_overscan == true) start_line -= 8;
 
@@ -1028,12 +1029,26 @@ bool retro_load_game(const struct retro_game_info *info)
       { 0 },
    };
 
-   enum retro_pixel_format fmt = RETRO_PIXEL_FORMAT_RGB565;
-   if (!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt)) {
-      if (log_cb)
-         log_cb(RETRO_LOG_ERROR, "RGB565 support required, sorry\n");
-      return false;
+   enum retro_pixel_format fmt = RETRO_PIXEL_FORMAT_XRGB8888;
+#ifndef _ASM_DRAW_C
+   // native 32bit output saves the frontend a conversion
+   if (environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt)) {
+      vout_bpp = 4;
+      PicoDrawSetOutFormat(PDF_RGB888, 0);
    }
+   else
+#endif
+   {
+      fmt = RETRO_PIXEL_FORMAT_RGB565;
+      if (!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt)) {
+         if (log_cb)
+            log_cb(RETRO_LOG_ERROR, "RGB565 support required, sorry\n");
+         return false;
+      }
+      vout_bpp = 2;
+      PicoDrawSetOutFormat(PDF_RGB555, 0);
+   }
+   PicoDrawSetOutBuf(vout_buf, vout_width * vout_bpp);
 
    if (info == NULL || info->path == NULL) {
       if (log_cb)
@@ -1337,13 +1352,18 @@ void retro_run(void)
    PicoPatchApply();
    PicoFrame();
 
-   video_cb((short *)vout_buf + vout_offset,
-      vout_width, vout_height, vout_width * 2);
+   // nothing was drawn, have the frontend show the last frame again
+   if ((PicoIn.opt & POPT_EN_DAMAGE) && !updated && !PicoDrawGetDamage(NULL))
+      video_cb(NULL, vout_width, vout_height, vout_width * vout_bpp);
+   else
+      video_cb((char *)vout_buf + vout_offset * vout_bpp,
+         vout_width, vout_height, vout_width * vout_bpp);
 }
 
 void retro_init(void)
 {
    struct retro_log_callback log;
+   bool can_dupe = false;
    int level;
 
    level = 0;
@@ -1366,6 +1386,8 @@ void retro_init(void)
       | POPT_EN_MCD_PCM|POPT_EN_MCD_CDDA|POPT_EN_MCD_GFX
       | POPT_EN_32X|POPT_EN_PWM
       | POPT_ACC_SPRITES|POPT_DIS_32C_BORDER;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_CAN_DUPE, &can_dupe) && can_dupe)
+      PicoIn.opt |= POPT_EN_DAMAGE;
 #ifdef __arm__
 #ifdef _3DS
    if (ctr_svchack_successful)
@@ -1378,9 +1400,9 @@ void retro_init(void)
    vout_width = 320;
    vout_height = 240;
 #ifdef _3DS
-   vout_buf = linearMemAlign(VOUT_MAX_WIDTH * VOUT_MAX_HEIGHT * 2, 0x80);
+   vout_buf = linearMemAlign(VOUT_MAX_WIDTH * VOUT_MAX_HEIGHT * 4, 0x80);
 #else
-   vout_buf = malloc(VOUT_MAX_WIDTH * VOUT_MAX_HEIGHT * 2);
+   vout_buf = malloc(VOUT_MAX_WIDTH * VOUT_MAX_HEIGHT * 4);
 #endif
 
    PicoInit();